@@ -10,10 +10,12 @@
 #include <vector>
 
 #include "attoclaw/common.hpp"
+#include "attoclaw/consolidation.hpp"
 #include "attoclaw/context.hpp"
 #include "attoclaw/cron.hpp"
 #include "attoclaw/events.hpp"
 #include "attoclaw/external_cli.hpp"
+#include "attoclaw/media.hpp"
 #include "attoclaw/memory.hpp"
 #include "attoclaw/metrics.hpp"
 #include "attoclaw/message_bus.hpp"
@@ -21,6 +23,7 @@
 #include "attoclaw/session.hpp"
 #include "attoclaw/subagent.hpp"
 #include "attoclaw/tools.hpp"
+#include "attoclaw/trace.hpp"
 
 namespace attoclaw {
 
@@ -28,11 +31,6 @@ class CronTool : public Tool {
  public:
   explicit CronTool(CronService* cron) : cron_(cron) {}
 
-  void set_context(std::string channel, std::string chat_id) {
-    channel_ = std::move(channel);
-    chat_id_ = std::move(chat_id);
-  }
-
   std::string name() const override { return "cron"; }
   std::string description() const override {
     return "Schedule reminders and recurring tasks (actions: add, list, remove)";
@@ -49,7 +47,9 @@ class CronTool : public Tool {
                 {"required", json::array({"action"})}};
   }
 
-  std::string execute(const json& params) override {
+  std::string execute(const json& params) override { return execute(params, ToolContext{}); }
+
+  std::string execute(const json& params, const ToolContext& ctx) override {
     if (!cron_) {
       return "Error: cron service unavailable";
     }
@@ -104,7 +104,7 @@ class CronTool : public Tool {
         return "Error: either every_seconds, cron_expr, or at is required";
       }
 
-      const auto job = cron_->add_job(message.substr(0, 30), schedule, message, true, channel_, chat_id_, delete_after);
+      const auto job = cron_->add_job(message.substr(0, 30), schedule, message, true, ctx.channel, ctx.chat_id, delete_after);
       return "Created job '" + job.name + "' (id: " + job.id + ")";
     }
 
@@ -127,8 +127,6 @@ class CronTool : public Tool {
   }
 
   CronService* cron_{nullptr};
-  std::string channel_;
-  std::string chat_id_;
 };
 
 class AgentLoop {
@@ -159,7 +157,9 @@ class AgentLoop {
         subagents_(provider_, workspace_, bus_, model_, temperature_, top_p_, max_tokens_, brave_api_key_,
                    transcribe_api_key_, transcribe_api_base_, transcribe_model_, transcribe_timeout_seconds_,
                    exec_timeout_seconds_, restrict_to_workspace_),
-        cron_(cron_service) {
+        cron_(cron_service),
+        media_(transcribe_api_key_, transcribe_api_base_, transcribe_model_, transcribe_timeout_seconds_),
+        consolidator_(provider_, workspace_, model_) {
     register_default_tools();
   }
 
@@ -169,18 +169,46 @@ class AgentLoop {
     if (running_.exchange(true)) {
       return;
     }
+    media_.start([this](InboundMessage ready) {
+      ready.metadata["enqueuedAtUs"] = Tracer::now_us();
+      bus_->publish_inbound(ready);
+    });
     worker_ = std::thread([this]() {
-      Logger::log(Logger::Level::kInfo, "Agent loop started");
+      ATTOCLAW_LOG_INFO("Agent loop started");
       while (running_.load()) {
         InboundMessage msg = bus_->consume_inbound();
         if (!running_.load()) {
           break;
         }
 
+        const std::string trace_id = trace_id_from_metadata(msg.metadata);
+        if (!trace_id.empty() && msg.metadata.contains("enqueuedAtUs") &&
+            msg.metadata["enqueuedAtUs"].is_number_integer()) {
+          record_trace_interval(trace_id, "bus.inbound_queue", msg.metadata["enqueuedAtUs"].get<int64_t>());
+        }
+
+        // Attachments are transcribed off this thread; the message comes back through
+        // the bus with its transcripts attached.
+        if (MediaPipeline::has_transcripts(msg)) {
+          media_.consumed(msg);
+        } else if (media_.should_defer(msg)) {
+          media_.submit(std::move(msg));
+          continue;
+        }
+
         try {
           auto response = process_message(msg, std::nullopt, {});
           if (response.has_value()) {
-            bus_->publish_outbound(*response);
+            if (!trace_id.empty() && trace_id_from_metadata(response->metadata) == trace_id) {
+              // The channel dispatcher closes the trace once the reply has been sent.
+              response->metadata["publishedAtUs"] = Tracer::now_us();
+              bus_->publish_outbound(*response);
+            } else {
+              bus_->publish_outbound(*response);
+              tracer().finish(trace_id);
+            }
+          } else {
+            tracer().finish(trace_id);
           }
         } catch (const std::exception& e) {
           OutboundMessage err;
@@ -188,12 +216,37 @@ class AgentLoop {
           err.chat_id = msg.chat_id;
           err.content = std::string("Sorry, I encountered an error: ") + e.what();
           bus_->publish_outbound(err);
+          tracer().finish(trace_id);  // the error reply carries no trace id for the dispatcher
         }
       }
     });
   }
 
+  void configure_subagents(int max_concurrency, int max_queued) {
+    subagents_.configure(max_concurrency, max_queued);
+  }
+
+  void configure_media(int workers) { media_.configure(workers); }
+
+  // embeddings: "off", "hash" (local, offline) or "provider" (the provider's /embeddings with `model`).
+  void configure_memory(int top_k, const std::string& embeddings = "off", const std::string& model = "") {
+    context_.set_memory_top_k(top_k);
+    if (embeddings == "hash") {
+      MemoryIndex::for_dir(workspace_ / "memory")->set_embedder(hashing_embedder());
+    } else if (embeddings == "provider") {
+      LLMProvider* provider = provider_;
+      MemoryIndex::for_dir(workspace_ / "memory")
+          ->set_embedder(Embedder{"provider:" + model, [provider, model](const std::vector<std::string>& texts) {
+                                    return provider->embed(texts, model);
+                                  }});
+    } else if (embeddings != "off") {
+      ATTOCLAW_LOG_WARN("Unknown memoryEmbeddings '" + embeddings + "', using keyword search only");
+    }
+  }
+
   void stop() {
+    subagents_.shutdown();
+    consolidator_.stop(kConsolidationStopDrainMs);
     if (!running_.exchange(false)) {
       return;
     }
@@ -203,14 +256,17 @@ class AgentLoop {
     if (worker_.joinable()) {
       worker_.join();
     }
+    media_.stop();
   }
 
   std::string process_direct(const std::string& content, const std::string& session_key = "cli:direct",
                              const std::string& channel = "cli", const std::string& chat_id = "direct") {
-    const InboundMessage msg{channel, "user", chat_id, content};
+    InboundMessage msg{channel, "user", chat_id, content};
+    stamp_trace_metadata(msg.metadata);
     auto response = process_message(msg, session_key, {});
     std::string out = response.has_value() ? response->content : std::string();
     out += drain_system_announcements(channel, chat_id);
+    tracer().finish(trace_id_from_metadata(msg.metadata));
     return out;
   }
 
@@ -218,7 +274,8 @@ class AgentLoop {
                                     const std::function<void(const std::string&)>& on_delta,
                                     const std::string& session_key = "cli:direct",
                                     const std::string& channel = "cli", const std::string& chat_id = "direct") {
-    const InboundMessage msg{channel, "user", chat_id, content};
+    InboundMessage msg{channel, "user", chat_id, content};
+    stamp_trace_metadata(msg.metadata);
     auto response = process_message(msg, session_key, on_delta);
     std::string out = response.has_value() ? response->content : std::string();
     const std::string extra = drain_system_announcements(channel, chat_id);
@@ -226,24 +283,19 @@ class AgentLoop {
       on_delta(extra);
     }
     out += extra;
+    tracer().finish(trace_id_from_metadata(msg.metadata));
     return out;
   }
 
  private:
   class RequestRunScope {
    public:
-    RequestRunScope(AgentLoop* owner, bool vision_enabled) : owner_(owner) {
+    explicit RequestRunScope(AgentLoop* owner) : owner_(owner) {
       owner_->task_in_progress_.store(true);
       owner_->cancel_requested_.store(false);
-      if (owner_->screen_capture_tool_) {
-        owner_->screen_capture_tool_->set_enabled(vision_enabled);
-      }
     }
 
     ~RequestRunScope() {
-      if (owner_->screen_capture_tool_) {
-        owner_->screen_capture_tool_->set_enabled(false);
-      }
       owner_->flush_deferred_inbound();
       owner_->cancel_requested_.store(false);
       owner_->task_in_progress_.store(false);
@@ -253,61 +305,31 @@ class AgentLoop {
     AgentLoop* owner_;
   };
 
+  // How long stop() lets a running memory consolidation finish before aborting it, so
+  // Ctrl-C or a gateway shutdown does not wait out a whole summary call.
+  static constexpr int kConsolidationStopDrainMs = 2000;
+
   void register_default_tools() {
-    std::optional<fs::path> allowed_dir;
-    if (restrict_to_workspace_) {
-      allowed_dir = workspace_;
-    }
-
-    tools_.register_tool(std::make_shared<ReadFileTool>(allowed_dir));
-    tools_.register_tool(std::make_shared<WriteFileTool>(allowed_dir));
-    tools_.register_tool(std::make_shared<EditFileTool>(allowed_dir));
-    tools_.register_tool(std::make_shared<ListDirTool>(allowed_dir));
-
-    tools_.register_tool(
-        std::make_shared<ExecTool>(exec_timeout_seconds_, workspace_, restrict_to_workspace_));
-    tools_.register_tool(std::make_shared<WebSearchTool>(brave_api_key_, 5));
-    tools_.register_tool(std::make_shared<WebFetchTool>());
-    if (!trim(transcribe_api_base_).empty()) {
-      tools_.register_tool(std::make_shared<TranscribeTool>(transcribe_api_key_, transcribe_api_base_,
-                                                            transcribe_model_, transcribe_timeout_seconds_));
-    }
-    tools_.register_tool(std::make_shared<SystemInspectTool>());
-    tools_.register_tool(std::make_shared<AppControlTool>());
-    screen_capture_tool_ = std::make_shared<ScreenCaptureTool>(false);
-    tools_.register_tool(screen_capture_tool_);
-
-    message_tool_ = std::make_shared<MessageTool>([this](const OutboundMessage& msg) {
+    register_core_tools(tools_, CoreToolOptions{workspace_, restrict_to_workspace_, exec_timeout_seconds_,
+                                                brave_api_key_, transcribe_api_key_, transcribe_api_base_,
+                                                transcribe_model_, transcribe_timeout_seconds_});
+
+    tools_.register_tool(std::make_shared<MessageTool>([this](const OutboundMessage& msg) {
       if (bus_) {
         bus_->publish_outbound(msg);
       }
-    });
-    tools_.register_tool(message_tool_);
-
-    spawn_tool_ = std::make_shared<SpawnTool>(&subagents_);
-    tools_.register_tool(spawn_tool_);
-
+    }));
+    tools_.register_tool(std::make_shared<SpawnTool>(&subagents_));
     if (cron_) {
-      cron_tool_ = std::make_shared<CronTool>(cron_);
-      tools_.register_tool(cron_tool_);
-    }
-  }
-
-  void set_tool_context(const std::string& channel, const std::string& chat_id) {
-    if (message_tool_) {
-      message_tool_->set_context(channel, chat_id);
-    }
-    if (cron_tool_) {
-      cron_tool_->set_context(channel, chat_id);
-    }
-    if (spawn_tool_) {
-      spawn_tool_->set_context(channel, chat_id);
+      tools_.register_tool(std::make_shared<CronTool>(cron_));
     }
   }
 
   std::pair<std::string, std::vector<std::string>> run_agent_loop(
-      const json& initial_messages, const std::string& channel, const std::string& chat_id,
+      const json& initial_messages, const ToolContext& tool_ctx,
       const std::function<void(const std::string&)>& on_stream_delta) {
+    const std::string& channel = tool_ctx.channel;
+    const std::string& chat_id = tool_ctx.chat_id;
     json messages = initial_messages;
     std::vector<std::string> tools_used;
     std::string final_content;
@@ -320,12 +342,14 @@ class AgentLoop {
       }
 
       std::string stream_buffer;
+      TraceSpan chat_span("provider.chat", model_);
       const LLMResponse resp = on_stream_delta
                                    ? provider_->chat_stream(
                                          messages, tools_.definitions(), model_, max_tokens_, temperature_, top_p_,
                                          [&](const std::string& piece) { stream_buffer += piece; })
                                    : provider_->chat(messages, tools_.definitions(), model_, max_tokens_,
                                                      temperature_, top_p_);
+      chat_span.end();
       if (on_stream_delta && !resp.has_tool_calls() && !stream_buffer.empty()) {
         on_stream_delta(stream_buffer);
       }
@@ -355,7 +379,7 @@ class AgentLoop {
             break;
           }
           tools_used.push_back(tc.name);
-          const std::string result = tools_.execute(tc.name, tc.arguments);
+          const std::string result = tools_.execute(tc.name, tc.arguments, tool_ctx);
           context_.add_tool_result(messages, tc.id, tc.name, result);
         }
 
@@ -389,11 +413,18 @@ class AgentLoop {
       return process_system_message(msg);
     }
 
+    TraceContext trace(trace_id_from_metadata(msg.metadata));
+    TraceSpan turn_span("agent.turn", msg.channel);
+
     const std::string key = session_override.has_value() ? *session_override : msg.session_key();
+    TraceSpan load_span("session.load", key);
     Session& session = sessions_.get_or_create(key);
+    load_span.end();
 
     const std::string command = trim(msg.content);
     if (to_lower(command) == "/new") {
+      apply_consolidation(session);
+      consolidate_memory(session, true);
       session.clear();
       sessions_.save(session);
       sessions_.invalidate(session.key);
@@ -413,73 +444,28 @@ class AgentLoop {
       return OutboundMessage{msg.channel, msg.chat_id, "Stopping current task..."};
     }
 
+    apply_consolidation(session);
     if (static_cast<int>(session.messages.size()) > memory_window_) {
+      TraceSpan span("memory.consolidate");
       consolidate_memory(session, false);
     }
 
     const ParsedExternalRequest parsed = parse_external_request(msg.content);
     std::string user_content = parsed.prompt;
 
-    if (!msg.media.empty() && !trim(transcribe_api_base_).empty()) {
-      std::ostringstream media_block;
-      media_block << "\n\n[Media attachments]\n";
-      int idx = 1;
-      for (const auto& p : msg.media) {
-        if (trim(p).empty()) {
-          continue;
-        }
-        media_block << "- audio[" << idx << "]: " << p << "\n";
-        ++idx;
-      }
-
-      std::ostringstream transcript_block;
-      transcript_block << "\n[Transcription]\n";
-      TranscribeTool transcriber(transcribe_api_key_, transcribe_api_base_, transcribe_model_,
-                                 transcribe_timeout_seconds_);
-      idx = 1;
-      for (const auto& p : msg.media) {
-        if (trim(p).empty()) {
-          continue;
-        }
-        fs::path audio_path = expand_user_path(p);
-#ifndef _WIN32
-        if (!audio_path.has_extension() || audio_path.extension() != ".wav") {
-          if (!command_exists_in_path("ffmpeg")) {
-            std::string note;
-            try_install_linux_package("ffmpeg", 240, &note);
-          }
-          if (command_exists_in_path("ffmpeg")) {
-            const fs::path out_dir = expand_user_path("~/.attoclaw") / "inbox" / "converted";
-            std::error_code ec;
-            fs::create_directories(out_dir, ec);
-            const fs::path out = out_dir / (audio_path.stem().string() + "_" + std::to_string(now_ms()) + ".wav");
-            const std::string in_q = sh_single_quote(fs::absolute(audio_path).string());
-            const std::string out_q = sh_single_quote(fs::absolute(out).string());
-            const std::string cmd =
-                "sh -lc \"ffmpeg -y -hide_banner -loglevel error -i " + in_q + " -ac 1 -ar 16000 " + out_q + "\"";
-            const CommandResult conv = run_command_capture(cmd, 240);
-            if (conv.ok && fs::exists(out, ec)) {
-              audio_path = out;
-            }
-          }
-        }
-#endif
-
-        metrics().inc("transcribe.total");
-        const std::string t = transcriber.execute(json{{"path", audio_path.string()}});
-        if (t.rfind("Error:", 0) == 0) {
-          metrics().inc("transcribe.error");
-        } else {
-          metrics().inc("transcribe.ok");
-        }
-        transcript_block << "- audio[" << idx << "]:\n" << t << "\n";
-        ++idx;
+    if (!msg.media.empty() && media_.enabled()) {
+      std::string block;
+      if (MediaPipeline::has_transcripts(msg)) {
+        block = MediaPipeline::attachment_block(msg);
+      } else {
+        InboundMessage with_transcripts = msg;
+        media_.process_inline(with_transcripts);
+        block = MediaPipeline::attachment_block(with_transcripts);
       }
-
       if (user_content.empty()) {
         user_content = trim(msg.content);
       }
-      user_content = trim(user_content + media_block.str() + transcript_block.str());
+      user_content = trim(user_content + block);
     }
     if (parsed.vision_enabled && is_headless_server()) {
       return OutboundMessage{msg.channel, msg.chat_id,
@@ -487,7 +473,8 @@ class AgentLoop {
     }
 
     if (parsed.external_cli.has_value()) {
-      const std::string final_content = run_external_cli(*parsed.external_cli, workspace_, parsed.vision_enabled);
+      TraceSpan cli_span("external_cli.run", parsed.external_cli->name);
+      const std::string final_content = run_external_cli(*parsed.external_cli, workspace_, parsed.vision_enabled, on_stream_delta);
       session.add_message("user", parsed.external_cli->prompt.empty() ? trim(msg.content) : parsed.external_cli->prompt);
       session.add_message("assistant", final_content, {parsed.external_cli->name});
       sessions_.save(session);
@@ -502,17 +489,22 @@ class AgentLoop {
 
     const bool vision_enabled = parsed.vision_enabled;
 
-    set_tool_context(msg.channel, msg.chat_id);
-    RequestRunScope run_scope(this, vision_enabled);
+    const ToolContext tool_ctx{msg.channel, msg.chat_id, vision_enabled};
+    RequestRunScope run_scope(this);
 
+    TraceSpan build_span("context.build_messages");
     json history = session.get_history(memory_window_);
     json initial_messages = context_.build_messages(history, user_content, {}, msg.channel, msg.chat_id);
+    build_span.end();
 
-    auto [final_content, tools_used] = run_agent_loop(initial_messages, msg.channel, msg.chat_id, on_stream_delta);
+    auto [final_content, tools_used] = run_agent_loop(initial_messages, tool_ctx, on_stream_delta);
 
     session.add_message("user", user_content);
     session.add_message("assistant", final_content, tools_used);
-    sessions_.save(session);
+    {
+      TraceSpan span("session.save");
+      sessions_.save(session);
+    }
 
     OutboundMessage out;
     out.channel = msg.channel;
@@ -537,12 +529,12 @@ class AgentLoop {
     const std::string key = origin_channel + ":" + origin_chat_id;
     Session& session = sessions_.get_or_create(key);
 
-    set_tool_context(origin_channel, origin_chat_id);
-    RequestRunScope run_scope(this, false);
+    const ToolContext tool_ctx{origin_channel, origin_chat_id, false};
+    RequestRunScope run_scope(this);
     json initial = context_.build_messages(session.get_history(memory_window_), msg.content, {}, origin_channel,
                                            origin_chat_id);
 
-    auto [final_content, _tools] = run_agent_loop(initial, origin_channel, origin_chat_id, {});
+    auto [final_content, _tools] = run_agent_loop(initial, tool_ctx, {});
 
     session.add_message("user", "[System] " + msg.content);
     session.add_message("assistant", final_content);
@@ -588,45 +580,49 @@ class AgentLoop {
     return appended;
   }
 
+  // Hands the messages that fell out of the window to the background consolidator. They stay
+  // in the session until it reports them archived (apply_consolidation), so nothing is lost
+  // if the process exits first; they are simply resubmitted on the next turn.
   void consolidate_memory(Session& session, bool archive_all) {
-    MemoryStore memory(workspace_);
-
     std::size_t keep_count = archive_all ? 0 : static_cast<std::size_t>((std::max)(1, memory_window_ / 2));
     if (session.messages.size() <= keep_count) {
       return;
     }
 
-    std::size_t start = archive_all ? 0 : session.last_consolidated;
-    std::size_t end = archive_all ? session.messages.size() : (session.messages.size() - keep_count);
-
-    if (start >= end || end > session.messages.size()) {
-      return;
+    std::size_t start = session.last_consolidated;
+    if (archive_all) {
+      // A window job still running for this session already covers its leading messages.
+      start = (std::max)(start, consolidator_.detach(session.key));
     }
-
-    std::ostringstream history;
-    history << "[" << now_iso8601().substr(0, 16) << "] Session summary\n";
-    for (std::size_t i = start; i < end; ++i) {
-      const auto& m = session.messages[i];
-      history << "[" << m.timestamp.substr(0, 16) << "] " << to_upper(m.role) << ": " << m.content << "\n";
+    start = (std::min)(start, session.messages.size());
+    std::size_t end = session.messages.size() - keep_count;
+    if (start >= end) {
+      return;
     }
 
-    memory.append_history(history.str());
-
+    std::vector<SessionMessage> archived(session.messages.begin() + static_cast<std::ptrdiff_t>(start),
+                                         session.messages.begin() + static_cast<std::ptrdiff_t>(end));
     if (archive_all) {
-      session.last_consolidated = 0;
-      session.messages.clear();
+      // The caller clears the session right away, so this job must not truncate it later.
+      consolidator_.submit(session.key + "#" + random_id(6), std::move(archived), 0);
     } else {
-      session.last_consolidated = end;
+      consolidator_.submit(session.key, std::move(archived), end);
     }
   }
 
-  static std::string to_lower(std::string s) {
-    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-    return s;
+  // Drops messages the consolidator has finished archiving, keeping get_history() small.
+  void apply_consolidation(Session& session) {
+    const std::size_t archived = consolidator_.take_completed(session);
+    if (archived == 0) {
+      return;
+    }
+    session.messages.erase(session.messages.begin(), session.messages.begin() + static_cast<std::ptrdiff_t>(archived));
+    session.last_consolidated = 0;
+    sessions_.save(session);
   }
 
-  static std::string to_upper(std::string s) {
-    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+  static std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
     return s;
   }
 
@@ -702,12 +698,9 @@ class AgentLoop {
   ToolRegistry tools_;
   SubagentManager subagents_;
 
-  std::shared_ptr<MessageTool> message_tool_;
-  std::shared_ptr<SpawnTool> spawn_tool_;
-  std::shared_ptr<CronTool> cron_tool_;
-  std::shared_ptr<ScreenCaptureTool> screen_capture_tool_;
-
   CronService* cron_{nullptr};
+  MediaPipeline media_;
+  MemoryConsolidator consolidator_;
   std::atomic<bool> cancel_requested_{false};
   std::atomic<bool> task_in_progress_{false};
   std::mutex deferred_mu_;
@@ -0,0 +1,469 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+namespace base64_detail {
+
+inline constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 6-bit value per input byte, 0xFF for anything outside the alphabet (padding included).
+inline const std::array<uint8_t, 256>& decode_table() {
+  static const auto table = []() {
+    std::array<uint8_t, 256> t{};
+    t.fill(0xFF);
+    for (int i = 0; i < 64; ++i) {
+      t[static_cast<unsigned char>(kAlphabet[i])] = static_cast<uint8_t>(i);
+    }
+    return t;
+  }();
+  return table;
+}
+
+// Kernels: `encode` handles whole 3-byte groups and returns the bytes consumed (the caller
+// finishes the tail); `decode` handles whole blocks of alphabet characters, stops at the
+// first block holding anything else and returns the characters consumed (a multiple of 4).
+// Decoders may write up to 32 bytes past the decoded output; callers keep that much slack.
+using EncodeFn = std::size_t (*)(const unsigned char*, std::size_t, char*);
+using DecodeFn = std::size_t (*)(const char*, std::size_t, unsigned char*);
+
+inline std::size_t encode_scalar(const unsigned char* in, std::size_t n, char* out) {
+  std::size_t i = 0;
+  for (; i + 3 <= n; i += 3, out += 4) {
+    const uint32_t v = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+    out[0] = kAlphabet[(v >> 18) & 0x3F];
+    out[1] = kAlphabet[(v >> 12) & 0x3F];
+    out[2] = kAlphabet[(v >> 6) & 0x3F];
+    out[3] = kAlphabet[v & 0x3F];
+  }
+  return i;
+}
+
+inline std::size_t decode_scalar(const char* in, std::size_t n, unsigned char* out) {
+  const auto& t = decode_table();
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4, out += 3) {
+    const uint32_t a = t[static_cast<unsigned char>(in[i])];
+    const uint32_t b = t[static_cast<unsigned char>(in[i + 1])];
+    const uint32_t c = t[static_cast<unsigned char>(in[i + 2])];
+    const uint32_t d = t[static_cast<unsigned char>(in[i + 3])];
+    if ((a | b | c | d) > 63) {
+      break;
+    }
+    const uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+    out[0] = static_cast<unsigned char>(v >> 16);
+    out[1] = static_cast<unsigned char>(v >> 8);
+    out[2] = static_cast<unsigned char>(v);
+  }
+  return i;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// Byte reshuffle and multiply-shift split of 12 bytes into 16 6-bit indices, then an
+// offset table keyed by range (Muła/Lemire). Shared by the SSE4.1 and AVX2 kernels.
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("ssse3,sse4.1")))
+#endif
+inline __m128i encode_lane_sse(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i idx = _mm_or_si128(t1, t3);
+  const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+  __m128i sel = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+  sel = _mm_sub_epi8(sel, _mm_cmpgt_epi8(idx, _mm_set1_epi8(25)));
+  return _mm_add_epi8(idx, _mm_shuffle_epi8(lut, sel));
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("ssse3,sse4.1")))
+#endif
+inline std::size_t encode_sse41(const unsigned char* in, std::size_t n, char* out) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 12, out += 16) {  // reads 16, consumes 12
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), encode_lane_sse(v));
+  }
+  return i + encode_scalar(in + i, n - i, out);
+}
+
+// Validates 16 characters and packs them into 12 bytes (stored as 16).
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("ssse3,sse4.1")))
+#endif
+inline bool decode_lane_sse(__m128i str, __m128i* packed) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B,
+                                       0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                       0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2F);
+
+  const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+  const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+  const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  if (!_mm_testz_si128(lo, hi)) {
+    return false;
+  }
+  const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+  const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  const __m128i values = _mm_add_epi8(str, roll);
+  const __m128i ab_bc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  const __m128i abc = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+  *packed = _mm_shuffle_epi8(abc, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  return true;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("ssse3,sse4.1")))
+#endif
+inline std::size_t decode_sse41(const char* in, std::size_t n, unsigned char* out) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16, out += 12) {
+    __m128i packed;
+    if (!decode_lane_sse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), &packed)) {
+      break;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+  }
+  return i + decode_scalar(in + i, n - i, out);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+inline std::size_t encode_avx2(const unsigned char* in, std::size_t n, char* out) {
+  const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,  //
+                                          10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,  //
+                                       65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+  std::size_t i = 0;
+  for (; i + 28 <= n; i += 24, out += 32) {  // lanes load [i, i+16) and [i+12, i+28)
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_shuffle_epi8(v, shuffle);
+    const __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i idx = _mm256_or_si256(t1, t3);
+    __m256i sel = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+    sel = _mm256_sub_epi8(sel, _mm256_cmpgt_epi8(idx, _mm256_set1_epi8(25)));
+    const __m256i chars = _mm256_add_epi8(idx, _mm256_shuffle_epi8(lut, sel));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+  }
+  return i + encode_sse41(in + i, n - i, out);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+inline std::size_t decode_avx2(const char* in, std::size_t n, unsigned char* out) {
+  const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                          0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,  //
+                                            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,  //
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32, out += 24) {
+    const __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    if (!_mm256_testz_si256(lo, hi)) {
+      break;
+    }
+    const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+    const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    const __m256i values = _mm256_add_epi8(str, roll);
+    const __m256i ab_bc = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i abc = _mm256_madd_epi16(ab_bc, _mm256_set1_epi32(0x00011000));
+    abc = _mm256_shuffle_epi8(abc, pack);
+    abc = _mm256_permutevar8x32_epi32(abc, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), abc);
+  }
+  return i + decode_sse41(in + i, n - i, out);
+}
+
+inline bool cpu_supports(const char* feature) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  return std::string_view(feature) == "avx2" ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse4.1");
+#elif defined(_MSC_VER)
+  int info[4] = {0, 0, 0, 0};
+  __cpuid(info, 1);
+  const bool sse41 = (info[2] & (1 << 19)) != 0;
+  if (std::string_view(feature) != "avx2") {
+    return sse41;
+  }
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  __cpuidex(info, 7, 0);
+  const bool avx2 = (info[1] & (1 << 5)) != 0;
+  return sse41 && avx2 && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+  (void)feature;
+  return false;
+#endif
+}
+#endif
+
+#if defined(__aarch64__)
+// 48 bytes -> 64 characters via de-interleaving loads and a 64-entry table lookup.
+inline std::size_t encode_neon(const unsigned char* in, std::size_t n, char* out) {
+  const uint8x16x4_t lut = {{vld1q_u8(reinterpret_cast<const uint8_t*>(kAlphabet)),
+                             vld1q_u8(reinterpret_cast<const uint8_t*>(kAlphabet) + 16),
+                             vld1q_u8(reinterpret_cast<const uint8_t*>(kAlphabet) + 32),
+                             vld1q_u8(reinterpret_cast<const uint8_t*>(kAlphabet) + 48)}};
+  const uint8x16_t mask = vdupq_n_u8(0x3F);
+  std::size_t i = 0;
+  for (; i + 48 <= n; i += 48, out += 64) {
+    const uint8x16x3_t v = vld3q_u8(in + i);
+    uint8x16x4_t idx;
+    idx.val[0] = vshrq_n_u8(v.val[0], 2);
+    idx.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 4), vshrq_n_u8(v.val[1], 4)), mask);
+    idx.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1], 2), vshrq_n_u8(v.val[2], 6)), mask);
+    idx.val[3] = vandq_u8(v.val[2], mask);
+    uint8x16x4_t chars;
+    for (int k = 0; k < 4; ++k) {
+      chars.val[k] = vqtbl4q_u8(lut, idx.val[k]);
+    }
+    vst4q_u8(reinterpret_cast<uint8_t*>(out), chars);
+  }
+  return i + encode_scalar(in + i, n - i, out);
+}
+
+// 64 characters -> 48 bytes; characters are looked up in two 64-entry halves of the table.
+inline std::size_t decode_neon(const char* in, std::size_t n, unsigned char* out) {
+  const auto& t = decode_table();
+  const uint8x16x4_t lut_lo = {{vld1q_u8(t.data()), vld1q_u8(t.data() + 16), vld1q_u8(t.data() + 32),
+                                vld1q_u8(t.data() + 48)}};
+  const uint8x16x4_t lut_hi = {{vld1q_u8(t.data() + 64), vld1q_u8(t.data() + 80), vld1q_u8(t.data() + 96),
+                                vld1q_u8(t.data() + 112)}};
+  const uint8x16_t offset = vdupq_n_u8(64);
+  std::size_t i = 0;
+  for (; i + 64 <= n; i += 64, out += 48) {
+    const uint8x16x4_t str = vld4q_u8(reinterpret_cast<const uint8_t*>(in + i));
+    uint8x16x4_t v;
+    uint8x16_t bad = vdupq_n_u8(0);
+    for (int k = 0; k < 4; ++k) {
+      v.val[k] = vqtbx4q_u8(vqtbl4q_u8(lut_lo, str.val[k]), lut_hi, vsubq_u8(str.val[k], offset));
+      bad = vorrq_u8(bad, vorrq_u8(v.val[k], vcgeq_u8(str.val[k], vdupq_n_u8(128))));
+    }
+    if (vmaxvq_u8(bad) > 63) {
+      break;
+    }
+    uint8x16x3_t bytes;
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+    vst3q_u8(out, bytes);
+  }
+  return i + decode_scalar(in + i, n - i, out);
+}
+#endif
+
+struct Kernels {
+  const char* name;
+  EncodeFn encode;
+  DecodeFn decode;
+};
+
+// Every kernel this CPU can run, widest first; the last entry is always scalar.
+inline std::vector<Kernels> available_kernels() {
+  std::vector<Kernels> out;
+#if defined(__x86_64__) || defined(_M_X64)
+  if (cpu_supports("avx2")) {
+    out.push_back({"avx2", &encode_avx2, &decode_avx2});
+  }
+  if (cpu_supports("sse4.1")) {
+    out.push_back({"sse4.1", &encode_sse41, &decode_sse41});
+  }
+#elif defined(__aarch64__)
+  out.push_back({"neon", &encode_neon, &decode_neon});
+#endif
+  out.push_back({"scalar", &encode_scalar, &decode_scalar});
+  return out;
+}
+
+inline const Kernels& kernels() {
+  static const Kernels k = available_kernels().front();
+  return k;
+}
+
+inline void encode_tail(const unsigned char* in, std::size_t n, char* out) {
+  const uint32_t v = (static_cast<uint32_t>(in[0]) << 16) | (n == 2 ? static_cast<uint32_t>(in[1]) << 8 : 0u);
+  out[0] = kAlphabet[(v >> 18) & 0x3F];
+  out[1] = kAlphabet[(v >> 12) & 0x3F];
+  out[2] = n == 2 ? kAlphabet[(v >> 6) & 0x3F] : '=';
+  out[3] = '=';
+}
+
+}  // namespace base64_detail
+
+// Name of the kernel picked at startup: "avx2", "sse4.1", "neon" or "scalar".
+inline const char* base64_impl() { return base64_detail::kernels().name; }
+
+inline std::size_t base64_encoded_size(std::size_t n) { return ((n + 2) / 3) * 4; }
+
+// Standard alphabet with '=' padding.
+inline std::string base64_encode(const void* data, std::size_t n) {
+  const auto* in = static_cast<const unsigned char*>(data);
+  std::string out(base64_encoded_size(n), '\0');
+  const std::size_t done = base64_detail::kernels().encode(in, n, out.data());
+  if (done < n) {
+    base64_detail::encode_tail(in + done, n - done, out.data() + done / 3 * 4);
+  }
+  return out;
+}
+
+inline std::string base64_encode(std::string_view data) { return base64_encode(data.data(), data.size()); }
+
+// Incremental encoder: feed chunks of any size, the output equals base64_encode of the
+// concatenation. Holds at most two bytes between calls.
+class Base64Encoder {
+ public:
+  void update(const void* data, std::size_t n, std::string& out) {
+    const auto* in = static_cast<const unsigned char*>(data);
+    while (pending_ > 0 && pending_ < 3 && n > 0) {
+      carry_[pending_++] = *in++;
+      --n;
+    }
+    if (pending_ == 3) {
+      const std::size_t at = out.size();
+      out.resize(at + 4);
+      base64_detail::encode_scalar(carry_, 3, out.data() + at);
+      pending_ = 0;
+    }
+    const std::size_t whole = n / 3 * 3;
+    if (whole > 0) {
+      const std::size_t at = out.size();
+      out.resize(at + whole / 3 * 4);
+      base64_detail::kernels().encode(in, whole, out.data() + at);
+    }
+    for (std::size_t i = whole; i < n; ++i) {
+      carry_[pending_++] = in[i];
+    }
+  }
+
+  void finish(std::string& out) {
+    if (pending_ > 0) {
+      const std::size_t at = out.size();
+      out.resize(at + 4);
+      base64_detail::encode_tail(carry_, static_cast<std::size_t>(pending_), out.data() + at);
+      pending_ = 0;
+    }
+  }
+
+ private:
+  unsigned char carry_[3]{};
+  int pending_{0};
+};
+
+// Incremental, lenient decoder: whitespace, line breaks, padding and other non-alphabet
+// bytes are skipped (as MIME requires), and trailing partial groups are dropped. Runs of
+// clean input go through the SIMD kernel; the scalar path only handles the gaps.
+class Base64Decoder {
+ public:
+  void update(std::string_view in, std::string& out) {
+    const auto& table = base64_detail::decode_table();
+    const std::size_t base = out.size();
+    out.resize(base + in.size() / 4 * 3 + 3 + kSlack);
+    auto* dst = reinterpret_cast<unsigned char*>(out.data()) + base;
+    std::size_t o = 0;
+    std::size_t i = 0;
+    bool try_kernel = true;
+    while (i < in.size()) {
+      if (try_kernel && bits_ == -8) {
+        const std::size_t used = base64_detail::kernels().decode(in.data() + i, in.size() - i, dst + o);
+        i += used;
+        o += used / 4 * 3;
+        if (i >= in.size()) {
+          break;
+        }
+        try_kernel = false;  // the next quad holds a skipped byte; retry once past it
+      }
+      const uint8_t d = table[static_cast<unsigned char>(in[i++])];
+      if (d > 63) {
+        try_kernel = true;
+        continue;
+      }
+      val_ = ((val_ << 6) | d) & 0xFFFFFF;
+      bits_ += 6;
+      if (bits_ >= 0) {
+        dst[o++] = static_cast<unsigned char>((val_ >> bits_) & 0xFF);
+        bits_ -= 8;
+      }
+    }
+    out.resize(base + o);
+  }
+
+ private:
+  static constexpr std::size_t kSlack = 32;  // kernels store whole vectors past the output
+  uint32_t val_{0};
+  int bits_{-8};
+};
+
+inline std::string base64_decode(std::string_view in) {
+  std::string out;
+  Base64Decoder dec;
+  dec.update(in, out);
+  return out;
+}
+
+// Streams a file through Base64Encoder in 48 KiB reads, so encoding overlaps the reads
+// and the raw bytes are never held in memory all at once. Returns false if it can't be read.
+inline bool base64_encode_file(const fs::path& path, std::string* out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::error_code ec;
+  const auto size = fs::file_size(path, ec);
+  out->clear();
+  if (!ec) {
+    out->reserve(base64_encoded_size(static_cast<std::size_t>(size)));
+  }
+  Base64Encoder enc;
+  std::vector<char> buf(48 * 1024);
+  while (in) {
+    in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    const auto got = static_cast<std::size_t>(in.gcount());
+    if (got == 0) {
+      break;
+    }
+    enc.update(buf.data(), got, *out);
+  }
+  enc.finish(*out);
+  return !in.bad();
+}
+
+}  // namespace attoclaw
@@ -0,0 +1,225 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/subprocess.hpp"
+
+namespace attoclaw {
+
+// Process-wide answer to "is X on PATH?". Lookups scan PATH in-process (stat + access,
+// PATHEXT on Windows) instead of forking `sh -lc "command -v X"` / `where X`, and results
+// are remembered until PATH changes or the entry's TTL runs out. On POSIX a miss is retried
+// against the login shell's PATH (read once), so tools added there by ~/.profile are still
+// found; callers launch the resolved path directly. Anything that installs a tool must
+// call invalidate() afterwards so the new binary is picked up immediately.
+class CapabilityCache {
+ public:
+  static constexpr int kFoundTtlS = 600;
+  static constexpr int kMissingTtlS = 60;  // short, so a tool installed by hand shows up soon
+
+  struct Entry {
+    std::string command;
+    fs::path path;  // empty when not found
+    int64_t resolved_ms{0};
+  };
+
+  // Binaries on the media, vision and --codex/--gemini paths, plus what doctor reports.
+  static const std::vector<std::string>& known_commands() {
+    static const std::vector<std::string> commands = {
+        "npm", "node", "codex", "gemini", "ffmpeg", "tesseract", "grim", "scrot", "python3", "python",
+    };
+    return commands;
+  }
+
+  std::optional<fs::path> resolve(const std::string& command) {
+    std::lock_guard<std::mutex> lock(mu_);
+    sync_path_locked();
+    const auto now = std::chrono::steady_clock::now();
+    auto it = entries_.find(command);
+    if (it != entries_.end() && now < it->second.expires) {
+      metrics().inc("capabilities.cache_hits");
+      return it->second.entry.path.empty() ? std::nullopt : std::optional<fs::path>(it->second.entry.path);
+    }
+    metrics().inc("capabilities.scans");
+    fs::path found = scan(command);
+#ifndef _WIN32
+    if (found.empty() && login_path_env() != path_env_) {
+      found = scan(command, login_path_env());
+    }
+#endif
+    Slot slot;
+    slot.entry = Entry{command, found, now_ms()};
+    slot.expires = now + std::chrono::seconds(found.empty() ? kMissingTtlS : kFoundTtlS);
+    entries_[command] = slot;
+    return found.empty() ? std::nullopt : std::optional<fs::path>(found);
+  }
+
+  bool has(const std::string& command) { return resolve(command).has_value(); }
+
+  // Drops one entry, or everything when `command` is empty (e.g. after a package install).
+  void invalidate(const std::string& command = "") {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (command.empty()) {
+      entries_.clear();
+    } else {
+      entries_.erase(command);
+    }
+  }
+
+  void prewarm(const std::vector<std::string>& commands = known_commands()) {
+    for (const auto& c : commands) {
+      (void)resolve(c);
+    }
+  }
+
+  // Cached entries sorted by command; never probes.
+  std::vector<Entry> snapshot() {
+    std::lock_guard<std::mutex> lock(mu_);
+    sync_path_locked();
+    std::map<std::string, Entry> sorted;
+    for (const auto& [name, slot] : entries_) {
+      sorted[name] = slot.entry;
+    }
+    std::vector<Entry> out;
+    out.reserve(sorted.size());
+    for (auto& [name, e] : sorted) {
+      out.push_back(std::move(e));
+    }
+    return out;
+  }
+
+  // Resolves `command` against a PATH-style list without touching the cache.
+  static fs::path scan(const std::string& command, const std::string& path_list = current_path_env()) {
+    if (trim(command).empty()) {
+      return {};
+    }
+#ifdef _WIN32
+    const char sep = ';';
+#else
+    const char sep = ':';
+#endif
+    if (command.find('/') != std::string::npos
+#ifdef _WIN32
+        || command.find('\\') != std::string::npos
+#endif
+    ) {
+      return executable_candidate(fs::path(command));
+    }
+
+    std::size_t start = 0;
+    while (start <= path_list.size()) {
+      std::size_t end = path_list.find(sep, start);
+      if (end == std::string::npos) {
+        end = path_list.size();
+      }
+      std::string dir = path_list.substr(start, end - start);
+#ifdef _WIN32
+      if (dir.size() >= 2 && dir.front() == '"' && dir.back() == '"') {
+        dir = dir.substr(1, dir.size() - 2);
+      }
+#else
+      if (dir.empty()) {
+        dir = ".";  // POSIX: an empty PATH element means the current directory
+      }
+#endif
+      if (!dir.empty()) {
+        const fs::path hit = executable_candidate(fs::path(dir) / command);
+        if (!hit.empty()) {
+          return hit;
+        }
+      }
+      start = end + 1;
+    }
+    return {};
+  }
+
+  static std::string current_path_env() {
+    const char* p = std::getenv("PATH");
+    return p ? std::string(p) : std::string();
+  }
+
+#ifndef _WIN32
+  // PATH as `sh -l` sets it up, read once per process; empty if the shell fails. The
+  // marker skips anything the profile itself prints.
+  static const std::string& login_path_env() {
+    static const std::string path = []() {
+      const ProcessOutput out =
+          run_process_capture({"sh", "-lc", "printf '\\n@PATH@%s' \"$PATH\""}, 10, 64 * 1024);
+      const std::size_t at = out.out.rfind("\n@PATH@");
+      return out.ok && at != std::string::npos ? out.out.substr(at + 7) : std::string();
+    }();
+    return path;
+  }
+#endif
+
+ private:
+  struct Slot {
+    Entry entry;
+    std::chrono::steady_clock::time_point expires{};
+  };
+
+  static fs::path executable_candidate(const fs::path& base) {
+    std::error_code ec;
+#ifdef _WIN32
+    if (base.has_extension() && fs::is_regular_file(base, ec)) {
+      return base;
+    }
+    const char* pathext = std::getenv("PATHEXT");
+    const std::string exts = (pathext && *pathext) ? pathext : ".COM;.EXE;.BAT;.CMD";
+    std::size_t start = 0;
+    while (start < exts.size()) {
+      std::size_t end = exts.find(';', start);
+      if (end == std::string::npos) {
+        end = exts.size();
+      }
+      if (end > start) {
+        fs::path candidate = base;
+        candidate += exts.substr(start, end - start);
+        if (fs::is_regular_file(candidate, ec)) {
+          return candidate;
+        }
+      }
+      start = end + 1;
+    }
+    return {};
+#else
+    if (fs::is_regular_file(base, ec) && ::access(base.c_str(), X_OK) == 0) {
+      return base;
+    }
+    return {};
+#endif
+  }
+
+  // A changed process PATH (only setenv in this process can change it) invalidates everything.
+  void sync_path_locked() {
+    std::string path = current_path_env();
+    if (path != path_env_) {
+      entries_.clear();
+      path_env_ = std::move(path);
+    }
+  }
+
+  std::mutex mu_;
+  std::string path_env_;
+  std::unordered_map<std::string, Slot> entries_;
+};
+
+inline CapabilityCache& capabilities() {
+  static CapabilityCache cache;
+  return cache;
+}
+
+}  // namespace attoclaw
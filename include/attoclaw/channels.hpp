@@ -7,6 +7,7 @@
 #include "attoclaw/events.hpp"
 #include "attoclaw/metrics.hpp"
 #include "attoclaw/message_bus.hpp"
+#include "attoclaw/trace.hpp"
 
 namespace attoclaw {
 
@@ -29,7 +30,9 @@ class BaseChannel {
     }
     metrics().inc("inbound.total");
     metrics().inc("inbound.channel." + name_);
-    bus_->publish_inbound(InboundMessage{name_, sender_id, chat_id, content});
+    InboundMessage msg{name_, sender_id, chat_id, content};
+    stamp_trace_metadata(msg.metadata);
+    bus_->publish_inbound(msg);
   }
 
   void handle_message(const std::string& sender_id, const std::string& chat_id, const std::string& content,
@@ -42,6 +45,7 @@ class BaseChannel {
     InboundMessage msg{name_, sender_id, chat_id, content};
     msg.media = media;
     msg.metadata = metadata;
+    stamp_trace_metadata(msg.metadata);
     bus_->publish_inbound(msg);
   }
 
@@ -58,7 +62,23 @@ class ChannelManager {
     bus_->subscribe_outbound(channel->name(), [channel](const OutboundMessage& msg) {
       metrics().inc("outbound.total");
       metrics().inc("outbound.channel." + channel->name());
-      channel->send(msg);
+      const std::string trace_id = trace_id_from_metadata(msg.metadata);
+      if (trace_id.empty() || !tracer().enabled()) {
+        channel->send(msg);
+        return;
+      }
+      if (msg.metadata.contains("publishedAtUs") && msg.metadata["publishedAtUs"].is_number_integer()) {
+        record_trace_interval(trace_id, "bus.outbound_queue", msg.metadata["publishedAtUs"].get<int64_t>());
+      }
+      try {
+        TraceContext trace(trace_id);
+        TraceSpan span("outbound.dispatch", channel->name());
+        channel->send(msg);
+      } catch (...) {
+        tracer().finish(trace_id);  // the span has ended; close the trace before the dispatcher sees the error
+        throw;
+      }
+      tracer().finish(trace_id);
     });
   }
 
@@ -4,6 +4,8 @@
 #include <atomic>
 #include <cctype>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
@@ -15,12 +17,22 @@
 #include <random>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include <nlohmann/json.hpp>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "attoclaw/logger.hpp"
+
 namespace attoclaw {
 
 using json = nlohmann::json;
@@ -135,6 +147,69 @@ inline std::string random_id(std::size_t n = 8) {
   return out;
 }
 
+// Writes a temp file next to `p`, flushes it to disk and renames it over `p`, so readers
+// and a crash see the old or the new content, never a torn file. Keeps the permissions of
+// an existing file and writes through a symlink to its target.
+inline bool write_file_atomic(const fs::path& p, const std::string& content) {
+  std::error_code ec;
+  fs::path target = p;
+  if (fs::is_symlink(p, ec)) {
+    target = fs::canonical(p, ec);
+    if (ec) {
+      return false;
+    }
+  }
+  const fs::path dir = target.parent_path();
+  if (!dir.empty()) {
+    fs::create_directories(dir, ec);
+  }
+  const fs::path tmp = dir / ("." + target.filename().string() + ".tmp" + random_id(6));
+#ifdef _WIN32
+  std::FILE* f = _wfopen(tmp.wstring().c_str(), L"wb");
+#else
+  std::FILE* f = std::fopen(tmp.c_str(), "wb");
+#endif
+  if (!f) {
+    return false;
+  }
+  bool ok = std::fwrite(content.data(), 1, content.size(), f) == content.size() && std::fflush(f) == 0;
+#ifdef _WIN32
+  ok = ok && _commit(_fileno(f)) == 0;
+#else
+  ok = ok && ::fsync(fileno(f)) == 0;
+#endif
+  ok = std::fclose(f) == 0 && ok;
+  if (ok && fs::exists(target, ec)) {
+    fs::permissions(tmp, fs::status(target, ec).permissions(), fs::perm_options::replace, ec);
+  }
+  if (ok) {
+    fs::rename(tmp, target, ec);
+    ok = !ec;
+  }
+  if (!ok) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+#ifndef _WIN32
+  // Persist the rename itself.
+  const int dfd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dfd >= 0) {
+    ::fsync(dfd);
+    ::close(dfd);
+  }
+#endif
+  return true;
+}
+
+// 64-bit FNV-1a; `h` chains hashes over several pieces.
+inline uint64_t fnv1a64(std::string_view data, uint64_t h = 1469598103934665603ULL) {
+  for (unsigned char c : data) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
 struct CommandResult {
   bool ok{false};
   int exit_code{-1};
@@ -157,68 +232,4 @@ inline CommandResult run_command_capture(const std::string& command, int timeout
   return {code == 0, code, out};
 }
 
-class Logger {
- public:
-  enum class Level { kInfo, kWarn, kError, kDebug };
-
-  static void set_json(bool enabled) { json_mode().store(enabled); }
-  static void set_min_level(Level level) { min_level() = level; }
-
-  static void log(Level level, const std::string& msg) {
-    if (level_rank(level) < level_rank(min_level())) {
-      return;
-    }
-    static std::mutex mu;
-    std::lock_guard<std::mutex> lock(mu);
-    if (json_mode().load()) {
-      json j;
-      j["time"] = now_iso8601();
-      j["level"] = level_name(level);
-      j["msg"] = msg;
-      std::cerr << j.dump() << "\n";
-    } else {
-      std::cerr << "[" << level_name(level) << "] " << msg << "\n";
-    }
-  }
-
- private:
-  static int level_rank(Level level) {
-    switch (level) {
-      case Level::kDebug:
-        return 0;
-      case Level::kInfo:
-        return 1;
-      case Level::kWarn:
-        return 2;
-      case Level::kError:
-      default:
-        return 3;
-    }
-  }
-
-  static std::atomic<bool>& json_mode() {
-    static std::atomic<bool> v{false};
-    return v;
-  }
-
-  static Level& min_level() {
-    static Level v = Level::kInfo;
-    return v;
-  }
-
-  static const char* level_name(Level level) {
-    switch (level) {
-      case Level::kInfo:
-        return "INFO";
-      case Level::kWarn:
-        return "WARN";
-      case Level::kError:
-        return "ERROR";
-      case Level::kDebug:
-      default:
-        return "DEBUG";
-    }
-  }
-};
-
 }  // namespace attoclaw
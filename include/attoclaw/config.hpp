@@ -21,6 +21,11 @@ struct AgentDefaults {
   double top_p{0.9};
   int max_tool_iterations{10};
   int memory_window{24};
+  int memory_top_k{8};
+  std::string memory_embeddings{"off"};  // off | hash | provider
+  std::string memory_embedding_model{"text-embedding-3-small"};
+  int max_subagents{4};
+  int max_queued_subagents{32};
 };
 
 struct ExecConfig {
@@ -37,12 +42,30 @@ struct TranscribeConfig {
   std::string api_base;
   std::string model{"whisper-1"};
   int timeout{180};
+  int media_workers{2};
+  int segment_seconds{30};
+  int concurrency{4};
+  bool cache{true};
+};
+
+struct VisionConfig {
+  int max_dimension{1280};
+  int jpeg_quality{70};
+  bool skip_unchanged{true};
+};
+
+struct ExternalCliConfig {
+  int max_concurrent{2};
+  int warm_workers{1};
+  int timeout{600};
 };
 
 struct ToolsConfig {
   ExecConfig exec{};
   WebSearchConfig web_search{};
   TranscribeConfig transcribe{};
+  VisionConfig vision{};
+  ExternalCliConfig external_cli{};
   bool restrict_to_workspace{false};
 };
 
@@ -54,6 +77,9 @@ struct TelegramChannelConfig : BasicChannelConfig {
   std::string token;
   std::vector<std::string> allow_from;
   std::string proxy;
+  int send_workers{4};
+  double global_messages_per_second{30.0};
+  double chat_messages_per_second{1.0};
 };
 
 struct WhatsAppChannelConfig : BasicChannelConfig {
@@ -64,6 +90,8 @@ struct WhatsAppChannelConfig : BasicChannelConfig {
 
 struct SlackChannelConfig : BasicChannelConfig {
   std::string token;
+  std::string app_token;  // xapp-... token with connections:write, used by Socket Mode
+  bool socket_mode{false};
   std::vector<std::string> channels;
   std::vector<std::string> allow_from;
   int poll_seconds{3};
@@ -75,6 +103,11 @@ struct DiscordChannelConfig : BasicChannelConfig {
   std::vector<std::string> channels;
   std::vector<std::string> allow_from;
   int poll_seconds{3};
+  int active_poll_ms{1000};
+  int idle_poll_seconds{30};
+  bool gateway{false};
+  std::string gateway_url{"wss://gateway.discord.gg/?v=10&encoding=json"};
+  int intents{37377};  // GUILDS | GUILD_MESSAGES | DIRECT_MESSAGES | MESSAGE_CONTENT
 };
 
 struct EmailChannelConfig : BasicChannelConfig {
@@ -85,6 +118,9 @@ struct EmailChannelConfig : BasicChannelConfig {
   std::string from;
   std::vector<std::string> default_to;
   std::string subject_prefix{"AttoClaw"};
+  int batch_window_ms{200};
+  std::string imap_url;  // e.g. imaps://imap.example.com/INBOX; empty = outbound only
+  std::vector<std::string> allow_from;
 };
 
 struct ChannelsConfig {
@@ -95,11 +131,31 @@ struct ChannelsConfig {
   EmailChannelConfig email{};
 };
 
+struct MetricsEndpointConfig {
+  bool enabled{false};
+  std::string host{"127.0.0.1"};
+  int port{9464};
+  bool write_snapshot{true};
+};
+
+struct GatewayConfig {
+  MetricsEndpointConfig metrics{};
+};
+
+struct TracingConfig {
+  bool enabled{false};
+  std::string dir{"~/.attoclaw/traces"};
+  std::string format{"chrome"};
+  int slow_turn_ms{0};
+};
+
 struct Config {
   AgentDefaults agent{};
   ProviderConfig provider{};
   ToolsConfig tools{};
   ChannelsConfig channels{};
+  GatewayConfig gateway{};
+  TracingConfig tracing{};
 };
 
 inline std::string to_lower(std::string s) {
@@ -185,23 +241,44 @@ inline json default_config_json() {
                 {"topP", 0.9},
                 {"maxToolIterations", 10},
                 {"memoryWindow", 24},
+                {"memoryTopK", 8},
+                {"memoryEmbeddings", "off"},
+                {"memoryEmbeddingModel", "text-embedding-3-small"},
+                {"maxSubagents", 4},
+                {"maxQueuedSubagents", 32},
             }},
        }},
       {"tools",
        {
            {"exec", {{"timeout", 60}}},
            {"web", {{"search", {{"apiKey", ""}, {"maxResults", 5}}}}},
-           {"transcribe", {{"apiKey", ""}, {"apiBase", ""}, {"model", "whisper-1"}, {"timeout", 180}}},
+           {"transcribe",
+            {{"apiKey", ""}, {"apiBase", ""}, {"model", "whisper-1"}, {"timeout", 180},
+             {"mediaWorkers", 2},
+             {"segmentSeconds", 30},
+             {"concurrency", 4},
+             {"cache", true}}},
+           {"vision", {{"maxDimension", 1280}, {"jpegQuality", 70}, {"skipUnchanged", true}}},
+           {"externalCli", {{"maxConcurrent", 2}, {"warmWorkers", 1}, {"timeout", 600}}},
            {"restrictToWorkspace", false},
        }},
       {"channels",
        {
            {"whatsapp",
             {{"enabled", false}, {"bridgeUrl", "ws://localhost:3001"}, {"bridgeToken", ""}, {"allowFrom", json::array()}}},
-           {"telegram", {{"enabled", false}, {"token", ""}, {"allowFrom", json::array()}, {"proxy", ""}}},
+           {"telegram",
+            {{"enabled", false},
+             {"token", ""},
+             {"allowFrom", json::array()},
+             {"proxy", ""},
+             {"sendWorkers", 4},
+             {"globalMessagesPerSecond", 30.0},
+             {"chatMessagesPerSecond", 1.0}}},
            {"slack",
             {{"enabled", false},
              {"token", ""},
+             {"appToken", ""},
+             {"socketMode", false},
              {"channels", json::array()},
              {"allowFrom", json::array()},
              {"pollSeconds", 3}}},
@@ -211,7 +288,12 @@ inline json default_config_json() {
              {"apiBase", "https://discord.com/api/v10"},
              {"channels", json::array()},
              {"allowFrom", json::array()},
-             {"pollSeconds", 3}}},
+             {"pollSeconds", 3},
+             {"activePollMs", 1000},
+             {"idlePollSeconds", 30},
+             {"gateway", false},
+             {"gatewayUrl", "wss://gateway.discord.gg/?v=10&encoding=json"},
+             {"intents", 37377}}},
            {"email",
             {{"enabled", false},
              {"smtpUrl", ""},
@@ -220,8 +302,16 @@ inline json default_config_json() {
              {"password", ""},
              {"from", ""},
              {"defaultTo", json::array()},
-             {"subjectPrefix", "AttoClaw"}}},
-       }}};
+             {"subjectPrefix", "AttoClaw"},
+             {"batchWindowMs", 200},
+             {"imapUrl", ""},
+             {"allowFrom", json::array()}}},
+       }},
+      {"gateway",
+       {
+           {"metrics", {{"enabled", false}, {"host", "127.0.0.1"}, {"port", 9464}, {"writeSnapshot", true}}},
+       }},
+      {"tracing", {{"enabled", false}, {"dir", "~/.attoclaw/traces"}, {"format", "chrome"}, {"slowTurnMs", 0}}}};
 }
 
 inline std::optional<ProviderConfig> extract_provider(const json& root, const std::string& model_hint) {
@@ -326,6 +416,11 @@ inline Config load_config(const fs::path& path = get_config_path()) {
         cfg.agent.top_p = d.value("topP", cfg.agent.top_p);
         cfg.agent.max_tool_iterations = d.value("maxToolIterations", cfg.agent.max_tool_iterations);
         cfg.agent.memory_window = d.value("memoryWindow", cfg.agent.memory_window);
+        cfg.agent.memory_top_k = d.value("memoryTopK", cfg.agent.memory_top_k);
+        cfg.agent.memory_embeddings = d.value("memoryEmbeddings", cfg.agent.memory_embeddings);
+        cfg.agent.memory_embedding_model = d.value("memoryEmbeddingModel", cfg.agent.memory_embedding_model);
+        cfg.agent.max_subagents = d.value("maxSubagents", cfg.agent.max_subagents);
+        cfg.agent.max_queued_subagents = d.value("maxQueuedSubagents", cfg.agent.max_queued_subagents);
       }
     }
 
@@ -352,6 +447,22 @@ inline Config load_config(const fs::path& path = get_config_path()) {
         cfg.tools.transcribe.api_base = t.value("apiBase", cfg.tools.transcribe.api_base);
         cfg.tools.transcribe.model = t.value("model", cfg.tools.transcribe.model);
         cfg.tools.transcribe.timeout = t.value("timeout", cfg.tools.transcribe.timeout);
+        cfg.tools.transcribe.media_workers = t.value("mediaWorkers", cfg.tools.transcribe.media_workers);
+        cfg.tools.transcribe.segment_seconds = t.value("segmentSeconds", cfg.tools.transcribe.segment_seconds);
+        cfg.tools.transcribe.concurrency = t.value("concurrency", cfg.tools.transcribe.concurrency);
+        cfg.tools.transcribe.cache = t.value("cache", cfg.tools.transcribe.cache);
+      }
+      if (tools.contains("vision") && tools["vision"].is_object()) {
+        const auto& v = tools["vision"];
+        cfg.tools.vision.max_dimension = v.value("maxDimension", cfg.tools.vision.max_dimension);
+        cfg.tools.vision.jpeg_quality = v.value("jpegQuality", cfg.tools.vision.jpeg_quality);
+        cfg.tools.vision.skip_unchanged = v.value("skipUnchanged", cfg.tools.vision.skip_unchanged);
+      }
+      if (tools.contains("externalCli") && tools["externalCli"].is_object()) {
+        const auto& x = tools["externalCli"];
+        cfg.tools.external_cli.max_concurrent = x.value("maxConcurrent", cfg.tools.external_cli.max_concurrent);
+        cfg.tools.external_cli.warm_workers = x.value("warmWorkers", cfg.tools.external_cli.warm_workers);
+        cfg.tools.external_cli.timeout = x.value("timeout", cfg.tools.external_cli.timeout);
       }
     }
 
@@ -380,6 +491,11 @@ inline Config load_config(const fs::path& path = get_config_path()) {
         cfg.channels.telegram.enabled = tg.value("enabled", cfg.channels.telegram.enabled);
         cfg.channels.telegram.token = resolve_env_ref(tg.value("token", cfg.channels.telegram.token));
         cfg.channels.telegram.proxy = tg.value("proxy", cfg.channels.telegram.proxy);
+        cfg.channels.telegram.send_workers = tg.value("sendWorkers", cfg.channels.telegram.send_workers);
+        cfg.channels.telegram.global_messages_per_second =
+            tg.value("globalMessagesPerSecond", cfg.channels.telegram.global_messages_per_second);
+        cfg.channels.telegram.chat_messages_per_second =
+            tg.value("chatMessagesPerSecond", cfg.channels.telegram.chat_messages_per_second);
         if (tg.contains("allowFrom") && tg["allowFrom"].is_array()) {
           cfg.channels.telegram.allow_from.clear();
           for (const auto& item : tg["allowFrom"]) {
@@ -396,6 +512,8 @@ inline Config load_config(const fs::path& path = get_config_path()) {
         const auto& s = channels["slack"];
         cfg.channels.slack.enabled = s.value("enabled", cfg.channels.slack.enabled);
         cfg.channels.slack.token = resolve_env_ref(s.value("token", cfg.channels.slack.token));
+        cfg.channels.slack.app_token = resolve_env_ref(s.value("appToken", cfg.channels.slack.app_token));
+        cfg.channels.slack.socket_mode = s.value("socketMode", cfg.channels.slack.socket_mode);
         cfg.channels.slack.poll_seconds = s.value("pollSeconds", cfg.channels.slack.poll_seconds);
         if (s.contains("channels") && s["channels"].is_array()) {
           cfg.channels.slack.channels.clear();
@@ -423,6 +541,11 @@ inline Config load_config(const fs::path& path = get_config_path()) {
         cfg.channels.discord.token = resolve_env_ref(d.value("token", cfg.channels.discord.token));
         cfg.channels.discord.api_base = d.value("apiBase", cfg.channels.discord.api_base);
         cfg.channels.discord.poll_seconds = d.value("pollSeconds", cfg.channels.discord.poll_seconds);
+        cfg.channels.discord.active_poll_ms = d.value("activePollMs", cfg.channels.discord.active_poll_ms);
+        cfg.channels.discord.idle_poll_seconds = d.value("idlePollSeconds", cfg.channels.discord.idle_poll_seconds);
+        cfg.channels.discord.gateway = d.value("gateway", cfg.channels.discord.gateway);
+        cfg.channels.discord.gateway_url = d.value("gatewayUrl", cfg.channels.discord.gateway_url);
+        cfg.channels.discord.intents = d.value("intents", cfg.channels.discord.intents);
         if (d.contains("channels") && d["channels"].is_array()) {
           cfg.channels.discord.channels.clear();
           for (const auto& item : d["channels"]) {
@@ -460,11 +583,40 @@ inline Config load_config(const fs::path& path = get_config_path()) {
             }
           }
         }
+        cfg.channels.email.batch_window_ms = e.value("batchWindowMs", cfg.channels.email.batch_window_ms);
+        cfg.channels.email.imap_url = e.value("imapUrl", cfg.channels.email.imap_url);
+        if (e.contains("allowFrom") && e["allowFrom"].is_array()) {
+          cfg.channels.email.allow_from.clear();
+          for (const auto& item : e["allowFrom"]) {
+            if (item.is_string()) {
+              cfg.channels.email.allow_from.push_back(item.get<std::string>());
+            }
+          }
+        }
       }
     }
 
+    if (root.contains("gateway") && root["gateway"].is_object()) {
+      const auto& gw = root["gateway"];
+      if (gw.contains("metrics") && gw["metrics"].is_object()) {
+        const auto& m = gw["metrics"];
+        cfg.gateway.metrics.enabled = m.value("enabled", cfg.gateway.metrics.enabled);
+        cfg.gateway.metrics.host = m.value("host", cfg.gateway.metrics.host);
+        cfg.gateway.metrics.port = m.value("port", cfg.gateway.metrics.port);
+        cfg.gateway.metrics.write_snapshot = m.value("writeSnapshot", cfg.gateway.metrics.write_snapshot);
+      }
+    }
+
+    if (root.contains("tracing") && root["tracing"].is_object()) {
+      const auto& t = root["tracing"];
+      cfg.tracing.enabled = t.value("enabled", cfg.tracing.enabled);
+      cfg.tracing.dir = t.value("dir", cfg.tracing.dir);
+      cfg.tracing.format = to_lower(t.value("format", cfg.tracing.format));
+      cfg.tracing.slow_turn_ms = t.value("slowTurnMs", cfg.tracing.slow_turn_ms);
+    }
+
   } catch (const std::exception& e) {
-    Logger::log(Logger::Level::kWarn, std::string("Failed to parse config: ") + e.what());
+    ATTOCLAW_LOG_WARN(std::string("Failed to parse config: ") + e.what());
   }
 
   return cfg;
@@ -0,0 +1,354 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/memory.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/provider.hpp"
+#include "attoclaw/session.hpp"
+
+namespace attoclaw {
+
+// Summarizes archived session messages with the provider on a background thread: durable
+// facts are appended to MEMORY.md and a short digest to HISTORY.md. The agent thread only
+// snapshots the messages and, once a job has finished, drops them from the session, so a
+// turn never waits on a summary call.
+//
+// Token usage and latency are reported under memory.consolidation.*; they are not part
+// of any user turn.
+class MemoryConsolidator {
+ public:
+  struct Summary {
+    std::string history_entry;
+    std::vector<std::string> facts;
+  };
+
+  MemoryConsolidator(LLMProvider* provider, fs::path workspace, std::string model)
+      : provider_(provider), workspace_(std::move(workspace)), model_(std::move(model)) {}
+
+  ~MemoryConsolidator() { stop(); }
+
+  MemoryConsolidator(const MemoryConsolidator&) = delete;
+  MemoryConsolidator& operator=(const MemoryConsolidator&) = delete;
+
+  // Queues `messages` for summarizing. They are the not yet archived part of the session's
+  // first `archived_end` messages; pass 0 when the caller drops them itself (e.g. /new).
+  // Returns false while an earlier job for the same session is unfinished.
+  bool submit(const std::string& session_key, std::vector<SessionMessage> messages, std::size_t archived_end) {
+    if (messages.empty()) {
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stopping_ || in_flight_.count(session_key) > 0) {
+        return false;
+      }
+      in_flight_.insert(session_key);
+      queue_.push_back(Job{session_key, std::move(messages), archived_end});
+      // Started lazily so CLI runs that never fill the window pay nothing.
+      if (!worker_.joinable()) {
+        worker_ = std::thread([this]() { worker_loop(); });
+      }
+    }
+    cv_.notify_one();
+    metrics().inc("memory.consolidation.queued");
+    return true;
+  }
+
+  bool in_flight(const std::string& session_key) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return in_flight_.count(session_key) > 0;
+  }
+
+  // How many leading messages of `session` are now archived and can be dropped (0 if none,
+  // or if the session was reset since the job was submitted).
+  std::size_t take_completed(const Session& session) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = completed_.find(session.key);
+    if (it == completed_.end()) {
+      return 0;
+    }
+    const Completed done = it->second;
+    completed_.erase(it);
+    if (done.archived_end > session.messages.size()) {
+      return 0;
+    }
+    const SessionMessage& last = session.messages[done.archived_end - 1];
+    return last.timestamp == done.last_timestamp && last.content == done.last_content ? done.archived_end : 0;
+  }
+
+  // Blocks until every queued job has finished or `timeout_ms` elapses.
+  bool wait_idle(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mu_);
+    return idle_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return in_flight_.empty(); });
+  }
+
+  // Hands the unfinished job for `session_key`, if any, over to a session reset: it will
+  // no longer truncate the session, and its raw transcript is kept if stop() abandons it.
+  // Returns how many leading messages that job covers (0 if none), so the caller does not
+  // submit them a second time.
+  std::size_t detach(const std::string& session_key) {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (auto& job : queue_) {
+      if (job.session_key == session_key) {
+        job.detached = true;
+        return job.archived_end;
+      }
+    }
+    if (running_ && running_key_ == session_key) {
+      running_detached_ = true;
+      return running_end_;
+    }
+    return 0;
+  }
+
+  // Finishes queued jobs (bounded by `drain_ms`) and joins the worker. A summary call
+  // still running after that is aborted and its result discarded; like anything still
+  // queued, those messages stay in the session file and are resubmitted on the session's
+  // next turn. Jobs whose session was already reset (/new) have no such second chance, so
+  // their raw transcript goes to HISTORY.md instead.
+  void stop(int drain_ms = 30000) {
+    wait_idle(drain_ms);
+    abandon_.store(true);
+    std::vector<Job> orphaned;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stopping_ = true;
+      for (auto& job : queue_) {
+        in_flight_.erase(job.session_key);
+        if (job.detached || job.archived_end == 0) {
+          orphaned.push_back(std::move(job));
+        }
+      }
+      queue_.clear();
+    }
+    cv_.notify_all();
+    idle_cv_.notify_all();
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+    if (!orphaned.empty()) {
+      MemoryStore memory(workspace_);
+      for (const auto& job : orphaned) {
+        append_raw_history(memory, job);
+      }
+    }
+  }
+
+  static std::string render_transcript(const std::vector<SessionMessage>& messages) {
+    std::ostringstream out;
+    for (const auto& m : messages) {
+      std::string role = m.role;
+      for (auto& c : role) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+      }
+      out << "[" << m.timestamp.substr(0, 16) << "] " << role << ": " << m.content << "\n";
+    }
+    return out.str();
+  }
+
+  // Accepts the JSON object the prompt asks for, also when wrapped in a code fence or prose.
+  static std::optional<Summary> parse_summary(const std::string& content) {
+    const std::size_t open = content.find('{');
+    const std::size_t close = content.rfind('}');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+      return std::nullopt;
+    }
+    try {
+      const json j = json::parse(content.substr(open, close - open + 1));
+      if (!j.is_object() || !j.contains("history_entry") || !j["history_entry"].is_string()) {
+        return std::nullopt;
+      }
+      Summary s;
+      s.history_entry = trim(j["history_entry"].get<std::string>());
+      if (j.contains("facts") && j["facts"].is_array()) {
+        for (const auto& f : j["facts"]) {
+          if (f.is_string() && !trim(f.get<std::string>()).empty()) {
+            s.facts.push_back(trim(f.get<std::string>()));
+          }
+        }
+      }
+      if (s.history_entry.empty()) {
+        return std::nullopt;
+      }
+      return s;
+    } catch (...) {
+      return std::nullopt;
+    }
+  }
+
+  // Appends facts not already present as "- fact" lines; returns how many were added.
+  static std::size_t merge_facts(const MemoryStore& memory, const std::vector<std::string>& facts) {
+    std::string current = memory.read_long_term();
+    std::size_t added = 0;
+    for (const auto& fact : facts) {
+      if (current.find(fact) != std::string::npos) {
+        continue;
+      }
+      if (!current.empty() && current.back() != '\n') {
+        current += "\n";
+      }
+      current += "- " + fact + "\n";
+      ++added;
+    }
+    if (added > 0) {
+      memory.write_long_term(current);
+    }
+    return added;
+  }
+
+ private:
+  struct Job {
+    std::string session_key;
+    std::vector<SessionMessage> messages;
+    std::size_t archived_end{0};
+    bool detached{false};  // the session was reset meanwhile; never truncate it
+  };
+
+  struct Completed {
+    std::size_t archived_end{0};
+    std::string last_timestamp;
+    std::string last_content;
+  };
+
+  static constexpr std::size_t kMaxTranscriptChars = 60000;  // keeps one summary call within context
+
+  void worker_loop() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        job = std::move(queue_.front());
+        queue_.pop_front();
+        running_ = true;
+        running_key_ = job.session_key;
+        running_end_ = job.archived_end;
+        running_detached_ = job.detached;
+      }
+
+      const bool finished = consolidate(job);
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        in_flight_.erase(job.session_key);
+        const bool detached = running_detached_;
+        running_ = false;
+        running_key_.clear();
+        if (finished && !detached && job.archived_end > 0) {
+          completed_[job.session_key] =
+              Completed{job.archived_end, job.messages.back().timestamp, job.messages.back().content};
+        }
+      }
+      idle_cv_.notify_all();
+    }
+  }
+
+  // Returns false when stop() abandoned the job. Nothing is written then, except the raw
+  // transcript of a job whose session was already reset.
+  bool consolidate(const Job& job) {
+    MemoryStore memory(workspace_);
+    std::string transcript = render_transcript(job.messages);
+    if (transcript.size() > kMaxTranscriptChars) {
+      transcript = "...\n" + transcript.substr(transcript.size() - kMaxTranscriptChars);
+    }
+
+    const json messages = json::array(
+        {{{"role", "system"},
+          {"content",
+           "You consolidate a personal assistant's memory. Reply with one JSON object only:\n"
+           "{\"history_entry\": \"...\", \"facts\": [\"...\"]}\n"
+           "history_entry: a 2-5 sentence digest of the conversation, starting with its [YYYY-MM-DD HH:MM] "
+           "timestamp, naming the topics, decisions and open items so it can be found by keyword later.\n"
+           "facts: durable facts worth remembering across conversations (user preferences, names, projects, "
+           "settings) that are not already in the current memory. Use [] if there are none."}},
+         {{"role", "user"},
+          {"content", "## Current memory\n" + memory.read_long_term() + "\n\n## Conversation\n" + transcript}}});
+
+    const auto start = std::chrono::steady_clock::now();
+    LLMResponse resp;
+    if (provider_) {
+      HttpClient::ScopedCancel cancel(&abandon_);
+      resp = provider_->chat(messages, json::array(), model_, 1024, 0.2, 1.0);
+    } else {
+      resp.finish_reason = "error";
+    }
+    if (abandon_.load()) {
+      metrics().inc("memory.consolidation.abandoned");
+      bool orphaned = job.archived_end == 0;
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        orphaned = orphaned || running_detached_;
+      }
+      if (orphaned) {
+        append_raw_history(memory, job);
+      }
+      return false;
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    metrics().observe("memory.consolidation.seconds", seconds);
+    if (resp.usage.is_object()) {
+      metrics().inc("memory.consolidation.prompt_tokens", resp.usage.value("prompt_tokens", uint64_t{0}));
+      metrics().inc("memory.consolidation.completion_tokens", resp.usage.value("completion_tokens", uint64_t{0}));
+    }
+
+    const auto summary = resp.finish_reason == "error" ? std::nullopt : parse_summary(resp.content);
+    if (!summary) {
+      // Keep the raw transcript rather than lose it; the digest is only a size optimization.
+      ATTOCLAW_LOG_WARN("Memory consolidation for " + job.session_key + " fell back to raw history: " +
+                        resp.content.substr(0, 200));
+      metrics().inc("memory.consolidation.fallback");
+      append_raw_history(memory, job);
+      return true;
+    }
+
+    memory.append_history(summary->history_entry);
+    const std::size_t added = merge_facts(memory, summary->facts);
+    metrics().inc("memory.consolidation.completed");
+    ATTOCLAW_LOG_INFO("Consolidated " + std::to_string(job.messages.size()) + " messages of " + job.session_key +
+                      " in " + std::to_string(static_cast<int>(seconds * 1000)) + " ms (" + std::to_string(added) +
+                      " new facts)");
+    return true;
+  }
+
+  // The HISTORY.md entry used when no digest is available.
+  static void append_raw_history(MemoryStore& memory, const Job& job) {
+    memory.append_history("[" + now_iso8601().substr(0, 16) + "] Session summary\n" + render_transcript(job.messages));
+  }
+
+  LLMProvider* provider_;
+  fs::path workspace_;
+  std::string model_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;
+  std::deque<Job> queue_;
+  std::set<std::string> in_flight_;
+  std::unordered_map<std::string, Completed> completed_;
+  bool stopping_{false};
+  bool running_{false};  // the worker holds a job; running_* describe it
+  std::string running_key_;
+  std::size_t running_end_{0};
+  bool running_detached_{false};
+  std::atomic<bool> abandon_{false};  // aborts the summary call in flight once stop() gives up
+  std::thread worker_;
+};
+
+}  // namespace attoclaw
@@ -5,6 +5,7 @@
 #include "attoclaw/common.hpp"
 #include "attoclaw/memory.hpp"
 #include "attoclaw/skills.hpp"
+#include "attoclaw/trace.hpp"
 
 namespace attoclaw {
 
@@ -13,7 +14,11 @@ class ContextBuilder {
   explicit ContextBuilder(fs::path workspace)
       : workspace_(std::move(workspace)), memory_(workspace_), skills_(workspace_) {}
 
-  std::string build_system_prompt(const std::vector<std::string>& skill_names = {}) {
+  // 0 keeps the old behaviour of inlining all of MEMORY.md.
+  void set_memory_top_k(int k) { memory_top_k_ = (std::max)(0, k); }
+
+  std::string build_system_prompt(const std::vector<std::string>& skill_names = {}, const std::string& query = "") {
+    TraceSpan span("context.build_system_prompt");
     std::vector<std::string> parts;
     parts.push_back(identity());
 
@@ -22,7 +27,9 @@ class ContextBuilder {
       parts.push_back(bootstrap);
     }
 
-    const std::string mem = memory_.memory_context();
+    const std::string mem = memory_top_k_ > 0
+                                ? memory_.relevant_context(query, static_cast<std::size_t>(memory_top_k_))
+                                : memory_.memory_context();
     if (!mem.empty()) {
       parts.push_back("# Memory\n\n" + mem);
     }
@@ -59,7 +66,7 @@ class ContextBuilder {
                       const std::vector<std::string>& skill_names = {},
                       const std::string& channel = "", const std::string& chat_id = "") {
     json messages = json::array();
-    std::string system = build_system_prompt(skill_names);
+    std::string system = build_system_prompt(skill_names, current_message);
     if (!channel.empty() && !chat_id.empty()) {
       system += "\n\n## Current Session\nChannel: " + channel + "\nChat ID: " + chat_id;
     }
@@ -103,6 +110,7 @@ class ContextBuilder {
     ss << "## Workspace\n" << workspace_.string() << "\n";
     ss << "- Long-term memory: " << (workspace_ / "memory" / "MEMORY.md").string() << "\n";
     ss << "- History log: " << (workspace_ / "memory" / "HISTORY.md").string() << "\n";
+    ss << "- Use memory_search to recall facts and past conversations not shown below.\n";
     ss << "- Skills: " << (workspace_ / "skills").string() << "\n\n";
     ss << "Respond directly to users. Use the message tool only for channel routing.";
     return ss.str();
@@ -128,6 +136,7 @@ class ContextBuilder {
   }
 
   fs::path workspace_;
+  int memory_top_k_{0};
   MemoryStore memory_;
   SkillsLoader skills_;
 };
@@ -502,7 +502,7 @@ class CronService {
       }
 
     } catch (const std::exception& e) {
-      Logger::log(Logger::Level::kWarn, std::string("Failed to load cron store: ") + e.what());
+      ATTOCLAW_LOG_WARN(std::string("Failed to load cron store: ") + e.what());
     }
   }
 
@@ -1,7 +1,11 @@
 ﻿#pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -14,9 +18,101 @@
 #include "attoclaw/channels.hpp"
 #include "attoclaw/config.hpp"
 #include "attoclaw/http.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/websocket.hpp"
 
 namespace attoclaw {
 
+// Tracks Discord's per-route rate-limit buckets (X-RateLimit-* headers) so a throttled
+// route only delays itself. A 429 flagged as global pauses every route.
+class DiscordRateLimiter {
+ public:
+  // Earliest time (ms since epoch) a request on `route` may be issued.
+  int64_t ready_at_ms(const std::string& route) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    int64_t t = global_until_ms_;
+    const auto it = buckets_.find(bucket_key_locked(route));
+    if (it != buckets_.end() && it->second.remaining <= 0) {
+      t = (std::max)(t, it->second.reset_at_ms);
+    }
+    return t;
+  }
+
+  void update(const std::string& route, const HttpResponse& resp, int64_t now) {
+    std::lock_guard<std::mutex> lock(mu_);
+    const auto bucket_it = resp.headers.find("x-ratelimit-bucket");
+    if (bucket_it != resp.headers.end() && !bucket_it->second.empty()) {
+      route_bucket_[route] = bucket_it->second;
+    }
+    Bucket& bucket = buckets_[bucket_key_locked(route)];
+    if (const auto it = resp.headers.find("x-ratelimit-remaining"); it != resp.headers.end()) {
+      bucket.remaining = std::atoi(it->second.c_str());
+    }
+    if (const auto it = resp.headers.find("x-ratelimit-reset-after"); it != resp.headers.end()) {
+      bucket.reset_at_ms = now + static_cast<int64_t>(std::atof(it->second.c_str()) * 1000.0);
+    }
+    if (resp.status != 429) {
+      return;
+    }
+
+    const int64_t wait_ms = retry_after_ms(resp);
+    bool global = false;
+    if (const auto it = resp.headers.find("x-ratelimit-global"); it != resp.headers.end()) {
+      global = it->second == "true";
+    }
+    if (const auto it = resp.headers.find("x-ratelimit-scope"); it != resp.headers.end()) {
+      global = global || it->second == "global";
+    }
+    if (global) {
+      global_until_ms_ = (std::max)(global_until_ms_, now + wait_ms);
+    } else {
+      bucket.remaining = 0;
+      bucket.reset_at_ms = (std::max)(bucket.reset_at_ms, now + wait_ms);
+    }
+  }
+
+  // 429 bodies carry a fractional retry_after; the header is whole seconds.
+  static int64_t retry_after_ms(const HttpResponse& resp) {
+    try {
+      const json j = json::parse(resp.body);
+      if (j.is_object() && j.contains("retry_after") && j["retry_after"].is_number()) {
+        return (std::max)(int64_t{50}, static_cast<int64_t>(j["retry_after"].get<double>() * 1000.0));
+      }
+    } catch (...) {
+    }
+    const auto it = resp.headers.find("retry-after");
+    if (it != resp.headers.end()) {
+      return (std::max)(int64_t{50}, static_cast<int64_t>(std::atof(it->second.c_str()) * 1000.0));
+    }
+    return 1000;
+  }
+
+ private:
+  struct Bucket {
+    int remaining{1};
+    int64_t reset_at_ms{0};
+  };
+
+  std::string bucket_key_locked(const std::string& route) const {
+    const auto it = route_bucket_.find(route);
+    return it == route_bucket_.end() ? route : it->second;
+  }
+
+  mutable std::mutex mu_;
+  std::unordered_map<std::string, std::string> route_bucket_;
+  std::unordered_map<std::string, Bucket> buckets_;
+  int64_t global_until_ms_{0};
+};
+
+// Next poll delay for one channel: snap to the fast interval after activity, otherwise
+// grow by half each quiet poll up to the idle ceiling.
+inline int64_t next_discord_poll_interval_ms(int64_t current_ms, bool active, int64_t active_ms, int64_t idle_ms) {
+  if (active) {
+    return active_ms;
+  }
+  return (std::min)(idle_ms, (std::max)(active_ms, current_ms + current_ms / 2));
+}
+
 class DiscordChannel : public BaseChannel {
  public:
   DiscordChannel(const DiscordChannelConfig& config, MessageBus* bus)
@@ -25,6 +121,7 @@ class DiscordChannel : public BaseChannel {
       allow_from_.insert(trim(x));
     }
     channels_ = config_.channels;
+    channel_set_.insert(channels_.begin(), channels_.end());
     state_path_ = expand_user_path("~/.attoclaw") / "state" / "discord_cursors.json";
   }
 
@@ -33,19 +130,37 @@ class DiscordChannel : public BaseChannel {
       return;
     }
     if (trim(config_.token).empty()) {
-      Logger::log(Logger::Level::kWarn, "Discord enabled but token is empty; channel will not start.");
+      ATTOCLAW_LOG_WARN("Discord enabled but token is empty; channel will not start.");
+      running_.store(false);
+      return;
+    }
+    if (channels_.empty() && !config_.gateway) {
+      ATTOCLAW_LOG_WARN("Discord enabled but no channels configured; channel will not start.");
       running_.store(false);
       return;
     }
-    if (channels_.empty()) {
-      Logger::log(Logger::Level::kWarn, "Discord enabled but no channels configured; channel will not start.");
+    // Without a channel list the gateway delivers every guild channel and DM the bot can
+    // see, so the sender list is the only thing standing between strangers and the agent.
+    if (channels_.empty() && allow_from_.empty()) {
+      ATTOCLAW_LOG_WARN("Discord gateway enabled with neither channels nor allowFrom configured; "
+                        "channel will not start.");
       running_.store(false);
       return;
     }
 
     load_state();
-    worker_ = std::thread([this]() { poll_loop(); });
-    Logger::log(Logger::Level::kInfo, "Discord channel started");
+    {
+      std::lock_guard<std::mutex> lock(attachment_mu_);
+      attachments_running_ = true;
+    }
+    attachment_worker_ = std::thread([this]() { attachment_loop(); });
+    worker_ = std::thread([this]() {
+      if (config_.gateway && gateway_loop()) {
+        return;
+      }
+      poll_loop();
+    });
+    ATTOCLAW_LOG_INFO(std::string("Discord channel started (") + (config_.gateway ? "gateway" : "polling") + ")");
   }
 
   void stop() override {
@@ -55,8 +170,21 @@ class DiscordChannel : public BaseChannel {
     if (worker_.joinable()) {
       worker_.join();
     }
+    {
+      std::lock_guard<std::mutex> lock(attachment_mu_);
+      attachments_running_ = false;
+      if (!attachment_jobs_.empty()) {
+        ATTOCLAW_LOG_WARN("Discord channel stopped; dropping " + std::to_string(attachment_jobs_.size()) +
+                          " message(s) waiting for an attachment download");
+        attachment_jobs_.clear();
+      }
+    }
+    attachment_cv_.notify_all();
+    if (attachment_worker_.joinable()) {
+      attachment_worker_.join();
+    }
     flush_state();
-    Logger::log(Logger::Level::kInfo, "Discord channel stopped");
+    ATTOCLAW_LOG_INFO("Discord channel stopped");
   }
 
   void send(const OutboundMessage& msg) override {
@@ -66,21 +194,24 @@ class DiscordChannel : public BaseChannel {
     thread_local HttpClient client;
     constexpr std::size_t kLimit = 1900;
     const std::string url = api_base_ + "/channels/" + msg.chat_id + "/messages";
+    const std::string route = "POST /channels/" + msg.chat_id + "/messages";
     for (const auto& part : chunk_text(msg.content, kLimit)) {
       json payload = {{"content", part}};
-      HttpResponse resp = client.post(url, payload.dump(),
-                                      {{"Authorization", "Bot " + config_.token},
-                                       {"Content-Type", "application/json"}},
-                                      20, true, 3);
-      if (resp.status == 429) {
-        const auto it = resp.headers.find("retry-after");
-        const int wait_s = it == resp.headers.end() ? 3 : (std::max)(1, std::atoi(it->second.c_str()));
-        std::this_thread::sleep_for(std::chrono::seconds(wait_s));
-        continue;
+      HttpResponse resp;
+      for (int attempt = 0; attempt < 4; ++attempt) {
+        wait_for_route(route);
+        resp = client.post(url, payload.dump(),
+                           {{"Authorization", "Bot " + config_.token}, {"Content-Type", "application/json"}}, 20,
+                           true, 3);
+        limiter_.update(route, resp, now_ms());
+        if (resp.status != 429) {
+          break;
+        }
+        metrics().inc("discord.rate_limited");
       }
       if (!resp.error.empty() || resp.status < 200 || resp.status >= 300) {
-        Logger::log(Logger::Level::kWarn, "Discord send failed: " +
-                                          (!resp.error.empty() ? resp.error : ("HTTP " + std::to_string(resp.status))));
+        ATTOCLAW_LOG_WARN("Discord send failed: " +
+                          (!resp.error.empty() ? resp.error : ("HTTP " + std::to_string(resp.status))));
         break;
       }
     }
@@ -191,161 +322,446 @@ class DiscordChannel : public BaseChannel {
     return allow_from_.contains(user_id);
   }
 
-  void poll_loop() {
-    HttpClient client;
-    const int poll_s = (std::max)(1, config_.poll_seconds);
+  struct ChannelPoll {
+    std::string channel_id;
+    std::string route;
+    int64_t interval_ms{0};
+    int64_t next_due_ms{0};
+  };
+
+  // Blocks until the route's rate-limit bucket allows a request (capped at one minute).
+  void wait_for_route(const std::string& route) const {
+    const int64_t deadline = now_ms() + 60000;
+    while (true) {
+      const int64_t now = now_ms();
+      const int64_t ready = limiter_.ready_at_ms(route);
+      if (ready <= now || now >= deadline) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds((std::min)(ready - now, int64_t{250})));
+    }
+  }
 
-    while (running_.load()) {
-      for (const auto& channel_id : channels_) {
-        if (!running_.load()) {
-          break;
-        }
+  // Advances the channel cursor and dispatches one message object (REST or Gateway shape).
+  // Returns true when the message was handed to the bus.
+  bool ingest_message(const json& m, const std::string& channel_id) {
+    if (!m.is_object() || !m.contains("id") || !m["id"].is_string()) {
+      return false;
+    }
+    const auto snow = parse_snowflake(m["id"].get<std::string>());
+    if (!snow.has_value()) {
+      return false;
+    }
+    unsigned long long cursor = 0;
+    if (auto it = last_id_.find(channel_id); it != last_id_.end() && !it->second.empty()) {
+      cursor = parse_snowflake(it->second).value_or(0);
+    }
+    if (*snow <= cursor) {
+      return false;  // Already seen (Gateway delivery racing a REST backfill).
+    }
+    last_id_[channel_id] = std::to_string(*snow);
+    dirty_.store(true);
 
-        std::string url = api_base_ + "/channels/" + channel_id + "/messages?limit=50";
-        const bool warmup = (last_id_.find(channel_id) == last_id_.end());
-        auto it = last_id_.find(channel_id);
-        if (it != last_id_.end() && !it->second.empty()) {
-          url += "&after=" + it->second;
+    if (!m.contains("content") || !m["content"].is_string()) {
+      return false;
+    }
+    if (!m.contains("author") || !m["author"].is_object()) {
+      return false;
+    }
+    const json& author = m["author"];
+    if (author.value("bot", false)) {
+      return false;
+    }
+    const std::string user_id = author.value("id", "");
+    if (user_id.empty() || !is_allowed_sender(user_id)) {
+      return false;
+    }
+
+    AttachmentJob job{user_id, channel_id, trim(m["content"].get<std::string>()), {}};
+    if (m.contains("attachments") && m["attachments"].is_array()) {
+      for (const auto& a : m["attachments"]) {
+        if (looks_like_audio_attachment(a) && !trim(a.value("url", "")).empty()) {
+          job.attachments.emplace_back(a.value("url", ""), a.value("filename", ""));
         }
+      }
+    }
+    if (job.text.empty() && job.attachments.empty()) {
+      return false;
+    }
+
+    // Downloads run on the attachment worker so the gateway thread keeps heartbeating.
+    // Messages queue behind a pending download to keep their order.
+    {
+      std::lock_guard<std::mutex> lock(attachment_mu_);
+      if (!job.attachments.empty() || attachment_busy_ || !attachment_jobs_.empty()) {
+        attachment_jobs_.push_back(std::move(job));
+        attachment_cv_.notify_one();
+        return true;
+      }
+    }
+    handle_message(job.user_id, job.channel_id, job.text, {}, json::object());
+    return true;
+  }
 
-        HttpResponse resp =
-            client.get(url, {{"Authorization", "Bot " + config_.token}}, 25, true, 2);
-        if (!running_.load()) {
+  struct AttachmentJob {
+    std::string user_id;
+    std::string channel_id;
+    std::string text;
+    std::vector<std::pair<std::string, std::string>> attachments;  // (url, filename)
+  };
+
+  void attachment_loop() {
+    std::unique_lock<std::mutex> lock(attachment_mu_);
+    while (true) {
+      attachment_cv_.wait(lock, [this]() { return !attachments_running_ || !attachment_jobs_.empty(); });
+      if (!attachments_running_) {
+        return;
+      }
+      AttachmentJob job = std::move(attachment_jobs_.front());
+      attachment_jobs_.pop_front();
+      attachment_busy_ = true;
+      lock.unlock();
+
+      std::vector<std::string> media_paths;
+      for (const auto& [url, fn] : job.attachments) {
+        if (auto p = download_discord_attachment(url, job.channel_id, fn)) {
+          media_paths.push_back(p->string());
           break;
         }
-        if (!resp.error.empty()) {
-          Logger::log(Logger::Level::kWarn, "Discord poll error: " + resp.error);
-          continue;
+      }
+      std::string text = job.text;
+      if (text.empty() && !media_paths.empty()) {
+        text = "Voice/audio file received. Please transcribe and respond.";
+      }
+      if (!text.empty() || !media_paths.empty()) {
+        handle_message(job.user_id, job.channel_id, text, media_paths, json::object());
+      }
+
+      lock.lock();
+      attachment_busy_ = false;
+    }
+  }
+
+  // Applies one channel's GET result. Returns the number of messages handed to the bus
+  // (0 when quiet or when everything was a duplicate, a bot or a disallowed sender), or -1
+  // on a transport/HTTP/parse error.
+  int handle_poll_response(const ChannelPoll& poll, const HttpResponse& resp) {
+    limiter_.update(poll.route, resp, now_ms());
+    if (!resp.error.empty()) {
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Discord poll error: " + resp.error);
+      return -1;
+    }
+    if (resp.status == 429) {
+      metrics().inc("discord.rate_limited");
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs,
+                                 "Discord rate limited on channel " + poll.channel_id + "; retry in " +
+                                     std::to_string(DiscordRateLimiter::retry_after_ms(resp)) + "ms");
+      return 0;
+    }
+    if (resp.status < 200 || resp.status >= 300) {
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Discord poll HTTP error: " + std::to_string(resp.status));
+      return -1;
+    }
+
+    try {
+      const json arr = json::parse(resp.body);
+      if (!arr.is_array()) {
+        return -1;
+      }
+
+      if (last_id_.find(poll.channel_id) == last_id_.end()) {
+        // First contact with this channel: remember the newest id, do not replay history.
+        unsigned long long max_seen = 0;
+        for (const auto& m : arr) {
+          if (m.is_object() && m.contains("id") && m["id"].is_string()) {
+            max_seen = (std::max)(max_seen, parse_snowflake(m["id"].get<std::string>()).value_or(0));
+          }
         }
-        if (resp.status == 429) {
-          const auto it_ra = resp.headers.find("retry-after");
-          const int wait_s = it_ra == resp.headers.end() ? 3 : (std::max)(1, std::atoi(it_ra->second.c_str()));
-          Logger::log(Logger::Level::kWarn, "Discord rate limited. Sleeping " + std::to_string(wait_s) + "s");
-          std::this_thread::sleep_for(std::chrono::seconds(wait_s));
-          continue;
+        last_id_[poll.channel_id] = std::to_string(max_seen);
+        dirty_.store(true);
+        return 0;
+      }
+
+      // Discord returns newest-first. Iterate oldest-first.
+      int arrived = 0;
+      for (auto it_msg = arr.rbegin(); it_msg != arr.rend(); ++it_msg) {
+        if (ingest_message(*it_msg, poll.channel_id)) {
+          ++arrived;
         }
-        if (resp.status < 200 || resp.status >= 300) {
-          Logger::log(Logger::Level::kWarn, "Discord poll HTTP error: " + std::to_string(resp.status));
-          continue;
+      }
+      return arrived;
+    } catch (const std::exception& e) {
+      ATTOCLAW_LOG_WARN(std::string("Discord parse error: ") + e.what());
+      return -1;
+    }
+  }
+
+  std::vector<ChannelPoll> make_channel_polls() const {
+    const int64_t base_ms = static_cast<int64_t>((std::max)(1, config_.poll_seconds)) * 1000;
+    std::vector<ChannelPoll> polls;
+    polls.reserve(channels_.size());
+    for (const auto& id : channels_) {
+      polls.push_back(ChannelPoll{id, "GET /channels/" + id + "/messages", base_ms, 0});
+    }
+    return polls;
+  }
+
+  // Issues one GET per selected channel concurrently and reschedules each channel.
+  void poll_batch(HttpMultiClient& multi, std::vector<ChannelPoll>& polls, const std::vector<std::size_t>& due) {
+    std::vector<HttpMultiClient::Request> requests;
+    requests.reserve(due.size());
+    for (const std::size_t i : due) {
+      std::string url = api_base_ + "/channels/" + polls[i].channel_id + "/messages?limit=50";
+      const auto it = last_id_.find(polls[i].channel_id);
+      if (it != last_id_.end() && !it->second.empty()) {
+        url += "&after=" + it->second;
+      }
+      requests.push_back(HttpMultiClient::Request{url, {{"Authorization", "Bot " + config_.token}}});
+    }
+
+    metrics().inc("discord.poll.requests", requests.size());
+    const std::vector<HttpResponse> responses = multi.get_all(requests, 25, &running_);
+    if (!running_.load()) {
+      return;
+    }
+
+    const int64_t active_ms = (std::max)(100, config_.active_poll_ms);
+    const int64_t idle_ms =
+        (std::max)(static_cast<int64_t>((std::max)(1, config_.idle_poll_seconds)) * 1000, active_ms);
+    for (std::size_t k = 0; k < due.size(); ++k) {
+      ChannelPoll& poll = polls[due[k]];
+      const int arrived = handle_poll_response(poll, responses[k]);
+      poll.interval_ms = next_discord_poll_interval_ms(poll.interval_ms, arrived > 0, active_ms, idle_ms);
+      poll.next_due_ms = now_ms() + poll.interval_ms;
+    }
+  }
+
+  void poll_loop() {
+    HttpMultiClient multi;
+    std::vector<ChannelPoll> polls = make_channel_polls();
+
+    while (running_.load()) {
+      const int64_t now = now_ms();
+      int64_t wake = now + 1000;
+      std::vector<std::size_t> due;
+      for (std::size_t i = 0; i < polls.size(); ++i) {
+        const int64_t ready = (std::max)(polls[i].next_due_ms, limiter_.ready_at_ms(polls[i].route));
+        if (ready <= now) {
+          due.push_back(i);
+        } else {
+          wake = (std::min)(wake, ready);
         }
+      }
 
-        try {
-          const json arr = json::parse(resp.body);
-          if (!arr.is_array()) {
-            continue;
-          }
+      if (!due.empty()) {
+        poll_batch(multi, polls, due);
+        maybe_flush_state();
+        continue;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds((std::min)(wake - now, int64_t{100})));
+    }
+  }
 
-          // Discord returns newest-first. Iterate oldest-first.
-          unsigned long long max_seen = 0;
-          if (it != last_id_.end() && !it->second.empty()) {
-            if (auto v = parse_snowflake(it->second)) {
-              max_seen = *v;
-            }
-          }
+  // Push delivery over the Discord Gateway. Returns false if the gateway refused us for
+  // good (bad token, disallowed intents) so the caller can fall back to REST polling, and
+  // true once stopped or when a refusal leaves no channels to poll.
+  bool gateway_loop() {
+    WebSocketClient ws;
+    HttpMultiClient multi;
+    int64_t backoff_ms = 1000;
 
-          if (warmup) {
-            for (const auto& m : arr) {
-              if (!m.is_object() || !m.contains("id") || !m["id"].is_string()) {
-                continue;
-              }
-              if (auto snow = parse_snowflake(m["id"].get<std::string>())) {
-                if (*snow > max_seen) {
-                  max_seen = *snow;
-                }
-              }
-            }
-            if (max_seen != 0) {
-              last_id_[channel_id] = std::to_string(max_seen);
-            }
-            continue;  // Do not replay history on first start.
-          }
+    while (running_.load()) {
+      const std::string url = !resume_url_.empty() && !session_id_.empty()
+                                  ? resume_url_ + "/?v=10&encoding=json"
+                                  : config_.gateway_url;
+      std::string err;
+      if (!ws.connect(url, {}, &err)) {
+        ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Discord gateway connect failed: " + err);
+        sleep_while_running(backoff_ms);
+        backoff_ms = (std::min)(backoff_ms * 2, int64_t{60000});
+        continue;
+      }
 
-          for (auto it_msg = arr.rbegin(); it_msg != arr.rend(); ++it_msg) {
-            const json& m = *it_msg;
-            if (!m.is_object()) {
-              continue;
-            }
-            if (!m.contains("id") || !m["id"].is_string()) {
-              continue;
-            }
-            if (!m.contains("content") || !m["content"].is_string()) {
-              continue;
-            }
-            if (!m.contains("author") || !m["author"].is_object()) {
-              continue;
-            }
-            const json author = m["author"];
-            if (author.value("bot", false)) {
-              continue;
-            }
-            const std::string user_id = author.value("id", "");
-            if (user_id.empty() || !is_allowed_sender(user_id)) {
-              continue;
-            }
-
-            const std::string msg_id = m["id"].get<std::string>();
-            const auto snow = parse_snowflake(msg_id);
-            if (!snow.has_value()) {
-              continue;
-            }
-            if (*snow > max_seen) {
-              max_seen = *snow;
-            }
-
-            std::string text = trim(m["content"].get<std::string>());
-            std::vector<std::string> media_paths;
-            if (m.contains("attachments") && m["attachments"].is_array()) {
-              for (const auto& a : m["attachments"]) {
-                if (!looks_like_audio_attachment(a)) {
-                  continue;
-                }
-                const std::string url = a.value("url", "");
-                const std::string fn = a.value("filename", "");
-                if (auto p = download_discord_attachment(url, channel_id, fn)) {
-                  media_paths.push_back(p->string());
-                  break;
-                }
-              }
-            }
-
-            if (text.empty() && !media_paths.empty()) {
-              text = "Voice/audio file received. Please transcribe and respond.";
-            }
-            if (text.empty() && media_paths.empty()) {
-              continue;
-            }
-
-            handle_message(user_id, channel_id, text, media_paths, json::object());
+      GatewayState gs;
+      while (running_.load()) {
+        std::string payload;
+        const auto st = ws.recv(&payload, &err);
+        if (st == WebSocketClient::RecvStatus::kMessage) {
+          if (!handle_gateway_payload(ws, multi, payload, gs)) {
+            break;
           }
+          continue;
+        }
+        if (st != WebSocketClient::RecvStatus::kIdle) {
+          break;
+        }
 
-          if (max_seen != 0) {
-            last_id_[channel_id] = std::to_string(max_seen);
-            dirty_.store(true);
+        const int64_t now = now_ms();
+        if (gs.heartbeat_ms > 0 && now >= gs.next_heartbeat_ms) {
+          if (gs.awaiting_ack) {
+            ATTOCLAW_LOG_WARN("Discord gateway heartbeat not acknowledged; reconnecting.");
+            break;
           }
-        } catch (const std::exception& e) {
-          Logger::log(Logger::Level::kWarn, std::string("Discord parse error: ") + e.what());
+          send_heartbeat(ws);
+          gs.awaiting_ack = true;
+          gs.next_heartbeat_ms = now + gs.heartbeat_ms;
         }
+        if (gs.ready) {
+          backoff_ms = 1000;
+        }
+        const int64_t until_heartbeat = gs.heartbeat_ms > 0 ? gs.next_heartbeat_ms - now_ms() : 500;
+        if (ws.wait(static_cast<int>((std::clamp)(until_heartbeat, int64_t{0}, int64_t{500}))) ==
+            WebSocketClient::WaitStatus::kError) {
+          break;
+        }
+      }
 
-        maybe_flush_state();
+      const int close_code = ws.close_code();
+      ws.close();
+      maybe_flush_state();
+      if (!running_.load()) {
+        break;
+      }
+      metrics().inc("discord.gateway.reconnects");
+      if (close_code == 4004 || (close_code >= 4010 && close_code <= 4014)) {
+        if (channels_.empty()) {
+          ATTOCLAW_LOG_ERROR("Discord gateway closed with code " + std::to_string(close_code) +
+                             " and no channels are configured for REST polling; Discord channel stopped.");
+          return true;
+        }
+        ATTOCLAW_LOG_ERROR("Discord gateway closed with code " + std::to_string(close_code) +
+                           "; falling back to REST polling.");
+        return false;
       }
+      if (close_code == 4007 || close_code == 4009) {
+        session_id_.clear();
+        seq_ = 0;
+      }
+      sleep_while_running(backoff_ms);
+      backoff_ms = (std::min)(backoff_ms * 2, int64_t{60000});
+    }
+    return true;
+  }
+
+  struct GatewayState {
+    int64_t heartbeat_ms{0};
+    int64_t next_heartbeat_ms{0};
+    bool awaiting_ack{false};
+    bool ready{false};
+  };
 
-      for (int i = 0; running_.load() && i < poll_s * 10; ++i) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  void send_heartbeat(WebSocketClient& ws) {
+    ws.send_json(json{{"op", 1}, {"d", seq_ > 0 ? json(seq_) : json(nullptr)}}, &running_);
+  }
+
+  // Returns false when the connection should be dropped and re-established.
+  bool handle_gateway_payload(WebSocketClient& ws, HttpMultiClient& multi, const std::string& raw, GatewayState& gs) {
+    json p;
+    try {
+      p = json::parse(raw);
+    } catch (const std::exception& e) {
+      ATTOCLAW_LOG_WARN(std::string("Discord gateway payload parse error: ") + e.what());
+      return true;
+    }
+    const int op = p.value("op", -1);
+    if (p.contains("s") && p["s"].is_number_integer()) {
+      seq_ = p["s"].get<int64_t>();
+    }
+
+    switch (op) {
+      case 10: {  // Hello
+        gs.heartbeat_ms = p["d"].value("heartbeat_interval", 41250);
+        gs.next_heartbeat_ms = now_ms() + gs.heartbeat_ms / 2;
+        if (!session_id_.empty() && seq_ > 0) {
+          return ws.send_json(
+              json{{"op", 6}, {"d", {{"token", config_.token}, {"session_id", session_id_}, {"seq", seq_}}}},
+              &running_);
+        }
+        return ws.send_json(json{{"op", 2},
+                                 {"d",
+                                  {{"token", config_.token},
+                                   {"intents", config_.intents},
+                                   {"properties", {{"os", "attoclaw"}, {"browser", "attoclaw"}, {"device", "attoclaw"}}}}}},
+                            &running_);
+      }
+      case 11:  // Heartbeat ACK
+        gs.awaiting_ack = false;
+        return true;
+      case 1:  // Heartbeat request
+        send_heartbeat(ws);
+        return true;
+      case 7:  // Reconnect (resume afterwards)
+        return false;
+      case 9:  // Invalid session
+        if (!p.value("d", false)) {
+          session_id_.clear();
+          seq_ = 0;
+        }
+        return false;
+      case 0:
+        break;
+      default:
+        return true;
+    }
+
+    const std::string type = p.value("t", "");
+    if (type == "READY") {
+      session_id_ = p["d"].value("session_id", "");
+      resume_url_ = p["d"].value("resume_gateway_url", "");
+      gs.ready = true;
+      ATTOCLAW_LOG_INFO("Discord gateway ready");
+      // Catch up on anything posted while disconnected.
+      std::vector<ChannelPoll> polls = make_channel_polls();
+      std::vector<std::size_t> all(polls.size());
+      for (std::size_t i = 0; i < all.size(); ++i) {
+        all[i] = i;
+      }
+      if (!all.empty()) {
+        poll_batch(multi, polls, all);
+      }
+    } else if (type == "RESUMED") {
+      gs.ready = true;
+    } else if (type == "MESSAGE_CREATE" && p.contains("d") && p["d"].is_object()) {
+      const std::string channel_id = p["d"].value("channel_id", "");
+      if (!channel_id.empty() && (channel_set_.empty() || channel_set_.contains(channel_id))) {
+        ingest_message(p["d"], channel_id);
       }
     }
+    maybe_flush_state();
+    return true;
+  }
+
+  void sleep_while_running(int64_t ms) const {
+    for (int64_t waited = 0; running_.load() && waited < ms; waited += 100) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
   }
 
   DiscordChannelConfig config_;
   std::string api_base_;
   std::vector<std::string> channels_;
+  std::unordered_set<std::string> channel_set_;
   std::unordered_set<std::string> allow_from_;
   std::unordered_map<std::string, std::string> last_id_;
   fs::path state_path_;
   std::atomic<bool> dirty_{false};
   int64_t last_flush_ms_{0};
+  DiscordRateLimiter limiter_;
+
+  // Gateway session (owned by the worker thread).
+  std::string session_id_;
+  std::string resume_url_;
+  int64_t seq_{0};
 
   std::atomic<bool> running_{false};
   std::thread worker_;
+
+  std::mutex attachment_mu_;
+  std::condition_variable attachment_cv_;
+  std::deque<AttachmentJob> attachment_jobs_;
+  bool attachments_running_{false};
+  bool attachment_busy_{false};
+  std::thread attachment_worker_;
 };
 
 }  // namespace attoclaw
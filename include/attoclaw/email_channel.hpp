@@ -1,123 +1,585 @@
 ﻿#pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <ctime>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include <curl/curl.h>
 
+#include "attoclaw/base64.hpp"
 #include "attoclaw/channels.hpp"
 #include "attoclaw/common.hpp"
 #include "attoclaw/config.hpp"
+#include "attoclaw/socket_wait.hpp"
 
 namespace attoclaw {
 
-class EmailChannel : public BaseChannel {
+struct ParsedEmail {
+  std::string from_address;
+  std::string subject;
+  std::string message_id;
+  std::string body;
+};
+
+namespace email_detail {
+
+inline std::string lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return s;
+}
+
+inline int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+inline std::string quoted_printable_decode(std::string_view in, bool underscore_is_space = false) {
+  std::string out;
+  out.reserve(in.size());
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    const char c = in[i];
+    if (c == '=' && i + 1 < in.size()) {
+      if (in[i + 1] == '\r' || in[i + 1] == '\n') {  // soft line break
+        i += (in[i + 1] == '\r' && i + 2 < in.size() && in[i + 2] == '\n') ? 2 : 1;
+        continue;
+      }
+      if (i + 2 < in.size() && hex_value(in[i + 1]) >= 0 && hex_value(in[i + 2]) >= 0) {
+        out.push_back(static_cast<char>(hex_value(in[i + 1]) * 16 + hex_value(in[i + 2])));
+        i += 2;
+        continue;
+      }
+    }
+    out.push_back(underscore_is_space && c == '_' ? ' ' : c);
+  }
+  return out;
+}
+
+// RFC 2047 encoded words (=?charset?B|Q?text?=); the charset is assumed to be UTF-8 compatible.
+inline std::string decode_header_words(const std::string& in) {
+  std::string out;
+  std::size_t pos = 0;
+  bool last_was_word = false;
+  while (pos < in.size()) {
+    const auto start = in.find("=?", pos);
+    if (start == std::string::npos) {
+      out += in.substr(pos);
+      break;
+    }
+    const auto q1 = in.find('?', start + 2);
+    const auto q2 = q1 == std::string::npos ? q1 : in.find('?', q1 + 1);
+    const auto end = q2 == std::string::npos ? q2 : in.find("?=", q2 + 1);
+    if (end == std::string::npos || q2 != q1 + 2) {
+      out += in.substr(pos);
+      break;
+    }
+    const std::string gap = in.substr(pos, start - pos);
+    if (!(last_was_word && trim(gap).empty())) {  // whitespace between encoded words is dropped
+      out += gap;
+    }
+    const char enc = static_cast<char>(std::toupper(static_cast<unsigned char>(in[q1 + 1])));
+    const std::string_view text(in.data() + q2 + 1, end - q2 - 1);
+    out += enc == 'B' ? base64_decode(text) : quoted_printable_decode(text, true);
+    pos = end + 2;
+    last_was_word = true;
+  }
+  return out;
+}
+
+// Header text taken from an inbound mail, made safe to echo: CR, LF and other control
+// characters become spaces, so the value cannot start a header of its own.
+inline std::string header_safe(std::string_view in) {
+  std::string out;
+  out.reserve(in.size());
+  for (unsigned char c : in) {
+    out.push_back(c < 0x20 || c == 0x7F ? ' ' : static_cast<char>(c));
+  }
+  return trim(out);
+}
+
+// RFC 2047 B-encoding for non-ASCII header text. Encoded words are folded onto separate
+// lines, stay well under 78 columns and never split a UTF-8 sequence. ASCII is unchanged.
+inline std::string encode_header_words(const std::string& text) {
+  if (std::all_of(text.begin(), text.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; })) {
+    return text;
+  }
+  constexpr std::size_t kWordBytes = 39;  // 52 base64 characters per word
+  std::string out;
+  for (std::size_t at = 0; at < text.size();) {
+    std::size_t n = (std::min)(kWordBytes, text.size() - at);
+    while (n > 0 && at + n < text.size() && (static_cast<unsigned char>(text[at + n]) & 0xC0) == 0x80) {
+      --n;
+    }
+    if (n == 0) {
+      n = (std::min)(kWordBytes, text.size() - at);
+    }
+    if (!out.empty()) {
+      out += "\r\n ";
+    }
+    out += "=?UTF-8?B?" + base64_encode(std::string_view(text).substr(at, n)) + "?=";
+    at += n;
+  }
+  return out;
+}
+
+// Splits a MIME entity into unfolded, lower-cased headers and its body.
+inline std::string split_headers(const std::string& raw, std::vector<std::pair<std::string, std::string>>* headers) {
+  if (raw.rfind("\r\n", 0) == 0 || raw.rfind("\n", 0) == 0) {
+    return raw.substr(raw[0] == '\r' ? 2 : 1);  // no headers at all
+  }
+  std::size_t sep = raw.find("\r\n\r\n");
+  std::size_t body_at = sep == std::string::npos ? std::string::npos : sep + 4;
+  if (sep == std::string::npos) {
+    sep = raw.find("\n\n");
+    body_at = sep == std::string::npos ? raw.size() : sep + 2;
+  }
+  const std::string head = raw.substr(0, sep == std::string::npos ? raw.size() : sep);
+  std::istringstream lines(head);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty() && (line[0] == ' ' || line[0] == '\t') && !headers->empty()) {
+      headers->back().second += " " + trim(line);
+      continue;
+    }
+    const auto colon = line.find(':');
+    if (colon != std::string::npos) {
+      headers->emplace_back(lower(trim(line.substr(0, colon))), trim(line.substr(colon + 1)));
+    }
+  }
+  return body_at >= raw.size() ? std::string() : raw.substr(body_at);
+}
+
+inline std::string header_value(const std::vector<std::pair<std::string, std::string>>& headers,
+                                const std::string& name) {
+  for (const auto& [k, v] : headers) {
+    if (k == name) {
+      return v;
+    }
+  }
+  return {};
+}
+
+inline std::string header_param(const std::string& value, const std::string& param) {
+  const std::string lv = lower(value);
+  const auto p = lv.find(param + "=");
+  if (p == std::string::npos) {
+    return {};
+  }
+  std::size_t i = p + param.size() + 1;
+  if (i < value.size() && value[i] == '"') {
+    const auto close = value.find('"', i + 1);
+    return value.substr(i + 1, close == std::string::npos ? std::string::npos : close - i - 1);
+  }
+  const auto end = value.find_first_of("; \t", i);
+  return value.substr(i, end == std::string::npos ? std::string::npos : end - i);
+}
+
+// Returns the decoded text/plain content of a MIME entity (first matching part of multiparts).
+inline std::optional<std::string> plain_text(const std::string& entity, int depth = 0) {
+  std::vector<std::pair<std::string, std::string>> headers;
+  const std::string body = split_headers(entity, &headers);
+  const std::string ctype = header_value(headers, "content-type");
+  const std::string lctype = lower(ctype);
+  if (lctype.rfind("multipart/", 0) == 0 && depth < 4) {
+    const std::string boundary = header_param(ctype, "boundary");
+    if (boundary.empty()) {
+      return std::nullopt;
+    }
+    const std::string delim = "--" + boundary;
+    std::size_t pos = body.find(delim);
+    while (pos != std::string::npos) {
+      pos += delim.size();
+      if (body.compare(pos, 2, "--") == 0) {
+        break;
+      }
+      const auto next = body.find(delim, pos);
+      std::string part = body.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+      const auto nl = part.find('\n');
+      part = nl == std::string::npos ? std::string() : part.substr(nl + 1);
+      if (auto text = plain_text(part, depth + 1)) {
+        return text;
+      }
+      pos = next;
+    }
+    return std::nullopt;
+  }
+  if (!lctype.empty() && lctype.rfind("text/plain", 0) != 0) {
+    return std::nullopt;
+  }
+  const std::string cte = lower(header_value(headers, "content-transfer-encoding"));
+  if (cte == "base64") {
+    return base64_decode(body);
+  }
+  if (cte == "quoted-printable") {
+    return quoted_printable_decode(body);
+  }
+  return body;
+}
+
+}  // namespace email_detail
+
+// Extracts what the agent needs from a raw RFC 5322 message: sender address, subject,
+// Message-ID and the first text/plain body (quoted-printable/base64 decoded).
+inline ParsedEmail parse_email_message(const std::string& raw) {
+  std::vector<std::pair<std::string, std::string>> headers;
+  email_detail::split_headers(raw, &headers);
+
+  ParsedEmail out;
+  std::string from = email_detail::header_value(headers, "from");
+  const auto lt = from.rfind('<');
+  const auto gt = from.rfind('>');
+  if (lt != std::string::npos && gt != std::string::npos && gt > lt) {
+    from = from.substr(lt + 1, gt - lt - 1);
+  }
+  out.from_address = email_detail::lower(trim(from));
+  out.subject = trim(email_detail::decode_header_words(email_detail::header_value(headers, "subject")));
+  out.message_id = email_detail::header_value(headers, "message-id");
+
+  std::string body = email_detail::plain_text(raw).value_or("");
+  std::string normalized;
+  normalized.reserve(body.size());
+  for (char c : body) {
+    if (c != '\r') {
+      normalized.push_back(c);
+    }
+  }
+  out.body = trim(normalized);
+  return out;
+}
+
+// Minimal IMAP session over a libcurl CONNECT_ONLY handle. libcurl performs the greeting,
+// STARTTLS/TLS and authentication; commands after that are written and read raw so the
+// session can sit in IDLE.
+class ImapConnection {
  public:
-  EmailChannel(const EmailChannelConfig& config, MessageBus* bus) : BaseChannel("email", bus), config_(config) {
-    ensure_global_init();
+  ImapConnection() = default;
+  ~ImapConnection() { close(); }
+
+  ImapConnection(const ImapConnection&) = delete;
+  ImapConnection& operator=(const ImapConnection&) = delete;
+
+  bool connect(const std::string& url, const std::string& user, const std::string& password, bool use_ssl,
+               std::string* error) {
+    close();
+    curl_ = curl_easy_init();
+    if (!curl_) {
+      *error = "curl init failed";
+      return false;
+    }
+    curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl_, CURLOPT_USERNAME, user.c_str());
+    curl_easy_setopt(curl_, CURLOPT_PASSWORD, password.c_str());
+    curl_easy_setopt(curl_, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT, 15L);
+    curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (use_ssl) {
+      curl_easy_setopt(curl_, CURLOPT_USE_SSL, static_cast<long>(CURLUSESSL_ALL));
+    }
+    const CURLcode rc = curl_easy_perform(curl_);
+    if (rc != CURLE_OK) {
+      *error = curl_easy_strerror(rc);
+      close();
+      return false;
+    }
+    return true;
   }
 
-  void start() override {
-    // Outbound-only adapter; nothing to poll.
-    running_.store(true);
-    Logger::log(Logger::Level::kInfo, "Email channel started (outbound only)");
+  void close() {
+    if (curl_) {
+      curl_easy_cleanup(curl_);
+      curl_ = nullptr;
+    }
+    rbuf_.clear();
   }
 
-  void stop() override {
-    running_.store(false);
-    Logger::log(Logger::Level::kInfo, "Email channel stopped");
+  // Runs one tagged command. Untagged responses (literals inlined) land in `untagged`.
+  // Returns true only for a tagged OK.
+  bool command(const std::string& cmd, std::vector<std::string>* untagged, int timeout_ms = 30000) {
+    const std::string tag = next_tag();
+    if (!send_raw(tag + " " + cmd + "\r\n")) {
+      return false;
+    }
+    return read_until_tagged(tag, untagged, timeout_ms);
   }
 
-  void send(const OutboundMessage& msg) override {
-    if (!running_.load()) {
-      return;
+  // IDLE until the server reports mailbox changes, `timeout_ms` passes, or `keep_running`
+  // turns false. Returns false if the connection is no longer usable.
+  bool idle(int timeout_ms, const std::atomic<bool>& keep_running) {
+    const std::string tag = next_tag();
+    if (!send_raw(tag + " IDLE\r\n")) {
+      return false;
     }
-    if (trim(config_.smtp_url).empty()) {
-      Logger::log(Logger::Level::kWarn, "Email send skipped: smtpUrl is empty");
-      return;
+    std::string line;
+    bool timed_out = false;
+    if (!read_line(&line, 10000, &timed_out) || line.empty() || line[0] != '+') {
+      return false;
     }
-    if (trim(config_.from).empty()) {
-      Logger::log(Logger::Level::kWarn, "Email send skipped: from is empty");
-      return;
+    const int64_t deadline = now_ms() + timeout_ms;
+    while (keep_running.load() && now_ms() < deadline) {
+      if (!read_line(&line, 500, &timed_out)) {
+        if (timed_out) {
+          continue;
+        }
+        return false;
+      }
+      if (line.find(" EXISTS") != std::string::npos || line.find(" RECENT") != std::string::npos) {
+        break;
+      }
     }
+    if (!send_raw("DONE\r\n")) {
+      return false;
+    }
+    return read_until_tagged(tag, nullptr, 10000);
+  }
 
-    std::vector<std::string> recipients;
-    if (!trim(msg.chat_id).empty()) {
-      recipients.push_back(trim(msg.chat_id));
-    } else {
-      recipients = config_.default_to;
+ private:
+  std::string next_tag() { return "ac" + std::to_string(++tag_seq_); }
+
+  bool send_raw(const std::string& data) {
+    if (!curl_) {
+      return false;
     }
-    if (recipients.empty()) {
-      Logger::log(Logger::Level::kWarn, "Email send skipped: no recipients (chat_id empty and defaultTo empty)");
-      return;
+    std::size_t off = 0;
+    const int64_t deadline = now_ms() + 15000;
+    while (off < data.size()) {
+      size_t n = 0;
+      const CURLcode rc = curl_easy_send(curl_, data.data() + off, data.size() - off, &n);
+      if (rc == CURLE_AGAIN) {
+        if (now_ms() > deadline) {
+          return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        continue;
+      }
+      if (rc != CURLE_OK) {
+        return false;
+      }
+      off += n;
     }
+    return true;
+  }
 
-    const std::string subject = config_.subject_prefix.empty() ? "AttoClaw" : config_.subject_prefix;
-    const std::string payload = build_email_payload(config_.from, recipients, subject, msg.content);
+  // Pulls more bytes into rbuf_. Sets *timed_out when nothing arrived within timeout_ms.
+  bool fill(int timeout_ms, bool* timed_out) {
+    char buf[16384];
+    const int64_t deadline = now_ms() + timeout_ms;
+    while (true) {
+      size_t n = 0;
+      const CURLcode rc = curl_easy_recv(curl_, buf, sizeof(buf), &n);
+      if (rc == CURLE_OK) {
+        if (n == 0) {
+          return false;  // closed by peer
+        }
+        rbuf_.append(buf, n);
+        return true;
+      }
+      if (rc != CURLE_AGAIN) {
+        return false;
+      }
+      const int64_t left = deadline - now_ms();
+      if (left <= 0) {
+        *timed_out = true;
+        return false;
+      }
+      curl_socket_t sock = CURL_SOCKET_BAD;
+      if (curl_easy_getinfo(curl_, CURLINFO_ACTIVESOCKET, &sock) != CURLE_OK || sock == CURL_SOCKET_BAD) {
+        return false;
+      }
+      if (wait_socket_readable(sock, static_cast<int>(left)) == SocketWaitStatus::kError) {
+        return false;
+      }
+    }
+  }
 
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-      Logger::log(Logger::Level::kWarn, "Email send failed: curl init failed");
-      return;
+  // Reads one response line; "{n}" literals are read in full and kept inline.
+  bool read_line(std::string* line, int timeout_ms, bool* timed_out) {
+    *timed_out = false;
+    std::string out;
+    std::size_t scan = 0;
+    while (true) {
+      const auto pos = rbuf_.find("\r\n", scan);
+      if (pos == std::string::npos) {
+        scan = rbuf_.size() > 0 ? rbuf_.size() - 1 : 0;
+        if (!fill(timeout_ms, timed_out)) {
+          return false;
+        }
+        continue;
+      }
+      std::size_t literal = 0;
+      bool has_literal = false;
+      if (pos > 0 && rbuf_[pos - 1] == '}') {
+        const auto open = rbuf_.rfind('{', pos - 1);
+        if (open != std::string::npos && open + 1 < pos - 1) {
+          try {
+            literal = static_cast<std::size_t>(std::stoull(rbuf_.substr(open + 1, pos - 1 - open - 1)));
+            has_literal = true;
+          } catch (...) {
+          }
+        }
+      }
+      if (!has_literal) {
+        out += rbuf_.substr(0, pos);
+        rbuf_.erase(0, pos + 2);
+        *line = std::move(out);
+        return true;
+      }
+      while (rbuf_.size() < pos + 2 + literal) {
+        if (!fill(timeout_ms, timed_out)) {
+          return false;
+        }
+      }
+      out += rbuf_.substr(0, pos + 2 + literal);
+      rbuf_.erase(0, pos + 2 + literal);
+      scan = 0;
     }
+  }
 
-    struct curl_slist* rcpt_list = nullptr;
-    for (const auto& r : recipients) {
-      rcpt_list = curl_slist_append(rcpt_list, r.c_str());
+  bool read_until_tagged(const std::string& tag, std::vector<std::string>* untagged, int timeout_ms) {
+    std::string line;
+    bool timed_out = false;
+    while (read_line(&line, timeout_ms, &timed_out)) {
+      if (line.rfind(tag + " ", 0) == 0) {
+        return line.compare(tag.size() + 1, 2, "OK") == 0;
+      }
+      if (untagged) {
+        untagged->push_back(std::move(line));
+      }
     }
+    return false;
+  }
 
-    UploadStatus upload;
-    upload.data = payload.c_str();
-    upload.len = payload.size();
+  CURL* curl_{nullptr};
+  std::string rbuf_;
+  uint64_t tag_seq_{0};
+};
 
-    curl_easy_setopt(curl, CURLOPT_URL, config_.smtp_url.c_str());
-    curl_easy_setopt(curl, CURLOPT_USERNAME, config_.username.c_str());
-    curl_easy_setopt(curl, CURLOPT_PASSWORD, config_.password.c_str());
-    curl_easy_setopt(curl, CURLOPT_MAIL_FROM, config_.from.c_str());
-    curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, rcpt_list);
-    curl_easy_setopt(curl, CURLOPT_READFUNCTION, &read_cb);
-    curl_easy_setopt(curl, CURLOPT_READDATA, &upload);
-    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "attoclaw/0.1");
+// Two-way email channel.
+//
+// Outbound: one worker keeps a persistent SMTP handle, so libcurl reuses the
+// connection (TLS + AUTH done once), and messages queued within batchWindowMs for
+// the same recipients go out as one email. The MIME payload is streamed from the
+// queued strings by the read callback.
+// Inbound (optional, imapUrl): an IMAP session parked in IDLE; new UIDs are fetched
+// as soon as the server announces them.
+class EmailChannel : public BaseChannel {
+ public:
+  EmailChannel(const EmailChannelConfig& config, MessageBus* bus) : BaseChannel("email", bus), config_(config) {
+    ensure_global_init();
+    for (const auto& x : config_.allow_from) {
+      const std::string t = email_detail::lower(trim(x));
+      if (!t.empty()) {
+        allow_from_.insert(t);
+      }
+    }
+    state_path_ = expand_user_path("~/.attoclaw") / "state" / "email_cursor.json";
+  }
 
-    if (config_.use_ssl) {
-      curl_easy_setopt(curl, CURLOPT_USE_SSL, static_cast<long>(CURLUSESSL_ALL));
+  ~EmailChannel() override { stop(); }
+
+  void start() override {
+    if (running_.exchange(true)) {
+      return;
     }
+    sender_ = std::thread([this]() { sender_loop(); });
+    bool inbound = !trim(config_.imap_url).empty();
+    // From headers are trivially spoofed and inbound mail drives an agent with exec and
+    // file tools, so intake needs an explicit sender list.
+    if (inbound && allow_from_.empty()) {
+      ATTOCLAW_LOG_ERROR("Email IMAP intake disabled: imapUrl is set but allowFrom is empty; "
+                         "list the sender addresses to accept");
+      inbound = false;
+    }
+    if (inbound) {
+      load_state();
+      imap_ = std::thread([this]() { imap_loop(); });
+    }
+    ATTOCLAW_LOG_INFO(std::string("Email channel started (") + (inbound ? "SMTP + IMAP IDLE" : "outbound only") + ")");
+  }
 
-    const CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-      Logger::log(Logger::Level::kWarn, std::string("Email send failed: ") + curl_easy_strerror(res));
+  // Sends whatever is still queued before returning.
+  void stop() override {
+    if (!running_.exchange(false)) {
+      return;
+    }
+    queue_cv_.notify_all();
+    if (sender_.joinable()) {
+      sender_.join();
+    }
+    if (imap_.joinable()) {
+      imap_.join();
     }
+    ATTOCLAW_LOG_INFO("Email channel stopped");
+  }
 
-    if (rcpt_list) {
-      curl_slist_free_all(rcpt_list);
+  void send(const OutboundMessage& msg) override {
+    if (!running_.load()) {
+      return;
+    }
+    if (trim(config_.smtp_url).empty()) {
+      ATTOCLAW_LOG_WARN("Email send skipped: smtpUrl is empty");
+      return;
+    }
+    if (trim(config_.from).empty()) {
+      ATTOCLAW_LOG_WARN("Email send skipped: from is empty");
+      return;
     }
-    curl_easy_cleanup(curl);
+    {
+      std::lock_guard<std::mutex> lock(queue_mu_);
+      queue_.push_back(msg);
+    }
+    queue_cv_.notify_one();
   }
 
  private:
-  struct UploadStatus {
-    const char* data{nullptr};
-    size_t len{0};
-    size_t pos{0};
+  static constexpr std::size_t kMaxBatch = 32;
+
+  struct Batch {
+    std::vector<std::string> recipients;
+    std::string subject;
+    std::string in_reply_to;
+    std::vector<std::string> bodies;
+  };
+
+  // Streams header block and bodies to libcurl without concatenating them.
+  struct PayloadReader {
+    std::vector<std::string_view> parts;
+    std::size_t index{0};
+    std::size_t offset{0};
   };
 
   static size_t read_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    auto* rd = static_cast<PayloadReader*>(userdata);
     const size_t max = size * nmemb;
-    auto* up = static_cast<UploadStatus*>(userdata);
-    if (!up || !up->data || up->pos >= up->len) {
-      return 0;
+    size_t written = 0;
+    while (rd && written < max && rd->index < rd->parts.size()) {
+      const std::string_view part = rd->parts[rd->index];
+      const size_t n = (std::min)(max - written, part.size() - rd->offset);
+      std::memcpy(ptr + written, part.data() + rd->offset, n);
+      written += n;
+      rd->offset += n;
+      if (rd->offset == part.size()) {
+        ++rd->index;
+        rd->offset = 0;
+      }
     }
-    const size_t n = (std::min)(max, up->len - up->pos);
-    std::memcpy(ptr, up->data + up->pos, n);
-    up->pos += n;
-    return n;
+    return written;
   }
 
   static void ensure_global_init() {
@@ -149,23 +611,350 @@ class EmailChannel : public BaseChannel {
     return ss.str();
   }
 
-  static std::string build_email_payload(const std::string& from, const std::vector<std::string>& to,
-                                         const std::string& subject, const std::string& body) {
+  static std::string build_email_headers(const std::string& from, const std::vector<std::string>& to,
+                                         const std::string& subject, const std::string& in_reply_to) {
     std::ostringstream ss;
     ss << "Date: " << rfc2822_date() << "\r\n";
     ss << "To: " << join_recipients(to) << "\r\n";
     ss << "From: " << from << "\r\n";
-    ss << "Subject: " << subject << "\r\n";
+    // Both come from the inbound mail.
+    ss << "Subject: " << email_detail::encode_header_words(email_detail::header_safe(subject)) << "\r\n";
+    const std::string reply_to = email_detail::header_safe(in_reply_to);
+    if (!reply_to.empty()) {
+      ss << "In-Reply-To: " << reply_to << "\r\n";
+      ss << "References: " << reply_to << "\r\n";
+    }
     ss << "MIME-Version: 1.0\r\n";
     ss << "Content-Type: text/plain; charset=utf-8\r\n";
     ss << "Content-Transfer-Encoding: 8bit\r\n";
     ss << "\r\n";
-    ss << body << "\r\n";
     return ss.str();
   }
 
+  // Groups queued messages by (recipients, subject, thread), preserving order.
+  std::vector<Batch> make_batches(const std::deque<OutboundMessage>& pending) const {
+    std::vector<Batch> batches;
+    for (const auto& msg : pending) {
+      std::vector<std::string> recipients;
+      if (!trim(msg.chat_id).empty()) {
+        recipients.push_back(trim(msg.chat_id));
+      } else {
+        recipients = config_.default_to;
+      }
+      if (recipients.empty()) {
+        ATTOCLAW_LOG_WARN("Email send skipped: no recipients (chat_id empty and defaultTo empty)");
+        continue;
+      }
+
+      std::string subject = config_.subject_prefix.empty() ? "AttoClaw" : config_.subject_prefix;
+      std::string in_reply_to;
+      if (msg.metadata.is_object()) {
+        const std::string orig = msg.metadata.value("subject", "");
+        if (!orig.empty()) {
+          subject = email_detail::lower(orig).rfind("re:", 0) == 0 ? orig : "Re: " + orig;
+        }
+        in_reply_to = msg.metadata.value("messageId", "");
+      }
+
+      auto it = std::find_if(batches.begin(), batches.end(), [&](const Batch& b) {
+        return b.recipients == recipients && b.subject == subject && b.in_reply_to == in_reply_to;
+      });
+      if (it == batches.end()) {
+        batches.push_back(Batch{recipients, subject, in_reply_to, {}});
+        it = batches.end() - 1;
+      }
+      it->bodies.push_back(msg.content);
+    }
+    return batches;
+  }
+
+  void sender_loop() {
+    CURL* smtp = nullptr;
+    const auto window = std::chrono::milliseconds((std::max)(0, config_.batch_window_ms));
+    while (true) {
+      std::deque<OutboundMessage> pending;
+      {
+        std::unique_lock<std::mutex> lock(queue_mu_);
+        queue_cv_.wait(lock, [this]() { return !queue_.empty() || !running_.load(); });
+        if (queue_.empty()) {
+          break;  // stopped and drained
+        }
+        if (running_.load() && window.count() > 0) {
+          queue_cv_.wait_for(lock, window, [this]() { return !running_.load() || queue_.size() >= kMaxBatch; });
+        }
+        pending.swap(queue_);
+      }
+      for (const auto& batch : make_batches(pending)) {
+        deliver(&smtp, batch);
+      }
+    }
+    if (smtp) {
+      curl_easy_cleanup(smtp);
+    }
+  }
+
+  void deliver(CURL** smtp, const Batch& batch) {
+    const std::string headers = build_email_headers(config_.from, batch.recipients, batch.subject, batch.in_reply_to);
+    static constexpr std::string_view kSeparator = "\r\n\r\n";
+    static constexpr std::string_view kTrailer = "\r\n";
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      if (!*smtp) {
+        *smtp = curl_easy_init();
+        if (!*smtp) {
+          ATTOCLAW_LOG_WARN("Email send failed: curl init failed");
+          return;
+        }
+      }
+      CURL* curl = *smtp;
+      // Reset clears options only; the cached SMTP connection survives for reuse.
+      curl_easy_reset(curl);
+
+      PayloadReader reader;
+      reader.parts.push_back(headers);
+      for (std::size_t i = 0; i < batch.bodies.size(); ++i) {
+        if (i > 0) {
+          reader.parts.push_back(kSeparator);
+        }
+        reader.parts.push_back(batch.bodies[i]);
+      }
+      reader.parts.push_back(kTrailer);
+
+      struct curl_slist* rcpt_list = nullptr;
+      for (const auto& r : batch.recipients) {
+        rcpt_list = curl_slist_append(rcpt_list, r.c_str());
+      }
+
+      curl_easy_setopt(curl, CURLOPT_URL, config_.smtp_url.c_str());
+      curl_easy_setopt(curl, CURLOPT_USERNAME, config_.username.c_str());
+      curl_easy_setopt(curl, CURLOPT_PASSWORD, config_.password.c_str());
+      curl_easy_setopt(curl, CURLOPT_MAIL_FROM, config_.from.c_str());
+      curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, rcpt_list);
+      curl_easy_setopt(curl, CURLOPT_READFUNCTION, &read_cb);
+      curl_easy_setopt(curl, CURLOPT_READDATA, &reader);
+      curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+      curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+      curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+      curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+      curl_easy_setopt(curl, CURLOPT_USERAGENT, "attoclaw/0.1");
+      if (config_.use_ssl) {
+        curl_easy_setopt(curl, CURLOPT_USE_SSL, static_cast<long>(CURLUSESSL_ALL));
+      }
+      if (attempt > 0) {
+        curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+      }
+
+      const CURLcode res = curl_easy_perform(curl);
+      curl_slist_free_all(rcpt_list);
+      if (res == CURLE_OK) {
+        metrics().inc("email.sent");
+        return;
+      }
+      long new_connects = 0;
+      curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connects);
+      // A stale pooled connection shows up as a failure without a new connect; retry fresh once.
+      if (attempt == 0 && new_connects == 0) {
+        continue;
+      }
+      ATTOCLAW_LOG_WARN(std::string("Email send failed: ") + curl_easy_strerror(res));
+      metrics().inc("email.send_error");
+      return;
+    }
+  }
+
+  void load_state() {
+    const std::string raw = read_text_file(state_path_);
+    if (trim(raw).empty()) {
+      return;
+    }
+    try {
+      const json j = json::parse(raw);
+      uid_validity_ = j.value("uidValidity", uint64_t{0});
+      last_uid_ = j.value("lastUid", uint64_t{0});
+    } catch (...) {
+    }
+  }
+
+  void flush_state() const {
+    json j;
+    j["updatedAt"] = now_iso8601();
+    j["uidValidity"] = uid_validity_;
+    j["lastUid"] = last_uid_;
+    write_text_file(state_path_, j.dump(2));
+  }
+
+  static uint64_t bracket_number(const std::string& line, const std::string& key) {
+    const auto p = line.find("[" + key + " ");
+    if (p == std::string::npos) {
+      return 0;
+    }
+    try {
+      return std::stoull(line.substr(p + key.size() + 2));
+    } catch (...) {
+      return 0;
+    }
+  }
+
+  static std::string mailbox_from_url(const std::string& url) {
+    const auto scheme = url.find("://");
+    const auto slash = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    if (slash == std::string::npos || slash + 1 >= url.size()) {
+      return "INBOX";
+    }
+    std::string box = url.substr(slash + 1);
+    const auto semi = box.find_first_of(";?");
+    return semi == std::string::npos ? box : box.substr(0, semi);
+  }
+
+  bool select_mailbox(ImapConnection& imap, const std::string& mailbox) {
+    std::vector<std::string> untagged;
+    if (!imap.command("SELECT \"" + mailbox + "\"", &untagged)) {
+      ATTOCLAW_LOG_WARN("Email IMAP SELECT " + mailbox + " failed");
+      return false;
+    }
+    uint64_t validity = 0;
+    uint64_t uid_next = 0;
+    for (const auto& line : untagged) {
+      validity = (std::max)(validity, bracket_number(line, "UIDVALIDITY"));
+      uid_next = (std::max)(uid_next, bracket_number(line, "UIDNEXT"));
+    }
+    if (validity != uid_validity_ || last_uid_ == 0) {
+      // New mailbox (or renumbered): start from what is there now, do not replay history.
+      uid_validity_ = validity;
+      last_uid_ = uid_next > 0 ? uid_next - 1 : 0;
+      flush_state();
+    }
+    return true;
+  }
+
+  bool fetch_new(ImapConnection& imap) {
+    std::vector<std::string> untagged;
+    if (!imap.command("UID SEARCH UID " + std::to_string(last_uid_ + 1) + ":*", &untagged)) {
+      return false;
+    }
+    std::vector<uint64_t> uids;
+    for (const auto& line : untagged) {
+      if (line.rfind("* SEARCH", 0) != 0) {
+        continue;
+      }
+      std::istringstream ss(line.substr(8));
+      uint64_t uid = 0;
+      while (ss >> uid) {
+        if (uid > last_uid_) {
+          uids.push_back(uid);
+        }
+      }
+    }
+    std::sort(uids.begin(), uids.end());
+
+    for (const uint64_t uid : uids) {
+      std::vector<std::string> fetched;
+      if (!imap.command("UID FETCH " + std::to_string(uid) + " (BODY.PEEK[])", &fetched, 60000)) {
+        return false;
+      }
+      for (const auto& line : fetched) {
+        const auto open = line.find('{');
+        const auto close = open == std::string::npos ? open : line.find("}\r\n", open);
+        if (close == std::string::npos) {
+          continue;
+        }
+        std::size_t len = 0;
+        try {
+          len = static_cast<std::size_t>(std::stoull(line.substr(open + 1, close - open - 1)));
+        } catch (...) {
+          continue;
+        }
+        ingest(parse_email_message(line.substr(close + 3, len)));
+        break;
+      }
+      last_uid_ = uid;
+      flush_state();
+    }
+    return true;
+  }
+
+  void ingest(const ParsedEmail& mail) {
+    if (mail.from_address.empty() || mail.from_address == email_detail::lower(trim(config_.from))) {
+      return;
+    }
+    if (!allow_from_.contains(mail.from_address)) {
+      return;
+    }
+    const std::string content = !mail.body.empty() ? mail.body : mail.subject;
+    if (content.empty()) {
+      return;
+    }
+    metrics().inc("email.received");
+    handle_message(mail.from_address, mail.from_address, content, {},
+                   json{{"subject", mail.subject}, {"messageId", mail.message_id}});
+  }
+
+  void imap_loop() {
+    static constexpr int kIdleRefreshMs = 25 * 60 * 1000;  // RFC 2177: re-issue IDLE before 29 minutes
+    static constexpr int kNoIdlePollMs = 60 * 1000;
+    const std::string mailbox = mailbox_from_url(config_.imap_url);
+    int64_t backoff_ms = 1000;
+
+    while (running_.load()) {
+      ImapConnection imap;
+      std::string err;
+      if (!imap.connect(config_.imap_url, config_.username, config_.password, config_.use_ssl, &err) ||
+          !select_mailbox(imap, mailbox)) {
+        if (!err.empty()) {
+          ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Email IMAP connect failed: " + err);
+        }
+        for (int64_t waited = 0; running_.load() && waited < backoff_ms; waited += 100) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        backoff_ms = (std::min)(backoff_ms * 2, int64_t{120000});
+        continue;
+      }
+
+      std::vector<std::string> caps;
+      imap.command("CAPABILITY", &caps);
+      bool has_idle = false;
+      for (const auto& line : caps) {
+        has_idle = has_idle || (" " + line + " ").find(" IDLE ") != std::string::npos;
+      }
+      if (!has_idle) {
+        ATTOCLAW_LOG_WARN("Email IMAP server lacks IDLE; checking every 60s instead.");
+      }
+      backoff_ms = 1000;
+
+      while (running_.load()) {
+        if (!fetch_new(imap)) {
+          break;
+        }
+        if (has_idle) {
+          if (!imap.idle(kIdleRefreshMs, running_)) {
+            break;
+          }
+        } else {
+          for (int waited = 0; running_.load() && waited < kNoIdlePollMs; waited += 100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          }
+          if (running_.load() && !imap.command("NOOP", nullptr)) {
+            break;
+          }
+        }
+      }
+      imap.close();
+    }
+  }
+
   EmailChannelConfig config_;
+  std::unordered_set<std::string> allow_from_;
   std::atomic<bool> running_{false};
+
+  std::mutex queue_mu_;
+  std::condition_variable queue_cv_;
+  std::deque<OutboundMessage> queue_;
+  std::thread sender_;
+
+  std::thread imap_;
+  fs::path state_path_;
+  uint64_t uid_validity_{0};
+  uint64_t last_uid_{0};
 };
 
 }  // namespace attoclaw
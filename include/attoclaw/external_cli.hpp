@@ -1,11 +1,21 @@
-#pragma once
-
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "attoclaw/common.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/subprocess.hpp"
 #include "attoclaw/vision.hpp"
 
 namespace attoclaw {
@@ -123,6 +133,7 @@ inline bool ensure_external_cli_available(const std::string& command, const std:
   if (!install_attempted[command]) {
     install_attempted[command] = true;
     CommandResult install = run_command_capture("npm install -g " + npm_package, 600);
+    capabilities().invalidate(command);
     if (!install.ok) {
       const std::string lower = cli_to_lower(install.output);
       if (lower.find("could not find any python installation") != std::string::npos ||
@@ -133,6 +144,7 @@ inline bool ensure_external_cli_available(const std::string& command, const std:
           (void)try_install_linux_package("python3", 300, &dep_note);
         }
         install = run_command_capture("npm install -g " + npm_package, 600);
+        capabilities().invalidate(command);
       }
     }
     if (!install.ok && note) {
@@ -329,47 +341,20 @@ inline ExternalVisionContext collect_external_vision_context(bool requested) {
     return ctx;
   }
 
-#ifdef _WIN32
-  auto frame = capture_vision_frame(1280, 70);
+  const fs::path out = expand_user_path("~/.attoclaw") / "screenshots" /
+                       ("external_vision_" + std::to_string(now_ms()) + ".jpg");
+  std::string capture_error;
+  const auto frame = vision_pipeline().capture(out, 0, false, 0, &capture_error);
   if (!frame.has_value()) {
-    ctx.note = "screen capture failed";
+    ctx.note = capture_error.empty() ? "screen capture failed" : capture_error;
     return ctx;
   }
   ctx.captured = true;
-  ctx.image_path = fs::absolute(frame->path);
-#else
-  if (!ensure_vision_capture_dependencies(&ctx.note)) {
-    return ctx;
-  }
-
-  const fs::path dir = expand_user_path("~/.attoclaw") / "screenshots";
-  std::error_code ec;
-  fs::create_directories(dir, ec);
-  const fs::path out = dir / ("external_vision_" + std::to_string(now_ms()) + ".png");
-  const std::string path_abs = fs::absolute(out).string();
-  const std::string path_q = sh_single_quote(path_abs);
-  std::string command;
-  if (command_exists_in_path("grim")) {
-    command = "sh -lc \"grim " + path_q + "\"";
-  } else if (command_exists_in_path("scrot")) {
-    command = "sh -lc \"scrot " + path_q + "\"";
-  } else {
-    ctx.note = "no screenshot tool available (grim/scrot)";
-    return ctx;
-  }
-  const CommandResult capture = run_command_capture(command, 30);
-  if (!capture.ok || !fs::exists(out)) {
-    const std::string msg = trim(capture.output);
-    ctx.note = msg.empty() ? "screen capture failed" : msg;
-    return ctx;
-  }
-  ctx.captured = true;
-  ctx.image_path = fs::absolute(out);
-#endif
+  ctx.image_path = frame->path;
 
   std::string ocr_note;
   if (ensure_tesseract_ocr(&ocr_note)) {
-    ctx.ocr_text = trim(extract_ocr_text(ctx.image_path, 20));
+    ctx.ocr_text = trim(vision_pipeline().ocr(*frame, 20));
   } else if (ctx.note.empty()) {
     ctx.note = ocr_note.empty() ? "tesseract OCR not available" : ocr_note;
   }
@@ -433,7 +418,326 @@ inline std::vector<ExternalCliCommandCandidate> build_external_cli_commands(cons
   return cmds;
 }
 
-inline std::string run_external_cli(const ExternalCliRoute& route, const fs::path& workspace, bool vision_enabled) {
+struct ExternalCliOptions {
+  int max_concurrent{2};  // CLI runs in flight at once; further requests wait for a slot
+  int warm_workers{1};    // pre-started workers kept per route and workspace; 0 disables
+  int timeout{600};
+};
+
+inline std::string external_cli_npm_package(const std::string& route_name) {
+  return route_name == "gemini" ? "@google/gemini-cli" : "@openai/codex";
+}
+
+// Worker command line: the prompt arrives on stdin, so the process can be started before
+// the prompt is known. Vision requests still go through build_external_cli_commands.
+inline std::vector<std::string> external_cli_worker_argv(const std::string& route_name) {
+  if (route_name == "gemini") {
+    return {"gemini"};  // non-TTY stdin puts gemini in non-interactive mode
+  }
+  return {"codex", "exec", "--skip-git-repo-check", "--json", "-"};
+}
+
+// Process-wide state behind --codex/--gemini:
+// - the availability probe (PATH lookup, maybe an npm install) is cached per route;
+// - a slot count bounds concurrent CLI runs;
+// - on POSIX, `warm_workers` processes per route are started ahead of time and block on
+//   stdin, so Node startup and CLI auth overlap the wait for the next request instead of
+//   delaying it. A route whose CLI rejects the worker flags is remembered, and later
+//   requests go straight to the command-line path.
+class ExternalCliPool {
+ public:
+  static constexpr int kProbeOkTtlS = 600;
+  static constexpr int kProbeFailTtlS = 60;
+  static constexpr double kMaxWorkerAgeS = 900;  // restart idle workers so auth doesn't go stale
+
+  ~ExternalCliPool() { shutdown(); }
+
+  void configure(const ExternalCliOptions& options) {
+    std::lock_guard<std::mutex> lock(mu_);
+    options_.max_concurrent = std::clamp(options.max_concurrent, 1, 16);
+    options_.warm_workers = std::clamp(options.warm_workers, 0, 4);
+    options_.timeout = std::clamp(options.timeout, 10, 3600);
+    cv_.notify_all();
+  }
+
+  ExternalCliOptions options() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return options_;
+  }
+
+  bool available(const std::string& route_name, std::string* note) {
+    std::lock_guard<std::mutex> probe_lock(probe_mu_);  // one probe (and npm install) at a time
+    const auto now = std::chrono::steady_clock::now();
+    auto it = probes_.find(route_name);
+    if (it != probes_.end() && now < it->second.expires) {
+      metrics().inc("external_cli.probe_cache_hits");
+      if (note) {
+        *note = it->second.note;
+      }
+      return it->second.ok;
+    }
+    std::string probe_note;
+    const bool ok = ensure_external_cli_available(route_name, external_cli_npm_package(route_name), &probe_note);
+    probes_[route_name] = Probe{ok, probe_note, now + std::chrono::seconds(ok ? kProbeOkTtlS : kProbeFailTtlS)};
+    if (note) {
+      *note = probe_note;
+    }
+    return ok;
+  }
+
+  // Holds one concurrency slot for its lifetime.
+  class Slot {
+   public:
+    explicit Slot(ExternalCliPool* pool) : pool_(pool) {}
+    ~Slot() {
+      if (pool_) {
+        pool_->release();
+      }
+    }
+    Slot(const Slot&) = delete;
+    Slot& operator=(const Slot&) = delete;
+
+   private:
+    ExternalCliPool* pool_;
+  };
+
+  std::unique_ptr<Slot> acquire(int timeout_s) {
+    const auto started = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mu_);
+    if (!cv_.wait_for(lock, std::chrono::seconds(timeout_s), [&]() { return active_ < options_.max_concurrent; })) {
+      return nullptr;
+    }
+    ++active_;
+    lock.unlock();
+    metrics().observe("external_cli.queue_wait_seconds",
+                      std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    return std::make_unique<Slot>(this);
+  }
+
+  // A live pre-started worker if there is one, otherwise a freshly spawned process.
+  // Returns nullptr where workers can't be spawned (Windows) or the spawn failed.
+  std::unique_ptr<ChildProcess> take_worker(const std::string& route_name, const fs::path& workspace) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (worker_rejected_.count(route_name) > 0) {
+        return nullptr;
+      }
+      auto& spares = spares_[worker_key(route_name, workspace)];
+      while (!spares.empty()) {
+        std::unique_ptr<ChildProcess> w = std::move(spares.back());
+        spares.pop_back();
+        if (w->running() && w->age_seconds() < kMaxWorkerAgeS) {
+          metrics().inc("external_cli.warm_hits");
+          return w;
+        }
+      }
+    }
+    auto w = std::make_unique<ChildProcess>();
+    if (!w->spawn(external_cli_worker_argv(route_name), true, workspace)) {
+      return nullptr;
+    }
+    metrics().inc("external_cli.cold_starts");
+    return w;
+  }
+
+  // Tops the spare list for (route, workspace) back up to `warm_workers`.
+  void refill(const std::string& route_name, const fs::path& workspace) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (worker_rejected_.count(route_name) > 0) {
+      return;
+    }
+    auto& spares = spares_[worker_key(route_name, workspace)];
+    while (static_cast<int>(spares.size()) < options_.warm_workers) {
+      auto w = std::make_unique<ChildProcess>();
+      if (!w->spawn(external_cli_worker_argv(route_name), true, workspace)) {
+        break;
+      }
+      spares.push_back(std::move(w));
+    }
+  }
+
+  // The installed CLI does not accept the worker command line: stop spawning workers for
+  // this route until restart and drop the spares already waiting on it.
+  void reject_workers(const std::string& route_name) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!worker_rejected_.insert(route_name).second) {
+      return;
+    }
+    metrics().inc("external_cli.worker_rejected");
+    for (auto it = spares_.begin(); it != spares_.end();) {
+      it = it->first.rfind(route_name + "\n", 0) == 0 ? spares_.erase(it) : std::next(it);
+    }
+  }
+
+  std::size_t idle_workers() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::size_t n = 0;
+    for (const auto& [key, spares] : spares_) {
+      n += spares.size();
+    }
+    return n;
+  }
+
+  void shutdown() {
+    std::lock_guard<std::mutex> lock(mu_);
+    spares_.clear();  // ~ChildProcess kills and reaps
+  }
+
+ private:
+  struct Probe {
+    bool ok{false};
+    std::string note;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  static std::string worker_key(const std::string& route_name, const fs::path& workspace) {
+    return route_name + "\n" + workspace.string();
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> lock(mu_);
+    --active_;
+    cv_.notify_one();
+  }
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  ExternalCliOptions options_{};
+  int active_{0};
+  std::map<std::string, std::vector<std::unique_ptr<ChildProcess>>> spares_;
+  std::set<std::string> worker_rejected_;
+  std::mutex probe_mu_;
+  std::unordered_map<std::string, Probe> probes_;
+};
+
+inline ExternalCliPool& external_cli_pool() {
+  static ExternalCliPool pool;
+  return pool;
+}
+
+// Turns worker stdout into user-visible deltas as it arrives: codex JSONL yields each new
+// agent message, other CLIs yield ANSI-stripped lines.
+class ExternalCliStream {
+ public:
+  ExternalCliStream(bool json_lines, std::function<void(const std::string&)> on_delta)
+      : json_lines_(json_lines), on_delta_(std::move(on_delta)) {}
+
+  void feed(std::string_view chunk) {
+    if (!on_delta_) {
+      return;
+    }
+    pending_.append(chunk);
+    std::size_t start = 0;
+    std::size_t nl;
+    while ((nl = pending_.find('\n', start)) != std::string::npos) {
+      emit_line(std::string_view(pending_).substr(start, nl - start));
+      start = nl + 1;
+    }
+    pending_.erase(0, start);
+  }
+
+  void finish() {
+    if (on_delta_ && !pending_.empty()) {
+      emit_line(pending_);
+      pending_.clear();
+    }
+  }
+
+ private:
+  void emit_line(std::string_view line) {
+    if (!json_lines_) {
+      on_delta_(strip_ansi_sequences(std::string(line)) + "\n");
+      return;
+    }
+    const std::string text = extract_codex_json_message(std::string(line));
+    if (text.empty() || text == last_) {
+      return;
+    }
+    on_delta_(last_.empty() ? text : "\n" + text);
+    last_ = text;
+  }
+
+  bool json_lines_;
+  std::function<void(const std::string&)> on_delta_;
+  std::string pending_;
+  std::string last_;
+};
+
+// Runs one prompt on a pooled worker. nullopt means "use the command-line path instead"
+// (no worker could be started, or this CLI version rejected the worker flags). `failed`
+// is set when the returned text is an error message rather than the CLI's reply. The
+// worker is killed once `*cancel` turns true.
+inline std::optional<std::string> run_external_cli_worker(const ExternalCliRoute& route, const fs::path& workspace,
+                                                          const std::string& prompt, int timeout_s,
+                                                          const std::function<void(const std::string&)>& on_delta,
+                                                          bool* failed = nullptr,
+                                                          const std::atomic<bool>* cancel = nullptr) {
+  auto& pool = external_cli_pool();
+  std::unique_ptr<ChildProcess> worker = pool.take_worker(route.name, workspace);
+  if (!worker) {
+    return std::nullopt;
+  }
+  pool.refill(route.name, workspace);
+  if (!worker->queue_stdin(prompt)) {
+    return std::nullopt;
+  }
+
+  const bool json_lines = route.name == "codex";
+  ExternalCliStream stream(json_lines, on_delta);
+  const ProcessOutput out = worker->collect(
+      timeout_s, 16u * 1024u * 1024u, [&stream](std::string_view chunk) { stream.feed(chunk); }, cancel);
+  stream.finish();
+  if (!out.ok) {
+    if (cancel && cancel->load()) {
+      if (failed) {
+        *failed = true;
+      }
+      return "Cancelled before " + route.name + " finished.";
+    }
+    if (looks_like_cli_usage_error(out.out + "\n" + out.err)) {
+      pool.reject_workers(route.name);
+      return std::nullopt;
+    }
+    if (failed) {
+      *failed = true;
+    }
+    std::string error = extract_plain_cli_message(route.name, out.err.empty() ? out.out : out.err);
+    if (error.empty()) {
+      error = !out.err.empty() ? trim(out.err) : "Command failed with exit code " + std::to_string(out.exit_code) + ".";
+    }
+    return "Failed to run " + route.name + " for this request.\n" + error;
+  }
+
+  std::string extracted = json_lines ? extract_codex_json_message(out.out) : "";
+  if (extracted.empty()) {
+    extracted = extract_plain_cli_message(route.name, out.out);
+  }
+  return extracted.empty() ? (route.name + " completed with no output.") : extracted;
+}
+
+// One command-line attempt, run in `workspace` with stderr folded into the output. On POSIX
+// the CLI is exec'd by the shell so a cancel or timeout kills the CLI itself.
+inline CommandResult run_external_cli_command(const fs::path& workspace, const std::string& command, int timeout_s,
+                                              const std::atomic<bool>* cancel) {
+#ifdef _WIN32
+  (void)cancel;
+  return run_command_capture(shell_in_dir_command(workspace, command), timeout_s);
+#else
+  ChildProcess child;
+  std::string error;
+  if (!child.spawn({"/bin/sh", "-c", "exec " + command + " 2>&1"}, false, workspace, &error)) {
+    return {false, -1, error};
+  }
+  const ProcessOutput out = child.collect(timeout_s, 16u * 1024u * 1024u, {}, cancel);
+  return {out.ok, out.exit_code, out.err.empty() ? out.out : out.out + "\n" + out.err};
+#endif
+}
+
+// `on_delta`, when set, receives the reply incrementally (or in one piece if the CLI output
+// could not be streamed). A run in progress is killed once `*cancel` turns true.
+inline std::string run_external_cli(const ExternalCliRoute& route, const fs::path& workspace, bool vision_enabled,
+                                    const std::function<void(const std::string&)>& on_delta = {},
+                                    const std::atomic<bool>* cancel = nullptr) {
   if (route.prompt.empty()) {
     return "Please include a prompt before " + route.suffix + ".";
   }
@@ -442,30 +746,60 @@ inline std::string run_external_cli(const ExternalCliRoute& route, const fs::pat
     return "Vision is unavailable on headless server (DISPLAY/WAYLAND_DISPLAY not set).";
   }
 
+  auto& pool = external_cli_pool();
   std::string cli_note;
-  if (route.name == "gemini") {
-    if (!ensure_external_cli_available("gemini", "@google/gemini-cli", &cli_note)) {
-      if (cli_note.empty()) {
-        return "Gemini CLI is not installed. Install with: npm install -g @google/gemini-cli";
-      }
-      return "Gemini CLI install failed: " + cli_note;
-    }
-  } else {
-    if (!ensure_external_cli_available("codex", "@openai/codex", &cli_note)) {
-      if (cli_note.empty()) {
-        return "Codex CLI is not installed. Install with: npm install -g @openai/codex";
-      }
-      return "Codex CLI install failed: " + cli_note;
+  if (!pool.available(route.name, &cli_note)) {
+    const std::string label = route.name == "gemini" ? "Gemini CLI" : "Codex CLI";
+    if (cli_note.empty()) {
+      return label + " is not installed. Install with: npm install -g " + external_cli_npm_package(route.name);
     }
+    return label + " install failed: " + cli_note;
   }
 
   const ExternalVisionContext vision = collect_external_vision_context(vision_enabled);
   const std::string enriched_prompt = build_prompt_with_vision_context(route.prompt, vision);
+  const int timeout_s = pool.options().timeout;
+
+  const auto slot = pool.acquire(timeout_s);
+  if (!slot) {
+    return "Too many " + route.name + " requests are running; try again shortly.";
+  }
+  metrics().inc("external_cli.runs");
+
+  bool streamed = false;  // by the attempt whose result is returned
+  const auto forward = [&](const std::string& piece) {
+    streamed = true;
+    on_delta(piece);
+  };
+  auto finish = [&](std::string reply) {
+    if (on_delta && !streamed) {
+      on_delta(reply);
+    }
+    return reply;
+  };
+
+  if (!vision.captured) {
+    bool failed = false;
+    auto reply = run_external_cli_worker(route, workspace, enriched_prompt, timeout_s,
+                                         on_delta ? std::function<void(const std::string&)>(forward) : nullptr,
+                                         &failed, cancel);
+    if (reply.has_value()) {
+      if (failed) {
+        streamed = false;  // the deltas were partial output; the error itself still has to go out
+      }
+      return finish(std::move(*reply));
+    }
+    streamed = false;  // a rejected worker may have streamed a little; the command line starts over
+  }
+
   const auto commands = build_external_cli_commands(route, enriched_prompt, vision);
 
   CommandResult last;
   for (std::size_t i = 0; i < commands.size(); ++i) {
-    last = run_command_capture(shell_in_dir_command(workspace, commands[i].command), 600);
+    last = run_external_cli_command(workspace, commands[i].command, timeout_s, cancel);
+    if (cancel && cancel->load()) {
+      return finish("Cancelled before " + route.name + " finished.");
+    }
     if (last.ok) {
       std::string extracted;
       if (route.name == "codex" && commands[i].expect_json) {
@@ -474,7 +808,7 @@ inline std::string run_external_cli(const ExternalCliRoute& route, const fs::pat
       if (extracted.empty()) {
         extracted = extract_plain_cli_message(route.name, last.output);
       }
-      return extracted.empty() ? (route.name + " completed with no output.") : extracted;
+      return finish(extracted.empty() ? (route.name + " completed with no output.") : extracted);
     }
 
     if (i + 1 < commands.size() && looks_like_cli_usage_error(last.output)) {
@@ -490,7 +824,7 @@ inline std::string run_external_cli(const ExternalCliRoute& route, const fs::pat
   if (error.empty()) {
     error = "Command failed with exit code " + std::to_string(last.exit_code) + ".";
   }
-  return "Failed to run " + route.name + " for this request.\n" + error;
+  return finish("Failed to run " + route.name + " for this request.\n" + error);
 }
 
 }  // namespace attoclaw
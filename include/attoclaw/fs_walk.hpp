@@ -0,0 +1,331 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+// Shell-style glob over '/'-separated paths: '*' and '?' stop at '/', "**" spans
+// directories ("**/" also matches none), "[abc]", "[a-z]" and "[!x]" match one character.
+inline bool glob_match(std::string_view pattern, std::string_view text) {
+  std::size_t p = 0;
+  std::size_t t = 0;
+  while (p < pattern.size()) {
+    const char c = pattern[p];
+    if (c == '*') {
+      const bool dbl = p + 1 < pattern.size() && pattern[p + 1] == '*';
+      std::string_view rest = pattern.substr(p + (dbl ? 2 : 1));
+      if (dbl && !rest.empty() && rest[0] == '/' && glob_match(rest.substr(1), text.substr(t))) {
+        return true;
+      }
+      for (std::size_t k = t;; ++k) {
+        if (glob_match(rest, text.substr(k))) {
+          return true;
+        }
+        if (k == text.size() || (!dbl && text[k] == '/')) {
+          return false;
+        }
+      }
+    }
+    if (t == text.size()) {
+      return false;
+    }
+    if (c == '[') {
+      const std::size_t close = pattern.find(']', p + 2);
+      if (close != std::string_view::npos) {
+        if (text[t] == '/') {
+          return false;
+        }
+        std::size_t i = p + 1;
+        const bool negate = pattern[i] == '!' || pattern[i] == '^';
+        i += negate ? 1 : 0;
+        bool hit = false;
+        for (; i < close; ++i) {
+          if (i + 2 < close && pattern[i + 1] == '-') {
+            hit = hit || (text[t] >= pattern[i] && text[t] <= pattern[i + 2]);
+            i += 2;
+          } else {
+            hit = hit || text[t] == pattern[i];
+          }
+        }
+        if (hit == negate) {
+          return false;
+        }
+        p = close + 1;
+        ++t;
+        continue;
+      }
+    }
+    if (c == '?' ? text[t] == '/' : c != text[t]) {
+      return false;
+    }
+    ++p;
+    ++t;
+  }
+  return t == text.size();
+}
+
+// The rules of one .gitignore file, matched against paths relative to its directory.
+class GitIgnore {
+ public:
+  struct Rule {
+    std::string pattern;
+    bool negate{false};
+    bool dir_only{false};
+    bool anchored{false};  // contains a '/' other than a trailing one: match the full relative path
+  };
+
+  static std::shared_ptr<const GitIgnore> load(const fs::path& dir, std::shared_ptr<const GitIgnore> parent,
+                                               const std::string& dir_rel) {
+    std::error_code ec;
+    const fs::path file = dir / ".gitignore";
+    if (!fs::is_regular_file(file, ec)) {
+      return parent;
+    }
+    auto out = std::make_shared<GitIgnore>();
+    out->parent_ = std::move(parent);
+    out->base_ = dir_rel;
+    std::istringstream in(read_text_file(file));
+    std::string line;
+    while (std::getline(in, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\')) {
+        line.pop_back();
+      }
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      Rule r;
+      if (line[0] == '!') {
+        r.negate = true;
+        line.erase(0, 1);
+      } else if (line[0] == '\\') {
+        line.erase(0, 1);
+      }
+      if (!line.empty() && line.back() == '/') {
+        r.dir_only = true;
+        line.pop_back();
+      }
+      r.anchored = line.find('/') != std::string::npos;
+      if (!line.empty() && line[0] == '/') {
+        line.erase(0, 1);
+      }
+      if (line.empty()) {
+        continue;
+      }
+      r.pattern = std::move(line);
+      out->rules_.push_back(std::move(r));
+    }
+    return out;
+  }
+
+  // `rel` is relative to the walk root, '/'-separated. The last matching rule in the
+  // nearest .gitignore wins, as in git.
+  bool ignored(std::string_view rel, bool is_dir) const {
+    for (const GitIgnore* g = this; g; g = g->parent_.get()) {
+      std::string_view local = rel;
+      if (!g->base_.empty()) {
+        local.remove_prefix(g->base_.size() + 1);
+      }
+      const std::size_t slash = local.rfind('/');
+      const std::string_view name = slash == std::string_view::npos ? local : local.substr(slash + 1);
+      for (auto it = g->rules_.rbegin(); it != g->rules_.rend(); ++it) {
+        if (it->dir_only && !is_dir) {
+          continue;
+        }
+        if (glob_match(it->pattern, it->anchored ? local : name)) {
+          return !it->negate;
+        }
+      }
+    }
+    return false;
+  }
+
+ private:
+  std::shared_ptr<const GitIgnore> parent_;
+  std::string base_;  // directory of this file, relative to the walk root
+  std::vector<Rule> rules_;
+};
+
+struct WalkOptions {
+  int threads{0};  // 0: hardware concurrency, capped at 8
+  bool respect_gitignore{true};
+  bool include_hidden{false};
+  int max_depth{0};  // 0: unlimited; 1: only the root's own entries
+  // Also report symlinks (a link to a directory as a directory, still not descended
+  // into), dangling links, sockets and fifos.
+  bool all_entries{false};
+};
+
+// Walks `root` on a small work-stealing pool: every directory is a task; a worker pops
+// its own newest task (depth first, cache friendly) and steals the oldest from others
+// when it runs dry. Callbacks run concurrently on the workers; return false to stop the
+// whole walk early. .git is reported like any hidden entry but never descended into.
+// Symlinks are never followed, so a link cannot lead a walk (or a restricted tool)
+// outside `root`; unless all_entries is set, they are not reported either.
+//
+// Entries come from directory_iterator, i.e. readdir (getdents64 batches on Linux) with
+// the d_type cached in directory_entry: nothing is stat'ed unless a callback asks the
+// entry for its size or time.
+class ParallelWalker {
+ public:
+  using FileCallback = std::function<bool(const fs::path& path, const std::string& rel)>;
+  using EntryCallback = std::function<bool(const fs::directory_entry& entry, const std::string& rel, bool is_dir)>;
+
+  static void walk(const fs::path& root, const WalkOptions& options, const FileCallback& on_file) {
+    walk_entries(root, options, [&on_file](const fs::directory_entry& entry, const std::string& rel, bool is_dir) {
+      return is_dir || on_file(entry.path(), rel);
+    });
+  }
+
+  // Like walk(), but also reports directories (before their contents).
+  static void walk_entries(const fs::path& root, const WalkOptions& options, const EntryCallback& on_entry) {
+    ParallelWalker w(options, on_entry);
+    w.run(root);
+  }
+
+ private:
+  struct Task {
+    fs::path dir;
+    std::string rel;
+    std::shared_ptr<const GitIgnore> ignore;
+    int depth{0};  // of the directory itself; the root is 0
+  };
+
+  struct Queue {
+    std::mutex mu;
+    std::deque<Task> tasks;
+  };
+
+  ParallelWalker(const WalkOptions& options, const EntryCallback& on_entry) : options_(options), on_entry_(on_entry) {
+    unsigned n = options.threads > 0 ? static_cast<unsigned>(options.threads)
+                                     : (std::min)(8U, (std::max)(1U, std::thread::hardware_concurrency()));
+    queues_ = std::vector<Queue>(n);
+  }
+
+  void run(const fs::path& root) {
+    outstanding_ = 1;
+    queues_[0].tasks.push_back(Task{root, "", nullptr, 0});
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+      workers.emplace_back([this, i]() { work(i); });
+    }
+    work(0);
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  void work(std::size_t self) {
+    while (true) {
+      std::optional<Task> task = pop(self);
+      if (!task) {
+        std::unique_lock<std::mutex> lock(idle_mu_);
+        if (outstanding_.load() == 0 || stop_.load()) {
+          idle_cv_.notify_all();
+          return;
+        }
+        idle_cv_.wait_for(lock, std::chrono::milliseconds(2));
+        continue;
+      }
+      if (!stop_.load()) {
+        scan(self, *task);
+      }
+      if (outstanding_.fetch_sub(1) == 1) {
+        idle_cv_.notify_all();
+      }
+    }
+  }
+
+  std::optional<Task> pop(std::size_t self) {
+    {
+      Queue& q = queues_[self];
+      std::lock_guard<std::mutex> lock(q.mu);
+      if (!q.tasks.empty()) {
+        Task t = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return t;
+      }
+    }
+    for (std::size_t k = 1; k < queues_.size(); ++k) {
+      Queue& q = queues_[(self + k) % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mu);
+      if (!q.tasks.empty()) {
+        Task t = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return t;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void scan(std::size_t self, const Task& task) {
+    std::shared_ptr<const GitIgnore> ignore =
+        options_.respect_gitignore ? GitIgnore::load(task.dir, task.ignore, task.rel) : nullptr;
+    std::error_code ec;
+    fs::directory_iterator it(task.dir, fs::directory_options::skip_permission_denied, ec);
+    std::vector<Task> subdirs;
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+      const fs::directory_entry& entry = *it;
+      const std::string name = entry.path().filename().string();
+      if (!options_.include_hidden && !name.empty() && name[0] == '.' && name != ".gitignore") {
+        continue;
+      }
+      std::error_code type_ec;
+      const bool is_link = entry.is_symlink(type_ec);
+      const bool is_dir = (options_.all_entries || !is_link) && entry.is_directory(type_ec);
+      if (!options_.all_entries && (is_link || (!is_dir && !entry.is_regular_file(type_ec)))) {
+        continue;
+      }
+      std::string rel = task.rel.empty() ? name : task.rel + "/" + name;
+      if (ignore && ignore->ignored(rel, is_dir)) {
+        continue;
+      }
+      if (!on_entry_(entry, rel, is_dir)) {
+        stop_.store(true);
+        return;
+      }
+      if (is_dir && !is_link && name != ".git" && (options_.max_depth <= 0 || task.depth + 1 < options_.max_depth)) {
+        subdirs.push_back(Task{entry.path(), std::move(rel), ignore, task.depth + 1});
+      }
+    }
+    if (subdirs.empty()) {
+      return;
+    }
+    outstanding_.fetch_add(subdirs.size());
+    {
+      Queue& q = queues_[self];
+      std::lock_guard<std::mutex> lock(q.mu);
+      for (auto& t : subdirs) {
+        q.tasks.push_back(std::move(t));
+      }
+    }
+    idle_cv_.notify_all();
+  }
+
+  const WalkOptions& options_;
+  const EntryCallback& on_entry_;
+  std::vector<Queue> queues_;
+  std::atomic<std::size_t> outstanding_{0};
+  std::atomic<bool> stop_{false};
+  std::mutex idle_mu_;
+  std::condition_variable idle_cv_;
+};
+
+}  // namespace attoclaw
@@ -97,7 +97,7 @@ class HeartbeatService {
           (void)response;
         }
       } catch (const std::exception& e) {
-        Logger::log(Logger::Level::kError, std::string("Heartbeat callback failed: ") + e.what());
+        ATTOCLAW_LOG_ERROR(std::string("Heartbeat callback failed: ") + e.what());
       }
     }
   }
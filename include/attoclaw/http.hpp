@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <mutex>
@@ -67,43 +68,53 @@ class HttpClient {
                                    const std::vector<MultipartField>& fields, const std::string& file_field_name,
                                    const fs::path& file_path, const std::string& content_type = "",
                                    int timeout_s = 300, bool follow_redirects = true, long max_redirects = 5) {
+    return post_multipart(
+        url, headers, fields, file_field_name,
+        [&](curl_mimepart* part) { curl_mime_filedata(part, file_path.string().c_str()); }, content_type, timeout_s,
+        follow_redirects, max_redirects);
+  }
+
+  // Same as post_multipart_file, but the file part comes from memory (e.g. ffmpeg output).
+  HttpResponse post_multipart_data(const std::string& url, const std::map<std::string, std::string>& headers,
+                                   const std::vector<MultipartField>& fields, const std::string& file_field_name,
+                                   const std::string& file_name, const std::string& data,
+                                   const std::string& content_type = "", int timeout_s = 300,
+                                   bool follow_redirects = true, long max_redirects = 5) {
+    return post_multipart(
+        url, headers, fields, file_field_name,
+        [&](curl_mimepart* part) {
+          curl_mime_data(part, data.data(), data.size());
+          curl_mime_filename(part, file_name.c_str());
+        },
+        content_type, timeout_s, follow_redirects, max_redirects);
+  }
+
+  HttpResponse download_to_file(const std::string& url, const std::map<std::string, std::string>& headers,
+                                const fs::path& out_path, int timeout_s = 120, bool follow_redirects = true,
+                                long max_redirects = 5) {
     CURL* curl = ensure_easy();
     if (!curl) {
       return HttpResponse{0, "", "", "curl init failed"};
     }
 
     curl_easy_reset(curl);
-    std::string response_body;
-    std::map<std::string, std::string> response_headers;
-    struct curl_slist* header_list = nullptr;
+    std::error_code ec;
+    fs::create_directories(out_path.parent_path(), ec);
+    FILE* fp = std::fopen(out_path.string().c_str(), "wb");
+    if (!fp) {
+      curl_easy_cleanup(curl);
+      return HttpResponse{0, "", "", "failed to open output file"};
+    }
 
+    struct curl_slist* header_list = nullptr;
+    std::map<std::string, std::string> response_headers;
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_file_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &header_cb);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_headers);
     apply_common_options(curl, timeout_s, follow_redirects, max_redirects);
 
-    curl_mime* mime = curl_mime_init(curl);
-    if (!mime) {
-      return HttpResponse{0, "", "", "curl mime init failed"};
-    }
-
-    for (const auto& f : fields) {
-      curl_mimepart* part = curl_mime_addpart(mime);
-      curl_mime_name(part, f.name.c_str());
-      curl_mime_data(part, f.value.c_str(), static_cast<size_t>(f.value.size()));
-    }
-
-    curl_mimepart* file_part = curl_mime_addpart(mime);
-    curl_mime_name(file_part, file_field_name.c_str());
-    curl_mime_filedata(file_part, file_path.string().c_str());
-    if (!content_type.empty()) {
-      curl_mime_type(file_part, content_type.c_str());
-    }
-
-    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
-
     for (const auto& [k, v] : headers) {
       const std::string line = k + ": " + v;
       header_list = curl_slist_append(header_list, line.c_str());
@@ -113,52 +124,94 @@ class HttpClient {
     }
 
     const CURLcode rc = curl_easy_perform(curl);
+    std::fclose(fp);
 
     HttpResponse out;
     if (rc != CURLE_OK) {
       out.error = curl_easy_strerror(rc);
     }
-
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &out.status);
     char* final_url = nullptr;
     curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &final_url);
     out.final_url = final_url ? std::string(final_url) : url;
-    out.body = std::move(response_body);
     out.headers = std::move(response_headers);
 
     if (header_list) {
       curl_slist_free_all(header_list);
     }
-    curl_mime_free(mime);
+
+    if (!out.error.empty() || out.status < 200 || out.status >= 300) {
+      std::error_code rm_ec;
+      fs::remove(out_path, rm_ec);
+    }
     return out;
   }
 
-  HttpResponse download_to_file(const std::string& url, const std::map<std::string, std::string>& headers,
-                                const fs::path& out_path, int timeout_s = 120, bool follow_redirects = true,
-                                long max_redirects = 5) {
+  // While alive, transfers started on this thread (by any HttpClient or HttpMultiClient)
+  // abort once `*cancel` turns true, so a cancelled job doesn't wait out a slow request.
+  class ScopedCancel {
+   public:
+    explicit ScopedCancel(const std::atomic<bool>* cancel) : prev_(cancel_flag()) { cancel_flag() = cancel; }
+    ~ScopedCancel() { cancel_flag() = prev_; }
+    ScopedCancel(const ScopedCancel&) = delete;
+    ScopedCancel& operator=(const ScopedCancel&) = delete;
+
+   private:
+    const std::atomic<bool>* prev_;
+  };
+
+ private:
+  static const std::atomic<bool>*& cancel_flag() {
+    static thread_local const std::atomic<bool>* flag = nullptr;
+    return flag;
+  }
+
+  static int cancel_cb(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<const std::atomic<bool>*>(userdata)->load() ? 1 : 0;
+  }
+
+  HttpResponse post_multipart(const std::string& url, const std::map<std::string, std::string>& headers,
+                              const std::vector<MultipartField>& fields, const std::string& file_field_name,
+                              const std::function<void(curl_mimepart*)>& fill_file_part,
+                              const std::string& content_type, int timeout_s, bool follow_redirects,
+                              long max_redirects) {
     CURL* curl = ensure_easy();
     if (!curl) {
       return HttpResponse{0, "", "", "curl init failed"};
     }
 
     curl_easy_reset(curl);
-    std::error_code ec;
-    fs::create_directories(out_path.parent_path(), ec);
-    FILE* fp = std::fopen(out_path.string().c_str(), "wb");
-    if (!fp) {
-      curl_easy_cleanup(curl);
-      return HttpResponse{0, "", "", "failed to open output file"};
-    }
-
-    struct curl_slist* header_list = nullptr;
+    std::string response_body;
     std::map<std::string, std::string> response_headers;
+    struct curl_slist* header_list = nullptr;
+
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_file_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_body);
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &header_cb);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_headers);
     apply_common_options(curl, timeout_s, follow_redirects, max_redirects);
 
+    curl_mime* mime = curl_mime_init(curl);
+    if (!mime) {
+      return HttpResponse{0, "", "", "curl mime init failed"};
+    }
+
+    for (const auto& f : fields) {
+      curl_mimepart* part = curl_mime_addpart(mime);
+      curl_mime_name(part, f.name.c_str());
+      curl_mime_data(part, f.value.c_str(), static_cast<size_t>(f.value.size()));
+    }
+
+    curl_mimepart* file_part = curl_mime_addpart(mime);
+    curl_mime_name(file_part, file_field_name.c_str());
+    fill_file_part(file_part);
+    if (!content_type.empty()) {
+      curl_mime_type(file_part, content_type.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+
     for (const auto& [k, v] : headers) {
       const std::string line = k + ": " + v;
       header_list = curl_slist_append(header_list, line.c_str());
@@ -168,30 +221,28 @@ class HttpClient {
     }
 
     const CURLcode rc = curl_easy_perform(curl);
-    std::fclose(fp);
 
     HttpResponse out;
     if (rc != CURLE_OK) {
       out.error = curl_easy_strerror(rc);
     }
+
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &out.status);
     char* final_url = nullptr;
     curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &final_url);
     out.final_url = final_url ? std::string(final_url) : url;
+    out.body = std::move(response_body);
     out.headers = std::move(response_headers);
 
     if (header_list) {
       curl_slist_free_all(header_list);
     }
-
-    if (!out.error.empty() || out.status < 200 || out.status >= 300) {
-      std::error_code rm_ec;
-      fs::remove(out_path, rm_ec);
-    }
+    curl_mime_free(mime);
     return out;
   }
 
- private:
+  friend class HttpMultiClient;
+
   static std::string to_lower_ascii(std::string s) {
     std::transform(s.begin(), s.end(), s.begin(),
                    [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
@@ -289,7 +340,7 @@ class HttpClient {
     return easy_;
   }
 
-  void apply_common_options(CURL* curl, int timeout_s, bool follow_redirects, long max_redirects) {
+  static void apply_common_options(CURL* curl, int timeout_s, bool follow_redirects, long max_redirects) {
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_s);
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (std::min)(10, (std::max)(1, timeout_s / 3)));
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, follow_redirects ? 1L : 0L);
@@ -299,6 +350,11 @@ class HttpClient {
     curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
     curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 60L);
     curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");  // allow gzip/br
+    if (const std::atomic<bool>* cancel = cancel_flag()) {
+      curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &HttpClient::cancel_cb);
+      curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(cancel));
+      curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
   }
 
   HttpResponse request(const std::string& method, const std::string& url, const std::string& body,
@@ -412,4 +468,165 @@ class HttpClient {
   }
 };
 
+// Runs a batch of GETs concurrently on one curl multi handle. Easy handles and the
+// multi handle's connection cache live as long as the client, so repeated polls of
+// the same host reuse warm connections (multiplexed over HTTP/2 when offered).
+// One owner thread per instance.
+class HttpMultiClient {
+ public:
+  struct Request {
+    std::string url;
+    std::map<std::string, std::string> headers{};
+  };
+
+  explicit HttpMultiClient(long max_host_connections = 4) {
+    HttpClient::ensure_global_init();
+    multi_ = curl_multi_init();
+    if (multi_) {
+      curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+      curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, max_host_connections);
+    }
+  }
+
+  ~HttpMultiClient() {
+    for (auto& slot : slots_) {
+      if (slot.active) {
+        curl_multi_remove_handle(multi_, slot.easy);
+      }
+      if (slot.easy) {
+        curl_easy_cleanup(slot.easy);
+      }
+      if (slot.header_list) {
+        curl_slist_free_all(slot.header_list);
+      }
+    }
+    if (multi_) {
+      curl_multi_cleanup(multi_);
+    }
+  }
+
+  HttpMultiClient(const HttpMultiClient&) = delete;
+  HttpMultiClient& operator=(const HttpMultiClient&) = delete;
+
+  // Responses come back in request order. Unfinished transfers are abandoned (with an
+  // "aborted" error) once `keep_running` turns false.
+  std::vector<HttpResponse> get_all(const std::vector<Request>& requests, int timeout_s = 30,
+                                    const std::atomic<bool>* keep_running = nullptr) {
+    std::vector<HttpResponse> out(requests.size());
+    if (!multi_) {
+      for (auto& r : out) {
+        r.error = "curl multi init failed";
+      }
+      return out;
+    }
+    while (slots_.size() < requests.size()) {
+      slots_.emplace_back();
+      slots_.back().easy = curl_easy_init();
+    }
+
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+      Slot& slot = slots_[i];
+      slot.body.clear();
+      slot.headers.clear();
+      if (slot.header_list) {
+        curl_slist_free_all(slot.header_list);
+        slot.header_list = nullptr;
+      }
+      if (!slot.easy) {
+        out[i].error = "curl init failed";
+        continue;
+      }
+      curl_easy_reset(slot.easy);
+      curl_easy_setopt(slot.easy, CURLOPT_URL, requests[i].url.c_str());
+      curl_easy_setopt(slot.easy, CURLOPT_WRITEFUNCTION, &HttpClient::write_cb);
+      curl_easy_setopt(slot.easy, CURLOPT_WRITEDATA, &slot.body);
+      curl_easy_setopt(slot.easy, CURLOPT_HEADERFUNCTION, &HttpClient::header_cb);
+      curl_easy_setopt(slot.easy, CURLOPT_HEADERDATA, &slot.headers);
+      curl_easy_setopt(slot.easy, CURLOPT_PRIVATE, reinterpret_cast<char*>(i));
+      HttpClient::apply_common_options(slot.easy, timeout_s, true, 2);
+      for (const auto& [k, v] : requests[i].headers) {
+        const std::string line = k + ": " + v;
+        slot.header_list = curl_slist_append(slot.header_list, line.c_str());
+      }
+      if (slot.header_list) {
+        curl_easy_setopt(slot.easy, CURLOPT_HTTPHEADER, slot.header_list);
+      }
+      curl_multi_add_handle(multi_, slot.easy);
+      slot.active = true;
+    }
+
+    int still_running = 0;
+    do {
+      if (keep_running && !keep_running->load()) {
+        break;
+      }
+      if (curl_multi_perform(multi_, &still_running) != CURLM_OK) {
+        break;
+      }
+      collect_done(out);
+      if (still_running > 0) {
+        curl_multi_poll(multi_, nullptr, 0, 100, nullptr);
+      }
+    } while (still_running > 0);
+    collect_done(out);
+
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+      Slot& slot = slots_[i];
+      if (slot.active) {
+        curl_multi_remove_handle(multi_, slot.easy);
+        slot.active = false;
+        if (out[i].error.empty() && out[i].status == 0) {
+          out[i].error = "aborted";
+        }
+      }
+      if (out[i].final_url.empty()) {
+        out[i].final_url = requests[i].url;
+      }
+    }
+    return out;
+  }
+
+ private:
+  struct Slot {
+    CURL* easy{nullptr};
+    std::string body;
+    std::map<std::string, std::string> headers;
+    struct curl_slist* header_list{nullptr};
+    bool active{false};
+  };
+
+  void collect_done(std::vector<HttpResponse>& out) {
+    int left = 0;
+    while (CURLMsg* msg = curl_multi_info_read(multi_, &left)) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      char* priv = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+      const std::size_t i = reinterpret_cast<std::size_t>(priv);
+      if (i >= out.size()) {
+        continue;
+      }
+      Slot& slot = slots_[i];
+      HttpResponse& r = out[i];
+      if (msg->data.result != CURLE_OK) {
+        r.error = curl_easy_strerror(msg->data.result);
+      }
+      curl_easy_getinfo(slot.easy, CURLINFO_RESPONSE_CODE, &r.status);
+      char* final_url = nullptr;
+      curl_easy_getinfo(slot.easy, CURLINFO_EFFECTIVE_URL, &final_url);
+      if (final_url) {
+        r.final_url = final_url;
+      }
+      r.body = std::move(slot.body);
+      r.headers = std::move(slot.headers);
+      curl_multi_remove_handle(multi_, slot.easy);
+      slot.active = false;
+    }
+  }
+
+  CURLM* multi_{nullptr};
+  std::vector<Slot> slots_;
+};
+
 }  // namespace attoclaw
@@ -0,0 +1,506 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+// Packed 8-bit RGB, rows top to bottom with no padding.
+struct RgbImage {
+  int width{0};
+  int height{0};
+  std::vector<unsigned char> rgb;
+
+  bool empty() const { return width <= 0 || height <= 0 || rgb.size() < static_cast<std::size_t>(width) * height * 3; }
+};
+
+namespace image_detail {
+
+inline uint32_t read_le32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint16_t read_le16(const unsigned char* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+// Reads one whitespace-delimited decimal field of a PNM header, skipping '#' comments.
+inline bool pnm_field(const std::vector<unsigned char>& b, std::size_t& i, int* out) {
+  while (i < b.size()) {
+    if (b[i] == '#') {
+      while (i < b.size() && b[i] != '\n') {
+        ++i;
+      }
+    } else if (b[i] == ' ' || b[i] == '\t' || b[i] == '\r' || b[i] == '\n') {
+      ++i;
+    } else {
+      break;
+    }
+  }
+  long v = 0;
+  const std::size_t start = i;
+  while (i < b.size() && b[i] >= '0' && b[i] <= '9' && v < (1L << 20)) {
+    v = v * 10 + (b[i] - '0');
+    ++i;
+  }
+  *out = static_cast<int>(v);
+  return i > start;
+}
+
+}  // namespace image_detail
+
+// Binary PPM (P6, maxval <= 255), as written by `grim -t ppm` and imlib2-based tools.
+inline bool decode_ppm(const std::vector<unsigned char>& bytes, RgbImage* out) {
+  if (bytes.size() < 3 || bytes[0] != 'P' || bytes[1] != '6') {
+    return false;
+  }
+  std::size_t i = 2;
+  int w = 0;
+  int h = 0;
+  int maxval = 0;
+  if (!image_detail::pnm_field(bytes, i, &w) || !image_detail::pnm_field(bytes, i, &h) ||
+      !image_detail::pnm_field(bytes, i, &maxval) || w <= 0 || h <= 0 || maxval <= 0 || maxval > 255) {
+    return false;
+  }
+  ++i;  // single whitespace byte before the raster
+  const std::size_t need = static_cast<std::size_t>(w) * h * 3;
+  if (i > bytes.size() || bytes.size() - i < need) {
+    return false;
+  }
+  out->width = w;
+  out->height = h;
+  out->rgb.assign(bytes.begin() + static_cast<std::ptrdiff_t>(i),
+                  bytes.begin() + static_cast<std::ptrdiff_t>(i + need));
+  if (maxval != 255) {
+    for (auto& c : out->rgb) {
+      c = static_cast<unsigned char>((std::min)(255, c * 255 / maxval));
+    }
+  }
+  return true;
+}
+
+// Uncompressed 24/32-bit BMP (BI_RGB or BI_BITFIELDS with BGRA masks), as written by
+// System.Drawing on Windows. Bottom-up and top-down rasters are both accepted.
+inline bool decode_bmp(const std::vector<unsigned char>& bytes, RgbImage* out) {
+  if (bytes.size() < 54 || bytes[0] != 'B' || bytes[1] != 'M') {
+    return false;
+  }
+  const uint32_t offset = image_detail::read_le32(&bytes[10]);
+  const int32_t w = static_cast<int32_t>(image_detail::read_le32(&bytes[18]));
+  const int32_t raw_h = static_cast<int32_t>(image_detail::read_le32(&bytes[22]));
+  const int bpp = image_detail::read_le16(&bytes[28]);
+  const uint32_t compression = image_detail::read_le32(&bytes[30]);
+  if (w <= 0 || raw_h == 0 || w > (1 << 16) || (bpp != 24 && bpp != 32) || (compression != 0 && compression != 3)) {
+    return false;
+  }
+  const bool top_down = raw_h < 0;
+  const int h = top_down ? -raw_h : raw_h;
+  if (h > (1 << 16)) {
+    return false;
+  }
+  const std::size_t stride = ((static_cast<std::size_t>(bpp) * w + 31) / 32) * 4;
+  if (offset > bytes.size() || bytes.size() - offset < stride * h) {
+    return false;
+  }
+  const int step = bpp / 8;
+  out->width = w;
+  out->height = h;
+  out->rgb.resize(static_cast<std::size_t>(w) * h * 3);
+  for (int y = 0; y < h; ++y) {
+    const unsigned char* src = &bytes[offset + stride * (top_down ? y : h - 1 - y)];
+    unsigned char* dst = &out->rgb[static_cast<std::size_t>(y) * w * 3];
+    for (int x = 0; x < w; ++x, src += step, dst += 3) {
+      dst[0] = src[2];
+      dst[1] = src[1];
+      dst[2] = src[0];
+    }
+  }
+  return true;
+}
+
+// Dispatches on the file magic; PNG and other compressed formats are not decoded here.
+inline bool decode_raster(const std::vector<unsigned char>& bytes, RgbImage* out) {
+  return decode_ppm(bytes, out) || decode_bmp(bytes, out);
+}
+
+// Box-filter downscale so the longer side is at most `max_dim`. Every source pixel contributes
+// to exactly one output pixel, so text stays legible where nearest-neighbour would drop strokes.
+// Images that already fit are returned unchanged.
+inline RgbImage downscale_to_fit(const RgbImage& src, int max_dim) {
+  if (src.empty() || max_dim <= 0 || (std::max)(src.width, src.height) <= max_dim) {
+    return src;
+  }
+  const double scale = static_cast<double>(max_dim) / (std::max)(src.width, src.height);
+  const int dw = (std::max)(1, static_cast<int>(std::lround(src.width * scale)));
+  const int dh = (std::max)(1, static_cast<int>(std::lround(src.height * scale)));
+
+  std::vector<int> xs(static_cast<std::size_t>(dw) + 1);
+  for (int x = 0; x <= dw; ++x) {
+    xs[x] = static_cast<int>(static_cast<int64_t>(x) * src.width / dw);
+  }
+
+  RgbImage dst;
+  dst.width = dw;
+  dst.height = dh;
+  dst.rgb.resize(static_cast<std::size_t>(dw) * dh * 3);
+  std::vector<uint32_t> sums(static_cast<std::size_t>(dw) * 3);
+  for (int y = 0; y < dh; ++y) {
+    const int y0 = static_cast<int>(static_cast<int64_t>(y) * src.height / dh);
+    const int y1 = static_cast<int>(static_cast<int64_t>(y + 1) * src.height / dh);
+    std::fill(sums.begin(), sums.end(), 0u);
+    for (int sy = y0; sy < y1; ++sy) {
+      const unsigned char* row = &src.rgb[static_cast<std::size_t>(sy) * src.width * 3];
+      for (int x = 0; x < dw; ++x) {
+        uint32_t r = 0;
+        uint32_t g = 0;
+        uint32_t b = 0;
+        for (int sx = xs[x]; sx < xs[x + 1]; ++sx) {
+          r += row[sx * 3];
+          g += row[sx * 3 + 1];
+          b += row[sx * 3 + 2];
+        }
+        sums[x * 3] += r;
+        sums[x * 3 + 1] += g;
+        sums[x * 3 + 2] += b;
+      }
+    }
+    unsigned char* out = &dst.rgb[static_cast<std::size_t>(y) * dw * 3];
+    for (int x = 0; x < dw; ++x) {
+      const uint32_t n = static_cast<uint32_t>((xs[x + 1] - xs[x]) * (y1 - y0));
+      const uint32_t half = n / 2;
+      out[x * 3] = static_cast<unsigned char>((sums[x * 3] + half) / n);
+      out[x * 3 + 1] = static_cast<unsigned char>((sums[x * 3 + 1] + half) / n);
+      out[x * 3 + 2] = static_cast<unsigned char>((sums[x * 3 + 2] + half) / n);
+    }
+  }
+  return dst;
+}
+
+inline uint64_t image_hash(const RgbImage& img) {
+  uint64_t h = fnv1a64(std::string_view(reinterpret_cast<const char*>(&img.width), sizeof(img.width)));
+  h = fnv1a64(std::string_view(reinterpret_cast<const char*>(&img.height), sizeof(img.height)), h);
+  return fnv1a64(std::string_view(reinterpret_cast<const char*>(img.rgb.data()), img.rgb.size()), h);
+}
+
+namespace jpeg_detail {
+
+struct HuffCode {
+  uint16_t code{0};
+  uint8_t len{0};
+};
+
+inline constexpr unsigned char kZigZag[64] = {
+    0,  1,  5,  6,  14, 15, 27, 28, 2,  4,  7,  13, 16, 26, 29, 42, 3,  8,  12, 17, 25, 30,
+    41, 43, 9,  11, 18, 24, 31, 40, 44, 53, 10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38,
+    46, 51, 55, 60, 21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
+
+inline constexpr unsigned char kLumaQuant[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,  14, 13, 16, 24,  40,  57,
+    69, 56, 14, 17, 22,  29,  51,  87,  80, 62, 18, 22, 37,  56,  68,  109, 103, 77, 24, 35, 55, 64,
+    81, 104, 113, 92, 49, 64, 78,  87,  103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+
+inline constexpr unsigned char kChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99,
+    99, 99, 47, 66, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Annex K.3 tables: code counts per length 1..16, then symbols.
+inline constexpr unsigned char kDcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+inline constexpr unsigned char kDcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+inline constexpr unsigned char kDcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+inline constexpr unsigned char kAcLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+inline constexpr unsigned char kAcLumaValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+    0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+inline constexpr unsigned char kAcChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+inline constexpr unsigned char kAcChromaValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22,
+    0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+// Canonical Huffman codes (JPEG Annex C) indexed by symbol.
+inline std::array<HuffCode, 256> build_codes(const unsigned char* bits, const unsigned char* values) {
+  std::array<HuffCode, 256> table{};
+  uint16_t code = 0;
+  std::size_t k = 0;
+  for (int len = 1; len <= 16; ++len) {
+    for (int n = 0; n < bits[len - 1]; ++n) {
+      table[values[k++]] = HuffCode{code++, static_cast<uint8_t>(len)};
+    }
+    code = static_cast<uint16_t>(code << 1);
+  }
+  return table;
+}
+
+struct Tables {
+  std::array<HuffCode, 256> dc_luma = build_codes(kDcLumaBits, kDcValues);
+  std::array<HuffCode, 256> dc_chroma = build_codes(kDcChromaBits, kDcValues);
+  std::array<HuffCode, 256> ac_luma = build_codes(kAcLumaBits, kAcLumaValues);
+  std::array<HuffCode, 256> ac_chroma = build_codes(kAcChromaBits, kAcChromaValues);
+};
+
+inline const Tables& tables() {
+  static const Tables t;
+  return t;
+}
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<unsigned char>& out) : out_(out) {}
+
+  void put(uint32_t code, int len) {
+    count_ += len;
+    buffer_ |= code << (24 - count_);
+    while (count_ >= 8) {
+      const auto c = static_cast<unsigned char>((buffer_ >> 16) & 0xFF);
+      out_.push_back(c);
+      if (c == 0xFF) {
+        out_.push_back(0);  // byte stuffing
+      }
+      buffer_ <<= 8;
+      count_ -= 8;
+    }
+  }
+  void put(const HuffCode& h) { put(h.code, h.len); }
+  void flush() { put(0x7F, 7); }  // pad the last byte with 1-bits
+
+ private:
+  std::vector<unsigned char>& out_;
+  uint32_t buffer_{0};
+  int count_{0};
+};
+
+// AAN forward DCT on eight samples spaced `stride` apart (outputs are scaled; the
+// quantiser divisors in encode_jpeg fold the scale back out).
+inline void fdct8(float* d, int stride) {
+  float* p[8];
+  for (int i = 0; i < 8; ++i) {
+    p[i] = d + i * stride;
+  }
+  const float tmp0 = *p[0] + *p[7];
+  const float tmp7 = *p[0] - *p[7];
+  const float tmp1 = *p[1] + *p[6];
+  const float tmp6 = *p[1] - *p[6];
+  const float tmp2 = *p[2] + *p[5];
+  const float tmp5 = *p[2] - *p[5];
+  const float tmp3 = *p[3] + *p[4];
+  const float tmp4 = *p[3] - *p[4];
+
+  float tmp10 = tmp0 + tmp3;
+  const float tmp13 = tmp0 - tmp3;
+  float tmp11 = tmp1 + tmp2;
+  float tmp12 = tmp1 - tmp2;
+  *p[0] = tmp10 + tmp11;
+  *p[4] = tmp10 - tmp11;
+  const float z1 = (tmp12 + tmp13) * 0.707106781f;
+  *p[2] = tmp13 + z1;
+  *p[6] = tmp13 - z1;
+
+  tmp10 = tmp4 + tmp5;
+  tmp11 = tmp5 + tmp6;
+  tmp12 = tmp6 + tmp7;
+  const float z5 = (tmp10 - tmp12) * 0.382683433f;
+  const float z2 = tmp10 * 0.541196100f + z5;
+  const float z4 = tmp12 * 1.306562965f + z5;
+  const float z3 = tmp11 * 0.707106781f;
+  const float z11 = tmp7 + z3;
+  const float z13 = tmp7 - z3;
+  *p[5] = z13 + z2;
+  *p[3] = z13 - z2;
+  *p[1] = z11 + z4;
+  *p[7] = z11 - z4;
+}
+
+inline void put_value(BitWriter& bw, const std::array<HuffCode, 256>& table, int symbol_high, int v) {
+  const int mag = v < 0 ? -v : v;
+  int len = 0;
+  while ((mag >> len) != 0) {
+    ++len;
+  }
+  bw.put(table[static_cast<std::size_t>(symbol_high | len)]);
+  if (len > 0) {
+    const int bits = v < 0 ? v - 1 : v;
+    bw.put(static_cast<uint32_t>(bits) & ((1u << len) - 1u), len);
+  }
+}
+
+// Transforms, quantises and entropy-codes one 8x8 block; returns its DC for prediction.
+inline int encode_block(BitWriter& bw, float* block, const float* divisors, int prev_dc,
+                        const std::array<HuffCode, 256>& dc, const std::array<HuffCode, 256>& ac) {
+  for (int r = 0; r < 8; ++r) {
+    fdct8(block + r * 8, 1);
+  }
+  for (int c = 0; c < 8; ++c) {
+    fdct8(block + c, 8);
+  }
+  int q[64];
+  for (int i = 0; i < 64; ++i) {
+    const float v = block[i] * divisors[i];
+    q[kZigZag[i]] = static_cast<int>(v < 0 ? v - 0.5f : v + 0.5f);
+  }
+
+  put_value(bw, dc, 0, q[0] - prev_dc);
+
+  int last = 63;
+  while (last > 0 && q[last] == 0) {
+    --last;
+  }
+  int run = 0;
+  for (int i = 1; i <= last; ++i) {
+    if (q[i] == 0) {
+      ++run;
+      continue;
+    }
+    while (run >= 16) {
+      bw.put(ac[0xF0]);  // ZRL
+      run -= 16;
+    }
+    put_value(bw, ac, run << 4, q[i]);
+    run = 0;
+  }
+  if (last != 63) {
+    bw.put(ac[0x00]);  // EOB
+  }
+  return q[0];
+}
+
+}  // namespace jpeg_detail
+
+// Baseline JPEG (JFIF, Huffman tables from Annex K, 4:2:0 chroma). Quality follows the
+// libjpeg scale: 1..100, 75 is the usual default. Returns an empty buffer for empty images.
+inline std::vector<unsigned char> encode_jpeg(const RgbImage& img, int quality) {
+  using namespace jpeg_detail;
+  std::vector<unsigned char> out;
+  if (img.empty() || img.width > 0xFFFF || img.height > 0xFFFF) {
+    return out;
+  }
+  quality = std::clamp(quality, 1, 100);
+  const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+  unsigned char qt_luma[64];
+  unsigned char qt_chroma[64];
+  for (int i = 0; i < 64; ++i) {
+    qt_luma[kZigZag[i]] = static_cast<unsigned char>(std::clamp((kLumaQuant[i] * scale + 50) / 100, 1, 255));
+    qt_chroma[kZigZag[i]] = static_cast<unsigned char>(std::clamp((kChromaQuant[i] * scale + 50) / 100, 1, 255));
+  }
+  static constexpr float kAanScale[8] = {1.0f,         1.387039845f, 1.306562965f, 1.175875602f,
+                                         1.0f,         0.785694958f, 0.541196100f, 0.275899379f};
+  float div_luma[64];
+  float div_chroma[64];
+  for (int r = 0, k = 0; r < 8; ++r) {
+    for (int c = 0; c < 8; ++c, ++k) {
+      const float s = kAanScale[r] * kAanScale[c] * 8.0f;
+      div_luma[k] = 1.0f / (qt_luma[kZigZag[k]] * s);
+      div_chroma[k] = 1.0f / (qt_chroma[kZigZag[k]] * s);
+    }
+  }
+
+  out.reserve(static_cast<std::size_t>(img.width) * img.height / 4 + 1024);
+  auto put16 = [&](int v) {
+    out.push_back(static_cast<unsigned char>((v >> 8) & 0xFF));
+    out.push_back(static_cast<unsigned char>(v & 0xFF));
+  };
+  static constexpr unsigned char kHeader[] = {0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J',  'F', 'I',
+                                              'F',  0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01,
+                                              0x00, 0x00, 0xFF, 0xDB, 0x00, 0x84, 0x00};
+  out.insert(out.end(), std::begin(kHeader), std::end(kHeader));
+  out.insert(out.end(), qt_luma, qt_luma + 64);
+  out.push_back(0x01);
+  out.insert(out.end(), qt_chroma, qt_chroma + 64);
+
+  // SOF0: 8-bit, three components; Y sampled 2x2, Cb/Cr 1x1.
+  out.insert(out.end(), {0xFF, 0xC0, 0x00, 0x11, 0x08});
+  put16(img.height);
+  put16(img.width);
+  out.insert(out.end(), {0x03, 0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01});
+
+  out.insert(out.end(), {0xFF, 0xC4, 0x01, 0xA2});
+  auto put_table = [&](unsigned char id, const unsigned char* bits, const unsigned char* values, std::size_t n) {
+    out.push_back(id);
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + n);
+  };
+  put_table(0x00, kDcLumaBits, kDcValues, 12);
+  put_table(0x10, kAcLumaBits, kAcLumaValues, 162);
+  put_table(0x01, kDcChromaBits, kDcValues, 12);
+  put_table(0x11, kAcChromaBits, kAcChromaValues, 162);
+
+  out.insert(out.end(), {0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00});
+
+  const Tables& t = tables();
+  BitWriter bw(out);
+  int dc_y = 0;
+  int dc_cb = 0;
+  int dc_cr = 0;
+  float y_blk[256];
+  float cb_blk[256];
+  float cr_blk[256];
+  float block[64];
+  const int w = img.width;
+  const int h = img.height;
+  for (int my = 0; my < h; my += 16) {
+    for (int mx = 0; mx < w; mx += 16) {
+      // Edge MCUs replicate the last row/column, which keeps the padding out of the visible area.
+      for (int y = 0; y < 16; ++y) {
+        const int sy = (std::min)(my + y, h - 1);
+        const unsigned char* row = &img.rgb[static_cast<std::size_t>(sy) * w * 3];
+        for (int x = 0; x < 16; ++x) {
+          const unsigned char* px = row + (std::min)(mx + x, w - 1) * 3;
+          const float r = px[0];
+          const float g = px[1];
+          const float b = px[2];
+          const int k = y * 16 + x;
+          y_blk[k] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+          cb_blk[k] = -0.16874f * r - 0.33126f * g + 0.5f * b;
+          cr_blk[k] = 0.5f * r - 0.41869f * g - 0.08131f * b;
+        }
+      }
+      for (int by = 0; by < 16; by += 8) {
+        for (int bx = 0; bx < 16; bx += 8) {
+          for (int y = 0; y < 8; ++y) {
+            std::copy_n(&y_blk[(by + y) * 16 + bx], 8, &block[y * 8]);
+          }
+          dc_y = encode_block(bw, block, div_luma, dc_y, t.dc_luma, t.ac_luma);
+        }
+      }
+      for (int pass = 0; pass < 2; ++pass) {
+        const float* src = pass == 0 ? cb_blk : cr_blk;
+        for (int y = 0; y < 8; ++y) {
+          for (int x = 0; x < 8; ++x) {
+            const int k = y * 32 + x * 2;
+            block[y * 8 + x] = (src[k] + src[k + 1] + src[k + 16] + src[k + 17]) * 0.25f;
+          }
+        }
+        int& dc = pass == 0 ? dc_cb : dc_cr;
+        dc = encode_block(bw, block, div_chroma, dc, t.dc_chroma, t.ac_chroma);
+      }
+    }
+  }
+  bw.flush();
+  out.push_back(0xFF);
+  out.push_back(0xD9);
+  return out;
+}
+
+}  // namespace attoclaw
@@ -0,0 +1,450 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace attoclaw {
+
+// Process-wide logger.
+//
+// Call sites use the ATTOCLAW_LOG_* macros below so the level is checked before the
+// message string is built. Logging is synchronous by default; start_async() switches
+// to per-thread lock-free rings (single producer, single consumer) drained by one
+// writer thread, so hot paths never contend on the sink mutex or block on stderr.
+// Lines go to stderr and, optionally, to a size-rotated file.
+class Logger {
+ public:
+  enum class Level { kInfo, kWarn, kError, kDebug };
+
+  static void set_json(bool enabled) { state().json_mode.store(enabled); }
+  static void set_min_level(Level level) { state().min_rank.store(level_rank(level)); }
+
+  static bool enabled(Level level) {
+    return level_rank(level) >= state().min_rank.load(std::memory_order_relaxed);
+  }
+
+  // Also writes every line to `path`, rotating to path.1 .. path.<keep> once it exceeds max_bytes.
+  static bool set_file(const std::filesystem::path& path, std::uint64_t max_bytes = 10ull * 1024 * 1024,
+                       int keep = 3) {
+    State& st = state();
+    std::lock_guard<std::mutex> lock(st.mu);
+    st.file.close();
+    st.file_path = path;
+    st.file_max_bytes = max_bytes;
+    st.file_keep = keep < 0 ? 0 : keep;
+    if (path.empty()) {
+      return true;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    st.file.open(path, std::ios::out | std::ios::binary | std::ios::app);
+    st.file_bytes = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+    return static_cast<bool>(st.file);
+  }
+
+  static void start_async() {
+    State& st = state();
+    std::lock_guard<std::mutex> lock(st.mu);
+    if (st.async.load()) {
+      return;
+    }
+    st.writer_running = true;
+    st.writer = std::thread([]() { writer_loop(); });
+    st.async.store(true);
+  }
+
+  // Drains all pending lines and returns to synchronous logging. A line pushed by a
+  // thread that still saw async on is drained either here or by that thread (see log()).
+  static void stop_async() {
+    State& st = state();
+    {
+      std::lock_guard<std::mutex> lock(st.mu);
+      if (!st.async.exchange(false)) {
+        return;
+      }
+      st.writer_running = false;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    st.cv.notify_all();
+    if (st.writer.joinable()) {
+      st.writer.join();
+    }
+    std::lock_guard<std::mutex> lock(st.mu);
+    drain_locked(st);
+    flush_locked(st);
+  }
+
+  static void log(Level level, std::string msg) {
+    if (!enabled(level)) {
+      return;
+    }
+    State& st = state();
+    const int64_t t = wall_ms();
+    if (st.async.load(std::memory_order_acquire)) {
+      if (auto* ring = thread_ring()) {
+        Record rec{level, t, std::move(msg)};
+        if (ring->push(std::move(rec))) {
+          // Pairs with the fence in stop_async(): if it switched to synchronous logging
+          // after we checked, its final drain may have missed this line, so drain here.
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if (!st.async.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(st.mu);
+            drain_locked(st);
+            flush_locked(st);
+            return;
+          }
+          st.cv.notify_one();
+          return;
+        }
+        // Ring full: write synchronously rather than drop the line.
+        msg = std::move(rec.msg);
+      }
+    }
+    std::lock_guard<std::mutex> lock(st.mu);
+    write_locked(st, level, t, msg);
+    if (level_rank(level) >= level_rank(Level::kWarn)) {
+      flush_locked(st);
+    }
+  }
+
+  static std::string with_suppressed(std::string msg, std::uint64_t suppressed) {
+    if (suppressed > 0) {
+      msg += " (" + std::to_string(suppressed) + " similar suppressed)";
+    }
+    return msg;
+  }
+
+ private:
+  struct Record {
+    Level level{Level::kInfo};
+    int64_t time_ms{0};
+    std::string msg;
+  };
+
+  // Single-producer (owning thread) / single-consumer (writer thread) ring.
+  class Ring {
+   public:
+    static constexpr std::size_t kSlots = 512;
+
+    bool push(Record&& r) {
+      const std::size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_.load(std::memory_order_acquire) >= kSlots) {
+        return false;
+      }
+      slots_[tail % kSlots] = std::move(r);
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(Record& out) {
+      const std::size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      out = std::move(slots_[head % kSlots]);
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    std::atomic<bool> alive{true};
+
+   private:
+    std::array<Record, kSlots> slots_{};
+    std::atomic<std::size_t> head_{0};
+    std::atomic<std::size_t> tail_{0};
+  };
+
+  struct State {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::atomic<bool> json_mode{false};
+    std::atomic<int> min_rank{1};
+    std::atomic<bool> async{false};
+    bool writer_running{false};
+    std::thread writer;
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    std::ofstream file;
+    std::filesystem::path file_path;
+    std::uint64_t file_max_bytes{0};
+    std::uint64_t file_bytes{0};
+    int file_keep{3};
+
+    ~State() {
+      if (writer.joinable()) {
+        {
+          std::lock_guard<std::mutex> lock(mu);
+          writer_running = false;
+          async.store(false);
+        }
+        cv.notify_all();
+        writer.join();
+      }
+    }
+  };
+
+  static State& state() {
+    static State s;
+    return s;
+  }
+
+  static Ring* thread_ring() {
+    struct Holder {
+      std::shared_ptr<Ring> ring;
+      ~Holder() {
+        if (ring) {
+          ring->alive.store(false, std::memory_order_release);
+        }
+      }
+    };
+    static thread_local Holder holder;
+    if (!holder.ring) {
+      holder.ring = std::make_shared<Ring>();
+      State& st = state();
+      std::lock_guard<std::mutex> lock(st.mu);
+      st.rings.push_back(holder.ring);
+    }
+    return holder.ring.get();
+  }
+
+  static void writer_loop() {
+    State& st = state();
+    std::unique_lock<std::mutex> lock(st.mu);
+    while (st.writer_running) {
+      st.cv.wait_for(lock, std::chrono::milliseconds(50));
+      drain_locked(st);
+      flush_locked(st);
+    }
+  }
+
+  static void drain_locked(State& st) {
+    Record r;
+    for (auto it = st.rings.begin(); it != st.rings.end();) {
+      Ring& ring = **it;
+      const bool dead = !ring.alive.load(std::memory_order_acquire);
+      while (ring.pop(r)) {
+        write_locked(st, r.level, r.time_ms, r.msg);
+      }
+      it = dead ? st.rings.erase(it) : it + 1;
+    }
+  }
+
+  static void flush_locked(State& st) {
+    std::cerr.flush();
+    if (st.file.is_open()) {
+      st.file.flush();
+    }
+  }
+
+  static void write_locked(State& st, Level level, int64_t time_ms, const std::string& msg) {
+    std::string line;
+    line.reserve(msg.size() + 64);
+    if (st.json_mode.load(std::memory_order_relaxed)) {
+      line += "{\"time\":\"";
+      append_time(line, time_ms);
+      line += "\",\"level\":\"";
+      line += level_name(level);
+      line += "\",\"msg\":\"";
+      append_json_escaped(line, msg);
+      line += "\"}\n";
+      std::cerr.write(line.data(), static_cast<std::streamsize>(line.size()));
+      write_file_locked(st, line);
+      return;
+    }
+
+    line += '[';
+    line += level_name(level);
+    line += "] ";
+    line += msg;
+    line += '\n';
+    std::cerr.write(line.data(), static_cast<std::streamsize>(line.size()));
+    if (st.file.is_open()) {
+      std::string stamped;
+      stamped.reserve(line.size() + 24);
+      append_time(stamped, time_ms);
+      stamped += ' ';
+      stamped += line;
+      write_file_locked(st, stamped);
+    }
+  }
+
+  static void write_file_locked(State& st, const std::string& line) {
+    if (!st.file.is_open()) {
+      return;
+    }
+    if (st.file_max_bytes > 0 && st.file_bytes + line.size() > st.file_max_bytes && st.file_bytes > 0) {
+      rotate_locked(st);
+    }
+    st.file.write(line.data(), static_cast<std::streamsize>(line.size()));
+    st.file_bytes += line.size();
+  }
+
+  static void rotate_locked(State& st) {
+    namespace fs = std::filesystem;
+    st.file.close();
+    std::error_code ec;
+    const std::string base = st.file_path.string();
+    if (st.file_keep > 0) {
+      fs::remove(base + "." + std::to_string(st.file_keep), ec);
+      for (int i = st.file_keep - 1; i >= 1; --i) {
+        fs::rename(base + "." + std::to_string(i), base + "." + std::to_string(i + 1), ec);
+      }
+      fs::rename(st.file_path, base + ".1", ec);
+    }
+    st.file.open(st.file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    st.file_bytes = 0;
+  }
+
+  static int64_t wall_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static void append_time(std::string& out, int64_t time_ms) {
+    const std::time_t t = static_cast<std::time_t>(time_ms / 1000);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    char buf[32];
+    const std::size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    out.append(buf, n);
+    char ms[8];
+    std::snprintf(ms, sizeof(ms), ".%03d", static_cast<int>(time_ms % 1000));
+    out += ms;
+  }
+
+  static void append_json_escaped(std::string& out, const std::string& s) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    for (unsigned char c : s) {
+      switch (c) {
+        case '"':
+          out += "\\\"";
+          break;
+        case '\\':
+          out += "\\\\";
+          break;
+        case '\n':
+          out += "\\n";
+          break;
+        case '\r':
+          out += "\\r";
+          break;
+        case '\t':
+          out += "\\t";
+          break;
+        default:
+          if (c < 0x20) {
+            out += "\\u00";
+            out += kHex[c >> 4];
+            out += kHex[c & 0xF];
+          } else {
+            out += static_cast<char>(c);
+          }
+      }
+    }
+  }
+
+  static int level_rank(Level level) {
+    switch (level) {
+      case Level::kDebug:
+        return 0;
+      case Level::kInfo:
+        return 1;
+      case Level::kWarn:
+        return 2;
+      case Level::kError:
+      default:
+        return 3;
+    }
+  }
+
+  static const char* level_name(Level level) {
+    switch (level) {
+      case Level::kInfo:
+        return "INFO";
+      case Level::kWarn:
+        return "WARN";
+      case Level::kError:
+        return "ERROR";
+      case Level::kDebug:
+      default:
+        return "DEBUG";
+    }
+  }
+};
+
+// Repeating channel poll/connect failures are reported at most this often.
+inline constexpr int64_t kPollErrorLogIntervalMs = 30000;
+
+// Lets one message through per interval and counts what it swallowed in between.
+class LogRateLimiter {
+ public:
+  explicit LogRateLimiter(int64_t interval_ms) : interval_ms_(interval_ms) {}
+
+  bool allow(std::uint64_t* suppressed) {
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count();
+    int64_t next = next_ms_.load(std::memory_order_relaxed);
+    if (now < next || !next_ms_.compare_exchange_strong(next, now + interval_ms_, std::memory_order_relaxed)) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+
+ private:
+  int64_t interval_ms_;
+  std::atomic<int64_t> next_ms_{0};
+  std::atomic<std::uint64_t> suppressed_{0};
+};
+
+}  // namespace attoclaw
+
+#define ATTOCLAW_LOG(level, ...)                                \
+  do {                                                          \
+    if (::attoclaw::Logger::enabled(level)) {                   \
+      ::attoclaw::Logger::log((level), __VA_ARGS__);            \
+    }                                                           \
+  } while (0)
+
+#define ATTOCLAW_LOG_DEBUG(...) ATTOCLAW_LOG(::attoclaw::Logger::Level::kDebug, __VA_ARGS__)
+#define ATTOCLAW_LOG_INFO(...) ATTOCLAW_LOG(::attoclaw::Logger::Level::kInfo, __VA_ARGS__)
+#define ATTOCLAW_LOG_WARN(...) ATTOCLAW_LOG(::attoclaw::Logger::Level::kWarn, __VA_ARGS__)
+#define ATTOCLAW_LOG_ERROR(...) ATTOCLAW_LOG(::attoclaw::Logger::Level::kError, __VA_ARGS__)
+
+// Rate-limited variant for messages that can repeat in a tight loop (poll errors).
+// One limiter per call site; the emitted line reports how many were suppressed.
+#define ATTOCLAW_LOG_EVERY_MS(level, interval_ms, ...)                                       \
+  do {                                                                                       \
+    if (::attoclaw::Logger::enabled(level)) {                                                \
+      static ::attoclaw::LogRateLimiter attoclaw_log_limiter_(interval_ms);                  \
+      std::uint64_t attoclaw_log_suppressed_ = 0;                                            \
+      if (attoclaw_log_limiter_.allow(&attoclaw_log_suppressed_)) {                          \
+        ::attoclaw::Logger::log((level), ::attoclaw::Logger::with_suppressed(                \
+                                             __VA_ARGS__, attoclaw_log_suppressed_));        \
+      }                                                                                      \
+    }                                                                                        \
+  } while (0)
+
+#define ATTOCLAW_LOG_WARN_EVERY_MS(interval_ms, ...) \
+  ATTOCLAW_LOG_EVERY_MS(::attoclaw::Logger::Level::kWarn, interval_ms, __VA_ARGS__)
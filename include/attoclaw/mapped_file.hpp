@@ -0,0 +1,253 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+// Read-only memory map of a whole file. Empty or missing files map to {nullptr, 0}.
+// Appends made after open() are not visible; call open() again to remap.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  explicit MappedFile(const fs::path& path) { open(path); }
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      close();
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+#ifdef _WIN32
+      std::swap(file_, other.file_);
+      std::swap(mapping_, other.mapping_);
+#endif
+    }
+    return *this;
+  }
+
+  bool open(const fs::path& path) {
+    close();
+#ifdef _WIN32
+    file_ = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+      close();
+      return size.QuadPart == 0;
+    }
+    mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_) {
+      close();
+      return false;
+    }
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+      close();
+      return false;
+    }
+    size_ = static_cast<std::size_t>(size.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    if (st.st_size > 0) {
+      void* p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+      }
+      data_ = static_cast<const char*>(p);
+      size_ = static_cast<std::size_t>(st.st_size);
+    }
+    ::close(fd);  // the mapping keeps the file referenced
+#endif
+    return true;
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (data_) {
+      UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+      CloseHandle(mapping_);
+      mapping_ = nullptr;
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(file_);
+      file_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (data_) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  const char* data_{nullptr};
+  std::size_t size_{0};
+#ifdef _WIN32
+  HANDLE file_{INVALID_HANDLE_VALUE};
+  HANDLE mapping_{nullptr};
+#endif
+};
+
+// Reads a file front to back in blocks that end on a line boundary, through one reused
+// buffer, so a scan needs O(block) memory whatever the file size. Uses plain reads rather
+// than a mapping: a file truncated while it is read just ends early, where a mapping would
+// raise SIGBUS. A line longer than the block is handed out in block-sized pieces.
+class LineBlockReader {
+ public:
+  static constexpr std::size_t kBlockSize = std::size_t{1} << 20;
+
+  explicit LineBlockReader(std::size_t block_size = kBlockSize) : block_size_(block_size) {}
+  ~LineBlockReader() { close(); }
+
+  LineBlockReader(const LineBlockReader&) = delete;
+  LineBlockReader& operator=(const LineBlockReader&) = delete;
+
+  bool open(const fs::path& path) {
+    close();
+    file_ = std::fopen(path.string().c_str(), "rb");
+    if (!file_) {
+      return false;
+    }
+    std::setvbuf(file_, nullptr, _IONBF, 0);  // reads go straight into buf_
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    size_ = ec ? 0 : static_cast<uint64_t>(size);
+    // Small files get a buffer just big enough for one read.
+    const std::size_t want = static_cast<std::size_t>((std::min)(static_cast<uint64_t>(block_size_), size_ + 1));
+    if (buf_.size() < want) {
+      buf_.resize(want);
+    }
+    return true;
+  }
+
+  void close() {
+    if (file_) {
+      std::fclose(file_);
+      file_ = nullptr;
+    }
+    begin_ = 0;
+    end_ = 0;
+    eof_ = false;
+    size_ = 0;
+  }
+
+  // Size at open(); the file may have changed since.
+  uint64_t size() const { return size_; }
+
+  // True once next() has nothing left to return.
+  bool done() const { return !file_ || (eof_ && begin_ == end_); }
+
+  // The next block: whole lines, the last ending in '\n' unless it is the end of the file
+  // or a piece of an over-long line. Empty at the end. Valid until the next call.
+  std::string_view next() {
+    if (!file_) {
+      return {};
+    }
+    if (begin_ > 0) {
+      std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == buf_.size() && buf_.size() < block_size_) {
+      buf_.resize(block_size_);  // the file grew past its size at open()
+    }
+    while (!eof_ && end_ < buf_.size()) {
+      const std::size_t want = buf_.size() - end_;
+      const std::size_t got = std::fread(buf_.data() + end_, 1, want, file_);
+      end_ += got;
+      eof_ = got < want;
+    }
+    std::size_t cut = end_;
+    if (!eof_) {
+      const std::size_t nl = std::string_view(buf_.data(), end_).rfind('\n');
+      if (nl != std::string_view::npos) {
+        cut = nl + 1;
+      }
+    }
+    begin_ = cut;
+    return std::string_view(buf_.data(), cut);
+  }
+
+ private:
+  std::size_t block_size_;
+  std::FILE* file_{nullptr};
+  std::string buf_;
+  std::size_t begin_{0};  // buf_[begin_, end_) was read but not handed out yet
+  std::size_t end_{0};
+  bool eof_{false};
+  uint64_t size_{0};
+};
+
+// First occurrence of `needle` in [hay, hay + n), or nullptr. memmem is vectorized in
+// glibc and the BSD libcs; Windows falls back to Boyer-Moore-Horspool.
+inline const char* find_bytes(const char* hay, std::size_t n, std::string_view needle) {
+  if (needle.empty()) {
+    return hay;
+  }
+  if (!hay || n < needle.size()) {
+    return nullptr;
+  }
+  if (needle.size() == 1) {
+    return static_cast<const char*>(std::memchr(hay, needle[0], n));
+  }
+#ifdef _WIN32
+  const char* end = hay + n;
+  const char* hit =
+      std::search(hay, end, std::boyer_moore_horspool_searcher(needle.begin(), needle.end()));
+  return hit == end ? nullptr : hit;
+#else
+  return static_cast<const char*>(::memmem(hay, n, needle.data(), needle.size()));
+#endif
+}
+
+// Binary heuristic shared with git and grep: a NUL byte in the first 8 KiB.
+inline bool looks_binary(const char* data, std::size_t n) {
+  return data && std::memchr(data, '\0', (std::min)(n, std::size_t{8192})) != nullptr;
+}
+
+}  // namespace attoclaw
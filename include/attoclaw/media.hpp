@@ -0,0 +1,366 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/events.hpp"
+#include "attoclaw/logger.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/subprocess.hpp"
+#include "attoclaw/tools.hpp"
+#include "attoclaw/trace.hpp"
+#include "attoclaw/transcription.hpp"
+#include "attoclaw/vision.hpp"
+
+namespace attoclaw {
+
+// Pipeline stage between the channels and the agent: converts and transcribes media
+// attachments on its own worker pool, then hands the agent a message with the results
+// in metadata["transcripts"]. Messages of a session that arrive while earlier ones are
+// still being transcribed, or released but not yet picked up by the agent, wait behind
+// them, so per-chat order is preserved.
+class MediaPipeline {
+ public:
+  using ReadyCallback = std::function<void(InboundMessage)>;
+
+  MediaPipeline(std::string api_key, std::string api_base, std::string model, int timeout_s)
+      : api_key_(std::move(api_key)),
+        api_base_(std::move(api_base)),
+        model_(std::move(model)),
+        timeout_s_(timeout_s) {}
+
+  ~MediaPipeline() { stop(); }
+
+  MediaPipeline(const MediaPipeline&) = delete;
+  MediaPipeline& operator=(const MediaPipeline&) = delete;
+
+  void configure(int workers) { workers_ = std::clamp(workers, 1, 16); }
+
+  bool enabled() const { return !trim(api_base_).empty(); }
+
+  void start(ReadyCallback on_ready) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (running_ || !enabled()) {
+      return;
+    }
+    on_ready_ = std::move(on_ready);
+    running_ = true;
+    for (int i = 0; i < workers_; ++i) {
+      threads_.emplace_back([this]() { worker_loop(); });
+    }
+  }
+
+  // Drops queued work; messages still in the pipeline are not delivered and are logged.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (!running_) {
+        return;
+      }
+      running_ = false;
+      jobs_.clear();
+      for (const auto& [key, queue] : sessions_) {
+        ATTOCLAW_LOG_WARN("Media pipeline stopped; dropping " + std::to_string(queue.size()) +
+                          " undelivered message(s) of " + key);
+      }
+      sessions_.clear();
+      released_.clear();
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+    threads_.clear();
+  }
+
+  static bool has_transcripts(const InboundMessage& msg) {
+    return msg.metadata.is_object() && msg.metadata.contains("transcripts");
+  }
+
+  // True if the agent should submit() this message instead of handling it now: it has
+  // media to transcribe, or an earlier message of its session is still in the pipeline.
+  bool should_defer(const InboundMessage& msg) {
+    if (msg.channel == "system" || has_transcripts(msg)) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!running_) {
+      return false;
+    }
+    const std::string key = msg.session_key();
+    return has_media(msg) || sessions_.count(key) > 0 || released_.count(key) > 0;
+  }
+
+  // The agent picked up a message this pipeline released; later messages of its session
+  // no longer need to queue behind it.
+  void consumed(const InboundMessage& msg) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = released_.find(msg.session_key());
+    if (it != released_.end() && --it->second == 0) {
+      released_.erase(it);
+    }
+  }
+
+  void submit(InboundMessage msg) {
+    auto entry = std::make_shared<Entry>();
+    entry->started = std::chrono::steady_clock::now();
+    entry->msg = std::move(msg);
+    entry->results.resize(entry->msg.media.size());
+    std::vector<InboundMessage> ready;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (!running_) {
+        return;
+      }
+      const std::string key = entry->msg.session_key();
+      sessions_[key].push_back(entry);
+      for (std::size_t i = 0; i < entry->msg.media.size(); ++i) {
+        if (!trim(entry->msg.media[i]).empty()) {
+          jobs_.push_back(Job{entry, i});
+          ++entry->remaining;
+        }
+      }
+      metrics().inc("media.messages");
+      if (entry->remaining == 0) {
+        release_ready_locked(key, &ready);
+      }
+    }
+    cv_.notify_all();
+    deliver(ready);
+  }
+
+  // Synchronous variant for direct calls (CLI, cron): the attachments of `msg` are still
+  // converted and transcribed concurrently, on at most `workers` threads.
+  void process_inline(InboundMessage& msg) const {
+    std::vector<json> results(msg.media.size());
+    std::vector<std::size_t> pending;
+    for (std::size_t i = 0; i < msg.media.size(); ++i) {
+      if (!trim(msg.media[i]).empty()) {
+        pending.push_back(i);
+      }
+    }
+    std::atomic<std::size_t> next{0};
+    auto run = [&]() {
+      for (std::size_t k = next++; k < pending.size(); k = next++) {
+        results[pending[k]] = transcribe_one(msg.media[pending[k]]);
+      }
+    };
+    const std::size_t n_threads = (std::min)(pending.size(), static_cast<std::size_t>(workers_));
+    std::vector<std::thread> threads;
+    for (std::size_t t = 1; t < n_threads; ++t) {
+      threads.emplace_back(run);
+    }
+    run();
+    for (auto& t : threads) {
+      t.join();
+    }
+    attach(msg, results);
+  }
+
+  // "[Media attachments]" and "[Transcription]" blocks appended to the user's turn.
+  static std::string attachment_block(const InboundMessage& msg) {
+    std::ostringstream media_block;
+    std::ostringstream transcript_block;
+    media_block << "\n\n[Media attachments]\n";
+    transcript_block << "\n[Transcription]\n";
+    int idx = 1;
+    const json empty = json::array();
+    const json& transcripts = has_transcripts(msg) ? msg.metadata["transcripts"] : empty;
+    for (const auto& t : transcripts) {
+      media_block << "- audio[" << idx << "]: " << t.value("path", "") << "\n";
+      transcript_block << "- audio[" << idx << "]:\n" << t.value("text", "") << "\n";
+      ++idx;
+    }
+    return media_block.str() + transcript_block.str();
+  }
+
+ private:
+  struct Entry {
+    InboundMessage msg;
+    std::vector<json> results;
+    std::size_t remaining{0};
+    std::chrono::steady_clock::time_point started;
+  };
+
+  struct Job {
+    std::shared_ptr<Entry> entry;
+    std::size_t index{0};
+  };
+
+  static bool has_media(const InboundMessage& msg) {
+    return std::any_of(msg.media.begin(), msg.media.end(), [](const std::string& p) { return !trim(p).empty(); });
+  }
+
+  static void attach(InboundMessage& msg, const std::vector<json>& results) {
+    json arr = json::array();
+    for (const auto& r : results) {
+      if (!r.is_null()) {
+        arr.push_back(r);
+      }
+    }
+    if (!msg.metadata.is_object()) {
+      msg.metadata = json::object();
+    }
+    msg.metadata["transcripts"] = std::move(arr);
+  }
+
+  void worker_loop() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+      cv_.wait(lock, [this]() { return !running_ || !jobs_.empty(); });
+      if (!running_) {
+        return;
+      }
+      Job job = std::move(jobs_.front());
+      jobs_.pop_front();
+      lock.unlock();
+
+      json result;
+      {
+        TraceContext trace(trace_id_from_metadata(job.entry->msg.metadata));
+        result = transcribe_one(job.entry->msg.media[job.index]);
+      }
+
+      std::vector<InboundMessage> ready;
+      lock.lock();
+      if (!running_) {
+        return;
+      }
+      job.entry->results[job.index] = std::move(result);
+      if (--job.entry->remaining == 0) {
+        release_ready_locked(job.entry->msg.session_key(), &ready);
+      }
+      if (!ready.empty()) {
+        lock.unlock();
+        deliver(ready);
+        lock.lock();
+      }
+    }
+  }
+
+  // Pops the finished prefix of the session queue (in arrival order). The session stays
+  // known through released_ until the agent has consumed() what was popped, since the
+  // messages travel back through the tail of the bus.
+  void release_ready_locked(const std::string& key, std::vector<InboundMessage>* ready) {
+    auto it = sessions_.find(key);
+    if (it == sessions_.end()) {
+      return;
+    }
+    auto& queue = it->second;
+    while (!queue.empty() && queue.front()->remaining == 0) {
+      Entry& e = *queue.front();
+      if (has_media(e.msg)) {
+        metrics().observe("media.pipeline_seconds",
+                          std::chrono::duration<double>(std::chrono::steady_clock::now() - e.started).count());
+      }
+      attach(e.msg, e.results);  // empty for messages held only for ordering
+      ready->push_back(std::move(e.msg));
+      queue.pop_front();
+      ++released_[key];
+    }
+    if (queue.empty()) {
+      sessions_.erase(it);
+    }
+  }
+
+  void deliver(std::vector<InboundMessage>& ready) {
+    for (auto& m : ready) {
+      if (on_ready_) {
+        on_ready_(std::move(m));
+      }
+    }
+  }
+
+  // Converts one attachment to 16 kHz mono WAV in memory (ffmpeg writing to a pipe) and
+  // uploads it (long clips are segmented by TranscribeTool). Falls back to uploading the
+  // original file when ffmpeg is unavailable.
+  json transcribe_one(const std::string& raw_path) const {
+    const fs::path path = expand_user_path(raw_path);
+    TraceSpan media_span("media.transcribe", raw_path);
+    TranscribeTool transcriber(api_key_, api_base_, model_, timeout_s_);
+    metrics().inc("transcribe.total");
+
+    // Checked against the original bytes so a forwarded voice note skips ffmpeg as well.
+    if (auto hit = transcriber.cached_file_transcript(path)) {
+      metrics().inc("transcribe.ok");
+      return json{{"path", raw_path}, {"text", *hit}, {"ok", true}, {"cached", true}};
+    }
+
+    std::string text;
+    bool converted = false;
+#ifndef _WIN32
+    if (!path.has_extension() || path.extension() != ".wav") {
+      TraceSpan convert_span("media.convert");
+      if (ensure_ffmpeg()) {
+        ProcessOutput conv = run_process_capture({"ffmpeg", "-hide_banner", "-loglevel", "error", "-i",
+                                                  fs::absolute(path).string(), "-ac", "1", "-ar", "16000", "-f",
+                                                  "wav", "pipe:1"},
+                                                 240);
+        if (conv.ok && !conv.out.empty()) {
+          fix_streamed_wav_header(conv.out);
+          convert_span.end();
+          text = transcriber.transcribe_data(conv.out, path.stem().string() + ".wav");
+          converted = true;
+        } else {
+          ATTOCLAW_LOG_WARN("ffmpeg conversion failed for " + path.string() + ": " + trim(conv.err));
+          metrics().inc("media.convert_error");
+        }
+      }
+    }
+#endif
+    if (!converted) {
+      text = transcriber.execute(json{{"path", path.string()}});
+    }
+
+    if (converted) {
+      transcriber.remember_file_transcript(path, text);
+    }
+    const bool ok = text.rfind("Error:", 0) != 0;
+    metrics().inc(ok ? "transcribe.ok" : "transcribe.error");
+    return json{{"path", raw_path}, {"text", text}, {"ok", ok}};
+  }
+
+  // One install attempt per process; concurrent workers must not race apt/dnf.
+  static bool ensure_ffmpeg() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+      if (!command_exists_in_path("ffmpeg")) {
+        std::string note;
+        try_install_linux_package("ffmpeg", 240, &note);
+      }
+    });
+    return command_exists_in_path("ffmpeg");
+  }
+
+  std::string api_key_;
+  std::string api_base_;
+  std::string model_;
+  int timeout_s_{180};
+  int workers_{2};
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool running_{false};
+  std::deque<Job> jobs_;
+  std::unordered_map<std::string, std::deque<std::shared_ptr<Entry>>> sessions_;
+  std::unordered_map<std::string, int> released_;  // per session: delivered, not yet consumed()
+  std::vector<std::thread> threads_;
+  ReadyCallback on_ready_;
+};
+
+}  // namespace attoclaw
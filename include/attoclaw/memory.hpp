@@ -1,9 +1,700 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "attoclaw/common.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/vector_index.hpp"
 
 namespace attoclaw {
 
+struct MemoryHit {
+  std::string source;  // "MEMORY.md" or "HISTORY.md"
+  std::string text;
+  double score{0.0};
+};
+
+// BM25 index over memory/HISTORY.md (append-only, persisted to memory/index.bin) and the
+// paragraphs of memory/MEMORY.md (small and freely rewritten, so rebuilt in RAM when it
+// changes). Both files stay the source of truth: the index stores offsets, not text, and
+// catches up lazily on the next search. index.bin is written every kSaveEveryDocs new
+// entries and on destruction; anything newer is simply re-indexed from HISTORY.md after a
+// restart. One instance is shared per memory directory.
+class MemoryIndex {
+ public:
+  explicit MemoryIndex(fs::path memory_dir)
+      : memory_dir_(std::move(memory_dir)),
+        history_file_(memory_dir_ / "HISTORY.md"),
+        memory_file_(memory_dir_ / "MEMORY.md"),
+        index_file_(memory_dir_ / "index.bin"),
+        vectors_file_(memory_dir_ / "vectors.bin") {}
+
+  ~MemoryIndex() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stopping_ = true;
+    }
+    embed_cv_.notify_all();
+    if (embed_thread_.joinable()) {
+      embed_thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    if (unsaved_docs_ > 0) {
+      save_locked();
+    }
+  }
+
+  MemoryIndex(const MemoryIndex&) = delete;
+  MemoryIndex& operator=(const MemoryIndex&) = delete;
+
+  static std::shared_ptr<MemoryIndex> for_dir(const fs::path& memory_dir) {
+    static std::mutex mu;
+    static std::map<fs::path, std::weak_ptr<MemoryIndex>> instances;
+    std::lock_guard<std::mutex> lock(mu);
+    auto& slot = instances[memory_dir];
+    auto idx = slot.lock();
+    if (!idx) {
+      idx = std::make_shared<MemoryIndex>(memory_dir);
+      slot = idx;
+    }
+    return idx;
+  }
+
+  // Enables semantic recall over history entries: a background worker embeds each entry
+  // once into memory/vectors.bin, and search() fuses vector and BM25 rankings.
+  void set_embedder(Embedder embedder) {
+    std::lock_guard<std::mutex> lock(mu_);
+    embedder_ = std::move(embedder);
+    vectors_.reset();
+    vectors_opened_ = false;
+    ++generation_;
+    embed_failures_ = 0;
+    embed_retry_at_ = {};
+    if (!embed_thread_.joinable()) {
+      embed_thread_ = std::thread([this]() { embed_loop(); });
+    }
+    embed_cv_.notify_all();
+  }
+
+  // Keyword search only, until vectors exist and while the embedder is backing off after a
+  // failure; the query embedding is the only network call and runs without the lock held.
+  std::vector<MemoryHit> search(const std::string& query, std::size_t k, std::size_t max_chars = 1200) {
+    std::unique_lock<std::mutex> lock(mu_);
+    refresh_locked();
+    if (k == 0) {
+      return {};
+    }
+
+    std::vector<std::pair<uint64_t, double>> semantic;
+    if (semantic_ready_locked() && !trim(query).empty()) {
+      const Embedder embedder = *embedder_;
+      const uint64_t generation = generation_;
+      lock.unlock();
+      const auto q = embedder.embed({query});
+      lock.lock();
+      if (!q || q->empty() || q->front().empty()) {
+        note_embed_failure_locked();
+      } else if (generation == generation_ && vectors_) {
+        for (const auto& [id, sim] : vectors_->search(q->front(), 2 * k)) {
+          if (id < history_.docs.size()) {
+            semantic.emplace_back(static_cast<uint64_t>(id), static_cast<double>(sim));
+          }
+        }
+      }
+    }
+
+    auto by_score = [](const auto& a, const auto& b) {
+      return a.second != b.second ? a.second > b.second : a.first > b.first;  // newer first on ties
+    };
+    std::vector<std::pair<uint64_t, double>> ranked = bm25_locked(query);
+    if (!semantic.empty()) {
+      // Reciprocal rank fusion: robust to the two scores living on different scales.
+      const std::size_t lexical = (std::min)(ranked.size(), 2 * k);
+      std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(lexical), ranked.end(), by_score);
+      std::unordered_map<uint64_t, double> fused;
+      for (std::size_t r = 0; r < lexical; ++r) {
+        fused[ranked[r].first] += 1.0 / (kRrfK + static_cast<double>(r + 1));
+      }
+      for (std::size_t r = 0; r < semantic.size(); ++r) {
+        fused[semantic[r].first] += 1.0 / (kRrfK + static_cast<double>(r + 1));
+      }
+      ranked.assign(fused.begin(), fused.end());
+    }
+    const std::size_t top = (std::min)(k, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(top), ranked.end(), by_score);
+    ranked.resize(top);
+
+    std::vector<MemoryHit> hits;
+    std::ifstream history_in;
+    for (const auto& [key, score] : ranked) {
+      const bool from_memory = (key & kMemoryBit) != 0;
+      const Doc& d = (from_memory ? memory_ : history_).docs[static_cast<std::size_t>(key & ~kMemoryBit)];
+      std::string text = from_memory ? memory_text_.substr(static_cast<std::size_t>(d.offset), d.length)
+                                     : read_history_locked(history_in, d);
+      text = trim(text);
+      if (text.size() > max_chars) {
+        text = text.substr(0, max_chars) + "...";
+      }
+      hits.push_back(MemoryHit{from_memory ? "MEMORY.md" : "HISTORY.md", std::move(text), score});
+    }
+    return hits;
+  }
+
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock(mu_);
+    refresh_locked();
+    return history_.docs.size() + memory_.docs.size();
+  }
+
+  // Blocks until every history entry has a vector. False on timeout, without an embedder,
+  // or while embedding is backing off after a failure.
+  bool wait_embedded(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mu_);
+    refresh_locked();
+    return idle_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() {
+      return !embedder_ || embed_failures_ > 0 || embedded_locked() >= history_.docs.size();
+    }) && embedder_ && embed_failures_ == 0;
+  }
+
+  // Lowercased ASCII alphanumeric runs; UTF-8 multibyte sequences count as word characters
+  // so non-Latin text is still searchable. Very common English words are dropped.
+  static std::vector<std::string> tokenize(std::string_view text) {
+    static const std::unordered_set<std::string> stop = {
+        "a",    "an",   "and", "are", "as",   "at",   "be",   "but", "by",   "for", "from", "has",
+        "have", "he",   "her", "his", "i",    "in",   "is",   "it",  "its",  "me",  "my",   "of",
+        "on",   "or",   "our", "she", "so",   "that", "the",  "their", "them", "they", "this", "to",
+        "was",  "we",   "were", "what", "when", "which", "who", "will", "with", "you", "your"};
+    std::vector<std::string> out;
+    std::string cur;
+    auto flush = [&]() {
+      if (cur.size() >= 2 && !stop.count(cur)) {
+        out.push_back(cur.size() > 40 ? cur.substr(0, 40) : cur);
+      }
+      cur.clear();
+    };
+    for (unsigned char c : text) {
+      if (std::isalnum(c) || c >= 0x80) {
+        cur.push_back(static_cast<char>(std::tolower(c)));
+      } else {
+        flush();
+      }
+    }
+    flush();
+    return out;
+  }
+
+  // Paragraph chunks (offset, length) of `text`: blank-line separated, with a lone
+  // markdown heading kept together with the paragraph after it and long paragraphs split
+  // at line breaks.
+  static std::vector<std::pair<std::size_t, std::size_t>> chunk(const std::string& text) {
+    constexpr std::size_t kMax = 2000;
+    std::vector<std::pair<std::size_t, std::size_t>> out;
+    std::size_t start = std::string::npos;
+    auto emit = [&](std::size_t end) {
+      while (end - start > kMax) {
+        std::size_t cut = text.rfind('\n', start + kMax);
+        cut = (cut == std::string::npos || cut <= start) ? start + kMax : cut + 1;
+        out.emplace_back(start, cut - start);
+        start = cut;
+      }
+      if (end > start) {
+        out.emplace_back(start, end - start);
+      }
+      start = std::string::npos;
+    };
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+      const std::size_t nl = text.find("\n\n", pos);
+      const std::size_t end = nl == std::string::npos ? text.size() : nl;
+      const std::string para = trim(text.substr(pos, end - pos));
+      if (!para.empty()) {
+        if (start == std::string::npos) {
+          start = pos;
+        }
+        const bool heading = para[0] == '#' && para.find('\n') == std::string::npos;
+        if (!heading) {
+          emit(end);
+        }
+      }
+      pos = nl == std::string::npos ? text.size() : nl + 2;
+    }
+    if (start != std::string::npos) {
+      emit(text.size());
+    }
+    return out;
+  }
+
+ private:
+  static constexpr double kK1 = 1.2;
+  static constexpr double kB = 0.75;
+  static constexpr double kRrfK = 60.0;
+  static constexpr uint64_t kMemoryBit = 1ULL << 63;
+  static constexpr std::size_t kEmbedBatch = 32;
+  static constexpr int kEmbedBackoffMinS = 30;
+  static constexpr int kEmbedBackoffMaxS = 900;
+  static constexpr std::size_t kSaveEveryDocs = 32;
+  static constexpr uint64_t kFingerprintSpan = 4096;
+  static constexpr char kMagic[8] = {'A', 'C', 'M', 'I', 'D', 'X', '2', '\n'};
+
+  struct Doc {
+    uint64_t offset{0};
+    uint32_t length{0};
+    uint32_t terms{0};
+  };
+
+  struct Posting {
+    uint32_t doc{0};
+    uint32_t tf{0};
+  };
+
+  struct Segment {
+    std::vector<Doc> docs;
+    std::unordered_map<std::string, std::vector<Posting>> postings;
+    uint64_t total_terms{0};
+
+    const std::vector<Posting>* postings_for(const std::string& term) const {
+      auto it = postings.find(term);
+      return it == postings.end() ? nullptr : &it->second;
+    }
+
+    void add(uint64_t offset, std::string_view text) {
+      const auto tokens = tokenize(text);
+      const uint32_t id = static_cast<uint32_t>(docs.size());
+      docs.push_back(Doc{offset, static_cast<uint32_t>(text.size()), static_cast<uint32_t>(tokens.size())});
+      total_terms += tokens.size();
+      std::unordered_map<std::string, uint32_t> tf;
+      for (const auto& t : tokens) {
+        ++tf[t];
+      }
+      for (const auto& [t, count] : tf) {
+        postings[t].push_back(Posting{id, count});
+      }
+    }
+
+    void clear() {
+      docs.clear();
+      postings.clear();
+      total_terms = 0;
+    }
+  };
+
+  // Unsorted (key, BM25 score) for every document matching a query term. Key: segment in
+  // the top bit (set for MEMORY.md), doc id below.
+  std::vector<std::pair<uint64_t, double>> bm25_locked(const std::string& query) const {
+    std::vector<std::string> terms = tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    const double n = static_cast<double>(history_.docs.size() + memory_.docs.size());
+    if (terms.empty() || n == 0) {
+      return {};
+    }
+    const double avgdl = static_cast<double>(history_.total_terms + memory_.total_terms) / n;
+
+    std::unordered_map<uint64_t, double> scores;
+    for (const auto& term : terms) {
+      const auto* hp = history_.postings_for(term);
+      const auto* mp = memory_.postings_for(term);
+      const double df = static_cast<double>((hp ? hp->size() : 0) + (mp ? mp->size() : 0));
+      if (df == 0) {
+        continue;
+      }
+      const double idf = std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+      auto accumulate = [&](const Segment& seg, const std::vector<Posting>* postings, uint64_t bit) {
+        if (!postings) {
+          return;
+        }
+        for (const auto& p : *postings) {
+          const double tf = static_cast<double>(p.tf);
+          const double dl = static_cast<double>(seg.docs[p.doc].terms);
+          scores[bit | p.doc] += idf * tf * (kK1 + 1.0) / (tf + kK1 * (1.0 - kB + kB * dl / avgdl));
+        }
+      };
+      accumulate(history_, hp, 0);
+      accumulate(memory_, mp, kMemoryBit);
+    }
+    return {scores.begin(), scores.end()};
+  }
+
+  std::size_t embedded_locked() const { return vectors_ ? vectors_->size() : 0; }
+
+  bool semantic_ready_locked() const {
+    return embedder_ && embedded_locked() > 0 && std::chrono::steady_clock::now() >= embed_retry_at_;
+  }
+
+  // Offline or failing embedder: stop calling it (from search() and the backfill worker)
+  // for 30 s, doubling up to 15 min while it keeps failing.
+  void note_embed_failure_locked() {
+    ++embed_failures_;
+    const int shift = (std::min)(embed_failures_ - 1, 5);
+    const int delay_s = (std::min)(kEmbedBackoffMaxS, kEmbedBackoffMinS << shift);
+    embed_retry_at_ = std::chrono::steady_clock::now() + std::chrono::seconds(delay_s);
+    metrics().inc("memory.embed_errors");
+    idle_cv_.notify_all();
+    embed_cv_.notify_all();  // re-arm the worker's wait for the new retry time
+  }
+
+  std::string read_history_locked(std::ifstream& in, const Doc& d) const {
+    if (!in.is_open()) {
+      in.open(history_file_, std::ios::in | std::ios::binary);
+    }
+    std::string text(d.length, '\0');
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(d.offset));
+    in.read(text.data(), static_cast<std::streamsize>(d.length));
+    text.resize(static_cast<std::size_t>(in.gcount()));
+    return text;
+  }
+
+  // Drops the vectors if history was rewritten underneath, and wakes the backfill worker
+  // when vectors.bin is still unopened or entries are missing vectors. Never opens the
+  // index or embeds on the caller.
+  void schedule_embedding_locked() {
+    if (!embedder_) {
+      return;
+    }
+    drop_stale_vectors_locked();
+    if (!vectors_opened_ || embedded_locked() < history_.docs.size()) {
+      embed_cv_.notify_one();
+    }
+  }
+
+  void drop_stale_vectors_locked() {
+    if (!vectors_) {
+      return;
+    }
+    const std::size_t n = vectors_->size();
+    if (n > history_.docs.size() || (n > 0 && vectors_->ref(n - 1) != history_.docs[n - 1].offset)) {
+      vectors_->reset();  // history was rewritten
+      ++generation_;
+    }
+  }
+
+  // Worker side of schedule_embedding_locked(): opens an existing vectors.bin with the lock
+  // released, so search() never waits on reading and mapping the file.
+  void open_vectors(std::unique_lock<std::mutex>& lock) {
+    const std::string embedder_id = embedder_->id;
+    const uint64_t generation = generation_;
+    lock.unlock();
+    std::unique_ptr<VectorIndex> opened;
+    if (const int dim = VectorIndex::stored_dim(vectors_file_); dim > 0) {
+      opened = std::make_unique<VectorIndex>(vectors_file_, dim, embedder_id);
+    }
+    lock.lock();
+    if (stopping_ || generation != generation_) {
+      return;  // rewritten or re-configured meanwhile; the loop tries again
+    }
+    vectors_ = std::move(opened);
+    vectors_opened_ = true;
+    drop_stale_vectors_locked();
+  }
+
+  // Backfill worker: embeds history entries without a vector, kEmbedBatch at a time, with
+  // the lock released during the embedding call. Results computed against an index that
+  // changed meanwhile (rewrite, new embedder) are discarded.
+  void embed_loop() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stopping_) {
+      const auto now = std::chrono::steady_clock::now();
+      if (now < embed_retry_at_) {
+        embed_cv_.wait_until(lock, embed_retry_at_);
+        continue;
+      }
+      if (embedder_ && !vectors_opened_) {
+        open_vectors(lock);
+        continue;
+      }
+      if (!embedder_ || embedded_locked() >= history_.docs.size()) {
+        idle_cv_.notify_all();
+        embed_cv_.wait(lock);
+        continue;
+      }
+      const std::size_t next = embedded_locked();
+      const std::size_t end = (std::min)(history_.docs.size(), next + kEmbedBatch);
+      std::vector<std::string> texts;
+      std::vector<uint64_t> refs;
+      std::ifstream in;
+      for (std::size_t i = next; i < end; ++i) {
+        texts.push_back(read_history_locked(in, history_.docs[i]));
+        refs.push_back(history_.docs[i].offset);
+      }
+      const Embedder embedder = *embedder_;
+      const uint64_t generation = generation_;
+      lock.unlock();
+      const auto vecs = embedder.embed(texts);
+      lock.lock();
+      if (stopping_ || generation != generation_ || embedded_locked() != next) {
+        continue;
+      }
+      if (!vecs || vecs->size() != texts.size() || vecs->front().empty()) {
+        note_embed_failure_locked();
+        continue;
+      }
+      if (!vectors_ || vectors_->dim() != vecs->front().size()) {
+        vectors_ = std::make_unique<VectorIndex>(vectors_file_, static_cast<int>(vecs->front().size()), embedder.id);
+        if (vectors_->size() != next) {
+          vectors_->reset();  // model or dimension changed underneath; start over
+          ++generation_;
+          continue;
+        }
+      }
+      std::vector<std::pair<uint64_t, std::vector<float>>> items;
+      for (std::size_t i = 0; i < refs.size(); ++i) {
+        items.emplace_back(refs[i], std::move((*vecs)[i]));
+      }
+      if (!vectors_->append(items)) {
+        note_embed_failure_locked();
+        continue;
+      }
+      embed_failures_ = 0;
+      metrics().inc("memory.embedded", static_cast<uint64_t>(items.size()));
+    }
+  }
+
+  // Hash of the first and last kFingerprintSpan bytes of HISTORY.md's first `bytes`. A
+  // rewrite that keeps or grows the file size still changes it, and it costs two small reads.
+  uint64_t history_fingerprint_locked(uint64_t bytes) const {
+    std::ifstream in(history_file_, std::ios::in | std::ios::binary);
+    std::string buf(static_cast<std::size_t>((std::min)(bytes, kFingerprintSpan)), '\0');
+    in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    uint64_t h = fnv1a64(std::string_view(buf.data(), static_cast<std::size_t>(in.gcount())));
+    if (bytes > kFingerprintSpan) {
+      const uint64_t start = (std::max)(kFingerprintSpan, bytes - kFingerprintSpan);
+      buf.assign(static_cast<std::size_t>(bytes - start), '\0');
+      in.clear();
+      in.seekg(static_cast<std::streamoff>(start));
+      in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+      h = fnv1a64(std::string_view(buf.data(), static_cast<std::size_t>(in.gcount())), h);
+    }
+    return h;
+  }
+
+  void refresh_locked() {
+    std::error_code ec;
+    const bool history_exists = fs::exists(history_file_, ec);
+    const uint64_t history_size = history_exists ? fs::file_size(history_file_, ec) : 0;
+    const auto history_mtime = history_exists ? fs::last_write_time(history_file_, ec) : fs::file_time_type{};
+    if (!loaded_) {
+      loaded_ = true;
+      if (!load_locked()) {
+        history_.clear();
+        history_bytes_ = 0;
+        history_fp_ = 0;
+      }
+    }
+    // Appends leave the indexed prefix alone; anything else (truncation, or a rewrite of
+    // any size) changes its fingerprint. Only checked when the file was touched.
+    bool rewritten = history_size < history_bytes_;
+    if (!rewritten && history_bytes_ > 0 && history_mtime != history_mtime_) {
+      rewritten = history_fingerprint_locked(history_bytes_) != history_fp_;
+    }
+    history_mtime_ = history_mtime;
+    if (rewritten) {
+      history_.clear();  // start over
+      history_bytes_ = 0;
+      history_fp_ = 0;
+      if (vectors_) {
+        vectors_->reset();
+      } else {
+        fs::remove(vectors_file_, ec);
+      }
+      ++generation_;
+    }
+    if (history_size > history_bytes_) {
+      std::ifstream in(history_file_, std::ios::in | std::ios::binary);
+      std::string tail(static_cast<std::size_t>(history_size - history_bytes_), '\0');
+      in.seekg(static_cast<std::streamoff>(history_bytes_));
+      in.read(tail.data(), static_cast<std::streamsize>(tail.size()));
+      tail.resize(static_cast<std::size_t>(in.gcount()));
+      // append_history() ends every entry with a blank line; stop at the last one so a
+      // half-written entry is picked up complete next time.
+      const std::size_t complete = tail.rfind("\n\n");
+      if (complete != std::string::npos) {
+        tail.resize(complete + 2);
+        for (const auto& [off, len] : chunk(tail)) {
+          history_.add(history_bytes_ + off, std::string_view(tail).substr(off, len));
+          ++unsaved_docs_;
+        }
+        history_bytes_ += tail.size();
+        history_fp_ = history_fingerprint_locked(history_bytes_);
+        if (unsaved_docs_ >= kSaveEveryDocs) {
+          save_locked();
+        }
+      }
+    }
+
+    const auto mtime = fs::exists(memory_file_, ec) ? fs::last_write_time(memory_file_, ec) : fs::file_time_type{};
+    const uint64_t memory_size = fs::exists(memory_file_, ec) ? fs::file_size(memory_file_, ec) : 0;
+    if (mtime != memory_mtime_ || memory_size != memory_text_.size()) {
+      memory_mtime_ = mtime;
+      memory_text_ = read_text_file(memory_file_);
+      memory_.clear();
+      for (const auto& [off, len] : chunk(memory_text_)) {
+        memory_.add(off, std::string_view(memory_text_).substr(off, len));
+      }
+    }
+    schedule_embedding_locked();
+  }
+
+  static void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+      out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+      v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+  }
+
+  static bool get_varint(const std::string& in, std::size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+      const auto b = static_cast<unsigned char>(in[pos++]);
+      v |= static_cast<uint64_t>(b & 0x7F) << shift;
+      if ((b & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Layout: magic, history bytes indexed and their fingerprint, docs (offset, length,
+  // terms), then per term its bytes and doc-delta/tf postings, all as LEB128 varints.
+  void save_locked() {
+    // write_text_file would recreate a memory directory deleted under us; nothing to keep then.
+    std::error_code dir_ec;
+    if (!fs::is_directory(memory_dir_, dir_ec)) {
+      return;
+    }
+    std::string out(kMagic, sizeof(kMagic));
+    put_varint(out, history_bytes_);
+    put_varint(out, history_fp_);
+    put_varint(out, history_.docs.size());
+    for (const auto& d : history_.docs) {
+      put_varint(out, d.offset);
+      put_varint(out, d.length);
+      put_varint(out, d.terms);
+    }
+    put_varint(out, history_.postings.size());
+    for (const auto& [term, postings] : history_.postings) {
+      put_varint(out, term.size());
+      out += term;
+      put_varint(out, postings.size());
+      uint32_t prev = 0;
+      for (const auto& p : postings) {
+        put_varint(out, p.doc - prev);
+        put_varint(out, p.tf);
+        prev = p.doc;
+      }
+    }
+    const fs::path tmp = index_file_.string() + ".tmp";
+    if (write_text_file(tmp, out)) {
+      std::error_code ec;
+      fs::rename(tmp, index_file_, ec);
+      if (!ec) {
+        unsaved_docs_ = 0;
+      }
+    }
+  }
+
+  bool load_locked() {
+    const std::string in = read_text_file(index_file_);
+    if (in.size() < sizeof(kMagic) || in.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0) {
+      return false;
+    }
+    std::size_t pos = sizeof(kMagic);
+    uint64_t bytes = 0;
+    uint64_t fingerprint = 0;
+    uint64_t ndocs = 0;
+    if (!get_varint(in, pos, bytes) || !get_varint(in, pos, fingerprint) || !get_varint(in, pos, ndocs) ||
+        ndocs > in.size()) {
+      return false;
+    }
+    Segment seg;
+    seg.docs.reserve(static_cast<std::size_t>(ndocs));
+    for (uint64_t i = 0; i < ndocs; ++i) {
+      uint64_t off = 0;
+      uint64_t len = 0;
+      uint64_t terms = 0;
+      if (!get_varint(in, pos, off) || !get_varint(in, pos, len) || !get_varint(in, pos, terms)) {
+        return false;
+      }
+      seg.docs.push_back(Doc{off, static_cast<uint32_t>(len), static_cast<uint32_t>(terms)});
+      seg.total_terms += terms;
+    }
+    uint64_t nterms = 0;
+    if (!get_varint(in, pos, nterms)) {
+      return false;
+    }
+    for (uint64_t i = 0; i < nterms; ++i) {
+      uint64_t tlen = 0;
+      uint64_t npost = 0;
+      if (!get_varint(in, pos, tlen) || pos + tlen > in.size()) {
+        return false;
+      }
+      std::string term = in.substr(pos, static_cast<std::size_t>(tlen));
+      pos += static_cast<std::size_t>(tlen);
+      if (!get_varint(in, pos, npost) || npost > ndocs) {
+        return false;
+      }
+      auto& postings = seg.postings[term];
+      postings.reserve(static_cast<std::size_t>(npost));
+      uint64_t doc = 0;
+      for (uint64_t j = 0; j < npost; ++j) {
+        uint64_t delta = 0;
+        uint64_t tf = 0;
+        if (!get_varint(in, pos, delta) || !get_varint(in, pos, tf) || (doc += delta) >= ndocs) {
+          return false;
+        }
+        postings.push_back(Posting{static_cast<uint32_t>(doc), static_cast<uint32_t>(tf)});
+      }
+    }
+    history_ = std::move(seg);
+    history_bytes_ = bytes;
+    history_fp_ = fingerprint;
+    return true;
+  }
+
+  std::mutex mu_;
+  fs::path memory_dir_;
+  fs::path history_file_;
+  fs::path memory_file_;
+  fs::path index_file_;
+  fs::path vectors_file_;
+  bool loaded_{false};
+  uint64_t history_bytes_{0};
+  uint64_t history_fp_{0};  // history_fingerprint_locked(history_bytes_)
+  fs::file_time_type history_mtime_{};
+  std::size_t unsaved_docs_{0};  // indexed since index.bin was last written
+  Segment history_;
+  Segment memory_;
+  std::string memory_text_;
+  fs::file_time_type memory_mtime_{};
+  std::optional<Embedder> embedder_;
+  std::unique_ptr<VectorIndex> vectors_;
+  bool vectors_opened_{false};  // the worker has looked for vectors.bin for this embedder
+  uint64_t generation_{0};  // bumped whenever doc ids or vectors are invalidated
+  int embed_failures_{0};   // consecutive
+  std::chrono::steady_clock::time_point embed_retry_at_{};
+  bool stopping_{false};
+  std::condition_variable embed_cv_;  // wakes the backfill worker
+  std::condition_variable idle_cv_;   // backfill caught up or failed
+  std::thread embed_thread_;
+};
+
 class MemoryStore {
  public:
   explicit MemoryStore(const fs::path& workspace) : memory_dir_(workspace / "memory") {
@@ -11,6 +702,7 @@ class MemoryStore {
     fs::create_directories(memory_dir_, ec);
     memory_file_ = memory_dir_ / "MEMORY.md";
     history_file_ = memory_dir_ / "HISTORY.md";
+    index_ = MemoryIndex::for_dir(memory_dir_);
   }
 
   std::string read_long_term() const { return read_text_file(memory_file_); }
@@ -39,6 +731,23 @@ class MemoryStore {
     return "## Long-term Memory\n" + data;
   }
 
+  std::vector<MemoryHit> search(const std::string& query, std::size_t k) const { return index_->search(query, k); }
+
+  // Top-k memory and history passages for `query`, used in place of the full MEMORY.md so
+  // the prompt stays the same size however much has been remembered.
+  std::string relevant_context(const std::string& query, std::size_t k) const {
+    const auto hits = search(query, k);
+    if (hits.empty()) {
+      return "";
+    }
+    std::ostringstream ss;
+    ss << "## Relevant Memory\n";
+    for (const auto& h : hits) {
+      ss << "\n[" << h.source << "]\n" << h.text << "\n";
+    }
+    return ss.str();
+  }
+
   fs::path memory_file() const { return memory_file_; }
   fs::path history_file() const { return history_file_; }
 
@@ -46,7 +755,7 @@ class MemoryStore {
   fs::path memory_dir_;
   fs::path memory_file_;
   fs::path history_file_;
+  std::shared_ptr<MemoryIndex> index_;
 };
 
 }  // namespace attoclaw
-
@@ -105,8 +105,7 @@ class MessageBus {
           try {
             cb(msg);
           } catch (const std::exception& e) {
-            Logger::log(Logger::Level::kError,
-                        "Outbound dispatch failed for channel " + msg.channel + ": " + e.what());
+            ATTOCLAW_LOG_ERROR("Outbound dispatch failed for channel " + msg.channel + ": " + e.what());
           }
         }
       }
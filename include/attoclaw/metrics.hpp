@@ -1,7 +1,15 @@
 ﻿#pragma once
 
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <map>
 #include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "attoclaw/common.hpp"
@@ -15,19 +23,115 @@ class Metrics {
     counters_[key] += delta;
   }
 
+  // Records one sample for a summary (count + sum), e.g. a latency in seconds.
+  void observe(const std::string& key, double value) {
+    std::lock_guard<std::mutex> lock(mu_);
+    Summary& s = summaries_[key];
+    ++s.count;
+    s.sum += value;
+  }
+
   json to_json() const {
     std::lock_guard<std::mutex> lock(mu_);
     json j = json::object();
     for (const auto& kv : counters_) {
       j[kv.first] = kv.second;
     }
+    if (!summaries_.empty()) {
+      json& sj = j["summaries"];
+      for (const auto& kv : summaries_) {
+        sj[kv.first] = {{"count", kv.second.count}, {"sum", kv.second.sum}};
+      }
+    }
     j["updatedAt"] = now_iso8601();
     return j;
   }
 
+  // OpenMetrics text exposition (application/openmetrics-text; version=1.0.0).
+  // Every counter key becomes its own family: "inbound.channel.telegram" ->
+  // attoclaw_inbound_channel_telegram_total. Summaries render as <family>_count/_sum, or
+  // <family>_summary_count/_sum when a counter already owns the family name. Keys that
+  // normalise to an already-used name ("a.b" vs "a_b", "x" vs "x_total") get a numeric
+  // suffix (_2, _3, ...) in key order instead of being merged into one series.
+  std::string to_openmetrics() const {
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, Summary> summaries;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      counters.insert(counters_.begin(), counters_.end());
+      summaries.insert(summaries_.begin(), summaries_.end());
+    }
+
+    std::set<std::string> used{std::string(kStartTimeFamily)};
+    const auto claim = [&used](std::string name) {
+      if (used.insert(name).second) {
+        return name;
+      }
+      for (int n = 2;; ++n) {
+        std::string candidate = name + "_" + std::to_string(n);
+        if (used.insert(candidate).second) {
+          return candidate;
+        }
+      }
+    };
+
+    std::ostringstream out;
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+    std::set<std::string> counter_families;
+    for (const auto& kv : counters) {
+      const std::string name = claim(openmetrics_family_name(kv.first));
+      counter_families.insert(name);
+      out << "# TYPE " << name << " counter\n";
+      out << name << "_total " << kv.second << "\n";
+    }
+    for (const auto& kv : summaries) {
+      std::string base = openmetrics_family_name(kv.first);
+      if (counter_families.count(base) > 0) {
+        base += "_summary";
+      }
+      const std::string name = claim(base);
+      out << "# TYPE " << name << " summary\n";
+      out << name << "_count " << kv.second.count << "\n";
+      out << name << "_sum " << kv.second.sum << "\n";
+    }
+    out << "# TYPE " << kStartTimeFamily << " gauge\n";
+    out << "# UNIT " << kStartTimeFamily << " seconds\n";
+    out << kStartTimeFamily << " " << start_time_seconds_ << "\n";
+    out << "# EOF\n";
+    return out.str();
+  }
+
+  static std::string openmetrics_family_name(const std::string& key) {
+    static constexpr std::string_view kPrefix = "attoclaw_";
+    static constexpr std::string_view kTotal = "_total";
+    std::string name(kPrefix);
+    name.reserve(name.size() + key.size());
+    for (unsigned char c : key) {
+      name.push_back(std::isalnum(c) ? static_cast<char>(std::tolower(c)) : '_');
+    }
+    // Counter families must not carry the _total suffix themselves; a bare "total" key
+    // keeps it so the family name is not just the prefix.
+    if (name.size() > kPrefix.size() + kTotal.size() &&
+        name.compare(name.size() - kTotal.size(), kTotal.size(), kTotal) == 0) {
+      name.resize(name.size() - kTotal.size());
+    }
+    return name;
+  }
+
  private:
+  static constexpr std::string_view kStartTimeFamily = "attoclaw_process_start_time_seconds";
+
+  struct Summary {
+    uint64_t count{0};
+    double sum{0.0};
+  };
+
   mutable std::mutex mu_;
   std::unordered_map<std::string, uint64_t> counters_;
+  std::unordered_map<std::string, Summary> summaries_;
+  long long start_time_seconds_{std::chrono::duration_cast<std::chrono::seconds>(
+                                    std::chrono::system_clock::now().time_since_epoch())
+                                    .count()};
 };
 
 inline Metrics& metrics() {
@@ -0,0 +1,224 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/metrics.hpp"
+
+namespace attoclaw {
+
+// Minimal scrape endpoint for the gateway. Serves:
+//   GET /metrics  -> OpenMetrics text rendered from the live Metrics registry
+//   GET /healthz  -> "ok"
+// Requests are handled one at a time on a single thread; scrapes are rare and tiny.
+class MetricsServer {
+ public:
+  MetricsServer(std::string host, int port) : host_(std::move(host)), port_(port) {}
+  ~MetricsServer() { stop(); }
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+  bool start() {
+    if (running_.load()) {
+      return true;
+    }
+#ifdef _WIN32
+    WSADATA wsa{};
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+      ATTOCLAW_LOG_WARN("Metrics server: WSAStartup failed");
+      return false;
+    }
+    wsa_started_ = true;
+#endif
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* res = nullptr;
+    const std::string port_str = std::to_string(port_);
+    if (getaddrinfo(host_.empty() ? nullptr : host_.c_str(), port_str.c_str(), &hints, &res) != 0 || !res) {
+      ATTOCLAW_LOG_WARN("Metrics server: cannot resolve " + host_);
+      return false;
+    }
+
+    for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+      SocketHandle fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd == kInvalidSocket) {
+        continue;
+      }
+      int yes = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+      if (::bind(fd, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0 && ::listen(fd, 16) == 0) {
+        listen_fd_ = fd;
+        break;
+      }
+      close_socket(fd);
+    }
+    freeaddrinfo(res);
+
+    if (listen_fd_ == kInvalidSocket) {
+      ATTOCLAW_LOG_WARN("Metrics server: cannot listen on " + host_ + ":" + std::to_string(port_));
+      return false;
+    }
+
+    running_.store(true);
+    thread_ = std::thread([this]() { serve_loop(); });
+    ATTOCLAW_LOG_INFO("Metrics endpoint listening on http://" + host_ + ":" + std::to_string(port_) + "/metrics");
+    return true;
+  }
+
+  void stop() {
+    running_.store(false);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (listen_fd_ != kInvalidSocket) {
+      close_socket(listen_fd_);
+      listen_fd_ = kInvalidSocket;
+    }
+#ifdef _WIN32
+    if (wsa_started_) {
+      WSACleanup();
+      wsa_started_ = false;
+    }
+#endif
+  }
+
+ private:
+#ifdef _WIN32
+  using SocketHandle = SOCKET;
+  static constexpr SocketHandle kInvalidSocket = INVALID_SOCKET;
+  static void close_socket(SocketHandle fd) { closesocket(fd); }
+  static int poll_fds(pollfd* fds, unsigned long n, int timeout_ms) { return WSAPoll(fds, n, timeout_ms); }
+#else
+  using SocketHandle = int;
+  static constexpr SocketHandle kInvalidSocket = -1;
+  static void close_socket(SocketHandle fd) { ::close(fd); }
+  static int poll_fds(pollfd* fds, nfds_t n, int timeout_ms) { return ::poll(fds, n, timeout_ms); }
+#endif
+
+  void serve_loop() {
+    while (running_.load()) {
+      pollfd pfd{};
+      pfd.fd = listen_fd_;
+      pfd.events = POLLIN;
+      // Short timeout so stop() is honored promptly without needing a wakeup socket.
+      const int rc = poll_fds(&pfd, 1, 250);
+      if (rc <= 0 || !(pfd.revents & POLLIN)) {
+        continue;
+      }
+      SocketHandle client = ::accept(listen_fd_, nullptr, nullptr);
+      if (client == kInvalidSocket) {
+        continue;
+      }
+      handle_client(client);
+      close_socket(client);
+    }
+  }
+
+  static void set_io_timeout(SocketHandle fd, int ms) {
+#ifdef _WIN32
+    DWORD tv = static_cast<DWORD>(ms);
+#else
+    timeval tv{};
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+#endif
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+  }
+
+  static void send_all(SocketHandle fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+      const auto n = ::send(fd, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+      if (n <= 0) {
+        return;
+      }
+      sent += static_cast<std::size_t>(n);
+    }
+  }
+
+  static void respond(SocketHandle fd, const std::string& status, const std::string& content_type,
+                      const std::string& body, bool head_only) {
+    std::string out = "HTTP/1.1 " + status + "\r\n";
+    out += "Content-Type: " + content_type + "\r\n";
+    out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    out += "Connection: close\r\n\r\n";
+    if (!head_only) {
+      out += body;
+    }
+    send_all(fd, out);
+  }
+
+  static void handle_client(SocketHandle fd) {
+    set_io_timeout(fd, 2000);
+
+    // Only the request line matters; read until the end of headers or 8 KB.
+    std::string req;
+    char buf[1024];
+    while (req.size() < 8192 && req.find("\r\n\r\n") == std::string::npos) {
+      const auto n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        break;
+      }
+      req.append(buf, static_cast<std::size_t>(n));
+    }
+
+    const auto line_end = req.find("\r\n");
+    if (line_end == std::string::npos) {
+      respond(fd, "400 Bad Request", "text/plain; charset=utf-8", "bad request\n", false);
+      return;
+    }
+    std::istringstream line(req.substr(0, line_end));
+    std::string method;
+    std::string target;
+    line >> method >> target;
+    const auto q = target.find('?');
+    const std::string path = q == std::string::npos ? target : target.substr(0, q);
+
+    if (method != "GET" && method != "HEAD") {
+      respond(fd, "405 Method Not Allowed", "text/plain; charset=utf-8", "method not allowed\n", false);
+      return;
+    }
+    const bool head_only = method == "HEAD";
+
+    if (path == "/metrics") {
+      respond(fd, "200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8",
+              metrics().to_openmetrics(), head_only);
+    } else if (path == "/healthz") {
+      respond(fd, "200 OK", "text/plain; charset=utf-8", "ok\n", head_only);
+    } else {
+      respond(fd, "404 Not Found", "text/plain; charset=utf-8", "not found\n", head_only);
+    }
+  }
+
+  std::string host_;
+  int port_{0};
+  std::atomic<bool> running_{false};
+  SocketHandle listen_fd_{kInvalidSocket};
+  std::thread thread_;
+#ifdef _WIN32
+  bool wsa_started_{false};
+#endif
+};
+
+}  // namespace attoclaw
@@ -0,0 +1,386 @@
+﻿#pragma once
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+// Native Linux backend for system_inspect: reads /proc and statvfs directly and returns
+// JSON, so an inspection is a few syscalls instead of forking ps/df/ss. Results are cached
+// for kTtl, which makes the repeated polls of heartbeat tasks nearly free. Thread-safe.
+class ProcfsInspector {
+ public:
+  static ProcfsInspector& instance() {
+    static ProcfsInspector inspector;
+    return inspector;
+  }
+
+  // nullopt when the action has no native implementation (the caller falls back to a shell).
+  std::optional<json> inspect(const std::string& action, int limit, const std::string& sort) {
+    if (action != "processes" && action != "memory" && action != "disks" && action != "network" &&
+        action != "uptime") {
+      return std::nullopt;
+    }
+    const std::string key = action + "|" + std::to_string(limit) + "|" + sort;
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = cache_.find(key);
+    if (it != cache_.end() && now - it->second.at < kTtl) {
+      return it->second.value;
+    }
+    json value;
+    if (action == "processes") {
+      value = processes(limit, sort, now);
+    } else if (action == "memory") {
+      value = memory();
+    } else if (action == "disks") {
+      value = disks();
+    } else if (action == "network") {
+      value = network(limit);
+    } else {
+      value = uptime();
+    }
+    cache_[key] = Cached{now, value};
+    return value;
+  }
+
+  // Reads a small /proc file in one read(2) into `buf`; returns the bytes read.
+  static std::string_view read_proc(const char* path, char* buf, std::size_t cap) {
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return {};
+    }
+    const ssize_t n = ::read(fd, buf, cap);
+    ::close(fd);
+    return n > 0 ? std::string_view(buf, static_cast<std::size_t>(n)) : std::string_view();
+  }
+
+  // "MemTotal:  16314336 kB" -> bytes, for every line of /proc/meminfo.
+  static std::unordered_map<std::string, uint64_t> meminfo() {
+    std::unordered_map<std::string, uint64_t> out;
+    char buf[8192];
+    std::string_view text = read_proc("/proc/meminfo", buf, sizeof(buf));
+    while (!text.empty()) {
+      const std::size_t nl = text.find('\n');
+      const std::string_view line = text.substr(0, nl);
+      const std::size_t colon = line.find(':');
+      if (colon != std::string_view::npos) {
+        const uint64_t v = std::strtoull(std::string(line.substr(colon + 1)).c_str(), nullptr, 10);
+        out[std::string(line.substr(0, colon))] = line.find("kB") != std::string_view::npos ? v * 1024 : v;
+      }
+      text = nl == std::string_view::npos ? std::string_view() : text.substr(nl + 1);
+    }
+    return out;
+  }
+
+  // The fields of /proc/<pid>/stat that the process list uses.
+  struct ProcStat {
+    int ppid{0};
+    std::string name;
+    char state{'?'};
+    uint64_t ticks{0};        // utime + stime
+    uint64_t start_ticks{0};  // since boot
+    uint64_t rss_pages{0};
+  };
+
+  static std::optional<ProcStat> read_stat(int pid) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    char buf[1024];
+    const std::string_view stat = read_proc(path, buf, sizeof(buf) - 1);
+    // pid (comm) state ppid ... ; comm may contain spaces and ')', so split at the last ')'.
+    const std::size_t open = stat.find('(');
+    const std::size_t close = stat.rfind(')');
+    if (open == std::string_view::npos || close == std::string_view::npos || close + 2 >= stat.size()) {
+      return std::nullopt;
+    }
+    std::vector<std::string_view> f;  // f[0] = state (field 3)
+    std::string_view rest = stat.substr(close + 2);
+    while (!rest.empty() && f.size() < 22) {
+      const std::size_t sp = rest.find(' ');
+      f.push_back(rest.substr(0, sp));
+      rest = sp == std::string_view::npos ? std::string_view() : rest.substr(sp + 1);
+    }
+    if (f.size() < 22) {
+      return std::nullopt;
+    }
+    auto num = [](std::string_view s) { return std::strtoull(std::string(s).c_str(), nullptr, 10); };
+    ProcStat st;
+    st.ppid = static_cast<int>(num(f[1]));
+    st.name = std::string(stat.substr(open + 1, close - open - 1));
+    st.state = f[0].empty() ? '?' : f[0][0];
+    st.ticks = num(f[11]) + num(f[12]);
+    st.start_ticks = num(f[19]);
+    st.rss_pages = num(f[21]);
+    return st;
+  }
+
+  // "0100007F:1F90" (little-endian IPv4) or the 32-hex-digit IPv6 form -> "127.0.0.1:8080".
+  static std::string decode_address(std::string_view hex) {
+    const std::size_t colon = hex.find(':');
+    if (colon == std::string_view::npos) {
+      return std::string(hex);
+    }
+    const std::string addr_hex(hex.substr(0, colon));
+    const std::string port_hex(hex.substr(colon + 1));
+    const unsigned port = static_cast<unsigned>(std::strtoul(port_hex.c_str(), nullptr, 16));
+    char text[INET6_ADDRSTRLEN] = "?";
+    if (addr_hex.size() == 8) {
+      in_addr a{};
+      a.s_addr = static_cast<uint32_t>(std::strtoul(addr_hex.c_str(), nullptr, 16));
+      inet_ntop(AF_INET, &a, text, sizeof(text));
+      return std::string(text) + ":" + std::to_string(port);
+    }
+    if (addr_hex.size() == 32) {
+      in6_addr a{};
+      for (int word = 0; word < 4; ++word) {
+        const uint32_t w = static_cast<uint32_t>(std::strtoul(addr_hex.substr(word * 8, 8).c_str(), nullptr, 16));
+        std::memcpy(a.s6_addr + word * 4, &w, 4);
+      }
+      inet_ntop(AF_INET6, &a, text, sizeof(text));
+      return "[" + std::string(text) + "]:" + std::to_string(port);
+    }
+    return std::string(hex);
+  }
+
+ private:
+  static constexpr std::chrono::milliseconds kTtl{1000};
+
+  struct Cached {
+    std::chrono::steady_clock::time_point at;
+    json value;
+  };
+
+  struct CpuSample {
+    uint64_t ticks{0};
+  };
+
+  json processes(int limit, const std::string& sort, std::chrono::steady_clock::time_point now) {
+    const double hz = static_cast<double>(::sysconf(_SC_CLK_TCK));
+    const double page = static_cast<double>(::sysconf(_SC_PAGESIZE));
+    const double mem_total = static_cast<double>(meminfo()["MemTotal"]);
+    char buf[1024];
+    const double uptime_s = std::strtod(std::string(read_proc("/proc/uptime", buf, sizeof(buf))).c_str(), nullptr);
+    const double since_last =
+        have_sample_ ? std::chrono::duration<double>(now - last_sample_at_).count() : 0.0;
+
+    struct Row {
+      int pid;
+      int ppid;
+      std::string name;
+      char state;
+      double cpu;
+      uint64_t rss;
+    };
+    std::vector<Row> rows;
+    std::unordered_map<int, CpuSample> sample;
+    DIR* dir = ::opendir("/proc");
+    if (!dir) {
+      return json{{"error", "cannot read /proc"}};
+    }
+    while (dirent* e = ::readdir(dir)) {
+      if (e->d_name[0] < '0' || e->d_name[0] > '9') {
+        continue;
+      }
+      const int pid = std::atoi(e->d_name);
+      const std::optional<ProcStat> st = read_stat(pid);
+      if (!st) {
+        continue;
+      }
+      Row r;
+      r.pid = pid;
+      r.ppid = st->ppid;
+      r.name = st->name;
+      r.state = st->state;
+      r.rss = st->rss_pages * static_cast<uint64_t>(page);
+      sample[r.pid] = CpuSample{st->ticks};
+      auto prev = last_sample_.find(r.pid);
+      if (since_last > 0.05 && prev != last_sample_.end() && prev->second.ticks <= st->ticks) {
+        r.cpu = 100.0 * static_cast<double>(st->ticks - prev->second.ticks) / hz / since_last;
+      } else {
+        // First sight of this process: lifetime average, as ps reports it.
+        const double age = uptime_s - static_cast<double>(st->start_ticks) / hz;
+        r.cpu = age > 0 ? 100.0 * static_cast<double>(st->ticks) / hz / age : 0.0;
+      }
+      rows.push_back(std::move(r));
+    }
+    ::closedir(dir);
+    last_sample_ = std::move(sample);
+    last_sample_at_ = now;
+    have_sample_ = true;
+
+    auto by = [&sort](const Row& a, const Row& b) {
+      if (sort == "memory") {
+        return a.rss > b.rss;
+      }
+      if (sort == "pid") {
+        return a.pid < b.pid;
+      }
+      return a.cpu != b.cpu ? a.cpu > b.cpu : a.rss > b.rss;
+    };
+    const std::size_t top = (std::min)(rows.size(), static_cast<std::size_t>(limit));
+    std::partial_sort(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(top), rows.end(), by);
+    json list = json::array();
+    for (std::size_t i = 0; i < top; ++i) {
+      const Row& r = rows[i];
+      const double mem = mem_total > 0 ? static_cast<double>(r.rss) / mem_total : 0.0;
+      list.push_back({{"pid", r.pid},
+                      {"ppid", r.ppid},
+                      {"name", r.name},
+                      {"state", std::string(1, r.state)},
+                      {"cpuPercent", std::round(r.cpu * 10) / 10},
+                      {"rssBytes", r.rss},
+                      {"memPercent", std::round(mem * 1000) / 10}});
+    }
+    return json{{"total", rows.size()}, {"sortedBy", sort}, {"processes", list}};
+  }
+
+  static json memory() {
+    auto m = meminfo();
+    return json{{"totalBytes", m["MemTotal"]},
+                {"availableBytes", m["MemAvailable"]},
+                {"freeBytes", m["MemFree"]},
+                {"buffersBytes", m["Buffers"]},
+                {"cachedBytes", m["Cached"]},
+                {"swapTotalBytes", m["SwapTotal"]},
+                {"swapFreeBytes", m["SwapFree"]}};
+  }
+
+  static json disks() {
+    static const char* const kVirtual[] = {"proc",     "sysfs",  "devpts",  "cgroup",    "cgroup2", "mqueue",
+                                           "securityfs", "pstore", "debugfs", "tracefs", "bpf",     "fusectl",
+                                           "configfs", "autofs", "binfmt_misc", "hugetlbfs", "nsfs", "devtmpfs",
+                                           "rpc_pipefs", "selinuxfs", "efivarfs"};
+    json list = json::array();
+    std::FILE* f = std::fopen("/proc/self/mounts", "r");
+    if (!f) {
+      return list;
+    }
+    char line[4096];
+    std::vector<std::string> seen;
+    while (std::fgets(line, sizeof(line), f)) {
+      char dev[1024];
+      char mnt[1024];
+      char type[128];
+      if (std::sscanf(line, "%1023s %1023s %127s", dev, mnt, type) != 3) {
+        continue;
+      }
+      const bool is_virtual = std::any_of(std::begin(kVirtual), std::end(kVirtual),
+                                          [&](const char* v) { return std::strcmp(v, type) == 0; });
+      if (is_virtual || std::find(seen.begin(), seen.end(), mnt) != seen.end()) {
+        continue;
+      }
+      struct statvfs st {};
+      if (::statvfs(mnt, &st) != 0 || st.f_blocks == 0) {
+        continue;
+      }
+      seen.emplace_back(mnt);
+      const uint64_t size = static_cast<uint64_t>(st.f_blocks) * st.f_frsize;
+      const uint64_t avail = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+      const uint64_t used = size - static_cast<uint64_t>(st.f_bfree) * st.f_frsize;
+      // Same basis as df: share of the space available to unprivileged users.
+      const double use = used + avail > 0 ? static_cast<double>(used) / static_cast<double>(used + avail) : 0.0;
+      list.push_back({{"mount", mnt},
+                      {"device", dev},
+                      {"type", type},
+                      {"sizeBytes", size},
+                      {"usedBytes", used},
+                      {"availableBytes", avail},
+                      {"usePercent", std::round(use * 1000) / 10}});
+    }
+    std::fclose(f);
+    return list;
+  }
+
+  static json network(int limit) {
+    static const char* const kStates[] = {"?",         "ESTABLISHED", "SYN_SENT", "SYN_RECV", "FIN_WAIT1", "FIN_WAIT2",
+                                          "TIME_WAIT", "CLOSE",       "CLOSE_WAIT", "LAST_ACK", "LISTEN",  "CLOSING"};
+    json listening = json::array();
+    json other = json::array();
+    std::size_t total = 0;
+    for (const char* path : {"/proc/net/tcp", "/proc/net/tcp6"}) {
+      std::FILE* f = std::fopen(path, "r");
+      if (!f) {
+        continue;
+      }
+      char line[512];
+      bool header = true;
+      while (std::fgets(line, sizeof(line), f)) {
+        if (header) {
+          header = false;
+          continue;
+        }
+        char local[64];
+        char remote[64];
+        unsigned state = 0;
+        if (std::sscanf(line, "%*s %63s %63s %x", local, remote, &state) != 3) {
+          continue;
+        }
+        ++total;
+        json row = {{"local", decode_address(local)},
+                    {"remote", decode_address(remote)},
+                    {"state", state < std::size(kStates) ? kStates[state] : "?"}};
+        (state == 10 ? listening : other).push_back(std::move(row));
+      }
+      std::fclose(f);
+    }
+    // Listening sockets first: they are what "what is running here" questions are about.
+    json list = json::array();
+    for (json* bucket : {&listening, &other}) {
+      for (auto& r : *bucket) {
+        if (static_cast<int>(list.size()) >= limit) {
+          break;
+        }
+        list.push_back(std::move(r));
+      }
+    }
+    return json{{"total", total}, {"connections", list}};
+  }
+
+  static json uptime() {
+    char buf[256];
+    const std::string up(read_proc("/proc/uptime", buf, sizeof(buf)));
+    const std::string load(read_proc("/proc/loadavg", buf, sizeof(buf)));
+    double l1 = 0;
+    double l5 = 0;
+    double l15 = 0;
+    std::sscanf(load.c_str(), "%lf %lf %lf", &l1, &l5, &l15);
+    return json{{"uptimeSeconds", std::strtod(up.c_str(), nullptr)},
+                {"load1", l1},
+                {"load5", l5},
+                {"load15", l15},
+                {"cpus", ::sysconf(_SC_NPROCESSORS_ONLN)}};
+  }
+
+  std::mutex mu_;
+  std::map<std::string, Cached> cache_;
+  std::unordered_map<int, CpuSample> last_sample_;
+  std::chrono::steady_clock::time_point last_sample_at_{};
+  bool have_sample_{false};
+};
+
+}  // namespace attoclaw
+
+#endif  // __linux__
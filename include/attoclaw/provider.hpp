@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <map>
+#include <optional>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -45,6 +46,14 @@ class LLMProvider {
     return r;
   }
 
+  // Optional OpenAI-style /embeddings call; nullopt when unsupported or on error.
+  virtual std::optional<std::vector<std::vector<float>>> embed(const std::vector<std::string>& inputs,
+                                                               const std::string& model) {
+    (void)inputs;
+    (void)model;
+    return std::nullopt;
+  }
+
   virtual std::string get_default_model() const = 0;
 };
 
@@ -59,6 +68,43 @@ class OpenAICompatibleProvider : public LLMProvider {
 
   std::string get_default_model() const override { return default_model_; }
 
+  std::optional<std::vector<std::vector<float>>> embed(const std::vector<std::string>& inputs,
+                                                       const std::string& model) override {
+    if (api_key_.empty() || inputs.empty()) {
+      return std::nullopt;
+    }
+    const json payload = {{"model", model}, {"input", inputs}};
+    const std::map<std::string, std::string> headers = {
+        {"Authorization", "Bearer " + api_key_},
+        {"Content-Type", "application/json"},
+    };
+    thread_local HttpClient client;
+    HttpResponse resp = client.post(api_base_ + "/embeddings", payload.dump(), headers, 60, true, 5);
+    if (!resp.error.empty() || resp.status < 200 || resp.status >= 300) {
+      ATTOCLAW_LOG_WARN("Embeddings request failed: " +
+                        (!resp.error.empty() ? resp.error : ("HTTP " + std::to_string(resp.status))));
+      return std::nullopt;
+    }
+    try {
+      const json data = json::parse(resp.body);
+      std::vector<std::vector<float>> out(inputs.size());
+      for (const auto& item : data.at("data")) {
+        const std::size_t index = item.value("index", std::size_t{0});
+        if (index < out.size()) {
+          out[index] = item.at("embedding").get<std::vector<float>>();
+        }
+      }
+      for (const auto& v : out) {
+        if (v.empty()) {
+          return std::nullopt;
+        }
+      }
+      return out;
+    } catch (...) {
+      return std::nullopt;
+    }
+  }
+
   LLMResponse chat(const json& messages, const json& tools, const std::string& model,
                    int max_tokens, double temperature, double top_p) override {
     LLMResponse out;
@@ -0,0 +1,285 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+// A tool's JSON-Schema parameters compiled once into a flat node table, so validating a
+// call is a walk over type tags, sorted property tables and required-key bitmaps instead
+// of re-reading (and re-building) the schema. Nothing is allocated unless a check fails.
+//
+// Supports the subset tools use: type, enum, properties, required, items, minimum, maximum.
+class SchemaValidator {
+ public:
+  SchemaValidator() = default;
+  explicit SchemaValidator(const json& schema) { compile(schema); }
+
+  // Appends one message per violation; an empty result means `value` is valid.
+  std::vector<std::string> validate(const json& value) const {
+    std::vector<std::string> errors;
+    if (!nodes_.empty()) {
+      check(0, value, Path{nullptr, "parameter", kNoIndex}, &errors);
+    }
+    return errors;
+  }
+
+  bool valid(const json& value) const {
+    if (nodes_.empty()) {
+      return true;
+    }
+    return check(0, value, Path{nullptr, "parameter", kNoIndex}, nullptr);
+  }
+
+ private:
+  enum class Type : uint8_t { kAny, kString, kInteger, kNumber, kBoolean, kArray, kObject };
+
+  static constexpr uint32_t kNone = UINT32_MAX;
+  static constexpr std::size_t kNoIndex = SIZE_MAX;
+  static constexpr std::size_t kMaskBits = 64;
+
+  struct Property {
+    std::string key;
+    uint32_t node{kNone};
+  };
+
+  struct Node {
+    Type type{Type::kAny};
+    std::string type_name;
+    bool has_min{false};
+    bool has_max{false};
+    double min{0};
+    double max{0};
+    std::string min_text;
+    std::string max_text;
+    std::vector<std::string> string_enum;  // sorted
+    std::vector<json> other_enum;
+    bool has_enum{false};
+    std::vector<Property> properties;  // sorted by key
+    uint64_t required_mask{0};         // bit i: properties[i] is required (first 64 properties)
+    std::vector<std::string> required_other;
+    uint32_t items{kNone};
+  };
+
+  // Label of the value being checked, rendered only when reporting an error.
+  struct Path {
+    const Path* parent;
+    std::string_view key;
+    std::size_t index;
+  };
+
+  static std::string render(const Path& p) {
+    std::string out = p.parent ? render(*p.parent) : std::string();
+    if (p.index != kNoIndex) {
+      out += "[" + std::to_string(p.index) + "]";
+    } else {
+      out += p.parent ? "." + std::string(p.key) : std::string(p.key);
+    }
+    return out;
+  }
+
+  static Type parse_type(const std::string& t) {
+    if (t == "string") {
+      return Type::kString;
+    }
+    if (t == "integer") {
+      return Type::kInteger;
+    }
+    if (t == "number") {
+      return Type::kNumber;
+    }
+    if (t == "boolean") {
+      return Type::kBoolean;
+    }
+    if (t == "array") {
+      return Type::kArray;
+    }
+    if (t == "object") {
+      return Type::kObject;
+    }
+    return Type::kAny;
+  }
+
+  uint32_t compile(const json& schema) {
+    const uint32_t id = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+    if (!schema.is_object()) {
+      return id;
+    }
+    Node n;
+    if (schema.contains("type") && schema["type"].is_string()) {
+      n.type_name = schema["type"].get<std::string>();
+      n.type = parse_type(n.type_name);
+    }
+    if (schema.contains("enum") && schema["enum"].is_array()) {
+      n.has_enum = true;
+      for (const auto& e : schema["enum"]) {
+        if (e.is_string()) {
+          n.string_enum.push_back(e.get<std::string>());
+        } else {
+          n.other_enum.push_back(e);
+        }
+      }
+      std::sort(n.string_enum.begin(), n.string_enum.end());
+    }
+    if (schema.contains("minimum") && schema["minimum"].is_number()) {
+      n.has_min = true;
+      n.min = schema["minimum"].get<double>();
+      n.min_text = schema["minimum"].dump();
+    }
+    if (schema.contains("maximum") && schema["maximum"].is_number()) {
+      n.has_max = true;
+      n.max = schema["maximum"].get<double>();
+      n.max_text = schema["maximum"].dump();
+    }
+    if (n.type == Type::kObject) {
+      if (schema.contains("properties") && schema["properties"].is_object()) {
+        for (auto it = schema["properties"].begin(); it != schema["properties"].end(); ++it) {
+          n.properties.push_back(Property{it.key(), compile(it.value())});
+        }
+        std::sort(n.properties.begin(), n.properties.end(),
+                  [](const Property& a, const Property& b) { return a.key < b.key; });
+      }
+      if (schema.contains("required") && schema["required"].is_array()) {
+        for (const auto& req : schema["required"]) {
+          if (!req.is_string()) {
+            continue;
+          }
+          const std::string key = req.get<std::string>();
+          const std::size_t i = find(n.properties, key);
+          if (i < kMaskBits) {
+            n.required_mask |= uint64_t{1} << i;
+          } else {
+            n.required_other.push_back(key);
+          }
+        }
+      }
+    }
+    if (n.type == Type::kArray && schema.contains("items")) {
+      n.items = compile(schema["items"]);
+    }
+    nodes_[id] = std::move(n);
+    return id;
+  }
+
+  static std::size_t find(const std::vector<Property>& props, std::string_view key) {
+    auto it = std::lower_bound(props.begin(), props.end(), key,
+                               [](const Property& p, std::string_view k) { return std::string_view(p.key) < k; });
+    return it != props.end() && it->key == key ? static_cast<std::size_t>(it - props.begin()) : kNoIndex;
+  }
+
+  static bool type_ok(Type type, const json& value) {
+    switch (type) {
+      case Type::kString:
+        return value.is_string();
+      case Type::kInteger:
+        return value.is_number_integer();
+      case Type::kNumber:
+        return value.is_number();
+      case Type::kBoolean:
+        return value.is_boolean();
+      case Type::kArray:
+        return value.is_array();
+      case Type::kObject:
+        return value.is_object();
+      case Type::kAny:
+        break;
+    }
+    return true;
+  }
+
+  static bool enum_ok(const Node& n, const json& value) {
+    if (value.is_string()) {
+      const std::string& s = value.get_ref<const std::string&>();
+      return std::binary_search(n.string_enum.begin(), n.string_enum.end(), s);
+    }
+    return std::find(n.other_enum.begin(), n.other_enum.end(), value) != n.other_enum.end();
+  }
+
+  // With `errors` null the walk stops at the first violation. Returns true if valid.
+  bool check(uint32_t id, const json& value, const Path& path, std::vector<std::string>* errors) const {
+    const Node& n = nodes_[id];
+    if (!type_ok(n.type, value)) {
+      report(errors, [&]() { return render(path) + " should be " + n.type_name; });
+      return false;
+    }
+
+    bool ok = true;
+    if (n.has_enum && !enum_ok(n, value)) {
+      report(errors, [&]() { return render(path) + " has invalid enum value"; });
+      ok = false;
+    }
+    if ((n.has_min || n.has_max) && value.is_number()) {
+      const double v = value.get<double>();
+      if (n.has_min && v < n.min) {
+        report(errors, [&]() { return render(path) + " must be >= " + n.min_text; });
+        ok = false;
+      }
+      if (n.has_max && v > n.max) {
+        report(errors, [&]() { return render(path) + " must be <= " + n.max_text; });
+        ok = false;
+      }
+    }
+
+    if (n.type == Type::kObject) {
+      uint64_t seen = 0;
+      for (auto it = value.begin(); it != value.end(); ++it) {
+        const std::size_t i = find(n.properties, it.key());
+        if (i == kNoIndex) {
+          continue;
+        }
+        if (i < kMaskBits) {
+          seen |= uint64_t{1} << i;
+        }
+        ok = check(n.properties[i].node, it.value(), Path{&path, n.properties[i].key, kNoIndex}, errors) && ok;
+        if (!ok && !errors) {
+          return false;
+        }
+      }
+      const uint64_t missing = n.required_mask & ~seen;
+      if (missing != 0) {
+        for (std::size_t i = 0; i < kMaskBits && i < n.properties.size(); ++i) {
+          if ((missing >> i) & 1U) {
+            report(errors, [&]() { return "missing required " + render(path) + "." + n.properties[i].key; });
+          }
+        }
+        ok = false;
+      }
+      for (const auto& key : n.required_other) {
+        if (!value.contains(key)) {
+          report(errors, [&]() { return "missing required " + render(path) + "." + key; });
+          ok = false;
+        }
+      }
+    }
+
+    if (n.type == Type::kArray && n.items != kNone) {
+      std::size_t i = 0;
+      for (const auto& item : value) {
+        ok = check(n.items, item, Path{&path, {}, i}, errors) && ok;
+        if (!ok && !errors) {
+          return false;
+        }
+        ++i;
+      }
+    }
+    return ok;
+  }
+
+  template <typename Make>
+  static void report(std::vector<std::string>* errors, Make&& make) {
+    if (errors) {
+      errors->push_back(make());
+    }
+  }
+
+  std::vector<Node> nodes_;
+};
+
+}  // namespace attoclaw
@@ -73,7 +73,7 @@ class SessionManager {
 
     std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
     if (!out) {
-      Logger::log(Logger::Level::kError, "Cannot save session: " + session.key);
+      ATTOCLAW_LOG_ERROR("Cannot save session: " + session.key);
       return;
     }
 
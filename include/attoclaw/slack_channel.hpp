@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <chrono>
+#include <deque>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -14,9 +15,44 @@
 #include "attoclaw/channels.hpp"
 #include "attoclaw/config.hpp"
 #include "attoclaw/http.hpp"
+#include "attoclaw/websocket.hpp"
 
 namespace attoclaw {
 
+// Bounded per-channel memory of delivered message timestamps, so a message seen through
+// both Socket Mode and the catch-up history poll is handed to the bus once.
+class SlackSeenWindow {
+ public:
+  static constexpr std::size_t kCapacity = 256;
+
+  // False if `ts` was already seen.
+  bool insert(const std::string& ts) {
+    if (!ids_.insert(ts).second) {
+      return false;
+    }
+    order_.push_back(ts);
+    if (order_.size() > kCapacity) {
+      ids_.erase(order_.front());
+      order_.pop_front();
+    }
+    return true;
+  }
+
+ private:
+  std::deque<std::string> order_;
+  std::unordered_set<std::string> ids_;
+};
+
+// The acknowledgement Socket Mode expects for an envelope, or nullopt if it carries no
+// envelope_id (hello, disconnect). Slack redelivers anything not acked within 3 seconds.
+inline std::optional<json> slack_envelope_ack(const json& envelope) {
+  const std::string id = envelope.is_object() ? envelope.value("envelope_id", "") : "";
+  if (id.empty()) {
+    return std::nullopt;
+  }
+  return json{{"envelope_id", id}};
+}
+
 class SlackChannel : public BaseChannel {
  public:
   SlackChannel(const SlackChannelConfig& config, MessageBus* bus) : BaseChannel("slack", bus), config_(config) {
@@ -24,6 +60,7 @@ class SlackChannel : public BaseChannel {
       allow_from_.insert(trim(x));
     }
     channels_ = config_.channels;
+    channel_set_.insert(channels_.begin(), channels_.end());
     state_path_ = expand_user_path("~/.attoclaw") / "state" / "slack_cursors.json";
   }
 
@@ -32,19 +69,37 @@ class SlackChannel : public BaseChannel {
       return;
     }
     if (trim(config_.token).empty()) {
-      Logger::log(Logger::Level::kWarn, "Slack enabled but token is empty; channel will not start.");
+      ATTOCLAW_LOG_WARN("Slack enabled but token is empty; channel will not start.");
+      running_.store(false);
+      return;
+    }
+    const bool socket_mode = config_.socket_mode && !trim(config_.app_token).empty();
+    if (config_.socket_mode && !socket_mode) {
+      ATTOCLAW_LOG_WARN("Slack socketMode enabled but appToken is empty; falling back to history polling.");
+    }
+    if (channels_.empty() && !socket_mode) {
+      ATTOCLAW_LOG_WARN("Slack enabled but no channels configured; channel will not start.");
       running_.store(false);
       return;
     }
-    if (channels_.empty()) {
-      Logger::log(Logger::Level::kWarn, "Slack enabled but no channels configured; channel will not start.");
+    // Socket Mode without a channel list pushes every channel the app is in, so the sender
+    // list has to narrow it down instead.
+    if (channels_.empty() && allow_from_.empty()) {
+      ATTOCLAW_LOG_WARN("Slack socketMode enabled with neither channels nor allowFrom configured; "
+                        "channel will not start.");
       running_.store(false);
       return;
     }
 
     load_state();
-    worker_ = std::thread([this]() { poll_loop(); });
-    Logger::log(Logger::Level::kInfo, "Slack channel started");
+    worker_ = std::thread([this, socket_mode]() {
+      if (socket_mode) {
+        socket_loop();
+      } else {
+        poll_loop();
+      }
+    });
+    ATTOCLAW_LOG_INFO(std::string("Slack channel started (") + (socket_mode ? "socket mode" : "polling") + ")");
   }
 
   void stop() override {
@@ -55,7 +110,7 @@ class SlackChannel : public BaseChannel {
       worker_.join();
     }
     flush_state();
-    Logger::log(Logger::Level::kInfo, "Slack channel stopped");
+    ATTOCLAW_LOG_INFO("Slack channel stopped");
   }
 
   void send(const OutboundMessage& msg) override {
@@ -72,7 +127,7 @@ class SlackChannel : public BaseChannel {
                                        {"Content-Type", "application/json"}},
                                       20, true, 3);
       if (!resp.error.empty()) {
-        Logger::log(Logger::Level::kWarn, "Slack send failed: " + resp.error);
+        ATTOCLAW_LOG_WARN("Slack send failed: " + resp.error);
         return;
       }
       if (resp.status == 429) {
@@ -82,14 +137,14 @@ class SlackChannel : public BaseChannel {
         continue;
       }
       if (resp.status < 200 || resp.status >= 300) {
-        Logger::log(Logger::Level::kWarn, "Slack send failed: HTTP " + std::to_string(resp.status));
+        ATTOCLAW_LOG_WARN("Slack send failed: HTTP " + std::to_string(resp.status));
         return;
       }
 
       try {
         const json body = json::parse(resp.body);
         if (!body.value("ok", false)) {
-          Logger::log(Logger::Level::kWarn, "Slack send failed: " + body.value("error", "unknown_error"));
+          ATTOCLAW_LOG_WARN("Slack send failed: " + body.value("error", "unknown_error"));
         }
       } catch (...) {
       }
@@ -193,130 +248,146 @@ class SlackChannel : public BaseChannel {
     return allow_from_.contains(user_id);
   }
 
-  void poll_loop() {
-    HttpClient client;
-    const int poll_s = (std::max)(1, config_.poll_seconds);
-    while (running_.load()) {
-      for (const auto& channel_id : channels_) {
-        if (!running_.load()) {
+  // Hands one Slack message object (history or event shape) to the bus, skipping
+  // redeliveries. Returns true when dispatched.
+  bool ingest_message(const json& m, const std::string& channel_id) {
+    if (!m.is_object()) {
+      return false;
+    }
+    if (m.contains("subtype") && m["subtype"].is_string()) {
+      const std::string subtype = m["subtype"].get<std::string>();
+      if (subtype == "bot_message" || subtype == "message_changed" || subtype == "message_deleted") {
+        return false;
+      }
+    }
+    if (m.contains("bot_id")) {
+      return false;
+    }
+    if (!m.contains("user") || !m["user"].is_string()) {
+      return false;
+    }
+    if (!m.contains("text") || !m["text"].is_string()) {
+      return false;
+    }
+    if (!m.contains("ts") || !m["ts"].is_string()) {
+      return false;
+    }
+    const std::string ts = m["ts"].get<std::string>();
+    if (!seen_[channel_id].insert(ts)) {
+      return false;
+    }
+    if (last_ts_[channel_id].empty() || ts > last_ts_[channel_id]) {
+      last_ts_[channel_id] = ts;
+      dirty_.store(true);
+    }
+    const std::string user_id = m["user"].get<std::string>();
+    if (!is_allowed_sender(user_id)) {
+      return false;
+    }
+    std::string text = trim(m["text"].get<std::string>());
+
+    std::vector<std::string> media_paths;
+    if (m.contains("files") && m["files"].is_array()) {
+      for (const auto& f : m["files"]) {
+        if (!looks_like_audio_file(f)) {
+          continue;
+        }
+        const std::string url_private = f.value("url_private_download", f.value("url_private", ""));
+        const std::string name = f.value("name", "");
+        if (auto p = download_slack_file(url_private, channel_id, name)) {
+          media_paths.push_back(p->string());
           break;
         }
+      }
+    }
 
-        const bool warmup = (last_ts_.find(channel_id) == last_ts_.end());
-        std::string oldest = "0";
-        auto it = last_ts_.find(channel_id);
-        if (it != last_ts_.end() && !it->second.empty()) {
-          oldest = it->second;
-        }
+    if (text.empty() && !media_paths.empty()) {
+      text = "Voice/audio file received. Please transcribe and respond.";
+    }
+    if (text.empty() && media_paths.empty()) {
+      return false;
+    }
 
-        const std::string url =
-            "https://slack.com/api/conversations.history?limit=50&channel=" + channel_id + "&oldest=" + oldest;
+    handle_message(user_id, channel_id, text, media_paths, json::object());
+    return true;
+  }
 
-        HttpResponse resp =
-            client.get(url, {{"Authorization", "Bearer " + config_.token}}, 25, true, 2);
-        if (!running_.load()) {
-          break;
-        }
-        if (!resp.error.empty()) {
-          Logger::log(Logger::Level::kWarn, "Slack poll error: " + resp.error);
-          continue;
-        }
-        if (resp.status == 429) {
-          const auto it = resp.headers.find("retry-after");
-          const int wait_s = it == resp.headers.end() ? 3 : (std::max)(1, std::atoi(it->second.c_str()));
-          Logger::log(Logger::Level::kWarn, "Slack rate limited. Sleeping " + std::to_string(wait_s) + "s");
-          std::this_thread::sleep_for(std::chrono::seconds(wait_s));
-          continue;
-        }
-        if (resp.status < 200 || resp.status >= 300) {
-          Logger::log(Logger::Level::kWarn, "Slack poll HTTP error: " + std::to_string(resp.status));
-          continue;
-        }
+  // One conversations.history round for a channel. Returns false if the caller should
+  // stop the current round (shutdown requested).
+  bool poll_channel(HttpClient& client, const std::string& channel_id) {
+    const bool warmup = (last_ts_.find(channel_id) == last_ts_.end());
+    std::string oldest = "0";
+    auto it = last_ts_.find(channel_id);
+    if (it != last_ts_.end() && !it->second.empty()) {
+      oldest = it->second;
+    }
 
-        try {
-          const json body = json::parse(resp.body);
-          if (!body.value("ok", false) || !body.contains("messages") || !body["messages"].is_array()) {
-            continue;
-          }
+    const std::string url =
+        "https://slack.com/api/conversations.history?limit=50&channel=" + channel_id + "&oldest=" + oldest;
 
-          // Slack returns newest-first.
-          const auto& msgs = body["messages"];
-          if (warmup) {
-            std::string max_ts;
-            for (const auto& m : msgs) {
-              if (m.is_object() && m.contains("ts") && m["ts"].is_string()) {
-                const std::string ts = m["ts"].get<std::string>();
-                if (max_ts.empty() || ts > max_ts) {
-                  max_ts = ts;
-                }
-              }
-            }
-            if (!max_ts.empty()) {
-              last_ts_[channel_id] = max_ts;
-            }
-            continue;  // Do not replay history on first start.
-          }
+    HttpResponse resp = client.get(url, {{"Authorization", "Bearer " + config_.token}}, 25, true, 2);
+    if (!running_.load()) {
+      return false;
+    }
+    if (!resp.error.empty()) {
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Slack poll error: " + resp.error);
+      return true;
+    }
+    if (resp.status == 429) {
+      const auto it_ra = resp.headers.find("retry-after");
+      const int wait_s = it_ra == resp.headers.end() ? 3 : (std::max)(1, std::atoi(it_ra->second.c_str()));
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Slack rate limited. Sleeping " + std::to_string(wait_s) + "s");
+      std::this_thread::sleep_for(std::chrono::seconds(wait_s));
+      return true;
+    }
+    if (resp.status < 200 || resp.status >= 300) {
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Slack poll HTTP error: " + std::to_string(resp.status));
+      return true;
+    }
 
-          for (auto it_msg = msgs.rbegin(); it_msg != msgs.rend(); ++it_msg) {
-            const json& m = *it_msg;
-            if (!m.is_object()) {
-              continue;
-            }
-            if (m.contains("subtype") && m["subtype"].is_string()) {
-              const std::string subtype = m["subtype"].get<std::string>();
-              if (subtype == "bot_message" || subtype == "message_changed" || subtype == "message_deleted") {
-                continue;
-              }
-            }
-            if (!m.contains("user") || !m["user"].is_string()) {
-              continue;
-            }
-            if (!m.contains("text") || !m["text"].is_string()) {
-              continue;
-            }
-            if (!m.contains("ts") || !m["ts"].is_string()) {
-              continue;
-            }
-            const std::string user_id = m["user"].get<std::string>();
-            if (!is_allowed_sender(user_id)) {
-              continue;
-            }
-            std::string text = trim(m["text"].get<std::string>());
+    try {
+      const json body = json::parse(resp.body);
+      if (!body.value("ok", false) || !body.contains("messages") || !body["messages"].is_array()) {
+        return true;
+      }
+
+      // Slack returns newest-first.
+      const auto& msgs = body["messages"];
+      if (warmup) {
+        std::string max_ts;
+        for (const auto& m : msgs) {
+          if (m.is_object() && m.contains("ts") && m["ts"].is_string()) {
             const std::string ts = m["ts"].get<std::string>();
-            if (last_ts_[channel_id].empty() || ts > last_ts_[channel_id]) {
-              last_ts_[channel_id] = ts;
-              dirty_.store(true);
+            if (max_ts.empty() || ts > max_ts) {
+              max_ts = ts;
             }
+          }
+        }
+        if (!max_ts.empty()) {
+          last_ts_[channel_id] = max_ts;
+        }
+        return true;  // Do not replay history on first start.
+      }
 
-            std::vector<std::string> media_paths;
-            if (m.contains("files") && m["files"].is_array()) {
-              for (const auto& f : m["files"]) {
-                if (!looks_like_audio_file(f)) {
-                  continue;
-                }
-                const std::string url_private = f.value("url_private_download", f.value("url_private", ""));
-                const std::string name = f.value("name", "");
-                if (auto p = download_slack_file(url_private, channel_id, name)) {
-                  media_paths.push_back(p->string());
-                  break;
-                }
-              }
-            }
+      for (auto it_msg = msgs.rbegin(); it_msg != msgs.rend(); ++it_msg) {
+        ingest_message(*it_msg, channel_id);
+      }
+    } catch (const std::exception& e) {
+      ATTOCLAW_LOG_WARN(std::string("Slack parse error: ") + e.what());
+    }
 
-            if (text.empty() && !media_paths.empty()) {
-              text = "Voice/audio file received. Please transcribe and respond.";
-            }
-            if (text.empty() && media_paths.empty()) {
-              continue;
-            }
+    maybe_flush_state();
+    return true;
+  }
 
-            handle_message(user_id, channel_id, text, media_paths, json::object());
-          }
-        } catch (const std::exception& e) {
-          Logger::log(Logger::Level::kWarn, std::string("Slack parse error: ") + e.what());
+  void poll_loop() {
+    HttpClient client;
+    const int poll_s = (std::max)(1, config_.poll_seconds);
+    while (running_.load()) {
+      for (const auto& channel_id : channels_) {
+        if (!running_.load() || !poll_channel(client, channel_id)) {
+          break;
         }
-
-        maybe_flush_state();
       }
 
       for (int i = 0; running_.load() && i < poll_s * 10; ++i) {
@@ -325,10 +396,156 @@ class SlackChannel : public BaseChannel {
     }
   }
 
+  // Asks Slack for a fresh single-use Socket Mode websocket URL.
+  std::string open_socket_url(HttpClient& client) {
+    HttpResponse resp = client.post("https://slack.com/api/apps.connections.open", "",
+                                    {{"Authorization", "Bearer " + config_.app_token},
+                                     {"Content-Type", "application/x-www-form-urlencoded"}},
+                                    20, true, 2);
+    if (!resp.error.empty() || resp.status < 200 || resp.status >= 300) {
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs,
+                                 "Slack apps.connections.open failed: " +
+                                     (!resp.error.empty() ? resp.error : ("HTTP " + std::to_string(resp.status))));
+      return {};
+    }
+    try {
+      const json body = json::parse(resp.body);
+      if (!body.value("ok", false)) {
+        ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs,
+                                   "Slack apps.connections.open failed: " + body.value("error", "unknown_error"));
+        return {};
+      }
+      return body.value("url", "");
+    } catch (const std::exception& e) {
+      ATTOCLAW_LOG_WARN(std::string("Slack apps.connections.open parse error: ") + e.what());
+      return {};
+    }
+  }
+
+  // Returns false when Slack asked us to drop this connection and reconnect.
+  bool handle_socket_payload(WebSocketClient& ws, HttpClient& client, const std::string& raw) {
+    json env;
+    try {
+      env = json::parse(raw);
+    } catch (const std::exception& e) {
+      ATTOCLAW_LOG_WARN(std::string("Slack socket payload parse error: ") + e.what());
+      return true;
+    }
+
+    // Ack first, before any slow work on the event.
+    if (const auto ack = slack_envelope_ack(env)) {
+      ws.send_json(*ack, &running_);
+    }
+
+    const std::string type = env.value("type", "");
+    if (type == "hello") {
+      ATTOCLAW_LOG_INFO("Slack socket mode connected");
+      // Socket Mode cannot resume; catch up on what arrived while disconnected.
+      for (const auto& channel_id : channels_) {
+        if (!running_.load() || !poll_channel(client, channel_id)) {
+          break;
+        }
+      }
+      return true;
+    }
+    if (type == "disconnect") {
+      ATTOCLAW_LOG_INFO("Slack socket mode disconnect requested (" + env.value("reason", "unknown") + ")");
+      return false;
+    }
+    if (type != "events_api" || !env.contains("payload") || !env["payload"].is_object()) {
+      return true;
+    }
+
+    const json& payload = env["payload"];
+    if (!payload.contains("event") || !payload["event"].is_object()) {
+      return true;
+    }
+    const json& event = payload["event"];
+    if (event.value("type", "") != "message") {
+      return true;
+    }
+    const std::string channel_id = event.value("channel", "");
+    if (channel_id.empty() || (!channel_set_.empty() && !channel_set_.contains(channel_id))) {
+      return true;
+    }
+    if (channel_set_.empty() && allow_from_.empty()) {
+      return true;  // start() refuses this; never accept events from anyone anywhere
+    }
+    ingest_message(event, channel_id);
+    maybe_flush_state();
+    return true;
+  }
+
+  // The backoff resets only once Slack has sent something (hello or an envelope) on a
+  // connection; a socket that connects and drops at once keeps backing off instead of
+  // hammering apps.connections.open.
+  void socket_loop() {
+    static constexpr int64_t kMinBackoffMs = 1000;
+    static constexpr int64_t kMaxBackoffMs = 60000;
+    HttpClient client;
+    WebSocketClient ws;
+    int64_t backoff_ms = kMinBackoffMs;
+
+    while (running_.load()) {
+      const std::string url = open_socket_url(client);
+      std::string err;
+      bool heard = false;
+      if (!url.empty() && ws.connect(url, {}, &err)) {
+        heard = receive_socket(ws, client);
+        ws.close();
+        maybe_flush_state();
+      } else if (!err.empty()) {
+        ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Slack socket mode connect failed: " + err);
+      }
+      if (heard) {
+        backoff_ms = kMinBackoffMs;
+        continue;
+      }
+      sleep_while_running(backoff_ms);
+      backoff_ms = (std::min)(backoff_ms * 2, kMaxBackoffMs);
+    }
+  }
+
+  // Reads one Socket Mode connection until it drops. Returns true if any payload arrived.
+  bool receive_socket(WebSocketClient& ws, HttpClient& client) {
+    bool heard = false;
+    std::string err;
+    while (running_.load()) {
+      std::string payload;
+      const auto st = ws.recv(&payload, &err);
+      if (st == WebSocketClient::RecvStatus::kMessage) {
+        heard = true;
+        if (!handle_socket_payload(ws, client, payload)) {
+          break;
+        }
+        continue;
+      }
+      if (st == WebSocketClient::RecvStatus::kClosed) {
+        break;
+      }
+      if (st == WebSocketClient::RecvStatus::kError) {
+        ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Slack socket mode recv failed: " + err);
+        break;
+      }
+      if (ws.wait(500) == WebSocketClient::WaitStatus::kError) {
+        break;
+      }
+    }
+    return heard;
+  }
+
+  void sleep_while_running(int64_t ms) const {
+    for (int64_t waited = 0; running_.load() && waited < ms; waited += 100) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+
   SlackChannelConfig config_;
   std::vector<std::string> channels_;
+  std::unordered_set<std::string> channel_set_;
   std::unordered_set<std::string> allow_from_;
   std::unordered_map<std::string, std::string> last_ts_;
+  std::unordered_map<std::string, SlackSeenWindow> seen_;
   fs::path state_path_;
   std::atomic<bool> dirty_{false};
   int64_t last_flush_ms_{0};
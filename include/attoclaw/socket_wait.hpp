@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include <curl/curl.h>
+
+namespace attoclaw {
+
+// Cross-thread wakeup that can sit in a poll() set next to a socket: an eventfd on
+// Linux, a non-blocking pipe on other POSIX systems. Windows has no pollable
+// equivalent for WSAPoll, so there fd() is invalid and waiters use short timeouts.
+class WakeupEvent {
+ public:
+  WakeupEvent() {
+#if defined(__linux__)
+    read_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    write_fd_ = read_fd_;
+#elif !defined(_WIN32)
+    int fds[2] = {-1, -1};
+    if (::pipe(fds) == 0) {
+      for (int fd : fds) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+      read_fd_ = fds[0];
+      write_fd_ = fds[1];
+    }
+#endif
+  }
+
+  ~WakeupEvent() {
+#ifndef _WIN32
+    if (write_fd_ >= 0 && write_fd_ != read_fd_) {
+      ::close(write_fd_);
+    }
+    if (read_fd_ >= 0) {
+      ::close(read_fd_);
+    }
+#endif
+  }
+
+  WakeupEvent(const WakeupEvent&) = delete;
+  WakeupEvent& operator=(const WakeupEvent&) = delete;
+
+  int fd() const { return read_fd_; }
+
+  void notify() {
+#if defined(__linux__)
+    const uint64_t one = 1;
+    [[maybe_unused]] const auto n = ::write(write_fd_, &one, sizeof(one));
+#elif !defined(_WIN32)
+    const char b = 1;
+    [[maybe_unused]] const auto n = ::write(write_fd_, &b, 1);
+#endif
+  }
+
+  void drain() {
+#ifndef _WIN32
+    char buf[64];
+    while (read_fd_ >= 0 && ::read(read_fd_, buf, sizeof(buf)) > 0) {
+    }
+#endif
+  }
+
+ private:
+  int read_fd_{-1};
+  int write_fd_{-1};
+};
+
+enum class SocketWaitStatus { kReadable, kWoken, kTimeout, kError };
+
+// Blocks until `sock` is readable, `wake` is notified, or timeout_ms elapses. Used on
+// sockets owned by libcurl CONNECT_ONLY handles (CURLINFO_ACTIVESOCKET); callers must
+// first drain libcurl so no already-decrypted bytes sit in its buffers.
+inline SocketWaitStatus wait_socket_readable(curl_socket_t sock, int timeout_ms, WakeupEvent* wake = nullptr) {
+#ifdef _WIN32
+  (void)wake;
+  WSAPOLLFD pfd{};
+  pfd.fd = sock;
+  pfd.events = POLLRDNORM;
+  // No pollable wakeup handle on Windows; keep the wakeup latency bounded instead.
+  const int rc = WSAPoll(&pfd, 1, (std::min)(timeout_ms, 50));
+  if (rc < 0) {
+    return SocketWaitStatus::kError;
+  }
+  if (rc == 0) {
+    return SocketWaitStatus::kTimeout;
+  }
+  return (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0 ? SocketWaitStatus::kError
+                                                              : SocketWaitStatus::kReadable;
+#else
+  pollfd fds[2]{};
+  fds[0].fd = static_cast<int>(sock);
+  fds[0].events = POLLIN;
+  nfds_t n = 1;
+  if (wake && wake->fd() >= 0) {
+    fds[1].fd = wake->fd();
+    fds[1].events = POLLIN;
+    n = 2;
+  }
+  const int rc = ::poll(fds, n, timeout_ms);
+  if (rc < 0) {
+    return errno == EINTR ? SocketWaitStatus::kTimeout : SocketWaitStatus::kError;
+  }
+  if (rc == 0) {
+    return SocketWaitStatus::kTimeout;
+  }
+  if (n == 2 && (fds[1].revents & POLLIN) != 0) {
+    wake->drain();
+    return SocketWaitStatus::kWoken;
+  }
+  if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+    return SocketWaitStatus::kReadable;  // the following read reports any close or error
+  }
+  return SocketWaitStatus::kTimeout;
+#endif
+}
+
+}  // namespace attoclaw
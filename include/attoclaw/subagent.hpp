@@ -1,13 +1,21 @@
 ﻿#pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "attoclaw/common.hpp"
 #include "attoclaw/events.hpp"
 #include "attoclaw/external_cli.hpp"
 #include "attoclaw/message_bus.hpp"
+#include "attoclaw/metrics.hpp"
 #include "attoclaw/provider.hpp"
 #include "attoclaw/tools.hpp"
 
@@ -34,32 +42,253 @@ class SubagentManager : public SpawnManager {
         transcribe_timeout_seconds_(transcribe_timeout_seconds),
         exec_timeout_seconds_(exec_timeout_seconds),
         restrict_to_workspace_(restrict_to_workspace),
-        running_count_(std::make_shared<std::atomic<int>>(0)) {}
+        tools_(build_tools()) {}
+
+  ~SubagentManager() override { shutdown(); }
+
+  // Bounds how many subagents run at once and how many may wait for a slot.
+  void configure(int max_concurrency, int max_queued) {
+    std::lock_guard<std::mutex> lock(mu_);
+    max_concurrency_ = (std::max)(1, max_concurrency);
+    max_queued_ = (std::max)(0, max_queued);
+  }
 
   std::string spawn(const std::string& task, const std::string& label, const std::string& origin_channel,
-                    const std::string& origin_chat_id) override {
+                    const std::string& origin_chat_id, int priority = 0) override {
     if (!provider_ || !bus_) {
       return "Error: Subagent runtime is unavailable";
     }
 
-    const std::string task_id = random_id(8);
-    const std::string display_label = trim(label).empty() ? summarize_label(task) : label;
-    auto running_count = running_count_;
-    running_count->fetch_add(1);
+    auto job = std::make_shared<Job>();
+    job->id = random_id(8);
+    job->task = task;
+    job->label = trim(label).empty() ? summarize_label(task) : label;
+    job->origin_channel = origin_channel;
+    job->origin_chat_id = origin_chat_id;
+    job->priority = priority;
+    job->enqueued_ms = now_ms();
 
-    // Detached subagent worker thread.
-    std::thread([=, this]() {
-      run_subagent(task_id, task, display_label, origin_channel, origin_chat_id);
-      running_count->fetch_sub(1);
-    }).detach();
+    bool queued_behind = false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stopping_) {
+        return "Error: Subagent runtime is shutting down";
+      }
+      if (static_cast<int>(pending_.size()) + running_ >= max_concurrency_ + max_queued_) {
+        metrics().inc("subagent.rejected");
+        return "Error: Too many subagents queued (" + std::to_string(pending_.size()) +
+               "). Wait for running tasks to finish or cancel some.";
+      }
+      job->seq = next_seq_++;
+      pending_.push_back(job);
+      std::push_heap(pending_.begin(), pending_.end(), JobOrder{});
+      jobs_[job->id] = job;
+      queued_behind = running_ + static_cast<int>(pending_.size()) > max_concurrency_;
+      // Workers are started lazily so CLI runs that never spawn pay nothing.
+      while (static_cast<int>(workers_.size()) < max_concurrency_) {
+        workers_.emplace_back([this]() { worker_loop(); });
+      }
+    }
+    cv_.notify_one();
+    metrics().inc("subagent.spawned");
 
-    return "Subagent [" + display_label + "] started (id: " + task_id +
+    return "Subagent [" + job->label + "] " + (queued_behind ? "queued" : "started") + " (id: " + job->id +
            "). I'll notify you when it completes.";
   }
 
-  int running_count() const { return running_count_->load(); }
+  std::string cancel(const std::string& task_id) override {
+    std::shared_ptr<Job> job;
+    bool was_queued = false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      auto it = jobs_.find(task_id);
+      if (it == jobs_.end()) {
+        return "Error: No subagent with id " + task_id;
+      }
+      job = it->second;
+      if (job->state == JobState::kQueued) {
+        pending_.erase(std::remove(pending_.begin(), pending_.end(), job), pending_.end());
+        std::make_heap(pending_.begin(), pending_.end(), JobOrder{});
+        job->state = JobState::kCancelled;
+        job->finished_ms = now_ms();
+        ++cancelled_;
+        remember_finished(job);
+        was_queued = true;
+      } else if (job->state != JobState::kRunning) {
+        return "Subagent [" + job->label + "] already finished.";
+      }
+      job->cancel_requested.store(true);
+    }
+    if (was_queued) {
+      metrics().inc("subagent.cancelled");
+      return "Subagent [" + job->label + "] cancelled before it started.";
+    }
+    return "Cancellation requested for subagent [" + job->label + "]; it stops after the current step.";
+  }
+
+  json status() const override {
+    std::lock_guard<std::mutex> lock(mu_);
+    json tasks = json::array();
+    const int64_t now = now_ms();
+    for (const auto& kv : jobs_) {
+      tasks.push_back(job_json(*kv.second, now));
+    }
+    for (const auto& job : finished_) {
+      tasks.push_back(job_json(*job, now));
+    }
+    return json{{"running", running_},
+                {"queued", pending_.size()},
+                {"completed", completed_},
+                {"failed", failed_},
+                {"cancelled", cancelled_},
+                {"maxConcurrency", max_concurrency_},
+                {"maxQueued", max_queued_},
+                {"tasks", std::move(tasks)}};
+  }
+
+  int running_count() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return running_;
+  }
+
+  int queued_count() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return static_cast<int>(pending_.size());
+  }
+
+  // Drops queued work, asks running subagents to stop and joins the workers.
+  void shutdown() {
+    std::vector<std::thread> workers;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stopping_) {
+        return;
+      }
+      stopping_ = true;
+      for (auto& job : pending_) {
+        job->state = JobState::kCancelled;
+        jobs_.erase(job->id);
+      }
+      pending_.clear();
+      for (auto& kv : jobs_) {
+        kv.second->cancel_requested.store(true);
+      }
+      workers.swap(workers_);
+    }
+    cv_.notify_all();
+    for (auto& t : workers) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+  }
 
  private:
+  enum class JobState { kQueued, kRunning, kCompleted, kFailed, kCancelled };
+
+  struct Job {
+    std::string id;
+    std::string task;
+    std::string label;
+    std::string origin_channel;
+    std::string origin_chat_id;
+    int priority{0};
+    uint64_t seq{0};
+    JobState state{JobState::kQueued};
+    int64_t enqueued_ms{0};
+    int64_t started_ms{0};
+    int64_t finished_ms{0};
+    std::atomic<bool> cancel_requested{false};
+  };
+
+  // Max-heap order: higher priority first, then FIFO.
+  struct JobOrder {
+    bool operator()(const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b) const {
+      if (a->priority != b->priority) {
+        return a->priority < b->priority;
+      }
+      return a->seq > b->seq;
+    }
+  };
+
+  static constexpr std::size_t kFinishedHistory = 32;
+
+  static const char* state_name(JobState s) {
+    switch (s) {
+      case JobState::kQueued:
+        return "queued";
+      case JobState::kRunning:
+        return "running";
+      case JobState::kCompleted:
+        return "completed";
+      case JobState::kFailed:
+        return "failed";
+      case JobState::kCancelled:
+      default:
+        return "cancelled";
+    }
+  }
+
+  static json job_json(const Job& job, int64_t now) {
+    json j{{"id", job.id}, {"label", job.label}, {"state", state_name(job.state)}, {"priority", job.priority}};
+    const int64_t started = job.started_ms > 0 ? job.started_ms : (job.finished_ms > 0 ? job.finished_ms : now);
+    j["queuedMs"] = started - job.enqueued_ms;
+    if (job.started_ms > 0) {
+      j["runMs"] = (job.finished_ms > 0 ? job.finished_ms : now) - job.started_ms;
+    }
+    return j;
+  }
+
+  // Caller holds mu_.
+  void remember_finished(const std::shared_ptr<Job>& job) {
+    jobs_.erase(job->id);
+    finished_.push_back(job);
+    while (finished_.size() > kFinishedHistory) {
+      finished_.pop_front();
+    }
+  }
+
+  void worker_loop() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this]() { return stopping_ || (!pending_.empty() && running_ < max_concurrency_); });
+        if (stopping_) {
+          return;
+        }
+        std::pop_heap(pending_.begin(), pending_.end(), JobOrder{});
+        job = pending_.back();
+        pending_.pop_back();
+        job->state = JobState::kRunning;
+        job->started_ms = now_ms();
+        ++running_;
+      }
+
+      const std::string status = run_subagent(*job);
+
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        --running_;
+        job->finished_ms = now_ms();
+        if (status == "ok") {
+          job->state = JobState::kCompleted;
+          ++completed_;
+        } else if (status == "cancelled") {
+          job->state = JobState::kCancelled;
+          ++cancelled_;
+        } else {
+          job->state = JobState::kFailed;
+          ++failed_;
+        }
+        remember_finished(job);
+      }
+      metrics().inc(status == "ok" ? "subagent.completed"
+                                   : (status == "cancelled" ? "subagent.cancelled" : "subagent.failed"));
+      cv_.notify_one();
+    }
+  }
+
   static std::string summarize_label(const std::string& task) {
     constexpr std::size_t kMax = 30;
     if (task.size() <= kMax) {
@@ -68,6 +297,15 @@ class SubagentManager : public SpawnManager {
     return task.substr(0, kMax) + "...";
   }
 
+  // One immutable tool set for every subagent; per-task state arrives through ToolContext.
+  std::shared_ptr<const ToolRegistry> build_tools() const {
+    auto tools = std::make_shared<ToolRegistry>();
+    register_core_tools(*tools, CoreToolOptions{workspace_, restrict_to_workspace_, exec_timeout_seconds_,
+                                                brave_api_key_, transcribe_api_key_, transcribe_api_base_,
+                                                transcribe_model_, transcribe_timeout_seconds_});
+    return tools;
+  }
+
   std::string subagent_prompt() const {
     std::ostringstream out;
     out << "# Subagent\n\n";
@@ -82,48 +320,47 @@ class SubagentManager : public SpawnManager {
     return out.str();
   }
 
-  void run_subagent(const std::string& task_id, const std::string& task, const std::string& label,
-                    const std::string& origin_channel, const std::string& origin_chat_id) const {
+  // Returns "ok", "error" or "cancelled".
+  std::string run_subagent(const Job& job) const {
+    const std::string& task_id = job.id;
+    const std::string& task = job.task;
+    const std::string& label = job.label;
     std::string final_result;
     std::string status = "ok";
     const ParsedExternalRequest parsed = parse_external_request(task);
     const std::string task_text = parsed.prompt;
     const bool vision_enabled = parsed.vision_enabled;
 
+    // cancel() and shutdown() abort this job's HTTP transfers (provider calls, web tools)
+    // and kill its external CLI, so stopping waits for at most one step to notice.
+    const HttpClient::ScopedCancel http_cancel(&job.cancel_requested);
+
     try {
       if (vision_enabled && is_headless_server()) {
         final_result = "Vision is unavailable on headless server (DISPLAY/WAYLAND_DISPLAY not set).";
       } else if (parsed.external_cli.has_value()) {
-        final_result = run_external_cli(*parsed.external_cli, workspace_, vision_enabled);
-      } else {
-        ToolRegistry tools;
-        std::optional<fs::path> allowed_dir;
-        if (restrict_to_workspace_) {
-          allowed_dir = workspace_;
+        final_result = run_external_cli(*parsed.external_cli, workspace_, vision_enabled, {}, &job.cancel_requested);
+        if (job.cancel_requested.load()) {
+          status = "cancelled";
         }
-        tools.register_tool(std::make_shared<ReadFileTool>(allowed_dir));
-        tools.register_tool(std::make_shared<WriteFileTool>(allowed_dir));
-        tools.register_tool(std::make_shared<EditFileTool>(allowed_dir));
-        tools.register_tool(std::make_shared<ListDirTool>(allowed_dir));
-        tools.register_tool(std::make_shared<ExecTool>(exec_timeout_seconds_, workspace_, restrict_to_workspace_));
-        tools.register_tool(std::make_shared<WebSearchTool>(brave_api_key_, 5));
-        tools.register_tool(std::make_shared<WebFetchTool>());
-        if (!trim(transcribe_api_key_).empty() && !trim(transcribe_api_base_).empty()) {
-          tools.register_tool(std::make_shared<TranscribeTool>(transcribe_api_key_, transcribe_api_base_,
-                                                               transcribe_model_, transcribe_timeout_seconds_));
-        }
-        tools.register_tool(std::make_shared<SystemInspectTool>());
-        tools.register_tool(std::make_shared<AppControlTool>());
-        tools.register_tool(std::make_shared<ScreenCaptureTool>(vision_enabled));
-
+      } else {
+        const ToolContext tool_ctx{job.origin_channel, job.origin_chat_id, vision_enabled};
         json messages = json::array();
         messages.push_back({{"role", "system"}, {"content", subagent_prompt()}});
         messages.push_back({{"role", "user"}, {"content", task_text}});
 
         constexpr int kMaxIterations = 15;
         for (int i = 0; i < kMaxIterations; ++i) {
+          if (job.cancel_requested.load()) {
+            status = "cancelled";
+            break;
+          }
           const LLMResponse resp =
-              provider_->chat(messages, tools.definitions(), model_, max_tokens_, temperature_, top_p_);
+              provider_->chat(messages, tools_->definitions(), model_, max_tokens_, temperature_, top_p_);
+          if (job.cancel_requested.load()) {
+            status = "cancelled";  // the aborted call's error is not a result
+            break;
+          }
 
           if (resp.has_tool_calls()) {
             json tool_call_dicts = json::array();
@@ -137,7 +374,10 @@ class SubagentManager : public SpawnManager {
                 {{"role", "assistant"}, {"content", resp.content}, {"tool_calls", tool_call_dicts}});
 
             for (const auto& tc : resp.tool_calls) {
-              const std::string result = tools.execute(tc.name, tc.arguments);
+              if (job.cancel_requested.load()) {
+                break;
+              }
+              const std::string result = tools_->execute(tc.name, tc.arguments, tool_ctx);
               messages.push_back({{"role", "tool"},
                                   {"tool_call_id", tc.id},
                                   {"name", tc.name},
@@ -149,7 +389,9 @@ class SubagentManager : public SpawnManager {
           }
         }
 
-        if (trim(final_result).empty()) {
+        if (status == "cancelled") {
+          final_result = "Cancelled before completion.";
+        } else if (trim(final_result).empty()) {
           final_result = "Task completed but no final response was generated.";
         }
       }
@@ -158,7 +400,8 @@ class SubagentManager : public SpawnManager {
       final_result = std::string("Error: ") + e.what();
     }
 
-    const std::string status_text = (status == "ok") ? "completed successfully" : "failed";
+    const std::string status_text =
+        status == "ok" ? "completed successfully" : (status == "cancelled" ? "was cancelled" : "failed");
     const std::string announce_content =
         "[Subagent '" + label + "' " + status_text +
         "]\n\nTask: " + task + "\n\nResult:\n" + final_result +
@@ -168,10 +411,11 @@ class SubagentManager : public SpawnManager {
     InboundMessage announce;
     announce.channel = "system";
     announce.sender_id = "subagent";
-    announce.chat_id = origin_channel + ":" + origin_chat_id;
+    announce.chat_id = job.origin_channel + ":" + job.origin_chat_id;
     announce.content = announce_content;
     bus_->publish_inbound(announce);
-    Logger::log(Logger::Level::kInfo, "Subagent [" + task_id + "] finished with status: " + status);
+    ATTOCLAW_LOG_INFO("Subagent [" + task_id + "] finished with status: " + status);
+    return status;
   }
 
   LLMProvider* provider_{nullptr};
@@ -188,7 +432,22 @@ class SubagentManager : public SpawnManager {
   int transcribe_timeout_seconds_{180};
   int exec_timeout_seconds_{60};
   bool restrict_to_workspace_{false};
-  std::shared_ptr<std::atomic<int>> running_count_;
+  std::shared_ptr<const ToolRegistry> tools_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<std::thread> workers_;
+  std::vector<std::shared_ptr<Job>> pending_;  // heap ordered by JobOrder
+  std::unordered_map<std::string, std::shared_ptr<Job>> jobs_;  // queued + running
+  std::deque<std::shared_ptr<Job>> finished_;
+  int max_concurrency_{4};
+  int max_queued_{32};
+  int running_{0};
+  uint64_t next_seq_{0};
+  uint64_t completed_{0};
+  uint64_t failed_{0};
+  uint64_t cancelled_{0};
+  bool stopping_{false};
 };
 
 }  // namespace attoclaw
@@ -0,0 +1,347 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+struct ProcessOutput {
+  bool ok{false};
+  int exit_code{-1};
+  bool timed_out{false};
+  std::string out;
+  std::string err;
+};
+
+// One child started with posix_spawnp (no shell), stdout/stderr on pipes and stdin either
+// /dev/null or a pipe fed once from collect(). Splitting spawn from collect lets a caller
+// start a process ahead of time and hand it input later. Killed on destruction if still
+// running. POSIX only; on Windows spawn() always fails.
+class ChildProcess {
+ public:
+  ChildProcess() = default;
+  ~ChildProcess() { kill(); }
+
+  ChildProcess(const ChildProcess&) = delete;
+  ChildProcess& operator=(const ChildProcess&) = delete;
+
+  // `cwd`, when set, is entered before exec through `sh -c 'cd "$0" && exec "$@"'`, which keeps
+  // argv unquoted and works without posix_spawn_file_actions_addchdir.
+  bool spawn(const std::vector<std::string>& argv, bool pipe_stdin = false, const fs::path& cwd = {},
+             std::string* error = nullptr) {
+    if (argv.empty()) {
+      set_error(error, "Error: empty command");
+      return false;
+    }
+#ifdef _WIN32
+    (void)pipe_stdin;
+    (void)cwd;
+    set_error(error, "Error: ChildProcess is not available on Windows");
+    return false;
+#else
+    kill();
+    status_ = 0;
+    std::vector<std::string> full;
+    if (!cwd.empty()) {
+      full = {"/bin/sh", "-c", "cd \"$0\" && exec \"$@\"", cwd.string()};
+    }
+    full.insert(full.end(), argv.begin(), argv.end());
+
+    int in_pipe[2] = {-1, -1};
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1};
+    if ((pipe_stdin && !open_pipe(in_pipe)) || !open_pipe(out_pipe) || !open_pipe(err_pipe)) {
+      for (int fd : {in_pipe[0], in_pipe[1], out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]}) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+      set_error(error, "Error: pipe() failed");
+      return false;
+    }
+
+    std::vector<char*> cargv;
+    cargv.reserve(full.size() + 1);
+    for (const auto& a : full) {
+      cargv.push_back(const_cast<char*>(a.c_str()));
+    }
+    cargv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    // Every pipe end is close-on-exec; dup2 onto 0/1/2 clears the flag for the child's copies.
+    if (pipe_stdin) {
+      posix_spawn_file_actions_adddup2(&actions, in_pipe[0], 0);
+    } else {
+      posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    }
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], 2);
+
+    const int rc = ::posix_spawnp(&pid_, cargv[0], &actions, nullptr, cargv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (pipe_stdin) {
+      ::close(in_pipe[0]);
+    }
+    ::close(out_pipe[1]);
+    ::close(err_pipe[1]);
+    if (rc != 0) {
+      pid_ = -1;
+      for (int fd : {in_pipe[1], out_pipe[0], err_pipe[0]}) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+      set_error(error, "Error: failed to start " + argv[0]);
+      return false;
+    }
+    stdin_fd_ = in_pipe[1];
+    out_fd_ = out_pipe[0];
+    err_fd_ = err_pipe[0];
+    started_ = std::chrono::steady_clock::now();
+    return true;
+#endif
+  }
+
+  // False once the child has exited; its status is kept for collect().
+  bool running() {
+#ifdef _WIN32
+    return false;
+#else
+    if (pid_ <= 0 || exited_) {
+      return false;
+    }
+    if (::waitpid(pid_, &status_, WNOHANG) == pid_) {
+      exited_ = true;
+      return false;
+    }
+    return true;
+#endif
+  }
+
+  // Seconds since spawn().
+  double age_seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+  }
+
+  // Queues `data` for the child's stdin. collect() writes it while draining stdout and
+  // stderr, then closes stdin so the child sees EOF; writing it all up front could block
+  // on a full pipe while the child blocks on a full stdout.
+  bool queue_stdin(std::string data) {
+    if (stdin_fd_ < 0) {
+      return false;
+    }
+    stdin_data_ = std::move(data);
+    return true;
+  }
+
+  static constexpr int kCancelPollMs = 250;
+
+  // Writes queued stdin and reads stdout/stderr until the child exits, then reaps it. `on_out`
+  // sees each stdout chunk as it arrives. The child is killed on timeout, once stdout exceeds
+  // max_output bytes, or within kCancelPollMs of `*cancel` turning true.
+  ProcessOutput collect(int timeout_s, std::size_t max_output = 256u * 1024u * 1024u,
+                        const std::function<void(std::string_view)>& on_out = {},
+                        const std::atomic<bool>* cancel = nullptr) {
+    ProcessOutput result;
+#ifdef _WIN32
+    (void)timeout_s;
+    (void)max_output;
+    (void)on_out;
+    (void)cancel;
+    result.err = "Error: ChildProcess is not available on Windows";
+    return result;
+#else
+    if (pid_ <= 0) {
+      result.err = "Error: process not started";
+      return result;
+    }
+    // A child that exits without reading stdin must not take the whole process down.
+    static const bool sigpipe_ignored = (::signal(SIGPIPE, SIG_IGN), true);
+    (void)sigpipe_ignored;
+    const std::string input = std::move(stdin_data_);
+    stdin_data_.clear();
+    std::size_t written = 0;
+    if (stdin_fd_ >= 0 && input.empty()) {
+      ::close(stdin_fd_);
+      stdin_fd_ = -1;
+    } else if (stdin_fd_ >= 0) {
+      ::fcntl(stdin_fd_, F_SETFL, ::fcntl(stdin_fd_, F_GETFL) | O_NONBLOCK);
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s);
+    pollfd fds[3] = {{out_fd_, POLLIN, 0}, {err_fd_, POLLIN, 0}, {stdin_fd_, POLLOUT, 0}};
+    out_fd_ = -1;
+    err_fd_ = -1;
+    stdin_fd_ = -1;
+    int open_fds = 2;
+    bool killed = false;
+    bool cancelled = false;
+    char buf[65536];
+    while (open_fds > 0) {
+      const auto left =
+          std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0) {
+        result.timed_out = true;
+        break;
+      }
+      if (cancel && cancel->load()) {
+        cancelled = true;
+        break;
+      }
+      const int n = ::poll(fds, 3, static_cast<int>((std::min<long long>)(left, cancel ? kCancelPollMs : 1000)));
+      if (n < 0 && errno != EINTR) {
+        break;
+      }
+      if (n > 0 && fds[2].fd >= 0 && fds[2].revents != 0) {
+        const ssize_t put = ::write(fds[2].fd, input.data() + written, input.size() - written);
+        if (put > 0) {
+          written += static_cast<std::size_t>(put);
+        }
+        if (written == input.size() || (put < 0 && errno != EAGAIN && errno != EINTR)) {
+          ::close(fds[2].fd);  // done, or the child closed its end
+          fds[2].fd = -1;
+        }
+      }
+      for (int i = 0; i < 2 && n > 0; ++i) {
+        if (fds[i].fd < 0 || (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+          continue;
+        }
+        const ssize_t got = ::read(fds[i].fd, buf, sizeof(buf));
+        if (got > 0) {
+          std::string& sink = i == 0 ? result.out : result.err;
+          if (i == 1 && sink.size() > 64 * 1024) {
+            continue;  // keep only the head of stderr
+          }
+          sink.append(buf, static_cast<std::size_t>(got));
+          if (i == 0 && on_out) {
+            on_out(std::string_view(buf, static_cast<std::size_t>(got)));
+          }
+          if (i == 0 && sink.size() > max_output) {
+            killed = true;
+            break;
+          }
+        } else if (got == 0 || errno != EINTR) {
+          ::close(fds[i].fd);
+          fds[i].fd = -1;
+          --open_fds;
+        }
+      }
+      if (killed) {
+        break;
+      }
+    }
+    if ((result.timed_out || killed || cancelled) && !exited_) {
+      ::kill(pid_, SIGKILL);
+    }
+    for (const auto& p : fds) {
+      if (p.fd >= 0) {
+        ::close(p.fd);
+      }
+    }
+
+    if (!exited_) {
+      while (::waitpid(pid_, &status_, 0) < 0 && errno == EINTR) {
+      }
+    }
+    const int status = status_;
+    pid_ = -1;
+    exited_ = false;
+    result.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    if (killed) {
+      result.err = "Error: output exceeded " + std::to_string(max_output) + " bytes";
+    } else if (result.timed_out) {
+      result.err = "Error: command timed out";
+    } else if (cancelled) {
+      result.err = "Error: cancelled";
+    }
+    result.ok = !killed && !result.timed_out && !cancelled && result.exit_code == 0;
+    return result;
+#endif
+  }
+
+  void kill() {
+#ifndef _WIN32
+    for (int* fd : {&stdin_fd_, &out_fd_, &err_fd_}) {
+      if (*fd >= 0) {
+        ::close(*fd);
+        *fd = -1;
+      }
+    }
+    stdin_data_.clear();
+    if (pid_ > 0 && !exited_) {
+      ::kill(pid_, SIGKILL);
+      while (::waitpid(pid_, nullptr, 0) < 0 && errno == EINTR) {
+      }
+    }
+    pid_ = -1;
+    exited_ = false;
+#endif
+  }
+
+ private:
+  static void set_error(std::string* error, const std::string& msg) {
+    if (error) {
+      *error = msg;
+    }
+  }
+
+#ifndef _WIN32
+  // Both ends close-on-exec from creation, so a child spawned concurrently from another
+  // thread never inherits them. Without pipe2 (macOS) the flag is set right after.
+  static bool open_pipe(int fds[2]) {
+#ifdef __linux__
+    return ::pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (::pipe(fds) != 0) {
+      return false;
+    }
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+  }
+
+  pid_t pid_{-1};
+  int status_{0};
+  bool exited_{false};
+#endif
+  int stdin_fd_{-1};
+  std::string stdin_data_;
+  int out_fd_{-1};
+  int err_fd_{-1};
+  std::chrono::steady_clock::time_point started_{};
+};
+
+// Runs argv[0] (looked up in PATH) without a shell, stdin from /dev/null, and collects
+// stdout/stderr through pipes. Binary-safe, so callers can stream converted media
+// straight into memory instead of through a temp file. The child is killed on timeout
+// or once stdout exceeds max_output bytes.
+inline ProcessOutput run_process_capture(const std::vector<std::string>& argv, int timeout_s = 60,
+                                         std::size_t max_output = 256u * 1024u * 1024u) {
+  ChildProcess child;
+  ProcessOutput result;
+  if (!child.spawn(argv, false, {}, &result.err)) {
+    return result;
+  }
+  return child.collect(timeout_s, max_output);
+}
+
+}  // namespace attoclaw
@@ -1,8 +1,12 @@
 ﻿#pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <filesystem>
@@ -13,10 +17,59 @@
 
 namespace attoclaw {
 
+// Classic token bucket (tokens per second, capacity `burst`). Not synchronized.
+class TokenBucket {
+ public:
+  TokenBucket(double rate_per_s = 1.0, double burst = 1.0)
+      : rate_per_ms_((std::max)(rate_per_s, 0.001) / 1000.0), burst_((std::max)(burst, 1.0)), tokens_(burst_) {}
+
+  // Earliest time a token is available (now if one is already there).
+  int64_t ready_at_ms(int64_t now) {
+    refill(now);
+    const int64_t t = tokens_ >= 1.0 ? now : now + static_cast<int64_t>((1.0 - tokens_) / rate_per_ms_) + 1;
+    return (std::max)(t, blocked_until_ms_);
+  }
+
+  void take(int64_t now) {
+    refill(now);
+    tokens_ -= 1.0;
+  }
+
+  // True once the bucket has refilled completely and no pause is pending, i.e. it holds
+  // no state a freshly constructed bucket would not.
+  bool idle(int64_t now) {
+    refill(now);
+    return tokens_ >= burst_ && now >= blocked_until_ms_;
+  }
+
+  // Server-imposed pause (e.g. Telegram's retry_after); also empties the bucket.
+  void block_until(int64_t t) {
+    blocked_until_ms_ = (std::max)(blocked_until_ms_, t);
+    tokens_ = (std::min)(tokens_, 0.0);
+  }
+
+ private:
+  void refill(int64_t now) {
+    if (last_ms_ != 0 && now > last_ms_) {
+      tokens_ = (std::min)(burst_, tokens_ + static_cast<double>(now - last_ms_) * rate_per_ms_);
+    }
+    last_ms_ = (std::max)(last_ms_, now);
+  }
+
+  double rate_per_ms_;
+  double burst_;
+  double tokens_;
+  int64_t last_ms_{0};
+  int64_t blocked_until_ms_{0};
+};
+
 class TelegramChannel : public BaseChannel {
  public:
   TelegramChannel(const TelegramChannelConfig& config, MessageBus* bus)
-      : BaseChannel("telegram", bus), config_(config), token_(config.token) {
+      : BaseChannel("telegram", bus),
+        config_(config),
+        token_(config.token),
+        global_bucket_(config.global_messages_per_second, config.global_messages_per_second) {
     for (const auto& x : config_.allow_from) {
       allow_from_.insert(trim(x));
     }
@@ -27,13 +80,20 @@ class TelegramChannel : public BaseChannel {
       return;
     }
     if (trim(token_).empty()) {
-      Logger::log(Logger::Level::kWarn, "Telegram enabled but token is empty; channel will not start.");
+      ATTOCLAW_LOG_WARN("Telegram enabled but token is empty; channel will not start.");
       running_.store(false);
       return;
     }
 
     worker_ = std::thread([this]() { poll_loop(); });
-    Logger::log(Logger::Level::kInfo, "Telegram channel started");
+    {
+      std::lock_guard<std::mutex> lock(send_mu_);
+      senders_running_ = true;
+    }
+    for (int i = 0; i < (std::max)(1, config_.send_workers); ++i) {
+      senders_.emplace_back([this]() { send_worker(); });
+    }
+    ATTOCLAW_LOG_INFO("Telegram channel started");
   }
 
   void stop() override {
@@ -43,29 +103,44 @@ class TelegramChannel : public BaseChannel {
     if (worker_.joinable()) {
       worker_.join();
     }
-    Logger::log(Logger::Level::kInfo, "Telegram channel stopped");
+    {
+      std::lock_guard<std::mutex> lock(send_mu_);
+      senders_running_ = false;
+      drain_deadline_ms_ = now_ms() + kDrainOnStopMs;
+    }
+    send_cv_.notify_all();
+    for (auto& t : senders_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+    senders_.clear();
+    ATTOCLAW_LOG_INFO("Telegram channel stopped");
   }
 
+  // Queues the reply's chunks on the chat's queue. Send workers deliver chats in parallel,
+  // chunks of one chat in order, within the per-chat and global token buckets. Without
+  // start() (one-shot CLI send) the chunks are delivered inline under the same limits.
   void send(const OutboundMessage& msg) override {
     if (trim(token_).empty()) {
       return;
     }
     constexpr std::size_t kLimit = 3900;
+    const int64_t now = now_ms();
+    std::unique_lock<std::mutex> lock(send_mu_);
+    prune_chat_buckets_locked(now);
+    ChatQueue& chat = chats_[msg.chat_id];
+    for (auto& part : chunk_text(msg.content, kLimit)) {
+      chat.parts.push_back(PendingPart{std::move(part), now, 0});
+    }
+    if (senders_running_) {
+      lock.unlock();
+      send_cv_.notify_all();
+      return;
+    }
+    lock.unlock();
     thread_local HttpClient client;
-    const std::string url = api_base() + "/sendMessage";
-    for (const auto& part : chunk_text(msg.content, kLimit)) {
-      json payload = {
-          {"chat_id", msg.chat_id},
-          {"text", part},
-      };
-      HttpResponse resp =
-          client.post(url, payload.dump(), {{"Content-Type", "application/json"}}, 15, true, 3);
-      if (!resp.error.empty() || resp.status < 200 || resp.status >= 300) {
-        Logger::log(Logger::Level::kWarn,
-                    "Telegram send failed: " +
-                        (!resp.error.empty() ? resp.error : ("HTTP " + std::to_string(resp.status))));
-        break;
-      }
+    while (deliver_next(client, msg.chat_id, true)) {
     }
   }
 
@@ -185,7 +260,7 @@ class TelegramChannel : public BaseChannel {
     const std::string url = api_base() + "/getFile?file_id=" + file_id;
     HttpResponse resp = client.get(url, {}, 20, true, 3);
     if (!resp.error.empty() || resp.status < 200 || resp.status >= 300) {
-      Logger::log(Logger::Level::kWarn, "Telegram getFile failed");
+      ATTOCLAW_LOG_WARN("Telegram getFile failed");
       return std::nullopt;
     }
 
@@ -211,7 +286,7 @@ class TelegramChannel : public BaseChannel {
       const std::string file_url = "https://api.telegram.org/file/bot" + token_ + "/" + file_path;
       HttpResponse dl = client.download_to_file(file_url, {}, out, 60, true, 3);
       if (!dl.error.empty() || dl.status < 200 || dl.status >= 300) {
-        Logger::log(Logger::Level::kWarn, "Telegram file download failed");
+        ATTOCLAW_LOG_WARN("Telegram file download failed");
         return std::nullopt;
       }
       return fs::absolute(out);
@@ -232,13 +307,13 @@ class TelegramChannel : public BaseChannel {
         break;
       }
       if (!resp.error.empty()) {
-        Logger::log(Logger::Level::kWarn, "Telegram getUpdates error: " + resp.error);
+        ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "Telegram getUpdates error: " + resp.error);
         std::this_thread::sleep_for(std::chrono::seconds(2));
         continue;
       }
       if (resp.status < 200 || resp.status >= 300) {
-        Logger::log(Logger::Level::kWarn,
-                    "Telegram getUpdates HTTP error: " + std::to_string(resp.status));
+        ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs,
+                                   "Telegram getUpdates HTTP error: " + std::to_string(resp.status));
         std::this_thread::sleep_for(std::chrono::seconds(2));
         continue;
       }
@@ -258,11 +333,186 @@ class TelegramChannel : public BaseChannel {
           process_update(update);
         }
       } catch (const std::exception& e) {
-        Logger::log(Logger::Level::kWarn, std::string("Telegram parse error: ") + e.what());
+        ATTOCLAW_LOG_WARN(std::string("Telegram parse error: ") + e.what());
+      }
+    }
+  }
+
+  static constexpr int64_t kDrainOnStopMs = 5000;
+  static constexpr int kMaxAttempts = 4;
+  static constexpr int64_t kBucketPruneIntervalMs = 10000;
+
+  struct PendingPart {
+    std::string text;
+    int64_t enqueued_ms{0};
+    int attempts{0};
+  };
+
+  struct ChatQueue {
+    std::deque<PendingPart> parts;
+    bool busy{false};
+  };
+
+  // Per-chat buckets outlive the chat's queue so back-to-back replies stay within the
+  // per-chat limit; they are dropped once refilled, when they no longer carry any state.
+  TokenBucket& chat_bucket_locked(const std::string& chat_id) {
+    auto it = chat_buckets_.find(chat_id);
+    if (it == chat_buckets_.end()) {
+      it = chat_buckets_.emplace(chat_id, TokenBucket(config_.chat_messages_per_second, 1.0)).first;
+    }
+    return it->second;
+  }
+
+  void prune_chat_buckets_locked(int64_t now) {
+    if (now - last_bucket_prune_ms_ < kBucketPruneIntervalMs) {
+      return;
+    }
+    last_bucket_prune_ms_ = now;
+    for (auto it = chat_buckets_.begin(); it != chat_buckets_.end();) {
+      if (chats_.find(it->first) == chats_.end() && it->second.idle(now)) {
+        it = chat_buckets_.erase(it);
+      } else {
+        ++it;
       }
     }
   }
 
+  struct PostResult {
+    bool ok{false};
+    bool retry{false};
+    int64_t retry_after_ms{0};
+  };
+
+  PostResult post_part(HttpClient& client, const std::string& chat_id, const std::string& text) {
+    const json payload = {{"chat_id", chat_id}, {"text", text}};
+    const auto t0 = std::chrono::steady_clock::now();
+    HttpResponse resp =
+        client.post(api_base() + "/sendMessage", payload.dump(), {{"Content-Type", "application/json"}}, 15, true, 3);
+    metrics().observe("telegram.send_latency_seconds",
+                      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+
+    PostResult out;
+    if (resp.status == 429) {
+      metrics().inc("telegram.rate_limited");
+      out.retry = true;
+      out.retry_after_ms = 1000;
+      try {
+        const json body = json::parse(resp.body);
+        if (body.contains("parameters") && body["parameters"].is_object()) {
+          out.retry_after_ms = (std::max)(1, body["parameters"].value("retry_after", 1)) * 1000LL;
+        }
+      } catch (...) {
+      }
+      return out;
+    }
+    if (!resp.error.empty() || resp.status < 200 || resp.status >= 300) {
+      ATTOCLAW_LOG_WARN("Telegram send failed: " +
+                        (!resp.error.empty() ? resp.error : ("HTTP " + std::to_string(resp.status))));
+      metrics().inc("telegram.send_error");
+      out.retry = !resp.error.empty() || resp.status >= 500;
+      out.retry_after_ms = 1000;
+      return out;
+    }
+    metrics().inc("telegram.sent");
+    out.ok = true;
+    return out;
+  }
+
+  // Sends the next chunk of `chat_id` once both buckets allow it. Returns false when the
+  // chat has nothing left (or, for inline callers, when it was abandoned). Inline callers
+  // also wait out a send worker still draining the same chat after stop().
+  bool deliver_next(HttpClient& client, const std::string& chat_id, bool inline_caller) {
+    std::unique_lock<std::mutex> lock(send_mu_);
+    auto it = chats_.find(chat_id);
+    while (inline_caller && it != chats_.end() && !it->second.parts.empty()) {
+      const int64_t now = now_ms();
+      if (it->second.busy) {
+        send_cv_.wait_for(lock, std::chrono::milliseconds(100));
+      } else {
+        const int64_t ready =
+            (std::max)(chat_bucket_locked(chat_id).ready_at_ms(now), global_bucket_.ready_at_ms(now));
+        if (ready <= now) {
+          break;
+        }
+        send_cv_.wait_for(lock, std::chrono::milliseconds(ready - now));
+      }
+      it = chats_.find(chat_id);
+    }
+    if (it == chats_.end() || it->second.parts.empty()) {
+      return false;
+    }
+    ChatQueue& chat = it->second;
+    const int64_t now = now_ms();
+    chat_bucket_locked(chat_id).take(now);
+    global_bucket_.take(now);
+    PendingPart part = std::move(chat.parts.front());
+    chat.parts.pop_front();
+    chat.busy = true;
+    lock.unlock();
+
+    metrics().observe("telegram.send_queue_delay_seconds", static_cast<double>(now - part.enqueued_ms) / 1000.0);
+    const PostResult res = post_part(client, chat_id, part.text);
+
+    lock.lock();
+    ChatQueue& after = chats_[chat_id];
+    after.busy = false;
+    if (!res.ok && res.retry && ++part.attempts < kMaxAttempts) {
+      chat_bucket_locked(chat_id).block_until(now_ms() + res.retry_after_ms);
+      after.parts.push_front(std::move(part));
+    } else if (!res.ok) {
+      after.parts.clear();  // later chunks would read out of context without this one
+    }
+    const bool more = !after.parts.empty();
+    if (!more) {
+      chats_.erase(chat_id);
+    }
+    lock.unlock();
+    send_cv_.notify_all();
+    return more;
+  }
+
+  void send_worker() {
+    HttpClient client;
+    std::unique_lock<std::mutex> lock(send_mu_);
+    while (true) {
+      if (!senders_running_ && (chats_.empty() || now_ms() >= drain_deadline_ms_)) {
+        break;
+      }
+      // Pick the idle chat whose next chunk becomes sendable first.
+      const int64_t now = now_ms();
+      std::string best;
+      int64_t best_ready = INT64_MAX;
+      for (auto& [id, chat] : chats_) {
+        if (chat.busy || chat.parts.empty()) {
+          continue;
+        }
+        const int64_t ready = chat_bucket_locked(id).ready_at_ms(now);
+        if (ready < best_ready) {
+          best_ready = ready;
+          best = id;
+        }
+      }
+      if (best.empty()) {
+        if (senders_running_) {
+          send_cv_.wait(lock);
+        } else {
+          send_cv_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        continue;
+      }
+      best_ready = (std::max)(best_ready, global_bucket_.ready_at_ms(now));
+      if (best_ready > now) {
+        metrics().inc("telegram.throttled");
+        send_cv_.wait_for(lock, std::chrono::milliseconds(best_ready - now));
+        continue;
+      }
+      chats_[best].busy = true;  // claimed before unlocking so chunks of one chat stay ordered
+      lock.unlock();
+      deliver_next(client, best, false);
+      lock.lock();
+    }
+  }
+
   std::string api_base() const { return "https://api.telegram.org/bot" + token_; }
 
   TelegramChannelConfig config_;
@@ -271,6 +521,16 @@ class TelegramChannel : public BaseChannel {
   std::atomic<bool> running_{false};
   std::thread worker_;
   long long next_update_offset_{0};
+
+  std::mutex send_mu_;
+  std::condition_variable send_cv_;
+  std::unordered_map<std::string, ChatQueue> chats_;
+  std::unordered_map<std::string, TokenBucket> chat_buckets_;
+  int64_t last_bucket_prune_ms_{0};
+  TokenBucket global_bucket_;
+  std::vector<std::thread> senders_;
+  bool senders_running_{false};
+  int64_t drain_deadline_ms_{0};
 };
 
 }  // namespace attoclaw
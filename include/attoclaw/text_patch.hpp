@@ -0,0 +1,272 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/mapped_file.hpp"
+
+namespace attoclaw {
+
+struct TextEdit {
+  std::string old_text;
+  std::string new_text;
+  bool replace_all{false};
+};
+
+// Applies every edit against the original `content` in a single output pass. Each
+// old_text must occur exactly once (or at least once with replace_all) and matches may
+// not overlap; otherwise nothing is applied and `error` says why. `replacements` gets
+// the number of spans replaced.
+inline std::optional<std::string> apply_text_edits(std::string_view content, const std::vector<TextEdit>& edits,
+                                                   std::string& error, std::size_t* replacements = nullptr) {
+  struct Span {
+    std::size_t pos;
+    std::size_t len;
+    const std::string* with;
+  };
+  std::vector<Span> spans;
+  for (std::size_t i = 0; i < edits.size(); ++i) {
+    const TextEdit& e = edits[i];
+    const std::string label = edits.size() > 1 ? "edit " + std::to_string(i + 1) + ": " : "";
+    if (e.old_text.empty()) {
+      error = label + "old_text is empty";
+      return std::nullopt;
+    }
+    const char* base = content.data();
+    const char* end = base + content.size();
+    const char* hit = find_bytes(base, content.size(), e.old_text);
+    if (!hit) {
+      error = label + "old_text not found in file";
+      return std::nullopt;
+    }
+    while (hit) {
+      spans.push_back(Span{static_cast<std::size_t>(hit - base), e.old_text.size(), &e.new_text});
+      const char* from = hit + e.old_text.size();
+      hit = find_bytes(from, static_cast<std::size_t>(end - from), e.old_text);
+      if (hit && !e.replace_all) {
+        error = label + "old_text appears multiple times; provide a more specific pattern or set replace_all";
+        return std::nullopt;
+      }
+    }
+  }
+  std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.pos < b.pos; });
+  std::size_t grow = 0;
+  for (std::size_t i = 0; i < spans.size(); ++i) {
+    if (i > 0 && spans[i].pos < spans[i - 1].pos + spans[i - 1].len) {
+      error = "edits overlap at byte " + std::to_string(spans[i].pos);
+      return std::nullopt;
+    }
+    grow += spans[i].with->size();
+  }
+
+  std::string out;
+  out.reserve(content.size() + grow);
+  std::size_t at = 0;
+  for (const auto& s : spans) {
+    out.append(content.substr(at, s.pos - at));
+    out.append(*s.with);
+    at = s.pos + s.len;
+  }
+  out.append(content.substr(at));
+  if (replacements) {
+    *replacements = spans.size();
+  }
+  return out;
+}
+
+// Applies a unified diff (as produced by `diff -u` / `git diff`) to one file's content.
+// File headers are ignored; a multi-file diff contributes only its first file's hunks.
+// Each hunk ends once the line counts in its @@ header are consumed, and a hunk whose body
+// disagrees with those counts is rejected. Context and removed lines must match the file;
+// a hunk that drifted is searched for near its stated position. Hunks are applied in one
+// pass; on any mismatch nothing is applied.
+inline std::optional<std::string> apply_unified_diff(std::string_view content, std::string_view patch,
+                                                     std::string& error, std::size_t* hunks_applied = nullptr) {
+  // Split the file into lines without their '\n'; remember a trailing '\r' separately so
+  // patches written with plain '\n' still match CRLF files.
+  std::vector<std::string_view> lines;
+  for (std::size_t at = 0; at < content.size();) {
+    const std::size_t nl = content.find('\n', at);
+    const std::size_t stop = nl == std::string_view::npos ? content.size() : nl;
+    lines.push_back(content.substr(at, stop - at));
+    at = stop + 1;
+  }
+  const bool ends_with_newline = !content.empty() && content.back() == '\n';
+  const bool crlf = !lines.empty() && !lines.front().empty() && lines.front().back() == '\r';
+  auto strip_cr = [](std::string_view s) {
+    return !s.empty() && s.back() == '\r' ? s.substr(0, s.size() - 1) : s;
+  };
+
+  struct Hunk {
+    std::size_t old_start{0};  // 1-based, as in the header
+    std::size_t old_count{1};
+    std::size_t new_count{1};
+    std::vector<std::string_view> old_lines;
+    std::vector<std::string_view> new_lines;
+    bool new_has_no_newline{false};
+  };
+  // "-l[,s]" / "+l[,s]": a missing count means one line.
+  auto parse_range = [](std::string_view header, char sign, std::size_t& start, std::size_t& count) {
+    const std::size_t at = header.find(sign, 2);
+    if (at == std::string_view::npos || at + 1 >= header.size() ||
+        !std::isdigit(static_cast<unsigned char>(header[at + 1]))) {
+      return false;
+    }
+    const std::string range(header.substr(at + 1, header.find(' ', at) - at - 1));
+    char* end = nullptr;
+    start = static_cast<std::size_t>(std::strtoul(range.c_str(), &end, 10));
+    count = 1;
+    if (*end == ',') {
+      count = static_cast<std::size_t>(std::strtoul(end + 1, &end, 10));
+    }
+    return *end == '\0';
+  };
+  std::vector<Hunk> hunks;
+  std::size_t old_left = 0;  // lines the open hunk still owes, per its header
+  std::size_t new_left = 0;
+  auto close_hunk = [&]() {
+    if (!hunks.empty() && (old_left > 0 || new_left > 0)) {
+      const Hunk& h = hunks.back();
+      error = "hunk " + std::to_string(hunks.size()) + " (line " + std::to_string(h.old_start) + ") has " +
+              std::to_string(h.old_lines.size()) + "/" + std::to_string(h.new_lines.size()) +
+              " old/new lines but its header says " + std::to_string(h.old_count) + "/" +
+              std::to_string(h.new_count);
+      return false;
+    }
+    return true;
+  };
+  std::size_t at = 0;
+  char last_kind = 0;
+  while (at < patch.size()) {
+    std::size_t nl = patch.find('\n', at);
+    if (nl == std::string_view::npos) {
+      nl = patch.size();
+    }
+    std::string_view line = strip_cr(patch.substr(at, nl - at));
+    at = nl + 1;
+    if (line.rfind("\\ No newline", 0) == 0) {
+      if (!hunks.empty() && (last_kind == '+' || last_kind == ' ')) {
+        hunks.back().new_has_no_newline = true;
+      }
+      continue;
+    }
+    if (old_left == 0 && new_left == 0) {
+      // Between hunks: a new header, or ---/+++/diff/index lines and blank separators.
+      // Once hunks exist, the next file's header ends this file's part of the diff.
+      if (!hunks.empty() && (line.rfind("--- ", 0) == 0 || line.rfind("diff ", 0) == 0)) {
+        break;
+      }
+      if (line.rfind("@@", 0) != 0) {
+        continue;
+      }
+      Hunk h;
+      std::size_t new_start = 0;
+      if (!parse_range(line, '-', h.old_start, h.old_count) || !parse_range(line, '+', new_start, h.new_count)) {
+        error = "malformed hunk header: " + std::string(line);
+        return std::nullopt;
+      }
+      old_left = h.old_count;
+      new_left = h.new_count;
+      hunks.push_back(std::move(h));
+      last_kind = 0;
+      continue;
+    }
+    Hunk& h = hunks.back();
+    // Some editors strip the lone space of an empty context line.
+    const char kind = line.empty() ? ' ' : line[0];
+    const std::string_view body = line.empty() ? line : line.substr(1);
+    if (kind == ' ' && old_left > 0 && new_left > 0) {
+      h.old_lines.push_back(body);
+      h.new_lines.push_back(body);
+      --old_left;
+      --new_left;
+    } else if (kind == '-' && old_left > 0) {
+      h.old_lines.push_back(body);
+      --old_left;
+    } else if (kind == '+' && new_left > 0) {
+      h.new_lines.push_back(body);
+      --new_left;
+    } else {
+      close_hunk();
+      return std::nullopt;
+    }
+    last_kind = kind;
+  }
+  if (!close_hunk()) {
+    return std::nullopt;
+  }
+  if (hunks.empty()) {
+    error = "patch has no @@ hunks";
+    return std::nullopt;
+  }
+
+  auto matches_at = [&](const Hunk& h, std::size_t first) {
+    if (first + h.old_lines.size() > lines.size()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < h.old_lines.size(); ++i) {
+      if (strip_cr(lines[first + i]) != h.old_lines[i]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::string out;
+  out.reserve(content.size() + patch.size());
+  const std::string_view eol = crlf ? "\r\n" : "\n";
+  std::size_t next = 0;  // first file line not yet copied
+  bool last_line_open = false;
+  for (std::size_t hi = 0; hi < hunks.size(); ++hi) {
+    const Hunk& h = hunks[hi];
+    // Pure insertions at the top say "-0,0"; otherwise the header is 1-based.
+    const std::size_t expected = h.old_start == 0 ? 0 : h.old_start - 1 + (h.old_lines.empty() ? 1 : 0);
+    std::optional<std::size_t> found;
+    for (std::size_t d = 0; !found && d <= lines.size(); ++d) {
+      const std::size_t below = expected - d;
+      const std::size_t above = expected + d;
+      if (expected >= d && below >= next && matches_at(h, below)) {
+        found = below;
+      } else if (d > 0 && above >= next && above <= lines.size() && matches_at(h, above)) {
+        found = above;
+      }
+    }
+    if (!found) {
+      error = "hunk " + std::to_string(hi + 1) + " (line " + std::to_string(h.old_start) +
+              ") does not match the file";
+      return std::nullopt;
+    }
+    for (; next < *found; ++next) {
+      out.append(lines[next]);
+      out.append("\n");
+    }
+    for (std::size_t i = 0; i < h.new_lines.size(); ++i) {
+      out.append(h.new_lines[i]);
+      out.append(eol);
+    }
+    next = *found + h.old_lines.size();
+    last_line_open = h.new_has_no_newline && next == lines.size();
+  }
+  for (; next < lines.size(); ++next) {
+    out.append(lines[next]);
+    if (next + 1 < lines.size() || ends_with_newline) {
+      out.append("\n");
+    }
+    last_line_open = false;
+  }
+  if (last_line_open && !out.empty()) {
+    out.resize(out.size() - eol.size());
+  }
+  if (hunks_applied) {
+    *hunks_applied = hunks.size();
+  }
+  return out;
+}
+
+}  // namespace attoclaw
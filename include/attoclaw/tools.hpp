@@ -2,8 +2,10 @@
 
 #include <atomic>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
+#include <optional>
 #include <regex>
 #include <string>
 #include <unordered_map>
@@ -12,11 +14,28 @@
 
 #include "attoclaw/common.hpp"
 #include "attoclaw/events.hpp"
+#include "attoclaw/fs_walk.hpp"
 #include "attoclaw/http.hpp"
+#include "attoclaw/mapped_file.hpp"
+#include "attoclaw/procfs.hpp"
+#include "attoclaw/memory.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/schema_validator.hpp"
+#include "attoclaw/text_patch.hpp"
+#include "attoclaw/trace.hpp"
+#include "attoclaw/transcription.hpp"
 #include "attoclaw/vision.hpp"
 
 namespace attoclaw {
 
+// Per-request state handed to tools at execution time, so one tool instance (and one
+// registry) can be shared by the agent loop and any number of concurrent subagents.
+struct ToolContext {
+  std::string channel;
+  std::string chat_id;
+  bool vision_enabled{false};
+};
+
 class Tool {
  public:
   virtual ~Tool() = default;
@@ -26,112 +45,69 @@ class Tool {
   virtual json parameters() const = 0;
   virtual std::string execute(const json& params) = 0;
 
+  // Registries are shared across the agent loop and subagents, so execute() can run on
+  // several threads at once. Tools that keep no unguarded state return true; the rest are
+  // serialised by ToolRegistry, one call at a time per tool.
+  virtual bool concurrency_safe() const { return false; }
+
+  // Tools that depend on the originating chat or request flags override this overload.
+  virtual std::string execute(const json& params, const ToolContext& ctx) {
+    (void)ctx;
+    return execute(params);
+  }
+
+  // ToolRegistry validates through a SchemaValidator compiled once at registration; this
+  // compiles one per call and is meant for tools used outside a registry.
   virtual std::vector<std::string> validate(const json& params) const {
-    json schema = parameters();
-    std::vector<std::string> errors;
-    validate_node(params, schema, "parameter", errors);
-    return errors;
+    return SchemaValidator(parameters()).validate(params);
   }
 
   json to_schema() const {
     return json{{"type", "function"},
                 {"function", {{"name", name()}, {"description", description()}, {"parameters", parameters()}}}};
   }
-
- private:
-  static bool type_ok(const json& value, const std::string& type_name) {
-    if (type_name == "string") {
-      return value.is_string();
-    }
-    if (type_name == "integer") {
-      return value.is_number_integer();
-    }
-    if (type_name == "number") {
-      return value.is_number();
-    }
-    if (type_name == "boolean") {
-      return value.is_boolean();
-    }
-    if (type_name == "array") {
-      return value.is_array();
-    }
-    if (type_name == "object") {
-      return value.is_object();
-    }
-    return true;
-  }
-
-  static void validate_node(const json& value, const json& schema, const std::string& label,
-                            std::vector<std::string>& errors) {
-    const std::string t = schema.value("type", "");
-    if (!t.empty() && !type_ok(value, t)) {
-      errors.push_back(label + " should be " + t);
-      return;
-    }
-
-    if (schema.contains("enum") && schema["enum"].is_array()) {
-      bool ok = false;
-      for (const auto& e : schema["enum"]) {
-        if (e == value) {
-          ok = true;
-          break;
-        }
-      }
-      if (!ok) {
-        errors.push_back(label + " has invalid enum value");
-      }
-    }
-
-    if (t == "object") {
-      const json props = schema.value("properties", json::object());
-      if (schema.contains("required") && schema["required"].is_array()) {
-        for (const auto& req : schema["required"]) {
-          const std::string key = req.get<std::string>();
-          if (!value.contains(key)) {
-            errors.push_back("missing required " + label + "." + key);
-          }
-        }
-      }
-
-      for (auto it = value.begin(); it != value.end(); ++it) {
-        if (props.contains(it.key())) {
-          validate_node(it.value(), props[it.key()], label + "." + it.key(), errors);
-        }
-      }
-    }
-
-    if (t == "array" && schema.contains("items") && value.is_array()) {
-      std::size_t i = 0;
-      for (const auto& item : value) {
-        validate_node(item, schema["items"], label + "[" + std::to_string(i) + "]", errors);
-        ++i;
-      }
-    }
-  }
 };
 
+// Built once, then only read: execute() is const and tools take per-request state through
+// ToolContext, so a registry can be shared across threads via shared_ptr<const ToolRegistry>.
+// Calls into tools that are not concurrency_safe() are serialised per tool.
 class ToolRegistry {
  public:
   void register_tool(std::shared_ptr<Tool> tool) {
-    tools_[tool->name()] = std::move(tool);
-    rebuild_definitions_cache();
+    const std::string name = tool->name();
+    json schema = tool->to_schema();
+    SchemaValidator validator(schema["function"]["parameters"]);
+    auto it = tools_.find(name);
+    if (it != tools_.end()) {
+      definitions_cache_[it->second.schema_index] = std::move(schema);
+      it->second.tool = std::move(tool);
+      it->second.validator = std::move(validator);
+      return;
+    }
+    tools_.emplace(name, Entry{std::move(tool), definitions_cache_.size(), std::move(validator),
+                               std::make_shared<std::mutex>()});
+    definitions_cache_.push_back(std::move(schema));
   }
 
   std::shared_ptr<Tool> get(const std::string& name) const {
     auto it = tools_.find(name);
-    return it == tools_.end() ? nullptr : it->second;
+    return it == tools_.end() ? nullptr : it->second.tool;
   }
 
+  std::size_t size() const { return tools_.size(); }
+
   const json& definitions() const { return definitions_cache_; }
 
-  std::string execute(const std::string& name, const json& params) {
+  std::string execute(const std::string& name, const json& params, const ToolContext& ctx = {}) const {
     auto it = tools_.find(name);
     if (it == tools_.end()) {
       return "Error: Tool '" + name + "' not found";
     }
+    Tool& tool = *it->second.tool;
 
-    const auto errors = it->second->validate(params);
-    if (!errors.empty()) {
+    TraceSpan span("tool.execute", name);
+    if (!it->second.validator.valid(params)) {
+      const auto errors = it->second.validator.validate(params);
       std::string msg = "Error: Invalid parameters for tool '" + name + "': ";
       for (std::size_t i = 0; i < errors.size(); ++i) {
         msg += errors[i];
@@ -142,22 +118,26 @@ class ToolRegistry {
       return msg;
     }
 
+    std::unique_lock<std::mutex> serial;
+    if (!tool.concurrency_safe()) {
+      serial = std::unique_lock<std::mutex>(*it->second.serial);
+    }
     try {
-      return it->second->execute(params);
+      return tool.execute(params, ctx);
     } catch (const std::exception& e) {
       return std::string("Error executing ") + name + ": " + e.what();
     }
   }
 
  private:
-  void rebuild_definitions_cache() {
-    definitions_cache_ = json::array();
-    for (const auto& [_, tool] : tools_) {
-      definitions_cache_.push_back(tool->to_schema());
-    }
-  }
-
-  std::unordered_map<std::string, std::shared_ptr<Tool>> tools_;
+  struct Entry {
+    std::shared_ptr<Tool> tool;
+    std::size_t schema_index{0};
+    SchemaValidator validator;
+    std::shared_ptr<std::mutex> serial;  // held around execute() for tools that are not concurrency_safe()
+  };
+
+  std::unordered_map<std::string, Entry> tools_;
   json definitions_cache_ = json::array();
 };
 
@@ -189,15 +169,32 @@ inline std::string shell_escape_single_quotes(const std::string& s) {
   return out;
 }
 
+// Reads the file in line-aligned blocks and copies only the requested slice into the
+// result, so a large log costs neither RAM nor context: results are capped at kMaxChars
+// with a note telling the model how to continue. Plain reads rather than a mapping keep a
+// log truncated in place (copytruncate) from raising SIGBUS mid-read.
 class ReadFileTool : public Tool {
  public:
   explicit ReadFileTool(std::optional<fs::path> allowed_dir) : allowed_dir_(std::move(allowed_dir)) {}
 
   std::string name() const override { return "read_file"; }
-  std::string description() const override { return "Read file content from a path"; }
+  bool concurrency_safe() const override { return true; }
+  std::string description() const override {
+    return "Read file content from a path. Large files are returned in slices: use offset/limit to page by line, "
+           "or pattern to list only matching lines (with line numbers)";
+  }
   json parameters() const override {
     return json{{"type", "object"},
-                {"properties", {{"path", {{"type", "string"}, {"description", "Path to file"}}}}},
+                {"properties",
+                 {{"path", {{"type", "string"}, {"description", "Path to file"}}},
+                  {"offset", {{"type", "integer"}, {"minimum", 1}, {"description", "First line to read (1-based)"}}},
+                  {"limit", {{"type", "integer"}, {"minimum", 1}, {"description", "Maximum number of lines"}}},
+                  {"char_offset",
+                   {{"type", "integer"},
+                    {"minimum", 0},
+                    {"description", "Characters of the first line to skip (to continue a very long line)"}}},
+                  {"pattern",
+                   {{"type", "string"}, {"description", "Only return lines containing this literal text"}}}}},
                 {"required", json::array({"path"})}};
   }
 
@@ -210,10 +207,187 @@ class ReadFileTool : public Tool {
     if (!fs::is_regular_file(p)) {
       return "Error: Not a file: " + path;
     }
-    return read_text_file(p);
+    const std::size_t offset = static_cast<std::size_t>(params.value("offset", 1));
+    const std::size_t limit = static_cast<std::size_t>(params.value("limit", 0));
+    const std::size_t char_offset = static_cast<std::size_t>(params.value("char_offset", 0));
+    const std::string pattern = params.value("pattern", "");
+
+    LineBlockReader reader;
+    if (!reader.open(p)) {
+      return "Error: Cannot read file: " + path;
+    }
+    const std::string_view first = reader.next();
+    if (looks_binary(first.data(), first.size())) {
+      return "Error: " + path + " is a binary file (" + std::to_string(reader.size()) + " bytes)";
+    }
+    if (!pattern.empty()) {
+      return grep(reader, first, pattern, offset, limit == 0 ? kDefaultMatches : limit);
+    }
+    return slice(reader, first, offset, limit == 0 ? SIZE_MAX : limit, char_offset);
   }
 
  private:
+  static constexpr std::size_t kMaxChars = 100000;
+  static constexpr std::size_t kMaxLineChars = 2000;  // per matched line
+  static constexpr std::size_t kDefaultMatches = 200;
+
+  // Moves a cut before s[n] back so it does not split a UTF-8 sequence; s[n] must be readable.
+  static std::size_t utf8_floor(const char* s, std::size_t n) {
+    std::size_t cut = n;
+    while (cut > 0 && (static_cast<unsigned char>(s[cut]) & 0xC0) == 0x80) {
+      --cut;
+    }
+    return cut > 0 ? cut : n;
+  }
+
+  static std::string range_note(std::size_t offset, std::size_t lines, uint64_t size) {
+    const std::size_t last = offset + lines - 1;
+    return "\n[Showing lines " + std::to_string(offset) + "-" + std::to_string(last) + " of a " + std::to_string(size) +
+           "-byte file. Continue with offset=" + std::to_string(last + 1) + ", or pass pattern to search.]";
+  }
+
+  static std::string cut_note(std::size_t line, std::size_t next_char) {
+    return "\n[Line " + std::to_string(line) + " is cut after character " + std::to_string(next_char) +
+           ". Continue with offset=" + std::to_string(line) + " and char_offset=" + std::to_string(next_char) + ".]";
+  }
+
+  // Reads up to `max` bytes of the current line, refilling `block` from `reader` as needed;
+  // stops before the '\n'. Returns the bytes passed over; `sink` (if set) receives them.
+  static std::size_t take_line_bytes(LineBlockReader& reader, std::string_view& block, std::size_t max,
+                                     std::string* sink) {
+    std::size_t taken = 0;
+    while (taken < max) {
+      if (block.empty() && (block = reader.next()).empty()) {
+        break;
+      }
+      const std::size_t nl = block.find('\n');
+      const std::size_t n = (std::min)(max - taken, nl == std::string_view::npos ? block.size() : nl);
+      if (sink) {
+        sink->append(block.data(), n);
+      }
+      block.remove_prefix(n);
+      taken += n;
+      if (nl != std::string_view::npos && n == nl) {
+        break;
+      }
+    }
+    return taken;
+  }
+
+  static std::string slice(LineBlockReader& reader, std::string_view block, std::size_t offset, std::size_t limit,
+                           std::size_t char_offset) {
+    for (std::size_t line = 1; line < offset;) {
+      if (block.empty() && (block = reader.next()).empty()) {
+        break;
+      }
+      const std::size_t nl = block.find('\n');
+      if (nl == std::string_view::npos) {
+        block = {};
+        continue;
+      }
+      block.remove_prefix(nl + 1);
+      ++line;
+    }
+    const std::size_t skipped = take_line_bytes(reader, block, char_offset, nullptr);
+    if (block.empty() && (block = reader.next()).empty()) {
+      if (offset == 1 && skipped == 0) {
+        return "";  // empty file
+      }
+      return "(offset " + std::to_string(offset) + " is past the end of the file)";
+    }
+
+    std::string out;
+    std::size_t lines = 0;
+    std::size_t line_begin = 0;  // start of the current line in `out`
+    bool more = false;
+    while (lines < limit) {
+      if (block.empty() && (block = reader.next()).empty()) {
+        break;
+      }
+      const std::size_t nl = block.find('\n');
+      const std::size_t take = nl == std::string_view::npos ? block.size() : nl + 1;
+      if (out.size() + take > kMaxChars) {
+        if (lines == 0) {
+          // Only the first line can be cut; keep one byte past the cap for utf8_floor.
+          out.append(block.data(), kMaxChars + 1 - out.size());
+          out.resize(utf8_floor(out.data(), kMaxChars));
+          return out + cut_note(offset, skipped + out.size());
+        }
+        out.resize(line_begin);  // the partial line starts the next slice
+        more = true;
+        break;
+      }
+      out.append(block.data(), take);
+      block.remove_prefix(take);
+      if (nl != std::string_view::npos) {
+        ++lines;
+        line_begin = out.size();
+      }
+    }
+    if (!more && out.size() > line_begin) {
+      ++lines;  // last line without a trailing newline
+    }
+    if (more || (lines == limit && (!block.empty() || !reader.next().empty()))) {
+      out += range_note(offset, lines, reader.size());
+    }
+    return out;
+  }
+
+  static void append_match(std::string& out, std::size_t line_no, std::string_view line) {
+    out += std::to_string(line_no) + ": ";
+    out.append(line.substr(0, kMaxLineChars));
+    out += line.size() > kMaxLineChars ? "...\n" : "\n";
+  }
+
+  static std::string grep(LineBlockReader& reader, std::string_view block, const std::string& pattern,
+                          std::size_t offset, std::size_t limit) {
+    std::string out;
+    std::size_t line_no = 1;
+    std::size_t matches = 0;
+    std::size_t last_match = 0;
+    for (; !block.empty(); block = reader.next()) {
+      const char* data = block.data();
+      const char* end = data + block.size();
+      const char* p = data;
+      for (; line_no < offset && p < end; ++line_no) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (!nl) {
+          p = end;  // the line continues in the next block
+          break;
+        }
+        p = nl + 1;
+      }
+      const char* counted = p;  // line_no is the line number at `counted`
+      while (p < end) {
+        const char* hit = find_bytes(p, static_cast<std::size_t>(end - p), pattern);
+        if (!hit) {
+          break;
+        }
+        line_no += static_cast<std::size_t>(std::count(counted, hit, '\n'));
+        const char* line_start = hit;
+        while (line_start > data && line_start[-1] != '\n') {
+          --line_start;
+        }
+        const char* nl = static_cast<const char*>(std::memchr(hit, '\n', static_cast<std::size_t>(end - hit)));
+        const char* line_end = nl ? nl : end;
+        if (matches == limit || out.size() > kMaxChars) {
+          return out + "[More matches follow; continue with offset=" + std::to_string(last_match + 1) + ".]\n";
+        }
+        append_match(out, line_no, std::string_view(line_start, static_cast<std::size_t>(line_end - line_start)));
+        ++matches;
+        last_match = line_no;
+        p = nl ? nl + 1 : end;
+        counted = p;
+        line_no += nl ? 1 : 0;
+      }
+      line_no += static_cast<std::size_t>(std::count(counted, end, '\n'));
+    }
+    if (matches == 0) {
+      return "No lines match '" + pattern + "'";
+    }
+    return out;
+  }
+
   std::optional<fs::path> allowed_dir_;
 };
 
@@ -235,7 +409,7 @@ class WriteFileTool : public Tool {
     const auto path = params.value("path", "");
     const auto content = params.value("content", "");
     const fs::path p = resolve_path(path, allowed_dir_);
-    if (!write_text_file(p, content)) {
+    if (!write_file_atomic(p, content)) {
       return "Error: failed to write file";
     }
     return "Successfully wrote " + std::to_string(content.size()) + " bytes to " + path;
@@ -245,62 +419,125 @@ class WriteFileTool : public Tool {
   std::optional<fs::path> allowed_dir_;
 };
 
+// Applies one replacement, a batch of them, or a unified diff in a single pass over the
+// file, then saves it with write_file_atomic. Either every change applies or none does.
 class EditFileTool : public Tool {
  public:
   explicit EditFileTool(std::optional<fs::path> allowed_dir) : allowed_dir_(std::move(allowed_dir)) {}
 
   std::string name() const override { return "edit_file"; }
   std::string description() const override {
-    return "Edit file by replacing old_text with new_text once";
+    return "Edit a file: replace old_text with new_text once, apply several replacements at once with edits, "
+           "or apply a unified diff (diff -u / git diff format) with patch";
   }
   json parameters() const override {
-    return json{{"type", "object"},
-                {"properties",
-                 {{"path", {{"type", "string"}}},
-                  {"old_text", {{"type", "string"}}},
-                  {"new_text", {{"type", "string"}}}}},
-                {"required", json::array({"path", "old_text", "new_text"})}};
+    return json{
+        {"type", "object"},
+        {"properties",
+         {{"path", {{"type", "string"}}},
+          {"old_text", {{"type", "string"}}},
+          {"new_text", {{"type", "string"}}},
+          {"edits",
+           {{"type", "array"},
+            {"description", "Replacements applied together; each old_text must match once unless replace_all"},
+            {"items",
+             {{"type", "object"},
+              {"properties",
+               {{"old_text", {{"type", "string"}}},
+                {"new_text", {{"type", "string"}}},
+                {"replace_all", {{"type", "boolean"}}}}},
+              {"required", json::array({"old_text", "new_text"})}}}}},
+          {"patch", {{"type", "string"}, {"description", "Unified diff hunks for this file"}}}}},
+        {"required", json::array({"path"})}};
   }
 
   std::string execute(const json& params) override {
     const auto path = params.value("path", "");
-    const auto old_text = params.value("old_text", "");
-    const auto new_text = params.value("new_text", "");
-
     const fs::path p = resolve_path(path, allowed_dir_);
     if (!fs::exists(p)) {
       return "Error: File not found: " + path;
     }
 
-    std::string content = read_text_file(p);
-    const std::size_t pos = content.find(old_text);
-    if (pos == std::string::npos) {
-      return "Error: old_text not found in file";
+    std::vector<TextEdit> edits;
+    if (params.contains("old_text")) {
+      edits.push_back(TextEdit{params.value("old_text", ""), params.value("new_text", ""), false});
+    }
+    if (params.contains("edits") && params["edits"].is_array()) {
+      for (const auto& e : params["edits"]) {
+        edits.push_back(TextEdit{e.value("old_text", ""), e.value("new_text", ""), e.value("replace_all", false)});
+      }
     }
-    if (content.find(old_text, pos + old_text.size()) != std::string::npos) {
-      return "Warning: old_text appears multiple times; provide a more specific pattern";
+    const std::string patch = params.value("patch", "");
+    if (edits.empty() == patch.empty()) {
+      return "Error: provide either old_text/new_text, edits, or patch";
     }
 
-    content.replace(pos, old_text.size(), new_text);
-    if (!write_text_file(p, content)) {
+    // Read into memory rather than mapped: another process truncating the file mid-edit
+    // would otherwise raise SIGBUS in the gateway.
+    const std::string content = read_text_file(p);
+    std::error_code ec;
+    if (content.empty() && fs::file_size(p, ec) != 0) {
+      return "Error: Cannot read file: " + path;
+    }
+    std::string error;
+    std::optional<std::string> edited;
+    std::string summary;
+    std::size_t count = 0;
+    if (!patch.empty()) {
+      edited = apply_unified_diff(content, patch, error, &count);
+      summary = std::to_string(count) + (count == 1 ? " hunk" : " hunks");
+    } else {
+      edited = apply_text_edits(content, edits, error, &count);
+      summary = std::to_string(count) + (count == 1 ? " replacement" : " replacements");
+    }
+    if (!edited) {
+      if (error.find("multiple times") != std::string::npos && edits.size() == 1) {
+        return "Warning: old_text appears multiple times; provide a more specific pattern";
+      }
+      return "Error: " + error;
+    }
+    if (!write_file_atomic(p, *edited)) {
       return "Error: failed to save edited file";
     }
-    return "Successfully edited " + path;
+    return "Successfully edited " + path + " (" + summary + ")";
   }
 
  private:
   std::optional<fs::path> allowed_dir_;
 };
 
+// A file-name glob: patterns without '/' match the base name at any depth.
+inline bool path_glob_match(const std::string& glob, const std::string& rel) {
+  if (glob.find('/') != std::string::npos) {
+    return glob_match(glob, rel);
+  }
+  const std::size_t slash = rel.rfind('/');
+  return glob_match(glob, slash == std::string::npos ? rel : std::string_view(rel).substr(slash + 1));
+}
+
+// One call can map a whole subtree: depth > 1 walks it on the parallel walker (honouring
+// .gitignore), glob filters entries, metadata adds size and mtime, offset/limit page
+// through long listings.
 class ListDirTool : public Tool {
  public:
   explicit ListDirTool(std::optional<fs::path> allowed_dir) : allowed_dir_(std::move(allowed_dir)) {}
 
   std::string name() const override { return "list_dir"; }
-  std::string description() const override { return "List files and folders in directory"; }
+  bool concurrency_safe() const override { return true; }
+  std::string description() const override {
+    return "List files and folders in directory. Set depth to list subdirectories too (skips .git and "
+           ".gitignore'd entries), glob to filter, metadata for size and modification time";
+  }
   json parameters() const override {
     return json{{"type", "object"},
-                {"properties", {{"path", {{"type", "string"}, {"description", "Directory path"}}}}},
+                {"properties",
+                 {{"path", {{"type", "string"}, {"description", "Directory path"}}},
+                  {"depth", {{"type", "integer"}, {"minimum", 1}, {"maximum", 20}, {"description", "Default 1"}}},
+                  {"glob", {{"type", "string"}, {"description", "Only entries matching, e.g. *.cpp or src/**"}}},
+                  {"metadata", {{"type", "boolean"}, {"description", "Include size and modification time"}}},
+                  {"offset", {{"type", "integer"}, {"minimum", 0}}},
+                  {"limit",
+                   {{"type", "integer"}, {"minimum", 1}, {"maximum", 5000}, {"description", "Default 500"}}}}},
                 {"required", json::array({"path"})}};
   }
 
@@ -313,26 +550,457 @@ class ListDirTool : public Tool {
     if (!fs::is_directory(p)) {
       return "Error: Not a directory: " + path;
     }
+    const int depth = params.value("depth", 1);
+    const std::string glob = params.value("glob", "");
+    const bool metadata = params.value("metadata", false);
+    const std::size_t offset = static_cast<std::size_t>(params.value("offset", 0));
+    const std::size_t limit = static_cast<std::size_t>(params.value("limit", 500));
 
-    std::vector<std::string> rows;
-    for (const auto& entry : fs::directory_iterator(p)) {
-      const std::string prefix = entry.is_directory() ? "[DIR] " : "[FILE] ";
-      rows.push_back(prefix + entry.path().filename().string());
+    struct Row {
+      std::string rel;
+      bool is_dir;
+      std::string meta;
+    };
+    std::mutex mu;
+    std::vector<Row> rows;
+    bool capped = false;
+    WalkOptions options;
+    options.max_depth = depth;
+    options.include_hidden = true;
+    options.respect_gitignore = depth > 1;
+    options.all_entries = true;
+    auto collect = [&](const fs::directory_entry& entry, const std::string& rel, bool is_dir) {
+      if (!glob.empty() && !path_glob_match(glob, rel)) {
+        return true;
+      }
+      Row row{rel, is_dir, metadata ? describe(entry, is_dir) : std::string()};
+      std::lock_guard<std::mutex> lock(mu);
+      if (rows.size() >= kMaxEntries) {
+        capped = true;
+        return false;
+      }
+      rows.push_back(std::move(row));
+      return true;
+    };
+    ParallelWalker::walk_entries(p, options, collect);
+    if (depth <= 1) {
+      // A single level keeps the original order: directories first.
+      std::sort(rows.begin(), rows.end(),
+                [](const Row& a, const Row& b) { return a.is_dir != b.is_dir ? a.is_dir : a.rel < b.rel; });
+    } else {
+      std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.rel < b.rel; });
     }
-    std::sort(rows.begin(), rows.end());
 
     if (rows.empty()) {
-      return "Directory is empty";
+      return glob.empty() ? "Directory is empty" : "No entries match '" + glob + "'";
+    }
+    if (offset >= rows.size()) {
+      return "Offset " + std::to_string(offset) + " is past the " + std::to_string(rows.size()) + " entries";
     }
 
     std::ostringstream out;
-    for (const auto& row : rows) {
-      out << row << "\n";
+    const std::size_t end = (std::min)(rows.size(), offset + limit);
+    for (std::size_t i = offset; i < end; ++i) {
+      out << (rows[i].is_dir ? "[DIR] " : "[FILE] ") << rows[i].rel << rows[i].meta << "\n";
+    }
+    if (end < rows.size() || capped) {
+      out << "[Showing " << offset + 1 << "-" << end << " of " << rows.size() << (capped ? "+" : "")
+          << " entries; continue with offset=" << end << "]";
     }
     return trim(out.str());
   }
 
  private:
+  static constexpr std::size_t kMaxEntries = 100000;
+
+  // "  12.3 KB  2026-01-02 10:00" (directories get only the time). Stats the entry.
+  static std::string describe(const fs::directory_entry& entry, bool is_dir) {
+    std::error_code ec;
+    std::string out = "  ";
+    if (!is_dir) {
+      const auto size = entry.file_size(ec);
+      out += ec ? "?" : human_size(static_cast<double>(size));
+      out += "  ";
+    }
+    const auto mtime = entry.last_write_time(ec);
+    if (!ec) {
+      const auto sys = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+          mtime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+      const std::time_t t = std::chrono::system_clock::to_time_t(sys);
+      std::tm tm{};
+#ifdef _WIN32
+      localtime_s(&tm, &t);
+#else
+      localtime_r(&t, &tm);
+#endif
+      char buf[32];
+      std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &tm);
+      out += buf;
+    }
+    return out;
+  }
+
+  static std::string human_size(double bytes) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    int u = 0;
+    while (bytes >= 1024 && u < 4) {
+      bytes /= 1024;
+      ++u;
+    }
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(u == 0 ? 0 : 1) << bytes << " " << units[u];
+    return ss.str();
+  }
+
+  std::optional<fs::path> allowed_dir_;
+};
+
+// Matches lines of a file's bytes. A literal, or the longest literal every match of
+// a regex must contain, is located with memmem/memchr first; the regex (if any) only runs
+// on lines that contain it.
+class LineMatcher {
+ public:
+  LineMatcher(const std::string& pattern, bool regex, bool ignore_case) : icase_(ignore_case) {
+    if (regex) {
+      auto flags = std::regex::ECMAScript | std::regex::optimize;
+      if (ignore_case) {
+        flags |= std::regex::icase;
+      }
+      re_.emplace(pattern, flags);
+      literal_ = required_literal(pattern);
+    } else {
+      literal_ = pattern;
+    }
+    if (icase_) {
+      literal_ = to_lower_ascii(literal_);
+    }
+  }
+
+  // Calls on_match(line_no, line) for each matching line until it returns false. `first_line`
+  // numbers the line at `data`, for scans that go block by block.
+  template <typename OnMatch>
+  void scan(const char* data, std::size_t n, OnMatch&& on_match, std::size_t first_line = 1) const {
+    const char* end = data + n;
+    const char* p = data;
+    const char* counted = data;
+    std::size_t line_no = first_line;
+    while (p < end) {
+      const char* line_start = p;
+      if (!literal_.empty()) {
+        const char* hit = find(p, static_cast<std::size_t>(end - p));
+        if (!hit) {
+          return;
+        }
+        line_start = hit;
+        while (line_start > p && line_start[-1] != '\n') {
+          --line_start;
+        }
+      }
+      const char* nl =
+          static_cast<const char*>(std::memchr(line_start, '\n', static_cast<std::size_t>(end - line_start)));
+      const char* line_end = nl ? nl : end;
+      std::string_view line(line_start, static_cast<std::size_t>(line_end - line_start));
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      if (!re_ || std::regex_search(line.begin(), line.end(), *re_)) {
+        line_no += static_cast<std::size_t>(std::count(counted, line_start, '\n'));
+        counted = line_start;
+        if (!on_match(line_no, line)) {
+          return;
+        }
+      }
+      p = nl ? nl + 1 : end;
+    }
+  }
+
+ private:
+  static std::string to_lower_ascii(std::string s) {
+    for (auto& c : s) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return s;
+  }
+
+  const char* find(const char* hay, std::size_t n) const {
+    if (!icase_) {
+      return find_bytes(hay, n, literal_);
+    }
+    // Case-insensitive: memchr for either case of the first byte, then compare the rest.
+    const char lo = literal_[0];
+    const char up = static_cast<char>(std::toupper(static_cast<unsigned char>(lo)));
+    const char* end = hay + n;
+    const char* p = hay;
+    while (static_cast<std::size_t>(end - p) >= literal_.size()) {
+      const std::size_t left = static_cast<std::size_t>(end - p) - literal_.size() + 1;
+      const char* a = static_cast<const char*>(std::memchr(p, lo, left));
+      const char* b =
+          lo == up ? nullptr : static_cast<const char*>(std::memchr(p, up, a ? static_cast<std::size_t>(a - p) : left));
+      const char* c = b ? b : a;
+      if (!c) {
+        return nullptr;
+      }
+      std::size_t i = 1;
+      while (i < literal_.size() &&
+             std::tolower(static_cast<unsigned char>(c[i])) == static_cast<unsigned char>(literal_[i])) {
+        ++i;
+      }
+      if (i == literal_.size()) {
+        return c;
+      }
+      p = c + 1;
+    }
+    return nullptr;
+  }
+
+  // Longest run of plain characters that every match of an ECMAScript pattern contains, or
+  // "" when none can be proven (alternation, or only classes and optional parts).
+  static std::string required_literal(const std::string& pattern) {
+    std::string best;
+    std::string run;
+    int depth = 0;
+    auto flush = [&]() {
+      if (run.size() > best.size()) {
+        best = run;
+      }
+      run.clear();
+    };
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+      const char c = pattern[i];
+      if (c == '|') {
+        return "";
+      }
+      if (c == '\\' && i + 1 < pattern.size()) {
+        const char e = pattern[++i];
+        if (depth == 0 && !std::isalnum(static_cast<unsigned char>(e))) {
+          run += e;
+        } else {
+          flush();
+        }
+        continue;
+      }
+      if (c == '[') {
+        flush();
+        const std::size_t close = pattern.find(']', i + 2);
+        i = close == std::string::npos ? pattern.size() : close;
+        continue;
+      }
+      if (c == '(' || c == ')') {
+        flush();
+        depth += c == '(' ? 1 : -1;
+        continue;
+      }
+      if (c == '*' || c == '?' || c == '{') {
+        if (!run.empty()) {
+          run.pop_back();  // the preceding character may be absent
+        }
+        flush();
+        if (c == '{') {
+          const std::size_t close = pattern.find('}', i);
+          i = close == std::string::npos ? pattern.size() : close;
+        }
+        continue;
+      }
+      if (c == '.' || c == '+' || c == '^' || c == '$') {
+        flush();
+        continue;
+      }
+      if (depth == 0) {
+        run += c;
+      }
+    }
+    flush();
+    return best;
+  }
+
+  bool icase_;
+  std::string literal_;
+  std::optional<std::regex> re_;
+};
+
+// Resolves the root for the workspace search tools: `path` if given, else the workspace.
+inline fs::path resolve_search_root(const std::string& path, const fs::path& workspace,
+                                    const std::optional<fs::path>& allowed_dir) {
+  return resolve_path(trim(path).empty() ? workspace.string() : path, allowed_dir);
+}
+
+// Matches are gathered per file while the parallel walk runs, and the walk stops as soon
+// as max_results is reached. The capped set is then sorted, because a tool result is a
+// single message and a stable order keeps repeated searches comparable.
+class SearchFilesTool : public Tool {
+ public:
+  SearchFilesTool(fs::path workspace, std::optional<fs::path> allowed_dir)
+      : workspace_(std::move(workspace)), allowed_dir_(std::move(allowed_dir)) {}
+
+  std::string name() const override { return "search_files"; }
+  bool concurrency_safe() const override { return true; }
+  std::string description() const override {
+    return "Search file contents under a directory (default: workspace), like grep -rn. Skips .gitignore'd, "
+           "hidden and binary files. Returns path:line: text";
+  }
+  json parameters() const override {
+    return json{{"type", "object"},
+                {"properties",
+                 {{"pattern", {{"type", "string"}, {"description", "Literal text, or a regex when regex=true"}}},
+                  {"path", {{"type", "string"}, {"description", "Directory to search (default: workspace)"}}},
+                  {"glob", {{"type", "string"}, {"description", "Only files matching this glob, e.g. *.cpp or src/**/*.h"}}},
+                  {"regex", {{"type", "boolean"}}},
+                  {"ignore_case", {{"type", "boolean"}}},
+                  {"max_results", {{"type", "integer"}, {"minimum", 1}, {"maximum", 1000}}}}},
+                {"required", json::array({"pattern"})}};
+  }
+
+  std::string execute(const json& params) override {
+    const std::string pattern = params.value("pattern", "");
+    if (pattern.empty()) {
+      return "Error: pattern is empty";
+    }
+    const fs::path root = resolve_search_root(params.value("path", ""), workspace_, allowed_dir_);
+    if (!fs::is_directory(root)) {
+      return "Error: Not a directory: " + root.string();
+    }
+    std::optional<LineMatcher> matcher;
+    try {
+      matcher.emplace(pattern, params.value("regex", false), params.value("ignore_case", false));
+    } catch (const std::regex_error& e) {
+      return std::string("Error: invalid regex: ") + e.what();
+    }
+    const std::string glob = params.value("glob", "");
+    const std::size_t max_results = static_cast<std::size_t>(params.value("max_results", 100));
+
+    struct Hit {
+      std::string rel;
+      std::size_t line;
+      std::string text;
+    };
+    std::mutex mu;
+    std::vector<Hit> hits;
+    std::atomic<std::size_t> found{0};
+    std::atomic<bool> capped{false};
+    ParallelWalker::walk(root, WalkOptions{}, [&](const fs::path& file, const std::string& rel) {
+      if (!glob.empty() && !path_glob_match(glob, rel)) {
+        return true;
+      }
+      thread_local LineBlockReader reader;
+      if (!reader.open(file)) {
+        return true;
+      }
+      std::string_view block = reader.next();
+      if (block.empty() || looks_binary(block.data(), block.size())) {
+        reader.close();
+        return true;
+      }
+      std::vector<Hit> local;
+      try {
+        for (std::size_t first_line = 1; !block.empty() && !capped.load(); block = reader.next()) {
+          matcher->scan(
+              block.data(), block.size(),
+              [&](std::size_t line, std::string_view text) {
+                if (found.fetch_add(1) >= max_results) {
+                  capped.store(true);
+                  return false;
+                }
+                local.push_back(Hit{rel, line, std::string(text.substr(0, kMaxLineChars))});
+                return true;
+              },
+              first_line);
+          if (!reader.done()) {
+            first_line += static_cast<std::size_t>(std::count(block.begin(), block.end(), '\n'));
+          }
+        }
+      } catch (const std::exception&) {
+        // std::regex can throw on pathological input; treat the file as not matching.
+      }
+      reader.close();  // the buffer is kept for the next file
+      if (!local.empty()) {
+        std::lock_guard<std::mutex> lock(mu);
+        for (auto& h : local) {
+          hits.push_back(std::move(h));
+        }
+      }
+      return !capped.load();
+    });
+
+    if (hits.empty()) {
+      return "No matches for '" + pattern + "'";
+    }
+    std::sort(hits.begin(), hits.end(),
+              [](const Hit& a, const Hit& b) { return a.rel != b.rel ? a.rel < b.rel : a.line < b.line; });
+    std::string out;
+    for (const auto& h : hits) {
+      out += h.rel + ":" + std::to_string(h.line) + ": " + h.text + "\n";
+    }
+    if (capped.load()) {
+      out += "[Stopped after " + std::to_string(max_results) + " matches; narrow the pattern, path or glob.]";
+    }
+    return trim(out);
+  }
+
+ private:
+  static constexpr std::size_t kMaxLineChars = 300;
+
+  fs::path workspace_;
+  std::optional<fs::path> allowed_dir_;
+};
+
+class GlobTool : public Tool {
+ public:
+  GlobTool(fs::path workspace, std::optional<fs::path> allowed_dir)
+      : workspace_(std::move(workspace)), allowed_dir_(std::move(allowed_dir)) {}
+
+  std::string name() const override { return "glob"; }
+  bool concurrency_safe() const override { return true; }
+  std::string description() const override {
+    return "Find files by name under a directory (default: workspace). '*' stays within a directory, '**' spans "
+           "directories; patterns without '/' match file names at any depth. Skips .gitignore'd and hidden files";
+  }
+  json parameters() const override {
+    return json{{"type", "object"},
+                {"properties",
+                 {{"pattern", {{"type", "string"}, {"description", "e.g. *.hpp, src/**/*.cpp, test_?.py"}}},
+                  {"path", {{"type", "string"}, {"description", "Directory to search (default: workspace)"}}},
+                  {"max_results", {{"type", "integer"}, {"minimum", 1}, {"maximum", 5000}}}}},
+                {"required", json::array({"pattern"})}};
+  }
+
+  std::string execute(const json& params) override {
+    const std::string pattern = params.value("pattern", "");
+    const fs::path root = resolve_search_root(params.value("path", ""), workspace_, allowed_dir_);
+    if (!fs::is_directory(root)) {
+      return "Error: Not a directory: " + root.string();
+    }
+    const std::size_t max_results = static_cast<std::size_t>(params.value("max_results", 500));
+    std::mutex mu;
+    std::vector<std::string> files;
+    bool capped = false;
+    ParallelWalker::walk(root, WalkOptions{}, [&](const fs::path&, const std::string& rel) {
+      if (!path_glob_match(pattern, rel)) {
+        return true;
+      }
+      std::lock_guard<std::mutex> lock(mu);
+      if (files.size() >= max_results) {
+        capped = true;
+        return false;
+      }
+      files.push_back(rel);
+      return true;
+    });
+    if (files.empty()) {
+      return "No files match '" + pattern + "'";
+    }
+    std::sort(files.begin(), files.end());
+    std::string out;
+    for (const auto& f : files) {
+      out += f + "\n";
+    }
+    if (capped) {
+      out += "[Stopped after " + std::to_string(max_results) + " files; narrow the pattern or path.]";
+    }
+    return trim(out);
+  }
+
+ private:
+  fs::path workspace_;
   std::optional<fs::path> allowed_dir_;
 };
 
@@ -343,6 +1011,7 @@ class ExecTool : public Tool {
         restrict_to_workspace_(restrict_to_workspace) {}
 
   std::string name() const override { return "exec"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override { return "Execute shell command and return output"; }
   json parameters() const override {
     return json{{"type", "object"},
@@ -425,15 +1094,17 @@ class ExecTool : public Tool {
 class SystemInspectTool : public Tool {
  public:
   std::string name() const override { return "system_inspect"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override {
-    return "Inspect local system state (processes, windows, disks, network, uptime).";
+    return "Inspect local system state (processes, memory, windows, disks, network, uptime).";
   }
   json parameters() const override {
     return json{{"type", "object"},
                 {"properties",
                  {{"action",
                    {{"type", "string"},
-                    {"enum", json::array({"processes", "windows", "disks", "network", "uptime"})}}},
+                    {"enum", json::array({"processes", "memory", "windows", "disks", "network", "uptime"})}}},
+                  {"sort", {{"type", "string"}, {"enum", json::array({"cpu", "memory", "pid"})}}},
                   {"limit", {{"type", "integer"}, {"minimum", 1}, {"maximum", 200}}}}},
                 {"required", json::array({"action"})}};
   }
@@ -442,6 +1113,13 @@ class SystemInspectTool : public Tool {
     const std::string action = params.value("action", "");
     const int limit = std::clamp(params.value("limit", 20), 1, 200);
 
+#ifdef __linux__
+    // Native /proc + statvfs backend; only "windows" still needs an external tool.
+    if (auto native = ProcfsInspector::instance().inspect(action, limit, params.value("sort", "cpu"))) {
+      return native->dump();
+    }
+#endif
+
     std::string command;
 #ifdef _WIN32
     if (action == "processes") {
@@ -480,6 +1158,12 @@ class SystemInspectTool : public Tool {
           "$boot=$os.LastBootUpTime; "
           "$uptime=(Get-Date)-$boot; "
           "[pscustomobject]@{LastBoot=$boot; Uptime=$uptime.ToString()} | ConvertTo-Json -Depth 3\"";
+    } else if (action == "memory") {
+      command =
+          "powershell -NoProfile -ExecutionPolicy Bypass -Command "
+          "\"Get-CimInstance Win32_OperatingSystem | "
+          "Select-Object TotalVisibleMemorySize,FreePhysicalMemory,TotalVirtualMemorySize,FreeVirtualMemory | "
+          "ConvertTo-Json -Depth 3\"";
     }
 #else
     if (action == "processes") {
@@ -493,6 +1177,8 @@ class SystemInspectTool : public Tool {
       command = "sh -lc \"ss -tan | head -n " + std::to_string(limit + 1) + "\"";
     } else if (action == "uptime") {
       command = "sh -lc \"uptime\"";
+    } else if (action == "memory") {
+      command = "sh -lc \"vm_stat 2>/dev/null || free -b\"";
     }
 #endif
 
@@ -608,30 +1294,46 @@ class AppControlTool : public Tool {
 
 class ScreenCaptureTool : public Tool {
  public:
-  explicit ScreenCaptureTool(bool enabled = false) : enabled_(enabled) {}
-
-  void set_enabled(bool enabled) { enabled_.store(enabled); }
+  // `always_enabled` skips the per-request --vision gate (direct use outside the agent loop).
+  explicit ScreenCaptureTool(bool always_enabled = false) : always_enabled_(always_enabled) {}
 
   std::string name() const override { return "screen_capture"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override {
-    return "Capture the current screen and save as PNG. Returns the saved file path.";
+    return "Capture the current screen. Saves a downscaled JPEG by default (format=png for a full-resolution "
+           "PNG) and returns the saved file path. If the screen has not changed since the last capture, the "
+           "previous path is returned with unchanged=true.";
   }
   json parameters() const override {
     return json{{"type", "object"},
-                {"properties", {{"path", {{"type", "string"}}}}},
+                {"properties",
+                 {{"path", {{"type", "string"}}},
+                  {"format", {{"type", "string"}, {"enum", json::array({"jpeg", "png"})}}},
+                  {"max_dimension", {{"type", "integer"}, {"minimum", 160}, {"maximum", 8192}}}}},
                 {"required", json::array()}};
   }
 
-  std::string execute(const json& params) override {
-    if (!enabled_.load()) {
+  std::string execute(const json& params) override { return execute(params, ToolContext{}); }
+
+  std::string execute(const json& params, const ToolContext& ctx) override {
+    if (!always_enabled_ && !ctx.vision_enabled) {
       return "Error: vision tools are disabled for this request. Add --vision in your message.";
     }
     if (is_headless_server()) {
       return "Error: vision is unavailable on headless server (DISPLAY/WAYLAND_DISPLAY not set).";
     }
 
-    fs::path out;
     const std::string user_path = trim(params.value("path", ""));
+    std::string format = trim(params.value("format", ""));
+    if (format.empty()) {
+      const std::string ext = fs::path(user_path).extension().string();
+      format = (ext == ".png" || ext == ".PNG") ? "png" : "jpeg";
+    }
+    if (format != "png") {
+      return capture_jpeg(user_path, params.value("max_dimension", 0), ctx.channel + ":" + ctx.chat_id);
+    }
+
+    fs::path out;
     if (user_path.empty()) {
       const fs::path dir = expand_user_path("~/.attoclaw") / "screenshots";
       std::error_code ec;
@@ -674,18 +1376,17 @@ class ScreenCaptureTool : public Tool {
     }
 
     const std::string path_abs = fs::absolute(out).string();
-    const std::string path_q = sh_single_quote(path_abs);
-    std::string command;
-    if (command_exists_in_path("grim")) {
-      command = "sh -lc \"grim " + path_q + "\"";
-    } else if (command_exists_in_path("scrot")) {
-      command = "sh -lc \"scrot " + path_q + "\"";
+    std::vector<std::string> argv;
+    if (const auto grim = capabilities().resolve("grim")) {
+      argv = {grim->string(), path_abs};
+    } else if (const auto scrot = capabilities().resolve("scrot")) {
+      argv = {scrot->string(), path_abs};
     } else {
       return "Error: no screenshot tool available (grim/scrot).";
     }
-    CommandResult res = run_command_capture(command, 30);
+    const ProcessOutput res = run_process_capture(argv, 30, 1024 * 1024);
     if (!res.ok) {
-      std::string out_err = trim(res.output);
+      std::string out_err = trim(res.err.empty() ? res.out : res.err);
       if (out_err.empty()) {
         out_err = "screenshot command failed";
       }
@@ -702,7 +1403,57 @@ class ScreenCaptureTool : public Tool {
   }
 
  private:
-  std::atomic<bool> enabled_{false};
+  // Downscaled JPEG through the shared vision pipeline. Repeated captures of an unchanged
+  // screen return the previous file instead of writing (and sending) the same pixels again.
+  // The previous frame is remembered per chat: one instance serves every session, and a
+  // chat must not be told it has already seen another chat's frame.
+  std::string capture_jpeg(const std::string& user_path, int max_dimension, const std::string& chat_key) {
+    fs::path out = user_path.empty() ? expand_user_path("~/.attoclaw") / "screenshots" /
+                                           ("screen_" + std::to_string(now_ms()) + ".jpg")
+                                     : expand_user_path(user_path);
+    uint64_t previous_hash = 0;
+    json previous;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      auto it = last_.find(chat_key);
+      if (user_path.empty() && it != last_.end() && fs::exists(it->second.result.value("path", ""))) {
+        previous_hash = it->second.hash;
+        previous = it->second.result;
+      }
+    }
+
+    std::string error;
+    const auto frame = vision_pipeline().capture(out, previous_hash, false, max_dimension, &error);
+    if (!frame.has_value()) {
+      return "Error: " + (error.empty() ? std::string("screenshot command failed") : error);
+    }
+    if (frame->unchanged) {
+      previous["unchanged"] = true;
+      return previous.dump();
+    }
+
+    json result{{"path", frame->path.string()},
+                {"bytes", static_cast<long long>(frame->bytes)},
+                {"format", "jpeg"},
+                {"width", frame->width},
+                {"height", frame->height}};
+    std::lock_guard<std::mutex> lock(mu_);
+    if (last_.size() >= kMaxChats && last_.find(chat_key) == last_.end()) {
+      last_.clear();  // plenty for live chats; a miss only costs one re-encode
+    }
+    last_[chat_key] = LastFrame{frame->hash, result};
+    return result.dump();
+  }
+
+  struct LastFrame {
+    uint64_t hash{0};
+    json result;
+  };
+  static constexpr std::size_t kMaxChats = 256;
+
+  const bool always_enabled_;
+  std::mutex mu_;
+  std::unordered_map<std::string, LastFrame> last_;  // by channel:chat_id
 };
 
 class WebSearchTool : public Tool {
@@ -711,6 +1462,7 @@ class WebSearchTool : public Tool {
       : api_key_(std::move(api_key)), max_results_(std::clamp(max_results, 1, 10)) {}
 
   std::string name() const override { return "web_search"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override { return "Search the web using Brave Search API"; }
   json parameters() const override {
     return json{{"type", "object"},
@@ -805,6 +1557,7 @@ class TranscribeTool : public Tool {
         timeout_s_(std::clamp(timeout_s, 10, 900)) {}
 
   std::string name() const override { return "transcribe"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override {
     return "Transcribe an audio file to text via an OpenAI-compatible /audio/transcriptions endpoint";
   }
@@ -818,12 +1571,8 @@ class TranscribeTool : public Tool {
   }
 
   std::string execute(const json& params) override {
-    if (trim(api_base_).empty()) {
-      return "Error: transcription apiBase not configured";
-    }
-
-    if (trim(api_key_).empty() && !is_local_nim_endpoint(api_base_)) {
-      return "Error: transcription apiKey not configured";
+    if (const std::string err = config_error(); !err.empty()) {
+      return err;
     }
 
     const std::string raw_path = trim(params.value("path", ""));
@@ -836,35 +1585,184 @@ class TranscribeTool : public Tool {
       return "Error: file not found: " + p.string();
     }
 
+    const std::string language = params.value("language", "");
+    const std::string prompt = params.value("prompt", "");
+    if (p.extension() == ".wav") {
+      const std::string audio = read_text_file(p);
+      if (parse_wav(audio)) {
+        return transcribe_data(audio, p.filename().string(), language, prompt);
+      }
+    }
+    if (auto hit = cached_file_transcript(p, language, prompt)) {
+      return *hit;
+    }
+
+    thread_local HttpClient client;
+    const std::string text = parse_response(client.post_multipart_file(
+        endpoint(), auth_headers(), request_fields(language, prompt), "file", p, "", timeout_s_, true, 5));
+    remember_file_transcript(p, text, language, prompt);
+    return text;
+  }
+
+  // Transcribes audio already in memory (e.g. ffmpeg output); `file_name` sets the upload's
+  // filename, which servers use to sniff the format. 16-bit PCM WAV longer than
+  // transcription().segment_seconds() is split at quiet points, the segments are uploaded
+  // concurrently on the shared transcription workers, and the texts are joined in order.
+  std::string transcribe_data(const std::string& data, const std::string& file_name, const std::string& language = "",
+                              const std::string& prompt = "") {
+    if (const std::string err = config_error(); !err.empty()) {
+      return err;
+    }
+    if (auto hit = cached_transcript(data, language, prompt)) {
+      return *hit;
+    }
+
+    std::vector<std::string> segments = split_wav_segments(data, transcription().segment_seconds());
+    std::string text;
+    if (segments.size() <= 1) {
+      thread_local HttpClient client;
+      text = parse_response(client.post_multipart_data(endpoint(), auth_headers(), request_fields(language, prompt),
+                                                       "file", file_name, data, "", timeout_s_, true, 5));
+    } else {
+      metrics().inc("transcribe.segments", static_cast<uint64_t>(segments.size()));
+      // Shared with the queued uploads, which can outlive this call if it unwinds early.
+      struct Request {
+        std::string url;
+        std::map<std::string, std::string> headers;
+        std::vector<MultipartField> fields;
+        int timeout_s;
+      };
+      const auto request = std::make_shared<const Request>(
+          Request{endpoint(), auth_headers(), request_fields(language, prompt), timeout_s_});
+      const fs::path stem = fs::path(file_name).stem();
+      std::vector<std::future<HttpResponse>> parts;
+      for (std::size_t i = 0; i < segments.size(); ++i) {
+        const std::string name = stem.string() + "_" + std::to_string(i + 1) + ".wav";
+        parts.push_back(transcription().submit(
+            [request, name, segment = std::move(segments[i])](HttpClient& client) {
+              return client.post_multipart_data(request->url, request->headers, request->fields, "file", name, segment,
+                                                "", request->timeout_s, true, 5);
+            }));
+      }
+      std::string error;
+      for (auto& part : parts) {
+        const std::string piece = parse_response(part.get());
+        if (piece.rfind("Error:", 0) == 0) {
+          if (error.empty()) {
+            error = piece;
+          }
+          continue;
+        }
+        const std::string t = trim(piece);
+        if (!t.empty()) {
+          text += (text.empty() ? "" : " ") + t;
+        }
+      }
+      if (!error.empty()) {
+        text = error;
+      }
+    }
+    remember_transcript(data, text, language, prompt);
+    return text;
+  }
+
+  std::optional<std::string> cached_transcript(std::string_view audio, const std::string& language = "",
+                                               const std::string& prompt = "") const {
+    const TranscriptCache* cache = transcription().cache();
+    if (!cache || audio.empty()) {
+      return std::nullopt;
+    }
+    auto hit = cache->get(TranscriptCache::key(audio, cache_params(language, prompt)));
+    if (hit) {
+      metrics().inc("transcribe.cache_hit");
+    }
+    return hit;
+  }
+
+  void remember_transcript(std::string_view audio, const std::string& text, const std::string& language = "",
+                           const std::string& prompt = "") const {
+    const TranscriptCache* cache = transcription().cache();
+    if (cache && !audio.empty() && text.rfind("Error:", 0) != 0) {
+      cache->put(TranscriptCache::key(audio, cache_params(language, prompt)), text);
+    }
+  }
+
+  // Same entries as cached_transcript()/remember_transcript() for the file's bytes, but
+  // the file is hashed in chunks instead of being read into memory.
+  std::optional<std::string> cached_file_transcript(const fs::path& path, const std::string& language = "",
+                                                    const std::string& prompt = "") const {
+    const TranscriptCache* cache = transcription().cache();
+    if (!cache) {
+      return std::nullopt;
+    }
+    const auto key = TranscriptCache::file_key(path, cache_params(language, prompt));
+    auto hit = key ? cache->get(*key) : std::nullopt;
+    if (hit) {
+      metrics().inc("transcribe.cache_hit");
+    }
+    return hit;
+  }
+
+  void remember_file_transcript(const fs::path& path, const std::string& text, const std::string& language = "",
+                                const std::string& prompt = "") const {
+    const TranscriptCache* cache = transcription().cache();
+    if (!cache || text.rfind("Error:", 0) == 0) {
+      return;
+    }
+    if (const auto key = TranscriptCache::file_key(path, cache_params(language, prompt))) {
+      cache->put(*key, text);
+    }
+  }
+
+ private:
+  std::string cache_params(const std::string& language, const std::string& prompt) const {
+    return trim(api_base_) + "\n" + trim(model_) + "\n" + trim(language) + "\n" + trim(prompt);
+  }
+
+  std::string config_error() const {
+    if (trim(api_base_).empty()) {
+      return "Error: transcription apiBase not configured";
+    }
+    if (trim(api_key_).empty() && !is_local_nim_endpoint(api_base_)) {
+      return "Error: transcription apiKey not configured";
+    }
+    return "";
+  }
+
+  std::string endpoint() const {
     std::string base = trim(api_base_);
     while (!base.empty() && base.back() == '/') {
       base.pop_back();
     }
-    const std::string url = base + "/audio/transcriptions";
+    return base + "/audio/transcriptions";
+  }
+
+  std::map<std::string, std::string> auth_headers() const {
+    std::map<std::string, std::string> headers;
+    if (!trim(api_key_).empty()) {
+      headers["Authorization"] = "Bearer " + api_key_;
+    }
+    return headers;
+  }
 
+  std::vector<MultipartField> request_fields(const std::string& raw_language, const std::string& raw_prompt) const {
     std::vector<MultipartField> fields;
     const std::string model = trim(model_);
     if (!model.empty() && model != "auto") {
       fields.push_back({"model", model});
     }
-    const std::string language = trim(params.value("language", ""));
+    const std::string language = trim(raw_language);
     if (!language.empty()) {
       fields.push_back({"language", language});
     }
-    const std::string prompt = trim(params.value("prompt", ""));
+    const std::string prompt = trim(raw_prompt);
     if (!prompt.empty()) {
       fields.push_back({"prompt", prompt});
     }
+    return fields;
+  }
 
-    thread_local HttpClient client;
-    std::map<std::string, std::string> headers;
-    if (!trim(api_key_).empty()) {
-      headers["Authorization"] = "Bearer " + api_key_;
-    }
-    HttpResponse resp = client.post_multipart_file(
-        url, headers,
-        fields, "file", p, "", timeout_s_, true, 5);
-
+  static std::string parse_response(const HttpResponse& resp) {
     if (!resp.error.empty()) {
       return "Error: " + resp.error;
     }
@@ -886,7 +1784,6 @@ class TranscribeTool : public Tool {
     }
   }
 
- private:
   std::string api_key_;
   std::string api_base_;
   std::string model_;
@@ -905,6 +1802,7 @@ class WebFetchTool : public Tool {
   explicit WebFetchTool(int max_chars = 50000) : max_chars_(max_chars) {}
 
   std::string name() const override { return "web_fetch"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override { return "Fetch URL and extract readable text"; }
   json parameters() const override {
     return json{{"type", "object"},
@@ -986,18 +1884,52 @@ class WebFetchTool : public Tool {
   int max_chars_;
 };
 
+class MemorySearchTool : public Tool {
+ public:
+  explicit MemorySearchTool(fs::path workspace) : memory_(workspace) {}
+
+  std::string name() const override { return "memory_search"; }
+  bool concurrency_safe() const override { return true; }
+  std::string description() const override {
+    return "Search long-term memory (MEMORY.md) and the conversation history log (HISTORY.md) by keywords";
+  }
+  json parameters() const override {
+    return json{{"type", "object"},
+                {"properties",
+                 {{"query", {{"type", "string"}}},
+                  {"limit", {{"type", "integer"}, {"minimum", 1}, {"maximum", 20}}}}},
+                {"required", json::array({"query"})}};
+  }
+
+  std::string execute(const json& params) override {
+    const std::string query = trim(params.value("query", ""));
+    if (query.empty()) {
+      return "Error: query is required";
+    }
+    const int limit = std::clamp(params.value("limit", 5), 1, 20);
+    const auto hits = memory_.search(query, static_cast<std::size_t>(limit));
+    if (hits.empty()) {
+      return "No memory matches for: " + query;
+    }
+    std::ostringstream out;
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+      out << (i ? "\n\n" : "") << (i + 1) << ". [" << hits[i].source << "] " << hits[i].text;
+    }
+    return out.str();
+  }
+
+ private:
+  MemoryStore memory_;
+};
+
 class MessageTool : public Tool {
  public:
   using SendCallback = std::function<void(const OutboundMessage&)>;
 
   explicit MessageTool(SendCallback cb) : callback_(std::move(cb)) {}
 
-  void set_context(std::string channel, std::string chat_id) {
-    default_channel_ = std::move(channel);
-    default_chat_id_ = std::move(chat_id);
-  }
-
   std::string name() const override { return "message"; }
+  bool concurrency_safe() const override { return true; }
   std::string description() const override { return "Send message to channel/chat"; }
   json parameters() const override {
     return json{{"type", "object"},
@@ -1008,10 +1940,12 @@ class MessageTool : public Tool {
                 {"required", json::array({"content"})}};
   }
 
-  std::string execute(const json& params) override {
+  std::string execute(const json& params) override { return execute(params, ToolContext{}); }
+
+  std::string execute(const json& params, const ToolContext& ctx) override {
     const std::string content = params.value("content", "");
-    const std::string channel = params.value("channel", default_channel_);
-    const std::string chat_id = params.value("chat_id", default_chat_id_);
+    const std::string channel = params.value("channel", ctx.channel);
+    const std::string chat_id = params.value("chat_id", ctx.chat_id);
 
     if (channel.empty() || chat_id.empty()) {
       return "Error: No target channel/chat specified";
@@ -1026,8 +1960,6 @@ class MessageTool : public Tool {
 
  private:
   SendCallback callback_;
-  std::string default_channel_;
-  std::string default_chat_id_;
 };
 
 class SpawnManager {
@@ -1035,43 +1967,97 @@ class SpawnManager {
   virtual ~SpawnManager() = default;
   virtual std::string spawn(const std::string& task, const std::string& label,
                             const std::string& origin_channel,
-                            const std::string& origin_chat_id) = 0;
+                            const std::string& origin_chat_id, int priority = 0) = 0;
+  virtual std::string cancel(const std::string& task_id) {
+    (void)task_id;
+    return "Error: Cancellation is not supported";
+  }
+  virtual json status() const { return json::object(); }
 };
 
 class SpawnTool : public Tool {
  public:
   explicit SpawnTool(SpawnManager* manager) : manager_(manager) {}
 
-  void set_context(std::string channel, std::string chat_id) {
-    origin_channel_ = std::move(channel);
-    origin_chat_id_ = std::move(chat_id);
-  }
-
   std::string name() const override { return "spawn"; }
   std::string description() const override {
-    return "Spawn a background subagent to handle long-running tasks.";
+    return "Spawn a background subagent to handle long-running tasks. "
+           "Use action=status to list subagents and action=cancel with task_id to stop one.";
   }
   json parameters() const override {
     return json{{"type", "object"},
-                {"properties", {{"task", {{"type", "string"}}}, {"label", {{"type", "string"}}}}},
-                {"required", json::array({"task"})}};
+                {"properties",
+                 {{"action", {{"type", "string"}, {"enum", json::array({"spawn", "cancel", "status"})}}},
+                  {"task", {{"type", "string"}}},
+                  {"label", {{"type", "string"}}},
+                  {"priority", {{"type", "integer"}, {"description", "Higher runs first when the pool is busy"}}},
+                  {"task_id", {{"type", "string"}}}}}};
   }
-  std::string execute(const json& params) override {
-    const std::string task = params.value("task", "");
-    const std::string label = params.value("label", "");
+  std::string execute(const json& params) override { return execute(params, ToolContext{}); }
+
+  std::string execute(const json& params, const ToolContext& ctx) override {
+    const std::string action = params.value("action", "spawn");
     if (!manager_) {
       return "Error: Spawn manager is not configured";
     }
+    if (action == "status") {
+      return manager_->status().dump(2);
+    }
+    if (action == "cancel") {
+      const std::string task_id = params.value("task_id", "");
+      if (trim(task_id).empty()) {
+        return "Error: task_id is required";
+      }
+      return manager_->cancel(task_id);
+    }
+    const std::string task = params.value("task", "");
+    const std::string label = params.value("label", "");
     if (trim(task).empty()) {
       return "Error: task is required";
     }
-    return manager_->spawn(task, label, origin_channel_, origin_chat_id_);
+    return manager_->spawn(task, label, ctx.channel.empty() ? "cli" : ctx.channel,
+                           ctx.chat_id.empty() ? "direct" : ctx.chat_id, params.value("priority", 0));
   }
 
  private:
   SpawnManager* manager_{nullptr};
-  std::string origin_channel_{"cli"};
-  std::string origin_chat_id_{"direct"};
 };
 
+struct CoreToolOptions {
+  fs::path workspace;
+  bool restrict_to_workspace{false};
+  int exec_timeout_seconds{60};
+  std::string brave_api_key;
+  std::string transcribe_api_key;
+  std::string transcribe_api_base;
+  std::string transcribe_model;
+  int transcribe_timeout_seconds{180};
+};
+
+// File, shell, web, transcription, inspection and vision tools shared by the agent loop and subagents.
+inline void register_core_tools(ToolRegistry& tools, const CoreToolOptions& o) {
+  std::optional<fs::path> allowed_dir;
+  if (o.restrict_to_workspace) {
+    allowed_dir = o.workspace;
+  }
+
+  tools.register_tool(std::make_shared<ReadFileTool>(allowed_dir));
+  tools.register_tool(std::make_shared<WriteFileTool>(allowed_dir));
+  tools.register_tool(std::make_shared<EditFileTool>(allowed_dir));
+  tools.register_tool(std::make_shared<ListDirTool>(allowed_dir));
+  tools.register_tool(std::make_shared<SearchFilesTool>(o.workspace, allowed_dir));
+  tools.register_tool(std::make_shared<GlobTool>(o.workspace, allowed_dir));
+  tools.register_tool(std::make_shared<ExecTool>(o.exec_timeout_seconds, o.workspace, o.restrict_to_workspace));
+  tools.register_tool(std::make_shared<WebSearchTool>(o.brave_api_key, 5));
+  tools.register_tool(std::make_shared<WebFetchTool>());
+  tools.register_tool(std::make_shared<MemorySearchTool>(o.workspace));
+  if (!trim(o.transcribe_api_base).empty()) {
+    tools.register_tool(std::make_shared<TranscribeTool>(o.transcribe_api_key, o.transcribe_api_base,
+                                                         o.transcribe_model, o.transcribe_timeout_seconds));
+  }
+  tools.register_tool(std::make_shared<SystemInspectTool>());
+  tools.register_tool(std::make_shared<AppControlTool>());
+  tools.register_tool(std::make_shared<ScreenCaptureTool>(false));
+}
+
 }  // namespace attoclaw
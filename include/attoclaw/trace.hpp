@@ -0,0 +1,367 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+
+namespace attoclaw {
+
+// Lightweight per-request tracing.
+//
+// A trace id is minted when a message enters the bus and travels in
+// InboundMessage::metadata["traceId"] (copied into the OutboundMessage). The
+// agent worker installs it as the thread's current trace with TraceContext;
+// TraceSpan scopes opened on that thread are then recorded into a fixed-size
+// ring buffer. When a turn completes, its spans are exported as Chrome
+// trace-event JSON (chrome://tracing, Perfetto) or OTLP/JSON if the turn took at
+// least slowTurnMs.
+//
+// When tracing is disabled every entry point is a single relaxed atomic load.
+
+struct TraceSpanRecord {
+  char trace_id[33]{};
+  char name[40]{};
+  char detail[88]{};
+  uint64_t span_id{0};
+  uint64_t parent_span_id{0};
+  int64_t start_us{0};  // unix epoch, microseconds
+  int64_t dur_us{0};
+  uint32_t tid{0};
+};
+
+class Tracer {
+ public:
+  static constexpr std::size_t kCapacity = 4096;
+
+  Tracer() : slots_(std::make_unique<Slot[]>(kCapacity)) {}
+
+  void configure(bool enabled, fs::path dir, std::string format, int slow_turn_ms) {
+    {
+      std::lock_guard<std::mutex> lock(export_mu_);
+      dir_ = std::move(dir);
+      format_ = format == "otlp" ? "otlp" : "chrome";
+    }
+    slow_turn_us_.store(static_cast<int64_t>((std::max)(0, slow_turn_ms)) * 1000, std::memory_order_relaxed);
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static std::string new_trace_id() {
+    static thread_local std::mt19937_64 rng(std::random_device{}() ^
+                                            static_cast<uint64_t>(now_us()));
+    std::ostringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << rng() << std::setw(16) << rng();
+    return ss.str();
+  }
+
+  static uint64_t new_span_id() {
+    static thread_local std::mt19937_64 rng(std::random_device{}() ^
+                                            (static_cast<uint64_t>(now_us()) << 1));
+    uint64_t id = 0;
+    while (id == 0) {
+      id = rng();
+    }
+    return id;
+  }
+
+  static uint32_t thread_index() {
+    static std::atomic<uint32_t> next{1};
+    static thread_local uint32_t idx = next.fetch_add(1, std::memory_order_relaxed);
+    return idx;
+  }
+
+  void record(std::string_view trace_id, std::string_view name, std::string_view note, uint64_t span_id,
+              uint64_t parent_span_id, int64_t start_us, int64_t dur_us) {
+    const uint64_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[pos % kCapacity];
+    while (slot.busy.test_and_set(std::memory_order_acquire)) {
+    }
+    TraceSpanRecord& r = slot.rec;
+    copy_field(r.trace_id, sizeof(r.trace_id), trace_id);
+    copy_field(r.name, sizeof(r.name), name);
+    copy_field(r.detail, sizeof(r.detail), note);
+    r.span_id = span_id;
+    r.parent_span_id = parent_span_id;
+    r.start_us = start_us;
+    r.dur_us = dur_us;
+    r.tid = thread_index();
+    slot.busy.clear(std::memory_order_release);
+  }
+
+  std::vector<TraceSpanRecord> spans_for(std::string_view trace_id) const {
+    std::vector<TraceSpanRecord> out;
+    if (trace_id.empty()) {
+      return out;
+    }
+    for (std::size_t i = 0; i < kCapacity; ++i) {
+      Slot& slot = slots_[i];
+      while (slot.busy.test_and_set(std::memory_order_acquire)) {
+      }
+      if (trace_id == slot.rec.trace_id) {
+        out.push_back(slot.rec);
+      }
+      slot.busy.clear(std::memory_order_release);
+    }
+    std::sort(out.begin(), out.end(),
+              [](const TraceSpanRecord& a, const TraceSpanRecord& b) {
+                // Parents before children when they start in the same microsecond.
+                return a.start_us != b.start_us ? a.start_us < b.start_us : a.dur_us > b.dur_us;
+              });
+    return out;
+  }
+
+  // Called once a turn has been answered (after outbound dispatch when there is one).
+  // Returns the written file, or an empty path when nothing was exported.
+  fs::path finish(std::string_view trace_id) {
+    if (!enabled() || trace_id.empty()) {
+      return {};
+    }
+    const auto spans = spans_for(trace_id);
+    if (spans.empty()) {
+      return {};
+    }
+    int64_t begin = spans.front().start_us;
+    int64_t end = begin;
+    for (const auto& s : spans) {
+      end = (std::max)(end, s.start_us + s.dur_us);
+    }
+    if (end - begin < slow_turn_us_.load(std::memory_order_relaxed)) {
+      return {};
+    }
+
+    std::lock_guard<std::mutex> lock(export_mu_);
+    const bool otlp = format_ == "otlp";
+    const json doc = otlp ? to_otlp_json(spans) : to_chrome_json(spans);
+    const fs::path path = expand_user_path(dir_.string()) /
+                          ("trace-" + std::string(trace_id) + (otlp ? ".otlp.json" : ".json"));
+    if (!write_text_file(path, doc.dump())) {
+      ATTOCLAW_LOG_WARN("Failed to write trace file: " + path.string());
+      return {};
+    }
+    return path;
+  }
+
+  static json to_chrome_json(const std::vector<TraceSpanRecord>& spans) {
+    json events = json::array();
+    for (const auto& s : spans) {
+      json args = {{"traceId", s.trace_id}};
+      if (s.detail[0] != '\0') {
+        args["detail"] = s.detail;
+      }
+      events.push_back({{"name", s.name},
+                        {"cat", "attoclaw"},
+                        {"ph", "X"},
+                        {"ts", s.start_us},
+                        {"dur", s.dur_us},
+                        {"pid", 1},
+                        {"tid", s.tid},
+                        {"args", std::move(args)}});
+    }
+    return json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}};
+  }
+
+  static json to_otlp_json(const std::vector<TraceSpanRecord>& spans) {
+    auto hex64 = [](uint64_t v) {
+      std::ostringstream ss;
+      ss << std::hex << std::setfill('0') << std::setw(16) << v;
+      return ss.str();
+    };
+    json out_spans = json::array();
+    for (const auto& s : spans) {
+      json span = {{"traceId", s.trace_id},
+                   {"spanId", hex64(s.span_id)},
+                   {"name", s.name},
+                   {"kind", 1},
+                   {"startTimeUnixNano", std::to_string(s.start_us * 1000)},
+                   {"endTimeUnixNano", std::to_string((s.start_us + s.dur_us) * 1000)}};
+      if (s.parent_span_id != 0) {
+        span["parentSpanId"] = hex64(s.parent_span_id);
+      }
+      json attrs = json::array();
+      attrs.push_back({{"key", "thread.id"}, {"value", {{"intValue", std::to_string(s.tid)}}}});
+      if (s.detail[0] != '\0') {
+        attrs.push_back({{"key", "detail"}, {"value", {{"stringValue", s.detail}}}});
+      }
+      span["attributes"] = std::move(attrs);
+      out_spans.push_back(std::move(span));
+    }
+    return json{
+        {"resourceSpans",
+         json::array({{{"resource",
+                        {{"attributes",
+                          json::array({{{"key", "service.name"}, {"value", {{"stringValue", "attoclaw"}}}}})}}},
+                       {"scopeSpans", json::array({{{"scope", {{"name", "attoclaw"}}}, {"spans", out_spans}}})}}})}};
+  }
+
+ private:
+  struct Slot {
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    TraceSpanRecord rec{};
+  };
+
+  static void copy_field(char* dst, std::size_t cap, std::string_view src) {
+    const std::size_t n = (std::min)(cap - 1, src.size());
+    std::memcpy(dst, src.data(), n);
+    dst[n] = '\0';
+  }
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<int64_t> slow_turn_us_{0};
+  std::atomic<uint64_t> head_{0};
+  std::unique_ptr<Slot[]> slots_;
+  std::mutex export_mu_;
+  fs::path dir_{"~/.attoclaw/traces"};
+  std::string format_{"chrome"};
+};
+
+inline Tracer& tracer() {
+  static Tracer t;
+  return t;
+}
+
+namespace detail {
+struct ThreadTraceState {
+  std::string trace_id;
+  uint64_t current_span{0};
+};
+
+inline ThreadTraceState& thread_trace_state() {
+  static thread_local ThreadTraceState state;
+  return state;
+}
+}  // namespace detail
+
+// Installs a trace id as the current thread's trace for the lifetime of the scope.
+class TraceContext {
+ public:
+  explicit TraceContext(std::string trace_id) {
+    auto& st = detail::thread_trace_state();
+    saved_id_ = std::move(st.trace_id);
+    saved_span_ = st.current_span;
+    st.trace_id = std::move(trace_id);
+    st.current_span = 0;
+  }
+
+  ~TraceContext() {
+    auto& st = detail::thread_trace_state();
+    st.trace_id = std::move(saved_id_);
+    st.current_span = saved_span_;
+  }
+
+  TraceContext(const TraceContext&) = delete;
+  TraceContext& operator=(const TraceContext&) = delete;
+
+  static const std::string& current() { return detail::thread_trace_state().trace_id; }
+
+ private:
+  std::string saved_id_;
+  uint64_t saved_span_{0};
+};
+
+// RAII span recorded under the thread's current trace. `name` must outlive the scope
+// (string literals in practice); `note` is copied.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name, std::string_view note = {}) {
+    if (!tracer().enabled()) {
+      return;
+    }
+    auto& st = detail::thread_trace_state();
+    if (st.trace_id.empty()) {
+      return;
+    }
+    active_ = true;
+    name_ = name;
+    copy_detail(note);
+    span_id_ = Tracer::new_span_id();
+    parent_ = st.current_span;
+    st.current_span = span_id_;
+    start_us_ = Tracer::now_us();
+  }
+
+  ~TraceSpan() { end(); }
+
+  // Closes the span early; later calls (and the destructor) are no-ops.
+  void end() {
+    if (!active_) {
+      return;
+    }
+    active_ = false;
+    auto& st = detail::thread_trace_state();
+    tracer().record(st.trace_id, name_, std::string_view(detail_.data()), span_id_, parent_, start_us_,
+                    Tracer::now_us() - start_us_);
+    st.current_span = parent_;
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  void set_detail(std::string_view note) {
+    if (active_) {
+      copy_detail(note);
+    }
+  }
+
+ private:
+  void copy_detail(std::string_view note) {
+    const std::size_t n = (std::min)(detail_.size() - 1, note.size());
+    std::memcpy(detail_.data(), note.data(), n);
+    detail_[n] = '\0';
+  }
+
+  bool active_{false};
+  const char* name_{""};
+  std::array<char, sizeof(TraceSpanRecord::detail)> detail_{};
+  uint64_t span_id_{0};
+  uint64_t parent_{0};
+  int64_t start_us_{0};
+};
+
+// Records a span whose start was observed elsewhere (e.g. time spent queued on the bus).
+inline void record_trace_interval(const std::string& trace_id, const char* name, int64_t start_us,
+                                  std::string_view note = {}) {
+  if (!tracer().enabled() || trace_id.empty() || start_us <= 0) {
+    return;
+  }
+  const int64_t now = Tracer::now_us();
+  tracer().record(trace_id, name, note, Tracer::new_span_id(), 0, start_us, (std::max<int64_t>)(0, now - start_us));
+}
+
+// Stamps a fresh trace id and enqueue time into message metadata when tracing is on.
+inline void stamp_trace_metadata(json& metadata) {
+  if (!tracer().enabled()) {
+    return;
+  }
+  if (!metadata.is_object()) {
+    metadata = json::object();
+  }
+  if (!metadata.contains("traceId")) {
+    metadata["traceId"] = Tracer::new_trace_id();
+  }
+  metadata["enqueuedAtUs"] = Tracer::now_us();
+}
+
+inline std::string trace_id_from_metadata(const json& metadata) {
+  if (metadata.is_object() && metadata.contains("traceId") && metadata["traceId"].is_string()) {
+    return metadata["traceId"].get<std::string>();
+  }
+  return "";
+}
+
+}  // namespace attoclaw
@@ -0,0 +1,356 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/http.hpp"
+
+namespace attoclaw {
+
+struct WavInfo {
+  int channels{0};
+  int sample_rate{0};
+  int bits_per_sample{0};
+  std::size_t data_offset{0};
+  std::size_t data_size{0};
+};
+
+inline uint32_t wav_le32(const std::string& b, std::size_t at) {
+  uint32_t v = 0;
+  for (int i = 3; i >= 0; --i) {
+    v = (v << 8) | static_cast<unsigned char>(b[at + static_cast<std::size_t>(i)]);
+  }
+  return v;
+}
+
+inline void wav_put_le32(std::string& b, std::size_t at, uint32_t v) {
+  for (int i = 0; i < 4; ++i) {
+    b[at + static_cast<std::size_t>(i)] = static_cast<char>((v >> (8 * i)) & 0xFF);
+  }
+}
+
+// Locates the fmt/data chunks of a PCM WAV. A data size past the end of the buffer
+// (streamed output) is clamped to what is actually there.
+inline std::optional<WavInfo> parse_wav(const std::string& wav) {
+  if (wav.size() < 44 || wav.compare(0, 4, "RIFF") != 0 || wav.compare(8, 4, "WAVE") != 0) {
+    return std::nullopt;
+  }
+  WavInfo info;
+  bool have_fmt = false;
+  std::size_t pos = 12;
+  while (pos + 8 <= wav.size()) {
+    const uint32_t len = wav_le32(wav, pos + 4);
+    if (wav.compare(pos, 4, "fmt ") == 0 && pos + 24 <= wav.size()) {
+      const int format = static_cast<unsigned char>(wav[pos + 8]) | (static_cast<unsigned char>(wav[pos + 9]) << 8);
+      if (format != 1) {
+        return std::nullopt;  // not integer PCM
+      }
+      info.channels = static_cast<unsigned char>(wav[pos + 10]) | (static_cast<unsigned char>(wav[pos + 11]) << 8);
+      info.sample_rate = static_cast<int>(wav_le32(wav, pos + 12));
+      info.bits_per_sample = static_cast<unsigned char>(wav[pos + 22]) | (static_cast<unsigned char>(wav[pos + 23]) << 8);
+      have_fmt = true;
+    } else if (wav.compare(pos, 4, "data") == 0) {
+      if (!have_fmt || info.channels <= 0 || info.sample_rate <= 0) {
+        return std::nullopt;
+      }
+      info.data_offset = pos + 8;
+      info.data_size = (std::min)(static_cast<std::size_t>(len), wav.size() - info.data_offset);
+      return info;
+    }
+    pos += 8 + static_cast<std::size_t>(len) + (len & 1u);
+  }
+  return std::nullopt;
+}
+
+// ffmpeg cannot seek back into a pipe, so a streamed WAV keeps placeholder RIFF/data
+// sizes. Patch them from the buffer length so strict decoders accept it.
+inline void fix_streamed_wav_header(std::string& wav) {
+  if (wav.size() < 44 || wav.compare(0, 4, "RIFF") != 0 || wav.compare(8, 4, "WAVE") != 0) {
+    return;
+  }
+  wav_put_le32(wav, 4, static_cast<uint32_t>(wav.size() - 8));
+  std::size_t pos = 12;
+  while (pos + 8 <= wav.size()) {
+    if (wav.compare(pos, 4, "data") == 0) {
+      wav_put_le32(wav, pos + 4, static_cast<uint32_t>(wav.size() - pos - 8));
+      return;
+    }
+    const uint32_t len = wav_le32(wav, pos + 4);
+    pos += 8 + static_cast<std::size_t>(len) + (len & 1u);
+  }
+}
+
+inline std::string make_wav_pcm16(std::string_view pcm, int sample_rate, int channels) {
+  std::string out("RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\x10\0data\0\0\0\0", 44);
+  out[22] = static_cast<char>(channels);
+  wav_put_le32(out, 24, static_cast<uint32_t>(sample_rate));
+  wav_put_le32(out, 28, static_cast<uint32_t>(sample_rate * channels * 2));
+  out[32] = static_cast<char>(channels * 2);
+  out.append(pcm.data(), pcm.size());
+  fix_streamed_wav_header(out);
+  return out;
+}
+
+// Splits 16-bit PCM audio into ~segment_seconds WAV clips. Each cut is moved to the
+// quietest 100 ms window in the 3 s before the nominal boundary, so words are rarely
+// split. Returns the input unchanged (one element) when it is short or not 16-bit PCM.
+inline std::vector<std::string> split_wav_segments(const std::string& wav, int segment_seconds) {
+  const auto info = parse_wav(wav);
+  if (segment_seconds <= 0 || !info || info->bits_per_sample != 16) {
+    return {wav};
+  }
+  const std::size_t frame = static_cast<std::size_t>(info->channels) * 2;
+  const std::size_t per_second = frame * static_cast<std::size_t>(info->sample_rate);
+  const std::size_t segment = per_second * static_cast<std::size_t>(segment_seconds);
+  const std::string_view pcm(wav.data() + info->data_offset, info->data_size - info->data_size % frame);
+  if (pcm.size() <= segment + segment / 4) {
+    return {wav};
+  }
+
+  const std::size_t window = (std::max<std::size_t>)(frame, per_second / 10 / frame * frame);
+  const std::size_t search = (std::min)(per_second * 3, segment / 2) / frame * frame;
+  const std::size_t step = (std::max<std::size_t>)(frame, window / 2 / frame * frame);
+  auto energy = [&](std::size_t at) {
+    uint64_t sum = 0;
+    for (std::size_t i = at; i + 1 < at + window && i + 1 < pcm.size(); i += 2) {
+      const auto s = static_cast<int16_t>(static_cast<unsigned char>(pcm[i]) | (static_cast<unsigned char>(pcm[i + 1]) << 8));
+      sum += static_cast<uint64_t>(s < 0 ? -static_cast<int32_t>(s) : s);
+    }
+    return sum;
+  };
+
+  std::vector<std::string> out;
+  std::size_t start = 0;
+  while (pcm.size() - start > segment + segment / 4) {
+    const std::size_t nominal = start + segment;
+    std::size_t cut = nominal;
+    uint64_t best = UINT64_MAX;
+    for (std::size_t at = nominal - search; at + window <= nominal; at += step) {
+      const uint64_t e = energy(at);
+      if (e < best) {
+        best = e;
+        cut = at + step;
+      }
+    }
+    out.push_back(make_wav_pcm16(pcm.substr(start, cut - start), info->sample_rate, info->channels));
+    start = cut;
+  }
+  out.push_back(make_wav_pcm16(pcm.substr(start), info->sample_rate, info->channels));
+  return out;
+}
+
+// Finished transcripts on disk, keyed by a hash of the audio bytes and the request
+// parameters, so a forwarded or re-sent voice note is not transcribed twice. Holds at
+// most `max_entries` transcripts; the least recently used are evicted on put(). The
+// directory is only listed on the first put() and when the running count crosses the cap.
+class TranscriptCache {
+ public:
+  static constexpr std::size_t kDefaultMaxEntries = 2000;
+
+  explicit TranscriptCache(fs::path dir = expand_user_path("~/.attoclaw") / "cache" / "transcripts",
+                           std::size_t max_entries = kDefaultMaxEntries)
+      : dir_(std::move(dir)), max_entries_((std::max)(std::size_t{1}, max_entries)) {}
+
+  static std::string key(std::string_view audio, const std::string& params) {
+    return format_key(fnv1a64(params, fnv1a64(audio)), audio.size());
+  }
+
+  // Same key as key(read_text_file(p), params), hashed in 64 KiB chunks so large
+  // attachments are never held in memory just to look them up.
+  static std::optional<std::string> file_key(const fs::path& p, const std::string& params) {
+    std::ifstream in(p, std::ios::binary);
+    if (!in) {
+      return std::nullopt;
+    }
+    uint64_t h = fnv1a64("");
+    std::size_t size = 0;
+    std::vector<char> buf(64 * 1024);
+    while (in) {
+      in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+      const std::size_t n = static_cast<std::size_t>(in.gcount());
+      h = fnv1a64(std::string_view(buf.data(), n), h);
+      size += n;
+    }
+    if (in.bad() || size == 0) {
+      return std::nullopt;
+    }
+    return format_key(fnv1a64(params, h), size);
+  }
+
+  std::optional<std::string> get(const std::string& k) const {
+    std::error_code ec;
+    const fs::path p = dir_ / (k + ".txt");
+    if (!fs::exists(p, ec)) {
+      return std::nullopt;
+    }
+    fs::last_write_time(p, fs::file_time_type::clock::now(), ec);  // recency for eviction
+    return read_text_file(p);
+  }
+
+  void put(const std::string& k, const std::string& text) const {
+    const fs::path p = dir_ / (k + ".txt");
+    const fs::path tmp = dir_ / (k + ".txt.tmp" + random_id(6));
+    if (!write_text_file(tmp, text)) {
+      return;
+    }
+    std::error_code ec;
+    const bool is_new = !fs::exists(p, ec);
+    fs::rename(tmp, p, ec);
+    if (ec) {
+      fs::remove(tmp, ec);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!entries_) {
+      entries_ = count_entries();
+    } else if (is_new) {
+      ++*entries_;
+    }
+    if (*entries_ > max_entries_) {
+      entries_ = evict();
+    }
+  }
+
+ private:
+  static std::string format_key(uint64_t h, std::size_t size) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return std::string(buf) + "-" + std::to_string(size);
+  }
+
+  std::size_t count_entries() const {
+    std::error_code ec;
+    std::size_t n = 0;
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+      n += it->path().extension() == ".txt" ? 1 : 0;
+    }
+    return n;
+  }
+
+  // Trims to 90% of the cap by modification time, so eviction runs once per batch of
+  // puts. Returns the number of entries left on disk.
+  std::size_t evict() const {
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+      if (it->path().extension() == ".txt") {
+        files.emplace_back(it->last_write_time(ec), it->path());
+      }
+    }
+    if (files.size() <= max_entries_) {
+      return files.size();
+    }
+    const std::size_t keep = max_entries_ - max_entries_ / 10;
+    std::sort(files.begin(), files.end());
+    for (std::size_t i = 0; i + keep < files.size(); ++i) {
+      fs::remove(files[i].second, ec);
+    }
+    return keep;
+  }
+
+  fs::path dir_;
+  std::size_t max_entries_;
+  mutable std::mutex mu_;
+  mutable std::optional<std::size_t> entries_;  // .txt files on disk; unset until the first put()
+};
+
+// Process-wide transcription settings plus a small pool of long-lived upload workers.
+// Each worker keeps its own HttpClient, so segment uploads to a local Whisper/NIM server
+// reuse warm keep-alive connections instead of reconnecting per clip.
+class TranscriptionService {
+ public:
+  ~TranscriptionService() { shutdown(); }
+
+  void configure(int segment_seconds, int concurrency, bool cache_enabled) {
+    std::lock_guard<std::mutex> lock(mu_);
+    segment_seconds_ = (std::max)(0, segment_seconds);
+    concurrency_ = std::clamp(concurrency, 1, 16);
+    cache_enabled_ = cache_enabled;
+  }
+
+  int segment_seconds() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return segment_seconds_;
+  }
+
+  const TranscriptCache* cache() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return cache_enabled_ ? &cache_ : nullptr;
+  }
+
+  std::future<HttpResponse> submit(std::function<HttpResponse(HttpClient&)> job) {
+    auto task = std::make_shared<std::packaged_task<HttpResponse(HttpClient&)>>(std::move(job));
+    std::future<HttpResponse> fut = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      while (static_cast<int>(workers_.size()) < concurrency_) {
+        workers_.emplace_back([this]() { worker_loop(); });
+      }
+      jobs_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+    return fut;
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+    workers_.clear();
+  }
+
+ private:
+  void worker_loop() {
+    HttpClient client;
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+      cv_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty()) {
+        return;
+      }
+      auto task = std::move(jobs_.front());
+      jobs_.pop_front();
+      lock.unlock();
+      (*task)(client);
+      lock.lock();
+    }
+  }
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  int segment_seconds_{30};
+  int concurrency_{4};
+  bool cache_enabled_{true};
+  bool stopping_{false};
+  TranscriptCache cache_;
+  std::deque<std::shared_ptr<std::packaged_task<HttpResponse(HttpClient&)>>> jobs_;
+  std::vector<std::thread> workers_;
+};
+
+inline TranscriptionService& transcription() {
+  static TranscriptionService service;
+  return service;
+}
+
+}  // namespace attoclaw
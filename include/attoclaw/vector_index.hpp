@@ -0,0 +1,625 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/mapped_file.hpp"
+
+namespace attoclaw {
+
+namespace vector_detail {
+
+inline float dot_scalar(const float* a, const float* b, std::size_t n) {
+  float s0 = 0.0f;
+  float s1 = 0.0f;
+  float s2 = 0.0f;
+  float s3 = 0.0f;
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < n; ++i) {
+    s0 += a[i] * b[i];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2,fma")))
+#endif
+inline float dot_avx2(const float* a, const float* b, std::size_t n) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+  }
+  const __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+  float out = _mm_cvtss_f32(s);
+  for (; i < n; ++i) {
+    out += a[i] * b[i];
+  }
+  return out;
+}
+
+inline bool cpu_has_avx2_fma() {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(_MSC_VER)
+  int info[4] = {0, 0, 0, 0};
+  __cpuid(info, 1);
+  const bool fma = (info[2] & (1 << 12)) != 0;
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  __cpuidex(info, 7, 0);
+  const bool avx2 = (info[1] & (1 << 5)) != 0;
+  return fma && avx2 && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+  return false;
+#endif
+}
+#endif
+
+#if defined(__aarch64__)
+inline float dot_neon(const float* a, const float* b, std::size_t n) {
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  float out = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; i < n; ++i) {
+    out += a[i] * b[i];
+  }
+  return out;
+}
+#endif
+
+using DotFn = float (*)(const float*, const float*, std::size_t);
+
+inline DotFn select_dot() {
+#if defined(__x86_64__) || defined(_M_X64)
+  if (cpu_has_avx2_fma()) {
+    return &dot_avx2;
+  }
+#elif defined(__aarch64__)
+  return &dot_neon;
+#endif
+  return &dot_scalar;
+}
+
+inline uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+}  // namespace vector_detail
+
+// Dot product with the widest SIMD path the CPU supports (AVX2+FMA, NEON, else scalar),
+// picked once at first use.
+inline float dot_f32(const float* a, const float* b, std::size_t n) {
+  static const vector_detail::DotFn fn = vector_detail::select_dot();
+  return fn(a, b, n);
+}
+
+inline void l2_normalize(std::vector<float>& v) {
+  const float norm = std::sqrt(dot_f32(v.data(), v.data(), v.size()));
+  if (norm > 0.0f) {
+    for (auto& x : v) {
+      x /= norm;
+    }
+  }
+}
+
+// Turns texts into vectors. `id` names the model; vectors from a different id are
+// never mixed into the same index.
+struct Embedder {
+  std::string id;
+  std::function<std::optional<std::vector<std::vector<float>>>(const std::vector<std::string>&)> embed;
+};
+
+// Deterministic offline embedding: signed feature hashing of lowercased words and their
+// character trigrams, L2-normalized. Captures lexical overlap and word-form similarity
+// only, but needs no network and is stable across runs (useful for tests).
+inline std::vector<float> hash_embed(std::string_view text, int dim) {
+  std::vector<float> v(static_cast<std::size_t>((std::max)(dim, 8)), 0.0f);
+  auto add = [&v](std::string_view feature, float weight) {
+    const uint64_t h = fnv1a64(feature);
+    v[static_cast<std::size_t>(h % v.size())] += (h >> 63) ? -weight : weight;
+  };
+  std::string word;
+  auto flush = [&]() {
+    if (word.size() >= 2) {
+      add(word, 1.0f);
+      const std::string padded = "<" + word + ">";
+      for (std::size_t i = 0; i + 3 <= padded.size(); ++i) {
+        add(std::string_view(padded).substr(i, 3), 0.35f);
+      }
+    }
+    word.clear();
+  };
+  for (unsigned char c : text) {
+    if (std::isalnum(c) || c >= 0x80) {
+      word.push_back(static_cast<char>(std::tolower(c)));
+    } else {
+      flush();
+    }
+  }
+  flush();
+  l2_normalize(v);
+  return v;
+}
+
+inline Embedder hashing_embedder(int dim = 256) {
+  return Embedder{"hash" + std::to_string(dim),
+                  [dim](const std::vector<std::string>& texts) -> std::optional<std::vector<std::vector<float>>> {
+                    std::vector<std::vector<float>> out;
+                    out.reserve(texts.size());
+                    for (const auto& t : texts) {
+                      out.push_back(hash_embed(t, dim));
+                    }
+                    return out;
+                  }};
+}
+
+// Cosine-similarity index over an append-only, memory-mapped vector file. Each record is
+// a caller-defined 64-bit ref followed by `dim` normalized floats. Small stores are
+// scanned exhaustively; from `hnsw_threshold` records on, queries go through an HNSW
+// graph, which is kept in RAM, persisted next to the vectors (".hnsw") and extended
+// incrementally as records are appended. Not thread-safe.
+class VectorIndex {
+ public:
+  static constexpr std::size_t kDefaultHnswThreshold = 20000;
+
+  VectorIndex(fs::path path, int dim, const std::string& model_id,
+              std::size_t hnsw_threshold = kDefaultHnswThreshold)
+      : path_(std::move(path)),
+        dim_(static_cast<std::size_t>(dim)),
+        model_hash_(fnv1a64(model_id)),
+        hnsw_threshold_(hnsw_threshold) {
+    open();
+  }
+
+  ~VectorIndex() { save_graph(); }
+
+  VectorIndex(const VectorIndex&) = delete;
+  VectorIndex& operator=(const VectorIndex&) = delete;
+
+  // Dimension recorded in an existing vector file, or 0.
+  static int stored_dim(const fs::path& path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    char header[12] = {};
+    if (!in.read(header, sizeof(header)) || std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+      return 0;
+    }
+    uint32_t dim = 0;
+    std::memcpy(&dim, header + 8, sizeof(dim));
+    return static_cast<int>(dim);
+  }
+
+  std::size_t dim() const { return dim_; }
+  std::size_t size() const { return count_; }
+  bool uses_graph() const { return !levels_.empty(); }
+
+  uint64_t ref(std::size_t i) const {
+    uint64_t r = 0;
+    std::memcpy(&r, record(i), sizeof(r));
+    return r;
+  }
+
+  const float* vec(std::size_t i) const { return reinterpret_cast<const float*>(record(i) + sizeof(uint64_t)); }
+
+  // Appends (ref, vector) records; vectors are normalized here. Returns false on I/O error.
+  bool append(const std::vector<std::pair<uint64_t, std::vector<float>>>& items) {
+    if (items.empty()) {
+      return true;
+    }
+    {
+      std::ofstream out(path_, std::ios::out | std::ios::app | std::ios::binary);
+      if (!out) {
+        return false;
+      }
+      for (const auto& [r, v] : items) {
+        if (v.size() != dim_) {
+          continue;
+        }
+        std::vector<float> unit = v;
+        l2_normalize(unit);
+        out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+        out.write(reinterpret_cast<const char*>(unit.data()), static_cast<std::streamsize>(unit.size() * sizeof(float)));
+      }
+      if (!out) {
+        return false;
+      }
+    }
+    remap();
+    if (count_ >= hnsw_threshold_) {
+      extend_graph();
+      if (levels_.size() - saved_nodes_ >= kSaveEvery) {
+        save_graph();
+      }
+    }
+    return true;
+  }
+
+  // Drops every record (e.g. when the source the refs point into was rewritten).
+  void reset() {
+    map_.close();
+    levels_.clear();
+    links_.clear();
+    saved_nodes_ = 0;
+    graph_dirty_ = false;
+    std::error_code ec;
+    fs::remove(graph_path(), ec);
+    write_header();
+    remap();
+  }
+
+  // Top-k (record index, cosine similarity), best first.
+  std::vector<std::pair<std::size_t, float>> search(const std::vector<float>& query, std::size_t k,
+                                                    std::size_t ef = 64) const {
+    if (query.size() != dim_ || count_ == 0 || k == 0) {
+      return {};
+    }
+    std::vector<float> q = query;
+    l2_normalize(q);
+    // Fixed-size min-heap on similarity: the worst kept hit sits at the front.
+    std::vector<std::pair<std::size_t, float>> out;
+    out.reserve((std::min)(k, count_));
+    const auto better = [](const auto& a, const auto& b) { return a.second > b.second; };
+    const auto offer = [&](std::size_t id, float sim) {
+      if (out.size() < k) {
+        out.emplace_back(id, sim);
+        std::push_heap(out.begin(), out.end(), better);
+      } else if (sim > out.front().second) {
+        std::pop_heap(out.begin(), out.end(), better);
+        out.back() = {id, sim};
+        std::push_heap(out.begin(), out.end(), better);
+      }
+    };
+    std::size_t unlinked = 0;
+    if (!levels_.empty()) {
+      uint32_t cur = entry_;
+      for (int l = max_level_; l > 0; --l) {
+        cur = greedy_closest(q.data(), cur, l);
+      }
+      for (const auto& [sim, id] : search_layer(q.data(), cur, (std::max)(ef, k), 0)) {
+        offer(id, sim);
+      }
+      unlinked = levels_.size();
+    }
+    for (std::size_t i = unlinked; i < count_; ++i) {
+      offer(i, dot_f32(q.data(), vec(i), dim_));
+    }
+    std::sort_heap(out.begin(), out.end(), better);
+    return out;
+  }
+
+  // Writes the HNSW graph if it changed since the last save.
+  void save_graph() {
+    std::error_code exists_ec;
+    if (!graph_dirty_ || levels_.empty() || !fs::exists(path_, exists_ec)) {
+      return;  // also when the vectors file was deleted: the graph would describe nothing
+    }
+    std::string out(kGraphMagic, sizeof(kGraphMagic));
+    auto put = [&out](const void* p, std::size_t n) { out.append(static_cast<const char*>(p), n); };
+    const uint64_t n = levels_.size();
+    put(&model_hash_, sizeof(model_hash_));
+    put(&n, sizeof(n));
+    put(&entry_, sizeof(entry_));
+    put(&max_level_, sizeof(max_level_));
+    for (std::size_t i = 0; i < levels_.size(); ++i) {
+      put(&levels_[i], sizeof(levels_[i]));
+      for (const auto& nbrs : links_[i]) {
+        const uint32_t c = static_cast<uint32_t>(nbrs.size());
+        put(&c, sizeof(c));
+        put(nbrs.data(), nbrs.size() * sizeof(uint32_t));
+      }
+    }
+    const fs::path tmp = graph_path().string() + ".tmp";
+    if (write_text_file(tmp, out)) {
+      std::error_code ec;
+      fs::rename(tmp, graph_path(), ec);
+      if (!ec) {
+        graph_dirty_ = false;
+        saved_nodes_ = levels_.size();
+      }
+    }
+  }
+
+ private:
+  static constexpr char kMagic[8] = {'A', 'C', 'V', 'E', 'C', '1', '\0', '\0'};
+  static constexpr char kGraphMagic[8] = {'A', 'C', 'H', 'N', 'S', 'W', '1', '\n'};
+  static constexpr std::size_t kHeaderSize = 32;  // magic, dim u32, pad u32, model hash u64, pad u64
+  static constexpr std::size_t kM = 16;
+  static constexpr std::size_t kM0 = 32;
+  static constexpr std::size_t kEfConstruction = 100;
+  static constexpr std::size_t kSaveEvery = 4096;  // unsaved graph nodes; a crash only costs re-inserting these
+
+  fs::path graph_path() const { return path_.string() + ".hnsw"; }
+  std::size_t record_size() const { return sizeof(uint64_t) + dim_ * sizeof(float); }
+  const char* record(std::size_t i) const { return map_.data() + kHeaderSize + i * record_size(); }
+
+  void open() {
+    remap();
+    bool ok = map_.size() >= kHeaderSize && std::memcmp(map_.data(), kMagic, sizeof(kMagic)) == 0;
+    if (ok) {
+      uint32_t dim = 0;
+      uint64_t model = 0;
+      std::memcpy(&dim, map_.data() + 8, sizeof(dim));
+      std::memcpy(&model, map_.data() + 16, sizeof(model));
+      ok = dim == dim_ && model == model_hash_;
+    }
+    if (!ok) {
+      reset();
+      return;
+    }
+    if (count_ >= hnsw_threshold_) {
+      load_graph();
+      extend_graph();
+    }
+  }
+
+  void write_header() {
+    std::string header(kHeaderSize, '\0');
+    std::memcpy(header.data(), kMagic, sizeof(kMagic));
+    const uint32_t dim = static_cast<uint32_t>(dim_);
+    std::memcpy(header.data() + 8, &dim, sizeof(dim));
+    std::memcpy(header.data() + 16, &model_hash_, sizeof(model_hash_));
+    write_text_file(path_, header);
+  }
+
+  // Records are counted from the file size, so a torn final append is simply ignored.
+  void remap() {
+    map_.open(path_);
+    count_ = map_.size() > kHeaderSize ? (map_.size() - kHeaderSize) / record_size() : 0;
+  }
+
+  void load_graph() {
+    const std::string in = read_text_file(graph_path());
+    std::size_t pos = 0;
+    auto get = [&](void* p, std::size_t n) {
+      if (pos + n > in.size()) {
+        return false;
+      }
+      std::memcpy(p, in.data() + pos, n);
+      pos += n;
+      return true;
+    };
+    char magic[8];
+    uint64_t model = 0;
+    uint64_t n = 0;
+    uint32_t entry = 0;
+    int32_t max_level = 0;
+    if (!get(magic, sizeof(magic)) || std::memcmp(magic, kGraphMagic, sizeof(magic)) != 0 || !get(&model, 8) ||
+        model != model_hash_ || !get(&n, 8) || n > count_ || !get(&entry, 4) || !get(&max_level, 4) ||
+        (n > 0 && entry >= n)) {
+      return;
+    }
+    std::vector<uint8_t> levels(static_cast<std::size_t>(n));
+    std::vector<std::vector<std::vector<uint32_t>>> links(static_cast<std::size_t>(n));
+    for (std::size_t i = 0; i < n; ++i) {
+      if (!get(&levels[i], 1)) {
+        return;
+      }
+      links[i].resize(static_cast<std::size_t>(levels[i]) + 1);
+      for (auto& nbrs : links[i]) {
+        uint32_t c = 0;
+        if (!get(&c, 4) || c > kM0) {
+          return;
+        }
+        nbrs.resize(c);
+        if (!get(nbrs.data(), c * sizeof(uint32_t))) {
+          return;
+        }
+        for (uint32_t id : nbrs) {
+          if (id >= n) {
+            return;
+          }
+        }
+      }
+    }
+    levels_ = std::move(levels);
+    links_ = std::move(links);
+    saved_nodes_ = levels_.size();
+    entry_ = entry;
+    max_level_ = max_level;
+  }
+
+  void extend_graph() {
+    while (levels_.size() < count_) {
+      insert(static_cast<uint32_t>(levels_.size()));
+      graph_dirty_ = true;
+    }
+  }
+
+  // Level is derived from the record index, so rebuilding gives the same graph.
+  static uint8_t level_for(uint32_t id) {
+    const double u = (static_cast<double>(vector_detail::splitmix64(id) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    const double ml = 1.0 / std::log(static_cast<double>(kM));
+    return static_cast<uint8_t>((std::min)(15.0, std::floor(-std::log(u) * ml)));
+  }
+
+  float sim(const float* q, uint32_t id) const { return dot_f32(q, vec(id), dim_); }
+
+  uint32_t greedy_closest(const float* q, uint32_t cur, int level) const {
+    float best = sim(q, cur);
+    for (bool moved = true; moved;) {
+      moved = false;
+      for (uint32_t n : links_[cur][static_cast<std::size_t>(level)]) {
+        const float s = sim(q, n);
+        if (s > best) {
+          best = s;
+          cur = n;
+          moved = true;
+        }
+      }
+    }
+    return cur;
+  }
+
+  // Best-first search of one layer; returns up to ef (similarity, id), best first.
+  std::vector<std::pair<float, uint32_t>> search_layer(const float* q, uint32_t entry, std::size_t ef,
+                                                        int level) const {
+    thread_local std::vector<uint32_t> visited;
+    thread_local uint32_t stamp = 0;
+    if (visited.size() < levels_.size()) {
+      visited.assign(levels_.size() + 1024, 0);
+      stamp = 0;
+    }
+    if (++stamp == 0) {
+      std::fill(visited.begin(), visited.end(), 0);
+      stamp = 1;
+    }
+
+    using Item = std::pair<float, uint32_t>;
+    std::priority_queue<Item> candidates;                                     // best first
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> results;  // worst on top
+    const float s0 = sim(q, entry);
+    candidates.emplace(s0, entry);
+    results.emplace(s0, entry);
+    visited[entry] = stamp;
+    while (!candidates.empty()) {
+      const auto [s, id] = candidates.top();
+      if (s < results.top().first && results.size() >= ef) {
+        break;
+      }
+      candidates.pop();
+      for (uint32_t n : links_[id][static_cast<std::size_t>(level)]) {
+        if (visited[n] == stamp) {
+          continue;
+        }
+        visited[n] = stamp;
+        const float sn = sim(q, n);
+        if (results.size() < ef || sn > results.top().first) {
+          candidates.emplace(sn, n);
+          results.emplace(sn, n);
+          if (results.size() > ef) {
+            results.pop();
+          }
+        }
+      }
+    }
+    std::vector<Item> out;
+    out.reserve(results.size());
+    while (!results.empty()) {
+      out.push_back(results.top());
+      results.pop();
+    }
+    std::reverse(out.begin(), out.end());
+    return out;
+  }
+
+  // HNSW neighbour heuristic: keep a candidate only if it is closer to the base than to
+  // any neighbour already kept, then top up with the closest rejected ones.
+  std::vector<uint32_t> select_neighbors(const std::vector<std::pair<float, uint32_t>>& sorted, std::size_t m) const {
+    std::vector<uint32_t> kept;
+    std::vector<uint32_t> rejected;
+    for (const auto& [s, id] : sorted) {
+      if (kept.size() >= m) {
+        break;
+      }
+      bool diverse = true;
+      for (uint32_t k : kept) {
+        if (dot_f32(vec(id), vec(k), dim_) > s) {
+          diverse = false;
+          break;
+        }
+      }
+      (diverse ? kept : rejected).push_back(id);
+    }
+    for (std::size_t i = 0; kept.size() < m && i < rejected.size(); ++i) {
+      kept.push_back(rejected[i]);
+    }
+    return kept;
+  }
+
+  void insert(uint32_t id) {
+    const int level = level_for(id);
+    levels_.push_back(static_cast<uint8_t>(level));
+    links_.emplace_back(static_cast<std::size_t>(level) + 1);
+    if (id == 0) {
+      entry_ = 0;
+      max_level_ = level;
+      return;
+    }
+    const float* q = vec(id);
+    uint32_t cur = entry_;
+    for (int l = max_level_; l > level; --l) {
+      cur = greedy_closest(q, cur, l);
+    }
+    for (int l = (std::min)(level, max_level_); l >= 0; --l) {
+      const auto found = search_layer(q, cur, kEfConstruction, l);
+      const std::size_t cap = l == 0 ? kM0 : kM;
+      links_[id][static_cast<std::size_t>(l)] = select_neighbors(found, cap);
+      for (uint32_t n : links_[id][static_cast<std::size_t>(l)]) {
+        auto& back = links_[n][static_cast<std::size_t>(l)];
+        back.push_back(id);
+        if (back.size() > cap) {
+          std::vector<std::pair<float, uint32_t>> scored;
+          scored.reserve(back.size());
+          for (uint32_t b : back) {
+            scored.emplace_back(dot_f32(vec(n), vec(b), dim_), b);
+          }
+          std::sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+          back = select_neighbors(scored, cap);
+        }
+      }
+      cur = found.front().second;
+    }
+    if (level > max_level_) {
+      max_level_ = level;
+      entry_ = id;
+    }
+  }
+
+  fs::path path_;
+  std::size_t dim_;
+  uint64_t model_hash_;
+  std::size_t hnsw_threshold_;
+  MappedFile map_;
+  std::size_t count_{0};
+
+  std::vector<uint8_t> levels_;
+  std::vector<std::vector<std::vector<uint32_t>>> links_;
+  uint32_t entry_{0};
+  int32_t max_level_{0};
+  bool graph_dirty_{false};
+  std::size_t saved_nodes_{0};
+};
+
+}  // namespace attoclaw
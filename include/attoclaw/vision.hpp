@@ -1,10 +1,19 @@
 #pragma once
 
+#include <cstdint>
+#include <list>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "attoclaw/base64.hpp"
+#include "attoclaw/capabilities.hpp"
 #include "attoclaw/common.hpp"
+#include "attoclaw/image_codec.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/subprocess.hpp"
 
 namespace attoclaw {
 
@@ -12,6 +21,11 @@ struct VisionFrame {
   fs::path path;
   std::string data_url;
   int64_t timestamp_ms{0};
+  uint64_t hash{0};  // of the downscaled pixels; keys the OCR cache
+  int width{0};
+  int height{0};
+  std::size_t bytes{0};
+  bool unchanged{false};  // same pixels as the caller's previous frame: nothing was written or encoded
 };
 
 inline std::string sh_single_quote(const std::string& s) {
@@ -27,14 +41,7 @@ inline std::string sh_single_quote(const std::string& s) {
   return out;
 }
 
-inline bool command_exists_in_path(const std::string& command) {
-#ifdef _WIN32
-  const CommandResult r = run_command_capture("where " + command, 10);
-#else
-  const CommandResult r = run_command_capture("sh -lc \"command -v " + command + "\"", 10);
-#endif
-  return r.ok && !trim(r.output).empty();
-}
+inline bool command_exists_in_path(const std::string& command) { return capabilities().has(command); }
 
 inline bool is_headless_server() {
 #ifdef _WIN32
@@ -87,6 +94,7 @@ inline bool try_install_linux_package(const std::string& package_name, int timeo
 
     CommandResult install = run_command_capture(cmd, timeout_s);
     if (install.ok) {
+      capabilities().invalidate();
       return true;
     }
     const std::string err = trim(install.output);
@@ -140,15 +148,7 @@ inline bool ensure_vision_capture_dependencies(std::string* note = nullptr) {
 #endif
 }
 
-inline bool has_tesseract_ocr() {
-#ifdef _WIN32
-  CommandResult r = run_command_capture("where tesseract", 10);
-  return r.ok && !trim(r.output).empty();
-#else
-  CommandResult r = run_command_capture("sh -lc \"command -v tesseract\"", 10);
-  return r.ok && !trim(r.output).empty();
-#endif
-}
+inline bool has_tesseract_ocr() { return command_exists_in_path("tesseract"); }
 
 inline bool ensure_tesseract_ocr(std::string* note = nullptr) {
   if (has_tesseract_ocr()) {
@@ -189,16 +189,17 @@ inline std::string extract_ocr_text(const fs::path& image_path, int timeout_s =
   }
 
 #ifdef _WIN32
-  const std::string cmd = "tesseract \"" + p.string() + "\" stdout --psm 6";
+  const CommandResult r = run_command_capture("tesseract \"" + p.string() + "\" stdout --psm 6", timeout_s);
+  std::string out = r.ok ? trim(r.output) : "";
 #else
-  const std::string cmd = "sh -lc \"tesseract '" + p.string() + "' stdout --psm 6\"";
-#endif
-  CommandResult r = run_command_capture(cmd, timeout_s);
-  if (!r.ok) {
+  // The binary the capability probe found, so probe and launch agree on PATH.
+  const auto tesseract = capabilities().resolve("tesseract");
+  if (!tesseract) {
     return "";
   }
-
-  std::string out = trim(r.output);
+  const ProcessOutput r = run_process_capture({tesseract->string(), p.string(), "stdout", "--psm", "6"}, timeout_s);
+  std::string out = r.ok ? trim(r.out) : "";
+#endif
   if (out.size() > 6000) {
     out.resize(6000);
     out += "\n... (truncated)";
@@ -207,40 +208,7 @@ inline std::string extract_ocr_text(const fs::path& image_path, int timeout_s =
 }
 
 inline std::string base64_encode_bytes(const std::vector<unsigned char>& data) {
-  static constexpr char tbl[] =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  std::string out;
-  out.reserve(((data.size() + 2) / 3) * 4);
-
-  std::size_t i = 0;
-  while (i + 3 <= data.size()) {
-    const unsigned int n = (static_cast<unsigned int>(data[i]) << 16) |
-                           (static_cast<unsigned int>(data[i + 1]) << 8) |
-                           static_cast<unsigned int>(data[i + 2]);
-    out.push_back(tbl[(n >> 18) & 0x3F]);
-    out.push_back(tbl[(n >> 12) & 0x3F]);
-    out.push_back(tbl[(n >> 6) & 0x3F]);
-    out.push_back(tbl[n & 0x3F]);
-    i += 3;
-  }
-
-  const std::size_t rem = data.size() - i;
-  if (rem == 1) {
-    const unsigned int n = static_cast<unsigned int>(data[i]) << 16;
-    out.push_back(tbl[(n >> 18) & 0x3F]);
-    out.push_back(tbl[(n >> 12) & 0x3F]);
-    out.push_back('=');
-    out.push_back('=');
-  } else if (rem == 2) {
-    const unsigned int n =
-        (static_cast<unsigned int>(data[i]) << 16) | (static_cast<unsigned int>(data[i + 1]) << 8);
-    out.push_back(tbl[(n >> 18) & 0x3F]);
-    out.push_back(tbl[(n >> 12) & 0x3F]);
-    out.push_back(tbl[(n >> 6) & 0x3F]);
-    out.push_back('=');
-  }
-
-  return out;
+  return base64_encode(data.data(), data.size());
 }
 
 inline std::vector<unsigned char> read_binary_file(const fs::path& p) {
@@ -271,69 +239,182 @@ inline std::string ps_quote(const std::string& s) {
   return out;
 }
 
-inline std::optional<VisionFrame> capture_vision_frame(int max_width = 960, int jpeg_quality = 60) {
-#ifndef _WIN32
-  (void)max_width;
-  (void)jpeg_quality;
-  return std::nullopt;
-#else
-  max_width = (std::max)(320, max_width);
-  jpeg_quality = std::clamp(jpeg_quality, 20, 95);
-
-  const fs::path dir = expand_user_path("~/.attoclaw") / "vision_frames";
-  std::error_code ec;
-  fs::create_directories(dir, ec);
-  const fs::path out = dir / ("frame_" + std::to_string(now_ms()) + ".jpg");
-  const std::string out_abs = fs::absolute(out).string();
-
-  const std::string command =
-      "powershell -NoProfile -ExecutionPolicy Bypass -Command "
-      "\"Add-Type -AssemblyName System.Windows.Forms; "
-      "Add-Type -AssemblyName System.Drawing; "
-      "$b=[System.Windows.Forms.SystemInformation]::VirtualScreen; "
-      "$bmp=New-Object System.Drawing.Bitmap $b.Width,$b.Height; "
-      "$g=[System.Drawing.Graphics]::FromImage($bmp); "
-      "$g.CopyFromScreen($b.Left,$b.Top,0,0,$bmp.Size); "
-      "$outBmp=$bmp; "
-      "if($bmp.Width -gt " +
-      std::to_string(max_width) +
-      "){"
-      "$h=[int]($bmp.Height*" +
-      std::to_string(max_width) +
-      "/$bmp.Width); "
-      "$outBmp=New-Object System.Drawing.Bitmap $bmp," +
-      std::to_string(max_width) +
-      ",$h;"
-      "} "
-      "$enc=[System.Drawing.Imaging.ImageCodecInfo]::GetImageEncoders() | "
-      "Where-Object { $_.MimeType -eq 'image/jpeg' }; "
-      "$ep=New-Object System.Drawing.Imaging.EncoderParameters 1; "
-      "$ep.Param[0]=New-Object System.Drawing.Imaging.EncoderParameter("
-      "[System.Drawing.Imaging.Encoder]::Quality," +
-      std::to_string(jpeg_quality) +
-      "); "
-      "$outBmp.Save('" +
-      ps_quote(out_abs) +
-      "',$enc,$ep); "
-      "if($outBmp -ne $bmp){$outBmp.Dispose()}; "
-      "$g.Dispose(); $bmp.Dispose();\"";
-
-  const CommandResult res = run_command_capture(command, 30);
-  if (!res.ok || !fs::exists(out)) {
-    return std::nullopt;
+struct VisionCaptureOptions {
+  int max_dimension{1280};
+  int jpeg_quality{70};
+  bool skip_unchanged{true};
+};
+
+// Screen capture pipeline: the platform tool grabs an uncompressed frame (PPM from grim/scrot,
+// BMP from System.Drawing), then decoding, box downscaling, change detection and JPEG encoding
+// all happen in-process. OCR results are cached by frame hash so an unchanged screen never
+// forks tesseract twice. Thread-safe; one instance is shared process-wide via vision_pipeline().
+class VisionPipeline {
+ public:
+  static constexpr std::size_t kOcrCacheEntries = 32;
+
+  void configure(const VisionCaptureOptions& options) {
+    std::lock_guard<std::mutex> lock(mu_);
+    options_.max_dimension = (std::max)(160, options.max_dimension);
+    options_.jpeg_quality = std::clamp(options.jpeg_quality, 20, 95);
+    options_.skip_unchanged = options.skip_unchanged;
+  }
+
+  VisionCaptureOptions options() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return options_;
   }
 
-  std::vector<unsigned char> bytes = read_binary_file(out);
-  if (bytes.empty()) {
-    return std::nullopt;
+  // Downscales `full`, and unless it matches `previous_hash` (with skip_unchanged on) encodes it
+  // as JPEG into `out` and optionally a data URL. max_dimension <= 0 uses the configured value.
+  std::optional<VisionFrame> process(const RgbImage& full, const fs::path& out, uint64_t previous_hash = 0,
+                                     bool want_data_url = true, int max_dimension = 0,
+                                     std::string* error = nullptr) const {
+    const VisionCaptureOptions opts = options();
+    const auto started = std::chrono::steady_clock::now();
+    const RgbImage scaled = downscale_to_fit(full, max_dimension > 0 ? max_dimension : opts.max_dimension);
+    if (scaled.empty()) {
+      set_error(error, "empty frame");
+      return std::nullopt;
+    }
+
+    VisionFrame f;
+    f.timestamp_ms = now_ms();
+    f.hash = image_hash(scaled);
+    f.width = scaled.width;
+    f.height = scaled.height;
+    metrics().inc("vision.frames");
+    if (opts.skip_unchanged && previous_hash != 0 && f.hash == previous_hash) {
+      f.unchanged = true;
+      metrics().inc("vision.frames_unchanged");
+      return f;
+    }
+
+    const std::vector<unsigned char> jpeg = encode_jpeg(scaled, opts.jpeg_quality);
+    std::error_code ec;
+    fs::create_directories(out.parent_path(), ec);
+    if (jpeg.empty() ||
+        !write_file_atomic(out, std::string(reinterpret_cast<const char*>(jpeg.data()), jpeg.size()))) {
+      set_error(error, "failed to write " + out.string());
+      return std::nullopt;
+    }
+    f.path = fs::absolute(out);
+    f.bytes = jpeg.size();
+    if (want_data_url) {
+      f.data_url = "data:image/jpeg;base64," + base64_encode_bytes(jpeg);
+    }
+    metrics().inc("vision.jpeg_bytes", static_cast<uint64_t>(jpeg.size()));
+    metrics().observe("vision.encode_seconds",
+                      std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    return f;
   }
 
-  VisionFrame f;
-  f.path = fs::absolute(out);
-  f.timestamp_ms = now_ms();
-  f.data_url = "data:image/jpeg;base64," + base64_encode_bytes(bytes);
-  return f;
+  // Grabs the screen and runs process(). The uncompressed grab goes to a unique temp file,
+  // never next to `out` (which may be a user path), and is removed afterwards.
+  std::optional<VisionFrame> capture(const fs::path& out, uint64_t previous_hash = 0, bool want_data_url = true,
+                                     int max_dimension = 0, std::string* error = nullptr) const {
+    std::string dep_note;
+    if (!ensure_vision_capture_dependencies(&dep_note)) {
+      set_error(error, dep_note);
+      return std::nullopt;
+    }
+
+    std::error_code ec;
+    fs::create_directories(out.parent_path(), ec);
+#ifdef _WIN32
+    const fs::path raw = fs::temp_directory_path(ec) / ("attoclaw_grab_" + random_id(12) + ".bmp");
+    const std::string command =
+        "powershell -NoProfile -ExecutionPolicy Bypass -Command "
+        "\"Add-Type -AssemblyName System.Windows.Forms; "
+        "Add-Type -AssemblyName System.Drawing; "
+        "$b=[System.Windows.Forms.SystemInformation]::VirtualScreen; "
+        "$bmp=New-Object System.Drawing.Bitmap $b.Width,$b.Height; "
+        "$g=[System.Drawing.Graphics]::FromImage($bmp); "
+        "$g.CopyFromScreen($b.Left,$b.Top,0,0,$bmp.Size); "
+        "$bmp.Save('" +
+        ps_quote(fs::absolute(raw).string()) +
+        "',[System.Drawing.Imaging.ImageFormat]::Bmp); "
+        "$g.Dispose(); $bmp.Dispose();\"";
+    const CommandResult res = run_command_capture(command, 30);
+    const bool ran = res.ok;
+    const std::string output = res.output;
+#else
+    const fs::path raw = fs::temp_directory_path(ec) / ("attoclaw_grab_" + random_id(12) + ".ppm");
+    // Launched by the path the capability probe resolved, so probe and launch agree on PATH.
+    std::vector<std::string> argv;
+    if (const auto grim = capabilities().resolve("grim")) {
+      argv = {grim->string(), "-t", "ppm", fs::absolute(raw).string()};
+    } else if (const auto scrot = capabilities().resolve("scrot")) {
+      argv = {scrot->string(), "-z", fs::absolute(raw).string()};
+    }
+    const ProcessOutput res = run_process_capture(argv, 30, 1024 * 1024);
+    const bool ran = res.ok;
+    const std::string output = res.err.empty() ? res.out : res.err;
 #endif
+    const std::vector<unsigned char> bytes = ran ? read_binary_file(raw) : std::vector<unsigned char>{};
+    fs::remove(raw, ec);
+    RgbImage full;
+    if (!decode_raster(bytes, &full)) {
+      const std::string msg = trim(output);
+      set_error(error, !msg.empty() ? msg : bytes.empty() ? "screenshot command failed" : "unsupported capture format");
+      return std::nullopt;
+    }
+    return process(full, out, previous_hash, want_data_url, max_dimension, error);
+  }
+
+  // Tesseract text for a captured frame, memoised by frame hash (LRU, kOcrCacheEntries).
+  std::string ocr(const VisionFrame& frame, int timeout_s = 20) {
+    if (frame.hash != 0) {
+      std::lock_guard<std::mutex> lock(mu_);
+      auto it = ocr_cache_.find(frame.hash);
+      if (it != ocr_cache_.end()) {
+        ocr_lru_.splice(ocr_lru_.begin(), ocr_lru_, it->second.second);
+        metrics().inc("vision.ocr_cache_hits");
+        return it->second.first;
+      }
+    }
+    if (frame.path.empty()) {
+      return "";
+    }
+    std::string text = extract_ocr_text(frame.path, timeout_s);
+    if (frame.hash != 0) {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (ocr_cache_.find(frame.hash) == ocr_cache_.end()) {
+        ocr_lru_.push_front(frame.hash);
+        ocr_cache_.emplace(frame.hash, std::make_pair(text, ocr_lru_.begin()));
+        if (ocr_cache_.size() > kOcrCacheEntries) {
+          ocr_cache_.erase(ocr_lru_.back());
+          ocr_lru_.pop_back();
+        }
+      }
+    }
+    return text;
+  }
+
+ private:
+  static void set_error(std::string* error, const std::string& msg) {
+    if (error) {
+      *error = msg;
+    }
+  }
+
+  mutable std::mutex mu_;
+  VisionCaptureOptions options_{};
+  std::list<uint64_t> ocr_lru_;
+  std::unordered_map<uint64_t, std::pair<std::string, std::list<uint64_t>::iterator>> ocr_cache_;
+};
+
+inline VisionPipeline& vision_pipeline() {
+  static VisionPipeline pipeline;
+  return pipeline;
+}
+
+// Captures one live-vision frame into ~/.attoclaw/vision_frames with the configured size and
+// quality. Pass the previous frame's hash to get an `unchanged` frame back instead of a re-encode.
+inline std::optional<VisionFrame> capture_vision_frame(uint64_t previous_hash = 0, std::string* error = nullptr) {
+  const fs::path out =
+      expand_user_path("~/.attoclaw") / "vision_frames" / ("frame_" + std::to_string(now_ms()) + ".jpg");
+  return vision_pipeline().capture(out, previous_hash, true, 0, error);
 }
 
 }  // namespace attoclaw
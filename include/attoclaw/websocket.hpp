@@ -0,0 +1,206 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <curl/curl.h>
+#include <curl/websockets.h>
+
+#include "attoclaw/common.hpp"
+#include "attoclaw/socket_wait.hpp"
+
+namespace attoclaw {
+
+// Thin client over libcurl's CONNECT_ONLY websocket mode (curl_ws_send/curl_ws_recv).
+// Shared by the WhatsApp bridge, Slack Socket Mode and the Discord Gateway. Not
+// thread-safe: one owner thread connects, sends and receives. Pings are answered by
+// libcurl itself.
+class WebSocketClient {
+ public:
+  enum class RecvStatus { kIdle, kMessage, kClosed, kError };
+  using WaitStatus = SocketWaitStatus;
+
+  WebSocketClient() = default;
+  ~WebSocketClient() { close(); }
+
+  WebSocketClient(const WebSocketClient&) = delete;
+  WebSocketClient& operator=(const WebSocketClient&) = delete;
+
+  // Performs the HTTP upgrade. On failure `error` is filled and the handle is released.
+  bool connect(const std::string& url, const std::map<std::string, std::string>& headers = {},
+               std::string* error = nullptr, long connect_timeout_s = 5) {
+    close();
+    ensure_global_init();
+    curl_ = curl_easy_init();
+    if (!curl_) {
+      set_error(error, "curl init failed");
+      return false;
+    }
+
+    curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl_, CURLOPT_CONNECT_ONLY, 2L);  // websocket mode
+    curl_easy_setopt(curl_, CURLOPT_USERAGENT, "attoclaw/0.1");
+    curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT, connect_timeout_s);
+    curl_easy_setopt(curl_, CURLOPT_TIMEOUT, connect_timeout_s * 2);
+    curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, &discard_write);
+    for (const auto& [k, v] : headers) {
+      const std::string line = k + ": " + v;
+      header_list_ = curl_slist_append(header_list_, line.c_str());
+    }
+    if (header_list_) {
+      curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, header_list_);
+    }
+
+    const CURLcode rc = curl_easy_perform(curl_);
+    if (rc != CURLE_OK) {
+      set_error(error, rc == CURLE_UNSUPPORTED_PROTOCOL
+                           ? "libcurl lacks WebSocket protocol support. Install vcpkg curl[websockets] and rebuild."
+                           : std::string(curl_easy_strerror(rc)));
+      close();
+      return false;
+    }
+
+    long http_code = 0;
+    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 101) {
+      set_error(error, "server did not switch protocols (HTTP " + std::to_string(http_code) + ")");
+      close();
+      return false;
+    }
+    accumulator_.clear();
+    close_code_ = 0;
+    return true;
+  }
+
+  bool connected() const { return curl_ != nullptr; }
+
+  // Close code from the last CLOSE frame received (0 if none or not provided).
+  int close_code() const { return close_code_; }
+
+  // Sends one text frame, retrying on EAGAIN until done or `keep_running` turns false.
+  bool send_text(const std::string& text, const std::atomic<bool>* keep_running = nullptr,
+                 std::string* error = nullptr) {
+    if (!curl_) {
+      set_error(error, "not connected");
+      return false;
+    }
+    std::size_t offset = 0;
+    while (offset < text.size() && (!keep_running || keep_running->load())) {
+      size_t sent = 0;
+      const CURLcode rc = curl_ws_send(curl_, text.data() + offset, text.size() - offset, &sent,
+                                       static_cast<curl_off_t>(text.size()), CURLWS_TEXT);
+      if (rc == CURLE_AGAIN) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      if (rc != CURLE_OK) {
+        set_error(error, curl_easy_strerror(rc));
+        return false;
+      }
+      if (sent == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        continue;
+      }
+      offset += sent;
+    }
+    return offset == text.size();
+  }
+
+  bool send_json(const json& payload, const std::atomic<bool>* keep_running = nullptr, std::string* error = nullptr) {
+    return send_text(payload.dump(), keep_running, error);
+  }
+
+  // Reads frames until a complete text message is assembled (kMessage, stored in `message`),
+  // nothing more is buffered (kIdle), the peer closed (kClosed) or the transfer failed (kError).
+  RecvStatus recv(std::string* message, std::string* error = nullptr) {
+    if (!curl_) {
+      set_error(error, "not connected");
+      return RecvStatus::kError;
+    }
+    char buffer[8192];
+    while (true) {
+      std::size_t nrecv = 0;
+      const struct curl_ws_frame* meta = nullptr;
+      const CURLcode rc = curl_ws_recv(curl_, buffer, sizeof(buffer), &nrecv, &meta);
+      if (rc == CURLE_AGAIN) {
+        return RecvStatus::kIdle;
+      }
+      if (rc != CURLE_OK) {
+        set_error(error, curl_easy_strerror(rc));
+        return RecvStatus::kError;
+      }
+      if (!meta) {
+        return RecvStatus::kIdle;
+      }
+      if ((meta->flags & CURLWS_CLOSE) != 0) {
+        if (nrecv >= 2) {
+          close_code_ = (static_cast<unsigned char>(buffer[0]) << 8) | static_cast<unsigned char>(buffer[1]);
+        }
+        return RecvStatus::kClosed;
+      }
+      if ((meta->flags & CURLWS_TEXT) == 0 && (meta->flags & CURLWS_CONT) == 0) {
+        continue;  // ping/pong/binary
+      }
+      if (nrecv > 0) {
+        accumulator_.append(buffer, nrecv);
+      }
+      if (meta->bytesleft == 0 && (meta->flags & CURLWS_CONT) == 0) {
+        message->swap(accumulator_);
+        accumulator_.clear();
+        return RecvStatus::kMessage;
+      }
+    }
+  }
+
+  // Blocks until the socket has data, `wake` is notified, or timeout_ms elapses.
+  // Call only after recv() returned kIdle so nothing is left in libcurl's buffers.
+  WaitStatus wait(int timeout_ms, WakeupEvent* wake = nullptr) {
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    if (!curl_ || curl_easy_getinfo(curl_, CURLINFO_ACTIVESOCKET, &sock) != CURLE_OK || sock == CURL_SOCKET_BAD) {
+      return WaitStatus::kError;
+    }
+    return wait_socket_readable(sock, timeout_ms, wake);
+  }
+
+  void close() {
+    if (curl_) {
+      curl_easy_cleanup(curl_);
+      curl_ = nullptr;
+    }
+    if (header_list_) {
+      curl_slist_free_all(header_list_);
+      header_list_ = nullptr;
+    }
+    accumulator_.clear();
+  }
+
+ private:
+  static void ensure_global_init() {
+    static std::once_flag flag;
+    std::call_once(flag, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+  }
+
+  static size_t discard_write(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    (void)ptr;
+    (void)userdata;
+    return size * nmemb;
+  }
+
+  static void set_error(std::string* error, const std::string& msg) {
+    if (error) {
+      *error = msg;
+    }
+  }
+
+  CURL* curl_{nullptr};
+  struct curl_slist* header_list_{nullptr};
+  std::string accumulator_;
+  int close_code_{0};
+};
+
+}  // namespace attoclaw
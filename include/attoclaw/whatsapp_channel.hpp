@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
@@ -9,11 +10,9 @@
 #include <unordered_set>
 #include <vector>
 
-#include <curl/curl.h>
-#include <curl/websockets.h>
-
 #include "attoclaw/channels.hpp"
 #include "attoclaw/config.hpp"
+#include "attoclaw/websocket.hpp"
 
 namespace attoclaw {
 
@@ -37,26 +36,31 @@ class WhatsAppChannel : public BaseChannel {
       return;
     }
     if (bridge_url_.empty()) {
-      Logger::log(Logger::Level::kWarn,
-                  "WhatsApp enabled but bridgeUrl is empty; channel will not start.");
+      ATTOCLAW_LOG_WARN("WhatsApp enabled but bridgeUrl is empty; channel will not start.");
       running_.store(false);
       return;
     }
 
     worker_ = std::thread([this]() { run_loop(); });
-    Logger::log(Logger::Level::kInfo, "WhatsApp channel started");
+    ATTOCLAW_LOG_INFO("WhatsApp channel started");
   }
 
   void stop() override {
     if (!running_.exchange(false)) {
       return;
     }
+    {
+      // backoff_sleep checks running_ under out_mu_; taking it here means the notify
+      // cannot fall between that check and the wait.
+      std::lock_guard<std::mutex> lock(out_mu_);
+    }
     out_cv_.notify_all();
+    wake_.notify();
     if (worker_.joinable()) {
       worker_.join();
     }
     connected_.store(false);
-    Logger::log(Logger::Level::kInfo, "WhatsApp channel stopped");
+    ATTOCLAW_LOG_INFO("WhatsApp channel stopped");
   }
 
   void send(const OutboundMessage& msg) override {
@@ -72,7 +76,7 @@ class WhatsAppChannel : public BaseChannel {
         std::lock_guard<std::mutex> lock(out_mu_);
         outbox_.push_back(PendingSend{to, part});
       }
-      out_cv_.notify_one();
+      wake_.notify();
     }
   }
 
@@ -82,17 +86,6 @@ class WhatsAppChannel : public BaseChannel {
     std::string text;
   };
 
-  static void ensure_global_init() {
-    static std::once_flag flag;
-    std::call_once(flag, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
-  }
-
-  static size_t discard_write(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    (void)ptr;
-    (void)userdata;
-    return size * nmemb;
-  }
-
   static std::string strip_jid_domain(const std::string& s) {
     const auto p = s.find('@');
     return p == std::string::npos ? s : s.substr(0, p);
@@ -109,73 +102,31 @@ class WhatsAppChannel : public BaseChannel {
            allow_from_.contains(pn_id);
   }
 
-  CURL* connect_bridge() const {
-    ensure_global_init();
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-      return nullptr;
+  bool connect_bridge(WebSocketClient& ws) const {
+    std::string err;
+    if (ws.connect(bridge_url_, {}, &err)) {
+      return true;
     }
-
-    curl_easy_setopt(curl, CURLOPT_URL, bridge_url_.c_str());
-    curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 2L);  // websocket mode
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "attoclaw/0.1");
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &discard_write);
-
-    const CURLcode rc = curl_easy_perform(curl);
-    if (rc != CURLE_OK) {
-      if (rc == CURLE_UNSUPPORTED_PROTOCOL) {
-        Logger::log(Logger::Level::kWarn,
-                    "WhatsApp bridge connect failed: libcurl lacks WebSocket protocol support. "
-                    "Install vcpkg curl[websockets] and rebuild.");
-      } else {
-        Logger::log(Logger::Level::kWarn,
-                    "WhatsApp bridge connect failed: " + std::string(curl_easy_strerror(rc)));
-      }
-      curl_easy_cleanup(curl);
-      return nullptr;
+    if (err.rfind("server did not switch", 0) == 0) {
+      ATTOCLAW_LOG_WARN("WhatsApp bridge " + err + ". Check bridgeUrl and ensure the bridge is running.");
+    } else {
+      ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "WhatsApp bridge connect failed: " + err);
     }
-
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    if (http_code != 101) {
-      Logger::log(Logger::Level::kWarn,
-                  "WhatsApp bridge did not switch protocols (HTTP " + std::to_string(http_code) +
-                      "). Check bridgeUrl and ensure the bridge is running.");
-      curl_easy_cleanup(curl);
-      return nullptr;
-    }
-    return curl;
+    return false;
   }
 
-  bool ws_send_text(CURL* curl, const std::string& text) const {
-    std::size_t offset = 0;
-    while (running_.load() && offset < text.size()) {
-      size_t sent = 0;
-      const CURLcode rc = curl_ws_send(curl, text.data() + offset, text.size() - offset, &sent,
-                                       static_cast<curl_off_t>(text.size()), CURLWS_TEXT);
-      if (rc == CURLE_AGAIN) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        continue;
-      }
-      if (rc != CURLE_OK) {
-        Logger::log(Logger::Level::kWarn,
-                    "WhatsApp bridge send failed: " + std::string(curl_easy_strerror(rc)));
-        return false;
-      }
-      if (sent == 0) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
-        continue;
+  bool ws_send_json(WebSocketClient& ws, const json& payload) const {
+    std::string err;
+    if (!ws.send_json(payload, &running_, &err)) {
+      if (!err.empty()) {
+        ATTOCLAW_LOG_WARN("WhatsApp bridge send failed: " + err);
       }
-      offset += sent;
+      return false;
     }
-    return offset == text.size();
+    return true;
   }
 
-  bool ws_send_json(CURL* curl, const json& payload) const { return ws_send_text(curl, payload.dump()); }
-
-  bool flush_outbox(CURL* curl) {
+  bool flush_outbox(WebSocketClient& ws) {
     std::deque<PendingSend> pending;
     {
       std::lock_guard<std::mutex> lock(out_mu_);
@@ -187,11 +138,10 @@ class WhatsAppChannel : public BaseChannel {
 
     for (const auto& msg : pending) {
       const json payload = {{"type", "send"}, {"to", msg.to}, {"text", msg.text}};
-      if (!ws_send_json(curl, payload)) {
+      if (!ws_send_json(ws, payload)) {
         return false;
       }
-      Logger::log(Logger::Level::kInfo,
-                  "WhatsApp outbound sent to bridge for " + msg.to);
+      ATTOCLAW_LOG_INFO("WhatsApp outbound sent to bridge for " + msg.to);
     }
     return true;
   }
@@ -256,12 +206,12 @@ class WhatsAppChannel : public BaseChannel {
       }
 
       if (type == "qr") {
-        Logger::log(Logger::Level::kInfo, "WhatsApp QR received. Run `attoclaw channels login` to scan.");
+        ATTOCLAW_LOG_INFO("WhatsApp QR received. Run `attoclaw channels login` to scan.");
         return;
       }
 
       if (type == "error") {
-        Logger::log(Logger::Level::kWarn, "WhatsApp bridge error: " + data.value("error", "unknown"));
+        ATTOCLAW_LOG_WARN("WhatsApp bridge error: " + data.value("error", "unknown"));
         return;
       }
 
@@ -269,92 +219,82 @@ class WhatsAppChannel : public BaseChannel {
         return;
       }
     } catch (const std::exception& e) {
-      Logger::log(Logger::Level::kWarn,
-                  std::string("WhatsApp bridge payload parse error: ") + e.what());
+      ATTOCLAW_LOG_WARN(std::string("WhatsApp bridge payload parse error: ") + e.what());
     }
   }
 
-  bool receive_once(CURL* curl, std::string& text_accumulator) {
-    char buffer[8192];
-    std::size_t nrecv = 0;
-    const struct curl_ws_frame* meta = nullptr;
-    const CURLcode rc = curl_ws_recv(curl, buffer, sizeof(buffer), &nrecv, &meta);
-
-    if (rc == CURLE_AGAIN) {
-      return true;
-    }
-    if (rc != CURLE_OK) {
-      Logger::log(Logger::Level::kWarn,
-                  "WhatsApp bridge recv failed: " + std::string(curl_easy_strerror(rc)));
-      return false;
-    }
-    if (!meta) {
-      return true;
-    }
-    if ((meta->flags & CURLWS_CLOSE) != 0) {
-      Logger::log(Logger::Level::kInfo, "WhatsApp bridge closed connection.");
-      return false;
-    }
-    if ((meta->flags & CURLWS_TEXT) == 0 && (meta->flags & CURLWS_CONT) == 0) {
-      return true;
+  bool receive_pending(WebSocketClient& ws) {
+    std::string message;
+    std::string err;
+    while (true) {
+      switch (ws.recv(&message, &err)) {
+        case WebSocketClient::RecvStatus::kMessage:
+          handle_bridge_json(message);
+          continue;
+        case WebSocketClient::RecvStatus::kIdle:
+          return true;
+        case WebSocketClient::RecvStatus::kClosed:
+          ATTOCLAW_LOG_INFO("WhatsApp bridge closed connection.");
+          return false;
+        case WebSocketClient::RecvStatus::kError:
+        default:
+          ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "WhatsApp bridge recv failed: " + err);
+          return false;
+      }
     }
+  }
 
-    if (nrecv > 0) {
-      text_accumulator.append(buffer, nrecv);
-    }
-    if (meta->bytesleft == 0) {
-      handle_bridge_json(text_accumulator);
-      text_accumulator.clear();
-    }
-    return true;
+  // Sleeps for the reconnect backoff, waking early on stop().
+  void backoff_sleep(int64_t ms) {
+    std::unique_lock<std::mutex> lock(out_mu_);
+    out_cv_.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return !running_.load(); });
   }
 
+  // Blocks on the bridge socket and the outbox wakeup; there is no periodic tick. The
+  // reconnect backoff only resets after a connection stayed up for kStableMs, so a bridge
+  // that accepts and immediately closes is not hammered every kMinBackoffMs.
   void run_loop() {
+    static constexpr int64_t kMinBackoffMs = 500;
+    static constexpr int64_t kMaxBackoffMs = 30000;
+    static constexpr int64_t kStableMs = 30000;
+    static constexpr int kIdleWaitMs = 30000;
+    WebSocketClient ws;
+    int64_t backoff_ms = kMinBackoffMs;
+
     while (running_.load()) {
-      CURL* curl = connect_bridge();
-      if (!curl) {
-        for (int i = 0; i < 20 && running_.load(); ++i) {
-          std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
+      if (!connect_bridge(ws) ||
+          (!bridge_token_.empty() && !ws_send_json(ws, json{{"type", "auth"}, {"token", bridge_token_}}))) {
+        ws.close();
+        backoff_sleep(backoff_ms);
+        backoff_ms = (std::min)(backoff_ms * 2, kMaxBackoffMs);
         continue;
       }
 
-      if (!bridge_token_.empty()) {
-        if (!ws_send_json(curl, json{{"type", "auth"}, {"token", bridge_token_}})) {
-          curl_easy_cleanup(curl);
-          for (int i = 0; i < 20 && running_.load(); ++i) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-          }
-          continue;
-        }
-      }
-
+      const auto connected_at = std::chrono::steady_clock::now();
       connected_.store(true);
-      Logger::log(Logger::Level::kInfo, "WhatsApp bridge connected");
+      ATTOCLAW_LOG_INFO("WhatsApp bridge connected");
 
-      std::string text_accumulator;
       while (running_.load()) {
-        if (!flush_outbox(curl)) {
+        if (!flush_outbox(ws) || !receive_pending(ws)) {
           break;
         }
-        if (!receive_once(curl, text_accumulator)) {
+        if (ws.wait(kIdleWaitMs, &wake_) == WebSocketClient::WaitStatus::kError) {
+          ATTOCLAW_LOG_WARN_EVERY_MS(kPollErrorLogIntervalMs, "WhatsApp bridge socket wait failed.");
           break;
         }
-
-        std::unique_lock<std::mutex> lock(out_mu_);
-        out_cv_.wait_for(lock, std::chrono::milliseconds(100),
-                         [this]() { return !running_.load() || !outbox_.empty(); });
       }
 
       connected_.store(false);
-      curl_easy_cleanup(curl);
+      ws.close();
 
       if (!running_.load()) {
         break;
       }
-      for (int i = 0; i < 20 && running_.load(); ++i) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      if (std::chrono::steady_clock::now() - connected_at >= std::chrono::milliseconds(kStableMs)) {
+        backoff_ms = kMinBackoffMs;
       }
+      backoff_sleep(backoff_ms);
+      backoff_ms = (std::min)(backoff_ms * 2, kMaxBackoffMs);
     }
   }
 
@@ -370,6 +310,7 @@ class WhatsAppChannel : public BaseChannel {
   std::mutex out_mu_;
   std::condition_variable out_cv_;
   std::deque<PendingSend> outbox_;
+  WakeupEvent wake_;
 };
 
 }  // namespace attoclaw
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "attoclaw/agent.hpp"
+#include "attoclaw/capabilities.hpp"
 #include "attoclaw/channels.hpp"
 #include "attoclaw/config.hpp"
 #include "attoclaw/cron.hpp"
@@ -16,9 +17,11 @@
 #include "attoclaw/email_channel.hpp"
 #include "attoclaw/heartbeat.hpp"
 #include "attoclaw/metrics.hpp"
+#include "attoclaw/metrics_server.hpp"
 #include "attoclaw/provider.hpp"
 #include "attoclaw/slack_channel.hpp"
 #include "attoclaw/telegram_channel.hpp"
+#include "attoclaw/trace.hpp"
 #include "attoclaw/vision.hpp"
 #include "attoclaw/whatsapp_channel.hpp"
 
@@ -72,15 +75,7 @@ int get_int_flag_value(const std::vector<std::string>& args, const std::string&
   }
 }
 
-bool command_exists(const std::string& command) {
-#ifdef _WIN32
-  const std::string probe = "where " + command;
-#else
-  const std::string probe = "command -v " + command;
-#endif
-  const CommandResult out = run_command_capture(probe, 10);
-  return out.ok && !trim(out.output).empty();
-}
+bool command_exists(const std::string& command) { return capabilities().has(command); }
 
 std::optional<fs::path> find_dashboard_script(const fs::path& argv0_path) {
   std::vector<fs::path> candidates;
@@ -124,6 +119,7 @@ int run_dashboard(const std::vector<std::string>& args, const fs::path& argv0_pa
     if (command_exists("pkg")) {
       std::cout << "Python not found. Attempting auto-install via pkg...\n";
       const CommandResult install = run_command_capture("pkg install -y python", 300);
+      capabilities().invalidate();
       if (!install.ok) {
         std::cerr << "Failed to install python automatically.\n" << install.output << "\n";
         return 1;
@@ -159,6 +155,7 @@ bool install_tesseract_onboard() {
 
   auto try_cmd = [](const std::string& cmd, int timeout_s = 240) -> bool {
     const CommandResult r = run_command_capture(cmd, timeout_s);
+    capabilities().invalidate("tesseract");
     return r.ok;
   };
 
@@ -798,11 +795,19 @@ int run_doctor(const std::vector<std::string>& args) {
   }
   if (cfg.channels.slack.enabled) {
     if (trim(cfg.channels.slack.token).empty()) problems.push_back("Slack enabled but channels.slack.token is empty.");
-    if (cfg.channels.slack.channels.empty()) problems.push_back("Slack enabled but channels.slack.channels is empty.");
+    if (cfg.channels.slack.socket_mode) {
+      if (trim(cfg.channels.slack.app_token).empty()) {
+        problems.push_back("Slack socketMode enabled but channels.slack.appToken is empty.");
+      }
+    } else if (cfg.channels.slack.channels.empty()) {
+      problems.push_back("Slack enabled but channels.slack.channels is empty.");
+    }
   }
   if (cfg.channels.discord.enabled) {
     if (trim(cfg.channels.discord.token).empty()) problems.push_back("Discord enabled but channels.discord.token is empty.");
-    if (cfg.channels.discord.channels.empty()) problems.push_back("Discord enabled but channels.discord.channels is empty.");
+    if (cfg.channels.discord.channels.empty() && !cfg.channels.discord.gateway) {
+      problems.push_back("Discord enabled but channels.discord.channels is empty.");
+    }
   }
   if (cfg.channels.email.enabled) {
     if (trim(cfg.channels.email.smtp_url).empty()) problems.push_back("Email enabled but channels.email.smtpUrl is empty.");
@@ -825,14 +830,16 @@ int run_doctor(const std::vector<std::string>& args) {
     }
   }
 
-  // Dependencies.
+  // Dependencies: one in-process PATH scan, then everything is read from the cache.
+  capabilities().prewarm();
   report["deps"] = json::object();
-  report["deps"]["npm"] = command_exists("npm");
-  report["deps"]["node"] = command_exists("node");
-  report["deps"]["codex"] = command_exists("codex");
-  report["deps"]["gemini"] = command_exists("gemini");
-  report["deps"]["ffmpeg"] = command_exists("ffmpeg");
-  report["deps"]["tesseract"] = command_exists("tesseract");
+  report["depPaths"] = json::object();
+  for (const auto& e : capabilities().snapshot()) {
+    report["deps"][e.command] = !e.path.empty();
+    if (!e.path.empty()) {
+      report["depPaths"][e.command] = e.path.string();
+    }
+  }
 
   if (cfg.channels.whatsapp.enabled && !command_exists("npm")) {
     problems.push_back("WhatsApp enabled but npm is missing (required for bridge).");
@@ -854,6 +861,12 @@ int run_doctor(const std::vector<std::string>& args) {
   std::cout << "Transcribe base: " << transcribe_base << "\n";
   std::cout << "Transcribe key: " << (trim(transcribe_key).empty() ? "not set" : mask_secret(transcribe_key)) << "\n\n";
 
+  std::cout << "Dependencies:\n";
+  for (const auto& e : capabilities().snapshot()) {
+    std::cout << "- " << e.command << ": " << (e.path.empty() ? "not found" : e.path.string()) << "\n";
+  }
+  std::cout << "\n";
+
   if (!notes.empty()) {
     std::cout << "Notes:\n";
     for (const auto& n : notes) {
@@ -922,7 +935,9 @@ int run_send(const std::vector<std::string>& args) {
     return 0;
   }
   if (channel == "email") {
-    EmailChannel e(cfg.channels.email, &bus);
+    EmailChannelConfig email_cfg = cfg.channels.email;
+    email_cfg.imap_url.clear();  // one-shot send; no inbound session
+    EmailChannel e(email_cfg, &bus);
     e.start();
     e.send(msg);
     e.stop();
@@ -954,6 +969,8 @@ int run_transcribe(const std::vector<std::string>& args) {
   const std::string transcribe_base =
       !trim(cfg.tools.transcribe.api_base).empty() ? cfg.tools.transcribe.api_base : cfg.provider.api_base;
 
+  transcription().configure(cfg.tools.transcribe.segment_seconds, cfg.tools.transcribe.concurrency,
+                            cfg.tools.transcribe.cache);
   TranscribeTool tool(transcribe_key, transcribe_base, cfg.tools.transcribe.model, cfg.tools.transcribe.timeout);
   json params = {{"path", file}};
 
@@ -975,6 +992,9 @@ int run_agent(const std::vector<std::string>& args) {
   Config cfg = load_config();
   const fs::path workspace = fs::weakly_canonical(expand_user_path(cfg.agent.workspace));
   create_workspace_templates(workspace);
+  tracer().configure(cfg.tracing.enabled, cfg.tracing.dir, cfg.tracing.format, cfg.tracing.slow_turn_ms);
+  transcription().configure(cfg.tools.transcribe.segment_seconds, cfg.tools.transcribe.concurrency,
+                            cfg.tools.transcribe.cache);
 
   MessageBus bus;
   auto provider = make_provider(cfg);
@@ -988,6 +1008,11 @@ int run_agent(const std::vector<std::string>& args) {
                   cfg.agent.temperature, cfg.agent.top_p, cfg.agent.max_tokens, cfg.agent.memory_window,
                   cfg.tools.web_search.api_key, transcribe_key, transcribe_base, cfg.tools.transcribe.model,
                   cfg.tools.transcribe.timeout, cfg.tools.exec.timeout, cfg.tools.restrict_to_workspace, nullptr);
+  agent.configure_subagents(cfg.agent.max_subagents, cfg.agent.max_queued_subagents);
+  agent.configure_media(cfg.tools.transcribe.media_workers);
+  agent.configure_memory(cfg.agent.memory_top_k, cfg.agent.memory_embeddings, cfg.agent.memory_embedding_model);
+  vision_pipeline().configure(
+      VisionCaptureOptions{cfg.tools.vision.max_dimension, cfg.tools.vision.jpeg_quality, cfg.tools.vision.skip_unchanged});
 
   const std::string message = get_flag_value(args, "-m", get_flag_value(args, "--message"));
   const std::string session = get_flag_value(args, "-s", get_flag_value(args, "--session", "cli:direct"));
@@ -996,15 +1021,19 @@ int run_agent(const std::vector<std::string>& args) {
   const int vision_fps = get_int_flag_value(args, "--vision-fps", 1, 1, 10);
   const int vision_frames = get_int_flag_value(args, "--vision-frames", 30, 0, 100000);
 
+  // A one-shot -m run exits after a single reply, so a pre-started spare would only be killed.
+  const bool one_shot = !message.empty() && !vision_mode;
+  external_cli_pool().configure(ExternalCliOptions{cfg.tools.external_cli.max_concurrent,
+                                                   one_shot ? 0 : cfg.tools.external_cli.warm_workers,
+                                                   cfg.tools.external_cli.timeout});
+
   if (vision_mode) {
     const std::string prompt = message.empty() ? "Analyze what is visible on this screen frame." : message;
 
-#ifndef _WIN32
-    (void)vision_fps;
-    (void)vision_frames;
-    std::cerr << "--vision is currently implemented for Windows builds only.\n";
-    return 1;
-#else
+    if (is_headless_server()) {
+      std::cerr << "--vision is unavailable on headless server (DISPLAY/WAYLAND_DISPLAY not set).\n";
+      return 1;
+    }
     const int frame_delay_ms = (std::max)(100, 1000 / vision_fps);
     std::cout << "Vision mode started (" << vision_fps << " FPS, "
               << (vision_frames == 0 ? std::string("unlimited") : std::to_string(vision_frames))
@@ -1016,16 +1045,25 @@ int run_agent(const std::vector<std::string>& args) {
       std::cout << "OCR mode: disabled (tesseract not found in PATH)\n";
     }
     std::string prev_summary;
+    uint64_t prev_hash = 0;
 
     for (int i = 1; (vision_frames == 0) || (i <= vision_frames); ++i) {
-      auto frame = capture_vision_frame(960, 60);
+      std::string capture_error;
+      auto frame = capture_vision_frame(prev_hash, &capture_error);
       if (!frame.has_value()) {
-        std::cout << "[Vision " << i << "] failed to capture frame\n";
+        std::cout << "[Vision " << i << "] failed to capture frame"
+                  << (capture_error.empty() ? "" : ": " + capture_error) << "\n";
         std::this_thread::sleep_for(std::chrono::milliseconds(frame_delay_ms));
         continue;
       }
+      if (frame->unchanged) {
+        std::cout << "[Vision " << i << "] screen unchanged, skipped\n";
+        std::this_thread::sleep_for(std::chrono::milliseconds(frame_delay_ms));
+        continue;
+      }
+      prev_hash = frame->hash;
 
-      const std::string ocr_text = ocr_available ? extract_ocr_text(frame->path, 20) : "";
+      const std::string ocr_text = ocr_available ? vision_pipeline().ocr(*frame, 20) : "";
 
       json messages = json::array();
       messages.push_back({{"role", "system"},
@@ -1073,7 +1111,6 @@ int run_agent(const std::vector<std::string>& args) {
       std::this_thread::sleep_for(std::chrono::milliseconds(frame_delay_ms));
     }
     return 0;
-#endif
   }
 
   if (!message.empty()) {
@@ -1123,6 +1160,9 @@ int run_gateway() {
   Config cfg = load_config();
   const fs::path workspace = fs::weakly_canonical(expand_user_path(cfg.agent.workspace));
   create_workspace_templates(workspace);
+  tracer().configure(cfg.tracing.enabled, cfg.tracing.dir, cfg.tracing.format, cfg.tracing.slow_turn_ms);
+  transcription().configure(cfg.tools.transcribe.segment_seconds, cfg.tools.transcribe.concurrency,
+                            cfg.tools.transcribe.cache);
 
   MessageBus bus;
   ChannelManager channel_manager(&bus);
@@ -1140,6 +1180,14 @@ int run_gateway() {
                   cfg.agent.temperature, cfg.agent.top_p, cfg.agent.max_tokens, cfg.agent.memory_window,
                   cfg.tools.web_search.api_key, transcribe_key, transcribe_base, cfg.tools.transcribe.model,
                   cfg.tools.transcribe.timeout, cfg.tools.exec.timeout, cfg.tools.restrict_to_workspace, &cron);
+  agent.configure_subagents(cfg.agent.max_subagents, cfg.agent.max_queued_subagents);
+  agent.configure_media(cfg.tools.transcribe.media_workers);
+  agent.configure_memory(cfg.agent.memory_top_k, cfg.agent.memory_embeddings, cfg.agent.memory_embedding_model);
+  vision_pipeline().configure(
+      VisionCaptureOptions{cfg.tools.vision.max_dimension, cfg.tools.vision.jpeg_quality, cfg.tools.vision.skip_unchanged});
+  external_cli_pool().configure(ExternalCliOptions{cfg.tools.external_cli.max_concurrent,
+                                                   cfg.tools.external_cli.warm_workers, cfg.tools.external_cli.timeout});
+  capabilities().prewarm();  // media/vision/--codex requests then find their tools without a PATH scan
 
   cron.set_on_job([&](const CronJob& job) -> std::optional<std::string> {
     const std::string response =
@@ -1186,13 +1234,26 @@ int run_gateway() {
     std::cout << "No channels enabled.\n";
   }
 
+  // Long-running: keep log writes off the channel/agent threads.
+  Logger::start_async();
+
   bus.start_dispatcher();
   channel_manager.start_all();
   cron.start();
   heartbeat.start();
   agent.run();
 
-  std::atomic<bool> metrics_running{true};
+  std::unique_ptr<MetricsServer> metrics_server;
+  if (cfg.gateway.metrics.enabled) {
+    metrics_server = std::make_unique<MetricsServer>(cfg.gateway.metrics.host, cfg.gateway.metrics.port);
+    if (!metrics_server->start()) {
+      metrics_server.reset();
+    }
+  }
+
+  // The snapshot file feeds `attoclaw metrics` and the dashboard; scrape-only setups can turn it off.
+  const bool write_snapshots = cfg.gateway.metrics.write_snapshot;
+  std::atomic<bool> metrics_running{write_snapshots};
   std::thread metrics_flush([&]() {
     while (metrics_running.load()) {
       write_metrics_snapshot();
@@ -1216,7 +1277,13 @@ int run_gateway() {
   if (metrics_flush.joinable()) {
     metrics_flush.join();
   }
-  write_metrics_snapshot();
+  if (metrics_server) {
+    metrics_server->stop();
+  }
+  if (write_snapshots) {
+    write_metrics_snapshot();
+  }
+  Logger::stop_async();
   return 0;
 }
 
@@ -1244,8 +1311,9 @@ int run_channels(const std::vector<std::string>& args) {
               << ", channels: " << cfg.channels.discord.channels.size() << ")\n";
     std::cout << "Email: " << (cfg.channels.email.enabled ? "enabled" : "disabled")
               << " (smtpUrl: " << (cfg.channels.email.smtp_url.empty() ? "not set" : "set")
-              << ", from: " << (cfg.channels.email.from.empty() ? "not set" : "set") << ")\n";
-    std::cout << "\nImplemented adapters: Telegram, WhatsApp bridge, Slack, Discord, Email (outbound).\n";
+              << ", from: " << (cfg.channels.email.from.empty() ? "not set" : "set")
+              << ", imapUrl: " << (cfg.channels.email.imap_url.empty() ? "not set" : "set") << ")\n";
+    std::cout << "\nImplemented adapters: Telegram, WhatsApp bridge, Slack, Discord, Email (SMTP + IMAP IDLE).\n";
     return 0;
   }
 
@@ -1411,6 +1479,28 @@ int main(int argc, char** argv) {
       Logger::set_json(true);
     }
   }
+  {
+    const char* v = std::getenv("ATTOCLAW_LOG_LEVEL");
+    const std::string level = v ? to_lower(v) : std::string();
+    if (level == "debug") {
+      Logger::set_min_level(Logger::Level::kDebug);
+    } else if (level == "warn") {
+      Logger::set_min_level(Logger::Level::kWarn);
+    } else if (level == "error") {
+      Logger::set_min_level(Logger::Level::kError);
+    }
+  }
+  {
+    const char* v = std::getenv("ATTOCLAW_LOG_FILE");
+    if (v && *v) {
+      const char* max_mb = std::getenv("ATTOCLAW_LOG_MAX_MB");
+      const std::uint64_t max_bytes = (max_mb && *max_mb) ? std::strtoull(max_mb, nullptr, 10) * 1024 * 1024
+                                                          : 10ull * 1024 * 1024;
+      if (!Logger::set_file(expand_user_path(v), max_bytes)) {
+        std::cerr << "Cannot open log file: " << v << "\n";
+      }
+    }
+  }
 
   std::vector<std::string> args;
   args.reserve(static_cast<std::size_t>(argc));
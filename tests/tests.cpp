@@ -1,10 +1,24 @@
 ﻿#include <cstdlib>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 
+#include "attoclaw/base64.hpp"
+#include "attoclaw/capabilities.hpp"
 #include "attoclaw/config.hpp"
+#include "attoclaw/consolidation.hpp"
+#include "attoclaw/discord_channel.hpp"
+#include "attoclaw/email_channel.hpp"
 #include "attoclaw/external_cli.hpp"
+#include "attoclaw/media.hpp"
+#include "attoclaw/memory.hpp"
+#include "attoclaw/metrics.hpp"
+#include "attoclaw/schema_validator.hpp"
+#include "attoclaw/slack_channel.hpp"
+#include "attoclaw/subagent.hpp"
+#include "attoclaw/telegram_channel.hpp"
 #include "attoclaw/tools.hpp"
+#include "attoclaw/trace.hpp"
 #include "attoclaw/vision.hpp"
 
 static int fail(const std::string& msg, const char* file, int line) {
@@ -48,6 +62,25 @@ int main() {
     EXPECT_EQ(p.prompt, "do thing");
   }
 
+  {
+    const SchemaValidator v(json{
+        {"type", "object"},
+        {"properties",
+         {{"action", {{"type", "string"}, {"enum", json::array({"add", "list"})}}},
+          {"limit", {{"type", "integer"}, {"minimum", 1}, {"maximum", 20}}},
+          {"tags", {{"type", "array"}, {"items", {{"type", "string"}}}}}}},
+        {"required", json::array({"action"})}});
+    EXPECT_TRUE(v.valid(json{{"action", "add"}, {"limit", 20}, {"tags", json::array({"a", "b"})}}));
+    EXPECT_TRUE(v.validate(json{{"action", "list"}}).empty());
+    EXPECT_TRUE(!v.valid(json{{"action", "add"}, {"limit", 0}}));
+    const auto errors = v.validate(json{{"limit", 21}, {"tags", json::array({"a", 3})}});
+    EXPECT_EQ(errors.size(), static_cast<std::size_t>(3));
+    EXPECT_TRUE(std::find(errors.begin(), errors.end(), "parameter.limit must be <= 20") != errors.end());
+    EXPECT_TRUE(std::find(errors.begin(), errors.end(), "parameter.tags[1] should be string") != errors.end());
+    EXPECT_TRUE(std::find(errors.begin(), errors.end(), "missing required parameter.action") != errors.end());
+    EXPECT_EQ(v.validate(json{{"action", "remove"}}).front(), "parameter.action has invalid enum value");
+  }
+
   {
     json root = default_config_json();
     root["channels"]["slack"]["enabled"] = true;
@@ -86,12 +119,1052 @@ int main() {
     EXPECT_EQ(parts[3].size(), static_cast<std::size_t>(1));
   }
 
+  {
+    Metrics m;
+    m.inc("inbound.total", 3);
+    m.inc("inbound.channel.telegram");
+    const std::string text = m.to_openmetrics();
+    EXPECT_TRUE(text.find("# TYPE attoclaw_inbound counter\n") != std::string::npos);
+    EXPECT_TRUE(text.find("attoclaw_inbound_total 3\n") != std::string::npos);
+    EXPECT_TRUE(text.find("attoclaw_inbound_channel_telegram_total 1\n") != std::string::npos);
+    EXPECT_TRUE(text.size() >= 6 && text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+  }
+
+  {
+    Metrics m;
+    m.observe("telegram.send_latency_seconds", 0.25);
+    m.observe("telegram.send_latency_seconds", 0.75);
+    const std::string text = m.to_openmetrics();
+    EXPECT_TRUE(text.find("# TYPE attoclaw_telegram_send_latency_seconds summary\n") != std::string::npos);
+    EXPECT_TRUE(text.find("attoclaw_telegram_send_latency_seconds_count 2\n") != std::string::npos);
+    EXPECT_TRUE(text.find("attoclaw_telegram_send_latency_seconds_sum 1\n") != std::string::npos);
+
+    // A summary sharing a counter's family name gets its own, and sums keep full precision.
+    Metrics shared;
+    shared.inc("external_cli.runs");
+    shared.observe("external_cli.runs", 1234567.125);
+    const std::string both = shared.to_openmetrics();
+    EXPECT_EQ(static_cast<std::size_t>(std::count(both.begin(), both.end(), '#')), static_cast<std::size_t>(5));
+    EXPECT_TRUE(both.find("# TYPE attoclaw_external_cli_runs counter\n") != std::string::npos);
+    EXPECT_TRUE(both.find("# TYPE attoclaw_external_cli_runs_summary summary\n") != std::string::npos);
+    EXPECT_TRUE(both.find("attoclaw_external_cli_runs_summary_sum 1234567.125\n") != std::string::npos);
+    EXPECT_EQ(Metrics::openmetrics_family_name("total"), "attoclaw_total");
+
+    // Keys that normalise to the same family stay separate series.
+    Metrics colliding;
+    colliding.inc("a.b", 1);
+    colliding.inc("a_b", 2);
+    colliding.inc("x", 3);
+    colliding.inc("x_total", 4);
+    const std::string separate = colliding.to_openmetrics();
+    EXPECT_TRUE(separate.find("attoclaw_a_b_total 1\n") != std::string::npos);
+    EXPECT_TRUE(separate.find("attoclaw_a_b_2_total 2\n") != std::string::npos);
+    EXPECT_TRUE(separate.find("attoclaw_x_total 3\n") != std::string::npos);
+    EXPECT_TRUE(separate.find("attoclaw_x_2_total 4\n") != std::string::npos);
+
+    TokenBucket bucket(2.0, 2.0);
+    EXPECT_EQ(bucket.ready_at_ms(1000), static_cast<int64_t>(1000));
+    bucket.take(1000);
+    bucket.take(1000);
+    EXPECT_TRUE(bucket.ready_at_ms(1000) > 1000);
+    EXPECT_TRUE(bucket.ready_at_ms(1000) <= 1501);
+    EXPECT_EQ(bucket.ready_at_ms(1600), static_cast<int64_t>(1600));
+    bucket.block_until(5000);
+    EXPECT_EQ(bucket.ready_at_ms(1700), static_cast<int64_t>(5000));
+    EXPECT_TRUE(!bucket.idle(4000));
+    EXPECT_TRUE(bucket.idle(6000));
+  }
+
+  {
+    // Streamed WAV: RIFF and data sizes left as 0xFFFFFFFF by ffmpeg.
+    std::string wav = std::string("RIFF\xff\xff\xff\xffWAVEfmt ", 16) + std::string("\x10\0\0\0", 4) + std::string(16, '\0') +
+                      std::string("data\xff\xff\xff\xff", 8) + std::string(10, 'x');
+    fix_streamed_wav_header(wav);
+    EXPECT_EQ(static_cast<unsigned char>(wav[4]), static_cast<unsigned char>(wav.size() - 8));
+    EXPECT_EQ(static_cast<unsigned char>(wav[40]), static_cast<unsigned char>(10));
+    EXPECT_EQ(static_cast<unsigned char>(wav[41]), static_cast<unsigned char>(0));
+
+    InboundMessage msg{"telegram", "u", "c", "hi"};
+    msg.metadata = json{{"transcripts", json::array({json{{"path", "a.ogg"}, {"text", "hello"}, {"ok", true}}})}};
+    const std::string block = MediaPipeline::attachment_block(msg);
+    EXPECT_TRUE(block.find("- audio[1]: a.ogg") != std::string::npos);
+    EXPECT_TRUE(block.find("[Transcription]\n- audio[1]:\nhello") != std::string::npos);
+  }
+
+  {
+    // A released message keeps its session ordered until the agent has consumed it.
+    MediaPipeline pipeline("", "http://127.0.0.1:1", "whisper-1", 2);
+    std::mutex ready_mu;
+    std::condition_variable ready_cv;
+    std::vector<InboundMessage> ready;
+    pipeline.start([&](InboundMessage m) {
+      std::lock_guard<std::mutex> lock(ready_mu);
+      ready.push_back(std::move(m));
+      ready_cv.notify_all();
+    });
+    InboundMessage voice{"telegram", "u", "c", ""};
+    voice.media = {(fs::temp_directory_path() / ("attoclaw_missing_" + random_id(8) + ".wav")).string()};
+    const InboundMessage text{"telegram", "u", "c", "after"};
+    EXPECT_TRUE(pipeline.should_defer(voice));
+    pipeline.submit(voice);
+    {
+      std::unique_lock<std::mutex> lock(ready_mu);
+      EXPECT_TRUE(ready_cv.wait_for(lock, std::chrono::seconds(10), [&]() { return !ready.empty(); }));
+    }
+    EXPECT_TRUE(pipeline.should_defer(text));  // the voice note is still on its way to the agent
+    EXPECT_TRUE(MediaPipeline::has_transcripts(ready.front()));
+    pipeline.consumed(ready.front());
+    EXPECT_TRUE(!pipeline.should_defer(text));
+    pipeline.stop();
+  }
+
+  {
+    // 70 s of tone at 8 kHz with a silent gap at 25-26 s: the first cut lands in the gap.
+    std::string pcm;
+    for (int i = 0; i < 8000 * 70; ++i) {
+      const bool silent = i >= 8000 * 25 && i < 8000 * 26;
+      const int16_t v = silent ? 0 : static_cast<int16_t>((i % 16) < 8 ? 4000 : -4000);
+      pcm.push_back(static_cast<char>(v & 0xFF));
+      pcm.push_back(static_cast<char>((v >> 8) & 0xFF));
+    }
+    const std::string wav = make_wav_pcm16(pcm, 8000, 1);
+    const auto info = parse_wav(wav);
+    EXPECT_TRUE(info.has_value() && info->data_size == pcm.size());
+    const auto segments = split_wav_segments(wav, 27);
+    EXPECT_EQ(segments.size(), static_cast<std::size_t>(3));
+    const auto first = parse_wav(segments[0]);
+    EXPECT_TRUE(first && first->data_size >= 8000u * 2u * 25u && first->data_size <= 8000u * 2u * 26u);
+    EXPECT_EQ(split_wav_segments(wav, 0).size(), static_cast<std::size_t>(1));
+
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_tcache_" + random_id(8));
+    TranscriptCache cache(dir);
+    const std::string key = TranscriptCache::key(wav, "whisper-1");
+    EXPECT_EQ(key, TranscriptCache::key(wav, "whisper-1"));
+    EXPECT_TRUE(key != TranscriptCache::key(wav, "other-model"));
+    EXPECT_TRUE(!cache.get(key).has_value());
+    cache.put(key, "hello world");
+    EXPECT_EQ(cache.get(key).value_or(""), std::string("hello world"));
+    write_text_file(dir / "clip.wav", wav);
+    EXPECT_EQ(TranscriptCache::file_key(dir / "clip.wav", "whisper-1").value_or(""), key);
+
+    TranscriptCache small(dir / "small", 3);
+    for (int i = 0; i < 5; ++i) {
+      small.put("k" + std::to_string(i), "t");
+    }
+    std::size_t kept = 0;
+    for (const auto& e : fs::directory_iterator(dir / "small")) {
+      kept += e.path().extension() == ".txt" ? 1 : 0;
+    }
+    EXPECT_TRUE(kept <= 3);
+    EXPECT_TRUE(small.get("k4").has_value());
+
+    // Overwriting a key does not count as a new entry; a fresh instance picks up what is on disk.
+    TranscriptCache reused(dir / "reused", 3);
+    for (int i = 0; i < 5; ++i) {
+      reused.put("same", "t" + std::to_string(i));
+    }
+    reused.put("other", "t");
+    EXPECT_EQ(reused.get("same").value_or(""), std::string("t4"));
+    TranscriptCache reopened(dir / "reused", 3);
+    reopened.put("a", "t");
+    reopened.put("b", "t");
+    std::size_t reused_kept = 0;
+    for (const auto& e : fs::directory_iterator(dir / "reused")) {
+      reused_kept += e.path().extension() == ".txt" ? 1 : 0;
+    }
+    EXPECT_EQ(reused_kept, static_cast<std::size_t>(3));
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+
+  {
+    const fs::path ws = fs::temp_directory_path() / ("attoclaw_test_memidx_" + random_id(8));
+    {
+      MemoryStore store(ws);
+      store.append_history("[2026-01-02 10:00] USER: my cat is called Miso and she likes tuna\n"
+                           "[2026-01-02 10:01] ASSISTANT: noted, Miso the tuna fan");
+      store.append_history("[2026-01-03 09:00] USER: deploy the staging server with docker compose");
+      store.write_long_term("User prefers metric units.\n\nFavourite editor: helix");
+      const auto hits = store.search("what does Miso eat? tuna", 3);
+      EXPECT_TRUE(!hits.empty() && hits[0].source == "HISTORY.md" && hits[0].text.find("Miso") != std::string::npos);
+      EXPECT_TRUE(store.relevant_context("which editor", 2).find("helix") != std::string::npos);
+      EXPECT_TRUE(store.search("kubernetes", 3).empty());
+    }
+    {
+      // A fresh index loads index.bin and picks up only what was appended since.
+      MemoryIndex reloaded(ws / "memory");
+      EXPECT_EQ(reloaded.size(), static_cast<std::size_t>(4));
+      MemoryStore(ws).append_history("[2026-01-04 08:00] USER: docker build fails on arm64");
+      const auto docker = reloaded.search("docker", 5);
+      EXPECT_EQ(docker.size(), static_cast<std::size_t>(2));
+      // A rewrite that keeps the size is caught by the indexed prefix's fingerprint.
+      const fs::path history = ws / "memory" / "HISTORY.md";
+      std::string text = read_text_file(history);
+      for (std::size_t at = text.find("docker"); at != std::string::npos; at = text.find("docker", at)) {
+        text.replace(at, 6, "podman");
+      }
+      write_text_file(history, text);
+      fs::last_write_time(history, fs::last_write_time(history) + std::chrono::seconds(2));
+      EXPECT_TRUE(reloaded.search("docker", 5).empty());
+      EXPECT_EQ(reloaded.search("podman", 5).size(), static_cast<std::size_t>(2));
+    }  // the index must be gone before its directory is removed
+    std::error_code ec;
+    fs::remove_all(ws, ec);
+  }
+
+  {
+    struct CannedProvider : LLMProvider {
+      LLMResponse chat(const json&, const json&, const std::string&, int, double, double) override {
+        LLMResponse r;
+        r.content = "```json\n{\"history_entry\": \"[2026-02-01 10:00] Planned the Lisbon trip.\", "
+                    "\"facts\": [\"User lives in Porto\"]}\n```";
+        r.usage = {{"prompt_tokens", 120}, {"completion_tokens", 30}};
+        return r;
+      }
+      std::string get_default_model() const override { return "canned"; }
+    } provider;
+    const fs::path ws = fs::temp_directory_path() / ("attoclaw_test_consolidate_" + random_id(8));
+    Session session;
+    session.key = "cli:test";
+    for (int i = 0; i < 6; ++i) {
+      session.add_message(i % 2 == 0 ? "user" : "assistant", "message " + std::to_string(i));
+    }
+    {
+      MemoryConsolidator consolidator(&provider, ws, "canned");
+      EXPECT_TRUE(consolidator.submit(session.key, {session.messages.begin(), session.messages.begin() + 4}, 4));
+      EXPECT_TRUE(!consolidator.submit(session.key, {session.messages.front()}, 1));  // one job per session
+      EXPECT_TRUE(consolidator.wait_idle(5000));
+      EXPECT_EQ(consolidator.take_completed(session), static_cast<std::size_t>(4));
+      EXPECT_EQ(consolidator.take_completed(session), static_cast<std::size_t>(0));
+    }
+    MemoryStore store(ws);
+    EXPECT_TRUE(store.read_long_term().find("- User lives in Porto") != std::string::npos);
+    EXPECT_TRUE(read_text_file(store.history_file()).find("Lisbon trip") != std::string::npos);
+    EXPECT_EQ(MemoryConsolidator::merge_facts(store, {"User lives in Porto"}), static_cast<std::size_t>(0));
+    EXPECT_TRUE(!MemoryConsolidator::parse_summary("no json here").has_value());
+
+    // Jobs dropped by a timed-out drain must not hold up the destructor's second stop().
+    struct SlowProvider : CannedProvider {
+      LLMResponse chat(const json& m, const json& t, const std::string& model, int n, double a, double b) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return CannedProvider::chat(m, t, model, n, a, b);
+      }
+    } slow;
+    const auto started = std::chrono::steady_clock::now();
+    {
+      MemoryConsolidator consolidator(&slow, ws, "canned");
+      EXPECT_TRUE(consolidator.submit("cli:a", {session.messages.front()}, 1));
+      EXPECT_TRUE(consolidator.submit("cli:b", {session.messages.front()}, 1));
+      consolidator.stop(10);
+      EXPECT_TRUE(!consolidator.in_flight("cli:b"));
+    }
+    EXPECT_TRUE(std::chrono::steady_clock::now() - started < std::chrono::seconds(5));
+    // The call still running when stop() gave up is abandoned, not written.
+    const std::string history_text = read_text_file(store.history_file());
+    EXPECT_EQ(history_text.find("Lisbon trip"), history_text.rfind("Lisbon trip"));
+
+    // Jobs whose session was reset (/new) keep their raw transcript when abandoned or dropped.
+    {
+      MemoryConsolidator consolidator(&slow, ws, "canned");
+      EXPECT_TRUE(consolidator.submit("cli:d", {session.messages[1], session.messages[2]}, 3));
+      EXPECT_EQ(consolidator.detach("cli:d"), static_cast<std::size_t>(3));
+      EXPECT_EQ(consolidator.detach("cli:none"), static_cast<std::size_t>(0));
+      EXPECT_TRUE(consolidator.submit("cli:e#1", {session.messages[3]}, 0));
+      consolidator.stop(10);
+    }
+    const std::string orphaned = read_text_file(store.history_file());
+    EXPECT_TRUE(orphaned.find("message 2") != std::string::npos);
+    EXPECT_TRUE(orphaned.find("message 3") != std::string::npos);
+    std::error_code ec;
+    fs::remove_all(ws, ec);
+  }
+
+  {
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_vec_" + random_id(8));
+    fs::create_directories(dir);
+    const auto a = hash_embed("restart the nginx container", 64);
+    EXPECT_TRUE(a == hash_embed("restart the nginx container", 64));
+    EXPECT_TRUE(dot_f32(a.data(), hash_embed("restarting nginx containers", 64).data(), 64) >
+                dot_f32(a.data(), hash_embed("grandma's apple pie recipe", 64).data(), 64));
+
+    std::vector<std::pair<uint64_t, std::vector<float>>> items;
+    for (uint64_t i = 0; i < 300; ++i) {
+      items.emplace_back(i * 10, hash_embed("note number " + std::to_string(i), 64));
+    }
+    {
+      VectorIndex graph(dir / "v.bin", 64, "hash", 100);  // HNSW once past 100 records
+      EXPECT_TRUE(graph.append(items));
+      EXPECT_EQ(graph.size(), static_cast<std::size_t>(300));
+    }
+    VectorIndex reopened(dir / "v.bin", 64, "hash", 100);
+    EXPECT_EQ(VectorIndex::stored_dim(dir / "v.bin"), 64);
+    const auto top = reopened.search(items[123].second, 1);
+    EXPECT_TRUE(!top.empty() && top[0].first == 123 && reopened.ref(top[0].first) == 1230);
+    VectorIndex other_model(dir / "v.bin", 64, "other", 100);
+    EXPECT_EQ(other_model.size(), static_cast<std::size_t>(0));
+
+    VectorIndex flat(dir / "flat.bin", 64, "hash", 1000);  // brute force below the threshold
+    EXPECT_TRUE(flat.append(items));
+    const auto best = flat.search(items[42].second, 5);
+    EXPECT_EQ(best.size(), static_cast<std::size_t>(5));
+    EXPECT_TRUE(!best.empty() && best[0].first == 42);
+    for (std::size_t i = 1; i < best.size(); ++i) {
+      EXPECT_TRUE(best[i - 1].second >= best[i].second);
+    }
+
+    const fs::path ws = dir / "ws";
+    {
+      MemoryStore store(ws);
+      store.append_history("[2026-01-02 10:00] USER: adopted a kitten from the shelter");
+      store.append_history("[2026-01-03 09:00] USER: renew the TLS certificate before friday");
+      const auto index = MemoryIndex::for_dir(ws / "memory");
+      index->set_embedder(hashing_embedder());
+      EXPECT_TRUE(index->wait_embedded(5000));  // backfill runs on the index's worker
+      const auto hits = store.search("kitty", 1);  // no shared keyword; found through trigrams
+      EXPECT_TRUE(!hits.empty() && hits[0].text.find("kitten") != std::string::npos);
+      EXPECT_TRUE(fs::exists(ws / "memory" / "vectors.bin"));
+
+      // An unreachable embedder backs off instead of being called on every search, and
+      // search() keeps answering from BM25.
+      std::atomic<int> calls{0};
+      index->set_embedder(Embedder{"offline", [&calls](const std::vector<std::string>&) {
+                                     ++calls;
+                                     return std::optional<std::vector<std::vector<float>>>();
+                                   }});
+      for (int i = 0; calls.load() == 0 && i < 500; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      EXPECT_TRUE(!index->wait_embedded(50));  // only has to show the wait does not succeed
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(store.search("certificate", 1).size(), static_cast<std::size_t>(1));
+      }
+      EXPECT_EQ(calls.load(), 1);
+    }  // the index must be gone before its directory is removed
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+
+  {
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_read_" + random_id(8));
+    fs::create_directories(dir);
+    std::string log;
+    for (int i = 1; i <= 120000; ++i) {
+      log += "line " + std::to_string(i) + (i % 10000 == 0 ? " ERROR disk full\n" : " ok\n");
+    }
+    write_text_file(dir / "big.log", log);
+    write_text_file(dir / "small.txt", "hello\nworld\n");
+    write_text_file(dir / "blob.bin", std::string("\x7f" "ELF\0\0\x01", 7));
+    ReadFileTool read(std::nullopt);
+    EXPECT_EQ(read.execute(json{{"path", (dir / "small.txt").string()}}), "hello\nworld\n");
+    EXPECT_EQ(read.execute(json{{"path", (dir / "big.log").string()}, {"offset", 3}, {"limit", 2}}).substr(0, 20),
+              "line 3 ok\nline 4 ok\n");
+    const std::string head = read.execute(json{{"path", (dir / "big.log").string()}});
+    EXPECT_TRUE(head.size() < 100200 && head.find("Continue with offset=") != std::string::npos);
+    const std::string errors = read.execute(json{{"path", (dir / "big.log").string()}, {"pattern", "ERROR"}});
+    EXPECT_TRUE(errors.rfind("10000: line 10000 ERROR disk full\n", 0) == 0);
+    EXPECT_TRUE(errors.find("50000: line 50000 ERROR") != std::string::npos);
+    const std::string later =
+        read.execute(json{{"path", (dir / "big.log").string()}, {"pattern", "ERROR"}, {"offset", 20001}, {"limit", 1}});
+    EXPECT_TRUE(later.rfind("30000: ", 0) == 0 && later.find("continue with offset=30001") != std::string::npos);
+    EXPECT_TRUE(read.execute(json{{"path", (dir / "blob.bin").string()}}).find("binary file") != std::string::npos);
+
+    // Past the first 1 MiB block: line numbers and slices carry across block boundaries.
+    EXPECT_TRUE(errors.find("110000: line 110000 ERROR disk full\n") != std::string::npos);
+    EXPECT_TRUE(read.execute(json{{"path", (dir / "big.log").string()}, {"offset", 115000}, {"limit", 1}})
+                    .rfind("line 115000 ok\n\n[Showing lines 115000-115000", 0) == 0);
+    write_text_file(dir / "empty.txt", "");
+    EXPECT_EQ(read.execute(json{{"path", (dir / "empty.txt").string()}}), "");
+
+    // A single line over the cap is cut with a note and can be continued by character.
+    const std::string minified = "[" + std::string(150000, '7') + "]";
+    write_text_file(dir / "one_line.json", minified);
+    const std::string first = read.execute(json{{"path", (dir / "one_line.json").string()}});
+    EXPECT_TRUE(first.rfind("[777", 0) == 0 && first.find("offset=1 and char_offset=100000") != std::string::npos);
+    const std::string rest = read.execute(json{{"path", (dir / "one_line.json").string()}, {"char_offset", 100000}});
+    EXPECT_EQ(rest, minified.substr(100000));
+    EXPECT_EQ(read.execute(json{{"path", (dir / "big.log").string()}, {"offset", 3}, {"limit", 2}}),
+              "line 3 ok\nline 4 ok\n\n[Showing lines 3-4 of a " + std::to_string(log.size()) +
+                  "-byte file. Continue with offset=5, or pass pattern to search.]");
+
+    // Blocks end on line boundaries; a line longer than the block comes in pieces.
+    LineBlockReader blocks(8);
+    EXPECT_TRUE(blocks.open(dir / "small.txt"));
+    EXPECT_EQ(blocks.next(), "hello\n");
+    EXPECT_EQ(blocks.next(), "world\n");
+    EXPECT_TRUE(blocks.next().empty() && blocks.done());
+    write_text_file(dir / "pieces.txt", "0123456789abcdef\nxy");
+    EXPECT_TRUE(blocks.open(dir / "pieces.txt"));
+    EXPECT_EQ(blocks.next(), "01234567");
+    EXPECT_EQ(blocks.next(), "89abcdef");
+    EXPECT_EQ(blocks.next(), "\nxy");
+    EXPECT_TRUE(blocks.next().empty());
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+
+  {
+    EXPECT_TRUE(glob_match("*.hpp", "tools.hpp") && !glob_match("*.hpp", "include/tools.hpp"));
+    EXPECT_TRUE(glob_match("src/**/*.cpp", "src/main.cpp") && glob_match("src/**/*.cpp", "src/a/b/x.cpp"));
+    EXPECT_TRUE(glob_match("test_[0-9]?.py", "test_1a.py") && !glob_match("test_[!0-9].py", "test_1.py"));
+
+    const fs::path root = fs::temp_directory_path() / ("attoclaw_test_search_" + random_id(8));
+    for (int d = 0; d < 6; ++d) {
+      const fs::path sub = root / "src" / ("mod" + std::to_string(d)) / "impl";
+      fs::create_directories(sub);
+      write_text_file(sub / "a.cpp", "int main() {\n  return Connect(\"db\");\n}\n");
+      write_text_file(sub / "notes.md", "call connect() before query\n");
+    }
+    fs::create_directories(root / "build");
+    write_text_file(root / "build" / "gen.cpp", "Connect(generated);\n");
+    write_text_file(root / "src" / "debug.log", "Connect failed\n");
+    write_text_file(root / ".gitignore", "build/\n*.log\n");
+
+    SearchFilesTool search(root, std::nullopt);
+    const std::string literal = search.execute(json{{"pattern", "Connect("}, {"path", root.string()}});
+    EXPECT_TRUE(literal.rfind("src/mod0/impl/a.cpp:2:   return Connect(\"db\");", 0) == 0);
+    EXPECT_TRUE(literal.find("build/") == std::string::npos && literal.find("debug.log") == std::string::npos);
+    EXPECT_EQ(static_cast<std::size_t>(std::count(literal.begin(), literal.end(), '\n')), static_cast<std::size_t>(5));
+    const std::string icase = search.execute(json{{"pattern", "CONNECT"}, {"ignore_case", true}, {"glob", "*.md"}});
+    EXPECT_EQ(static_cast<std::size_t>(std::count(icase.begin(), icase.end(), '\n')), static_cast<std::size_t>(5));
+    const std::string regex = search.execute(json{{"pattern", "return [A-Z]\\w+\\(\"d"}, {"regex", true}, {"max_results", 2}});
+    EXPECT_TRUE(regex.find("Stopped after 2 matches") != std::string::npos);
+
+    ListDirTool list(std::nullopt);
+    EXPECT_EQ(list.execute(json{{"path", root.string()}}), "[DIR] build\n[DIR] src\n[FILE] .gitignore");
+    const std::string tree = list.execute(json{{"path", (root / "src").string()}, {"depth", 3}, {"limit", 4}});
+    EXPECT_TRUE(tree.rfind("[FILE] debug.log\n[DIR] mod0\n[DIR] mod0/impl\n[FILE] mod0/impl/a.cpp\n", 0) == 0);
+    EXPECT_TRUE(tree.find("[Showing 1-4 of 25 entries; continue with offset=4]") != std::string::npos);
+    const std::string md = list.execute(json{{"path", root.string()}, {"depth", 4}, {"glob", "*.md"}, {"metadata", true}});
+    EXPECT_TRUE(md.rfind("[FILE] src/mod0/impl/notes.md  28 B  20", 0) == 0);
+    GlobTool glob(root, std::nullopt);
+    EXPECT_EQ(glob.execute(json{{"pattern", "src/mod3/**/*.cpp"}}), "src/mod3/impl/a.cpp");
+    const std::string all = glob.execute(json{{"pattern", "*.cpp"}});
+    EXPECT_EQ(static_cast<std::size_t>(std::count(all.begin(), all.end(), '\n')), static_cast<std::size_t>(5));
+    // list_dir shows .git itself but never walks into it.
+    write_text_file(root / "repo" / ".git" / "HEAD", "ref: refs/heads/main\n");
+    EXPECT_EQ(list.execute(json{{"path", (root / "repo").string()}}), "[DIR] .git");
+    EXPECT_EQ(list.execute(json{{"path", (root / "repo").string()}, {"depth", 3}}), "[DIR] .git");
+    // Files over one read block are scanned block by block with running line numbers.
+    std::string big;
+    for (int i = 1; i <= 100000; ++i) {
+      big += i == 90000 ? "needle here\n" : "filler line " + std::to_string(i) + "\n";
+    }
+    write_text_file(root / "src" / "big.txt", big);
+    EXPECT_EQ(search.execute(json{{"pattern", "needle"}, {"glob", "*.txt"}}), "src/big.txt:90000: needle here");
+    std::error_code ec;
+
+#ifndef _WIN32
+    // A symlink must not let a restricted search read outside the workspace.
+    const fs::path outside = fs::temp_directory_path() / ("attoclaw_test_outside_" + random_id(8) + ".txt");
+    write_text_file(outside, "root:x:0:0:secret-token\n");
+    fs::create_symlink(outside, root / "src" / "passwd");
+    SearchFilesTool restricted(root, root);
+    EXPECT_EQ(restricted.execute(json{{"pattern", "secret-token"}}), "No matches for 'secret-token'");
+    EXPECT_EQ(GlobTool(root, root).execute(json{{"pattern", "passwd"}}), "No files match 'passwd'");
+    fs::remove(outside, ec);
+
+    // list_dir shows links (directory links as [DIR], not descended into) and dangling ones.
+    fs::create_directories(root / "links");
+    fs::create_directory_symlink(root / "src" / "mod1", root / "links" / "mod");
+    fs::create_symlink(root / "missing", root / "links" / "dangling");
+    EXPECT_EQ(list.execute(json{{"path", (root / "links").string()}}), "[DIR] mod\n[FILE] dangling");
+    EXPECT_EQ(list.execute(json{{"path", (root / "links").string()}, {"depth", 3}}), "[FILE] dangling\n[DIR] mod");
+#endif
+    fs::remove_all(root, ec);
+  }
+
+  {
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_edit_" + random_id(8));
+    const fs::path file = dir / "main.cpp";
+    WriteFileTool write(std::nullopt);
+    EditFileTool edit(std::nullopt);
+    EXPECT_TRUE(write.execute(json{{"path", file.string()}, {"content", "int a = 1;\nint b = 2;\nint c = 3;\n"}})
+                    .rfind("Successfully", 0) == 0);
+    EXPECT_EQ(edit.execute(json{{"path", file.string()}, {"old_text", "int"}, {"new_text", "long"}}),
+              "Warning: old_text appears multiple times; provide a more specific pattern");
+    const json batch = json::array({{{"old_text", "a = 1"}, {"new_text", "a = 10"}},
+                                    {{"old_text", "int"}, {"new_text", "auto"}, {"replace_all", true}}});
+    EXPECT_EQ(edit.execute(json{{"path", file.string()}, {"edits", batch}}),
+              "Successfully edited " + file.string() + " (4 replacements)");
+    EXPECT_EQ(read_text_file(file), "auto a = 10;\nauto b = 2;\nauto c = 3;\n");
+    const json overlap = json::array({{{"old_text", "a = 10"}, {"new_text", "x"}}, {{"old_text", "10;"}, {"new_text", "y"}}});
+    EXPECT_TRUE(edit.execute(json{{"path", file.string()}, {"edits", overlap}}).find("overlap") != std::string::npos);
+
+    const std::string patch =
+        "--- a/main.cpp\n+++ b/main.cpp\n"
+        "@@ -1,2 +1,3 @@\n auto a = 10;\n-auto b = 2;\n+auto b = 20;\n+auto bb = 21;\n"
+        "@@ -3 +4 @@\n-auto c = 3;\n+auto c = 30;\n\\ No newline at end of file\n";
+    EXPECT_EQ(edit.execute(json{{"path", file.string()}, {"patch", patch}}),
+              "Successfully edited " + file.string() + " (2 hunks)");
+    EXPECT_EQ(read_text_file(file), "auto a = 10;\nauto b = 20;\nauto bb = 21;\nauto c = 30;");
+    EXPECT_TRUE(edit.execute(json{{"path", file.string()}, {"patch", patch}}).find("does not match") != std::string::npos);
+
+    std::string error;
+    const auto shifted = apply_unified_diff("x\ny\nkeep\nold\n", "@@ -1,2 +1,2 @@\n keep\n-old\n+new\n", error);
+    EXPECT_EQ(shifted.value_or(error), "x\ny\nkeep\nnew\n");
+    EXPECT_EQ(apply_unified_diff("a\r\nb\r\n", "@@ -2 +2 @@\n-b\n+c\n", error).value_or(error), "a\r\nc\r\n");
+    const std::string two_files =
+        "--- a/one.txt\n+++ b/one.txt\n@@ -1,2 +1,2 @@\n-a\n+A\n b\n\n"
+        "--- a/two.txt\n+++ b/two.txt\n@@ -1 +1 @@\n-b\n+B\n";
+    std::size_t applied = 0;
+    EXPECT_EQ(apply_unified_diff("a\nb\n\nc\n", two_files, error, &applied).value_or(error), "A\nb\n\nc\n");
+    EXPECT_EQ(applied, 1u);
+    EXPECT_TRUE(!apply_unified_diff("a\nb\n", "@@ -1,2 +1,2 @@\n-a\n+A\n", error));
+    EXPECT_TRUE(error.find("header says 2/2") != std::string::npos);
+    EXPECT_TRUE(!apply_unified_diff("a\nb\n", "@@ -1,1 +1,1 @@\n-a\n-b\n+A\n", error));
+    EXPECT_TRUE(std::none_of(fs::directory_iterator(dir), fs::directory_iterator(),
+                             [](const fs::directory_entry& e) { return e.path().filename().string().find(".tmp") != std::string::npos; }));
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+
+#ifdef __linux__
+  {
+    EXPECT_EQ(ProcfsInspector::decode_address("0100007F:1F90"), "127.0.0.1:8080");
+    EXPECT_EQ(ProcfsInspector::decode_address("00000000000000000000000001000000:0016"), "[::1]:22");
+    SystemInspectTool inspect;
+    const auto self = ProcfsInspector::read_stat(static_cast<int>(::getpid()));
+    EXPECT_TRUE(self && self->ppid == static_cast<int>(::getppid()) && self->rss_pages > 0 && !self->name.empty());
+    const json procs = json::parse(inspect.execute(json{{"action", "processes"}, {"sort", "memory"}, {"limit", 5}}));
+    EXPECT_TRUE(!procs["processes"].empty() && procs["processes"][0]["rssBytes"].get<uint64_t>() > 0);
+    const json mem = json::parse(inspect.execute(json{{"action", "memory"}}));
+    EXPECT_TRUE(mem["totalBytes"].get<uint64_t>() >= mem["availableBytes"].get<uint64_t>());
+    EXPECT_TRUE(json::parse(inspect.execute(json{{"action", "disks"}})).is_array());
+    EXPECT_TRUE(json::parse(inspect.execute(json{{"action", "uptime"}}))["uptimeSeconds"].get<double>() > 0);
+  }
+#endif
+
+  {
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_trace_" + random_id(8));
+    tracer().configure(true, dir, "otlp", 0);
+    const std::string id = Tracer::new_trace_id();
+    EXPECT_EQ(id.size(), static_cast<std::size_t>(32));
+    {
+      TraceContext ctx(id);
+      TraceSpan outer("agent.turn");
+      TraceSpan inner("tool.execute", "read_file");
+    }
+    const auto spans = tracer().spans_for(id);
+    EXPECT_EQ(spans.size(), static_cast<std::size_t>(2));
+    const bool outer_first = std::string(spans[0].name) == "agent.turn";
+    const auto& outer_rec = spans[outer_first ? 0 : 1];
+    const auto& inner_rec = spans[outer_first ? 1 : 0];
+    EXPECT_EQ(std::string(inner_rec.name), "tool.execute");
+    EXPECT_EQ(inner_rec.parent_span_id, outer_rec.span_id);
+    EXPECT_EQ(outer_rec.parent_span_id, static_cast<uint64_t>(0));
+    const fs::path out = tracer().finish(id);
+    EXPECT_TRUE(!out.empty());
+    const json doc = json::parse(read_text_file(out));
+    EXPECT_EQ(doc["resourceSpans"][0]["scopeSpans"][0]["spans"].size(), static_cast<std::size_t>(2));
+
+    // A channel whose send() throws still gets its trace finished.
+    struct ThrowingChannel : BaseChannel {
+      ThrowingChannel() : BaseChannel("boom", nullptr) {}
+      void start() override {}
+      void stop() override {}
+      void send(const OutboundMessage&) override { throw std::runtime_error("send failed"); }
+    };
+    MessageBus bus;
+    ChannelManager manager(&bus);
+    manager.add_channel(std::make_shared<ThrowingChannel>());
+    bus.start_dispatcher();
+    const std::string failed_id = Tracer::new_trace_id();
+    OutboundMessage failing;
+    failing.channel = "boom";
+    failing.chat_id = "1";
+    failing.content = "hi";
+    failing.metadata = json{{"traceId", failed_id}};
+    bus.publish_outbound(failing);
+    const fs::path failed_out = dir / ("trace-" + failed_id + ".otlp.json");
+    for (int i = 0; !fs::exists(failed_out) && i < 200; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    bus.stop_dispatcher();
+    EXPECT_TRUE(fs::exists(failed_out));
+    tracer().configure(false, dir, "chrome", 0);
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+
+  {
+    LogRateLimiter limiter(60000);
+    std::uint64_t suppressed = 0;
+    EXPECT_TRUE(limiter.allow(&suppressed));
+    EXPECT_TRUE(!limiter.allow(&suppressed));
+    EXPECT_TRUE(!limiter.allow(&suppressed));
+    EXPECT_EQ(Logger::with_suppressed("x", 2), std::string("x (2 similar suppressed)"));
+
+    const fs::path log_path = fs::temp_directory_path() / ("attoclaw_test_log_" + random_id(8) + ".log");
+    EXPECT_TRUE(Logger::set_file(log_path));
+    Logger::start_async();
+    std::thread other([]() { ATTOCLAW_LOG_INFO("async line from worker"); });
+    ATTOCLAW_LOG_INFO("async line from main");
+    other.join();
+    Logger::stop_async();
+    Logger::set_file({});
+    const std::string logged = read_text_file(log_path);
+    EXPECT_TRUE(logged.find("[INFO] async line from worker") != std::string::npos);
+    EXPECT_TRUE(logged.find("[INFO] async line from main") != std::string::npos);
+
+    // Lines logged while stop_async() switches back to synchronous writes are not lost.
+    const fs::path race_path = fs::temp_directory_path() / ("attoclaw_test_log_" + random_id(8) + ".log");
+    EXPECT_TRUE(Logger::set_file(race_path));
+    Logger::start_async();
+    std::vector<std::thread> loggers;
+    for (int t = 0; t < 4; ++t) {
+      loggers.emplace_back([]() {
+        for (int i = 0; i < 2000; ++i) {
+          ATTOCLAW_LOG_INFO("race line");
+        }
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Logger::stop_async();
+    for (auto& t : loggers) {
+      t.join();
+    }
+    Logger::set_file({});
+    const std::string raced = read_text_file(race_path);
+    std::size_t race_lines = 0;
+    for (std::size_t at = raced.find("race line"); at != std::string::npos; at = raced.find("race line", at + 1)) {
+      ++race_lines;
+    }
+    EXPECT_EQ(race_lines, static_cast<std::size_t>(8000));
+    std::error_code ec;
+    fs::remove(log_path, ec);
+    fs::remove(race_path, ec);
+  }
+
+  {
+    // Provider calls block until released so the pool stays saturated while we inspect it.
+    struct BlockingProvider : LLMProvider {
+      std::mutex mu;
+      std::condition_variable cv;
+      bool release{false};
+      LLMResponse chat(const json&, const json&, const std::string&, int, double, double) override {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [this]() { return release; });
+        LLMResponse r;
+        r.content = "done";
+        return r;
+      }
+      std::string get_default_model() const override { return "m"; }
+    };
+    BlockingProvider provider;
+    MessageBus bus;
+    SubagentManager subagents(&provider, fs::temp_directory_path(), &bus, "m", 0.1, 0.9, 64, "", "", "", "", 10,
+                              10, false);
+    subagents.configure(1, 1);
+    EXPECT_TRUE(subagents.spawn("first", "a", "cli", "direct").find("started") != std::string::npos);
+    const std::string queued = subagents.spawn("second", "b", "cli", "direct");
+    EXPECT_TRUE(queued.find("queued") != std::string::npos);
+    EXPECT_TRUE(subagents.spawn("third", "c", "cli", "direct").rfind("Error:", 0) == 0);
+    const std::string second_id = queued.substr(queued.find("id: ") + 4, 8);
+    EXPECT_TRUE(subagents.cancel(second_id).find("cancelled") != std::string::npos);
+    EXPECT_EQ(subagents.status()["cancelled"].get<int>(), 1);
+    {
+      std::lock_guard<std::mutex> lock(provider.mu);
+      provider.release = true;
+    }
+    provider.cv.notify_all();
+    for (int i = 0; i < 200 && subagents.status()["completed"].get<int>() < 1; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(subagents.status()["completed"].get<int>(), 1);
+    EXPECT_EQ(subagents.running_count(), 0);
+    subagents.shutdown();
+  }
+
+  {
+    ToolRegistry registry;
+    CoreToolOptions options;
+    options.workspace = fs::temp_directory_path();
+    register_core_tools(registry, options);
+    const std::size_t n = registry.size();
+    EXPECT_EQ(registry.definitions().size(), n);
+    std::vector<OutboundMessage> sent;
+    registry.register_tool(std::make_shared<MessageTool>([&](const OutboundMessage& m) { sent.push_back(m); }));
+    registry.register_tool(std::make_shared<MessageTool>([&](const OutboundMessage& m) { sent.push_back(m); }));
+    EXPECT_EQ(registry.size(), n + 1);
+    EXPECT_EQ(registry.definitions().size(), n + 1);
+
+    const ToolRegistry& shared = registry;
+    shared.execute("message", json{{"content", "hi"}}, ToolContext{"telegram", "42", false});
+    EXPECT_EQ(sent.size(), static_cast<std::size_t>(1));
+    EXPECT_EQ(sent[0].channel, "telegram");
+    EXPECT_EQ(sent[0].chat_id, "42");
+    EXPECT_TRUE(shared.execute("screen_capture", json::object(), ToolContext{}).find("--vision") != std::string::npos);
+  }
+
+  {
+    // Tools that do not declare themselves concurrency-safe run one call at a time.
+    struct CountingTool : Tool {
+      std::atomic<int> active{0};
+      std::atomic<int> peak{0};
+      std::string name() const override { return "counting"; }
+      std::string description() const override { return "test"; }
+      json parameters() const override { return json{{"type", "object"}}; }
+      std::string execute(const json&) override {
+        const int now = ++active;
+        int seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        --active;
+        return "ok";
+      }
+    };
+    auto counting = std::make_shared<CountingTool>();
+    ToolRegistry registry;
+    registry.register_tool(counting);
+    std::vector<std::thread> callers;
+    for (int i = 0; i < 4; ++i) {
+      callers.emplace_back([&registry]() { registry.execute("counting", json::object()); });
+    }
+    for (auto& t : callers) {
+      t.join();
+    }
+    EXPECT_EQ(counting->peak.load(), 1);
+
+    // Tools that mutate shared state stay serialised; spawn's task is only checked for action=spawn.
+    SpawnTool spawn(nullptr);
+    EXPECT_TRUE(!spawn.concurrency_safe());
+    EXPECT_TRUE(!spawn.parameters().contains("required"));
+    EXPECT_TRUE(!EditFileTool(std::nullopt).concurrency_safe());
+    EXPECT_TRUE(ReadFileTool(std::nullopt).concurrency_safe());
+  }
+
+  {
+    DiscordRateLimiter limiter;
+    const int64_t t0 = 1000000;
+    HttpResponse ok;
+    ok.status = 200;
+    ok.headers = {{"x-ratelimit-bucket", "abc"}, {"x-ratelimit-remaining", "0"}, {"x-ratelimit-reset-after", "1.5"}};
+    limiter.update("GET /channels/1/messages", ok, t0);
+    EXPECT_EQ(limiter.ready_at_ms("GET /channels/1/messages"), t0 + 1500);
+    EXPECT_EQ(limiter.ready_at_ms("GET /channels/2/messages"), int64_t{0});
+
+    HttpResponse limited;
+    limited.status = 429;
+    limited.body = R"({"retry_after": 0.25, "global": true})";
+    limited.headers = {{"x-ratelimit-global", "true"}};
+    limiter.update("GET /channels/2/messages", limited, t0);
+    EXPECT_EQ(limiter.ready_at_ms("GET /channels/2/messages"), t0 + 250);
+
+    EXPECT_EQ(next_discord_poll_interval_ms(3000, true, 1000, 30000), int64_t{1000});
+    EXPECT_EQ(next_discord_poll_interval_ms(3000, false, 1000, 30000), int64_t{4500});
+    EXPECT_EQ(next_discord_poll_interval_ms(25000, false, 1000, 30000), int64_t{30000});
+  }
+
+  {
+    SlackSeenWindow seen;
+    EXPECT_TRUE(seen.insert("1700000000.000100"));
+    EXPECT_TRUE(!seen.insert("1700000000.000100"));
+    for (std::size_t i = 0; i < SlackSeenWindow::kCapacity; ++i) {
+      EXPECT_TRUE(seen.insert("ts" + std::to_string(i)));
+    }
+    EXPECT_TRUE(!seen.insert("ts" + std::to_string(SlackSeenWindow::kCapacity - 1)));
+    EXPECT_TRUE(seen.insert("1700000000.000100"));
+
+    const auto ack = slack_envelope_ack(json::parse(R"({"envelope_id":"e-1","type":"events_api","payload":{}})"));
+    EXPECT_TRUE(ack.has_value());
+    EXPECT_EQ(ack->dump(), std::string(R"({"envelope_id":"e-1"})"));
+    EXPECT_TRUE(!slack_envelope_ack(json::parse(R"({"type":"hello"})")).has_value());
+    EXPECT_TRUE(!slack_envelope_ack(json::parse(R"({"type":"disconnect","envelope_id":""})")).has_value());
+    EXPECT_TRUE(!slack_envelope_ack(json::array()).has_value());
+  }
+
+  {
+    const std::string raw =
+        "From: Bob <Bob@Example.com>\r\n"
+        "Subject: =?UTF-8?B?SGVsbG8=?= there\r\n"
+        "Message-ID: <m1@x>\r\n"
+        "Content-Type: multipart/alternative; boundary=\"b1\"\r\n\r\n"
+        "--b1\r\nContent-Type: text/html\r\n\r\n<b>x</b>\r\n"
+        "--b1\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Transfer-Encoding: quoted-printable\r\n\r\n"
+        "Hi =\r\nagent=21\r\n--b1--\r\n";
+    const ParsedEmail mail = parse_email_message(raw);
+    EXPECT_EQ(mail.from_address, "bob@example.com");
+    EXPECT_EQ(mail.subject, "Hello there");
+    EXPECT_EQ(mail.message_id, "<m1@x>");
+    EXPECT_EQ(mail.body, "Hi agent!");
+
+    // A decoded subject is echoed into the reply: no header injection, non-ASCII encoded.
+    EXPECT_EQ(email_detail::header_safe("Hi\r\nBcc: evil@x\t"), "Hi  Bcc: evil@x");
+    EXPECT_EQ(email_detail::encode_header_words("Re: plain"), "Re: plain");
+    const std::string subject = "Re: Grüße aus Köln, " + std::string(40, 'x') + " – ünd mehr";
+    const std::string encoded = email_detail::encode_header_words(subject);
+    EXPECT_TRUE(encoded.rfind("=?UTF-8?B?", 0) == 0 && encoded.find("\r\n =?UTF-8?B?") != std::string::npos);
+    std::size_t widest = 0;
+    for (std::size_t at = 0; at <= encoded.size();) {
+      const std::size_t nl = (std::min)(encoded.find("\r\n", at), encoded.size());
+      widest = (std::max)(widest, nl - at);
+      at = nl + 2;
+    }
+    EXPECT_TRUE(widest <= 70);
+    EXPECT_EQ(parse_email_message("Subject: " + encoded + "\r\n\r\nbody").subject, subject);
+  }
+
   {
     TranscribeTool t("", "https://api.example/v1", "whisper-1", 30);
     const std::string out = t.execute(json{{"path", "missing.wav"}});
     EXPECT_TRUE(out.find("apiKey") != std::string::npos);
   }
 
+  {
+    // Every kernel the CPU supports must agree with scalar, then report its throughput.
+    std::string data(4 << 20, '\0');
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    for (auto& c : data) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      c = static_cast<char>(x);
+    }
+    const std::string expect = base64_encode(data);
+    EXPECT_EQ(base64_decode(expect) == data, true);
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    for (const auto& k : base64_detail::available_kernels()) {
+      for (std::size_t n : {0, 1, 2, 3, 16, 28, 47, 48, 95, 200}) {
+        std::string enc(base64_encoded_size(n), '\0');
+        const std::size_t done = k.encode(bytes, n, enc.data());
+        if (done < n) {
+          base64_detail::encode_tail(bytes + done, n - done, enc.data() + done / 3 * 4);
+        }
+        EXPECT_EQ(enc, base64_encode(data.substr(0, n)));
+      }
+      constexpr int kReps = 4;
+      std::string enc(expect.size(), '\0');
+      std::vector<unsigned char> dec(data.size() + 32);
+      k.encode(bytes, data.size() / 3 * 3, enc.data());  // warm up: fault in both buffers
+      std::size_t used = k.decode(expect.data(), expect.size() - 4, dec.data());
+      const auto t0 = std::chrono::steady_clock::now();
+      for (int r = 0; r < kReps; ++r) {
+        k.encode(bytes, data.size() / 3 * 3, enc.data());
+      }
+      const auto t1 = std::chrono::steady_clock::now();
+      for (int r = 0; r < kReps; ++r) {
+        used = k.decode(expect.data(), expect.size() - 4, dec.data());
+      }
+      const auto t2 = std::chrono::steady_clock::now();
+      EXPECT_EQ(enc.compare(0, expect.size() - 4, expect, 0, expect.size() - 4), 0);
+      EXPECT_EQ(used, expect.size() - 4);
+      EXPECT_TRUE(std::memcmp(dec.data(), bytes, used / 4 * 3) == 0);
+      const double mb = kReps * static_cast<double>(data.size()) / (1 << 20);
+      std::cout << "base64 " << k.name << ": encode " << static_cast<int>(mb / std::chrono::duration<double>(t1 - t0).count())
+                << " MB/s, decode " << static_cast<int>(mb / std::chrono::duration<double>(t2 - t1).count())
+                << " MB/s\n";
+    }
+
+    std::string mime;
+    for (std::size_t i = 0; i < 4000; i += 76) {
+      mime += expect.substr(i, (std::min<std::size_t>)(76, 4000 - i)) + "\r\n";
+    }
+    Base64Decoder dec;
+    std::string streamed;
+    for (std::size_t i = 0; i < mime.size(); i += 37) {
+      dec.update(std::string_view(mime).substr(i, 37), streamed);
+    }
+    EXPECT_EQ(streamed == data.substr(0, 3000), true);
+    Base64Encoder enc;
+    std::string chunked;
+    for (std::size_t i = 0; i < 1000; i += 7) {
+      enc.update(data.data() + i, (std::min<std::size_t>)(7, 1000 - i), chunked);
+    }
+    enc.finish(chunked);
+    EXPECT_EQ(chunked, base64_encode(data.substr(0, 1000)));
+
+    // Several 48 KiB reads plus a partial group at the end.
+    const fs::path file = fs::temp_directory_path() / ("attoclaw_test_b64_" + random_id(8) + ".bin");
+    const std::string big = data.substr(0, 150001);
+    write_text_file(file, big);
+    std::string from_file = "stale";
+    EXPECT_TRUE(base64_encode_file(file, &from_file));
+    EXPECT_EQ(from_file == base64_encode(big), true);
+    fs::remove(file);
+    EXPECT_TRUE(!base64_encode_file(file, &from_file));
+  }
+
+  {
+    EXPECT_EQ(base64_encode_bytes(std::vector<unsigned char>{'f', 'o', 'o', 'b'}), "Zm9vYg==");
+    EXPECT_EQ(base64_encode_bytes(std::vector<unsigned char>{'f', 'o', 'o', 'b', 'a'}), "Zm9vYmE=");
+
+    std::string ppm = "P6\n# grim\n4 2\n255\n";
+    for (int i = 0; i < 8; ++i) {
+      ppm += (i % 2 == 0) ? std::string("\xff\x00\x00", 3) : std::string("\x00\x00\xff", 3);
+    }
+    RgbImage img;
+    EXPECT_TRUE(decode_ppm(std::vector<unsigned char>(ppm.begin(), ppm.end()), &img));
+    EXPECT_EQ(img.width, 4);
+    const RgbImage half = downscale_to_fit(img, 2);
+    EXPECT_EQ(half.width, 2);
+    EXPECT_EQ(half.height, 1);
+    EXPECT_EQ(static_cast<int>(half.rgb[0]), 128);  // red and blue averaged
+    EXPECT_EQ(static_cast<int>(half.rgb[2]), 128);
+
+    const std::vector<unsigned char> jpeg = encode_jpeg(img, 70);
+    EXPECT_TRUE(jpeg.size() > 600 && jpeg[0] == 0xFF && jpeg[1] == 0xD8 && jpeg[jpeg.size() - 2] == 0xFF &&
+                jpeg.back() == 0xD9);
+
+    VisionPipeline pipeline;
+    const fs::path out = fs::temp_directory_path() / ("attoclaw_frame_" + random_id(6) + ".jpg");
+    const auto first = pipeline.process(img, out);
+    EXPECT_TRUE(first.has_value() && !first->unchanged && fs::exists(out));
+    EXPECT_TRUE(first->data_url.rfind("data:image/jpeg;base64,/9j/", 0) == 0);
+    const auto again = pipeline.process(img, out, first->hash);
+    EXPECT_TRUE(again.has_value() && again->unchanged && again->data_url.empty());
+    std::error_code ec;
+    fs::remove(out, ec);
+  }
+
+  {
+    std::string streamed;
+    ExternalCliStream stream(true, [&](const std::string& d) { streamed += d; });
+    stream.feed(R"({"type":"item.completed","item":{"type":"agent_message","text":"one"}})"
+                "\n{\"type\":\"item.comp");
+    stream.feed(R"(leted","item":{"type":"agent_message","text":"two"}})");
+    stream.finish();
+    EXPECT_EQ(streamed, "one\ntwo");
+
+    ExternalCliPool pool;
+    pool.configure(ExternalCliOptions{1, 0, 60});
+    auto slot = pool.acquire(1);
+    EXPECT_TRUE(slot != nullptr);
+    EXPECT_TRUE(pool.acquire(0) == nullptr);
+    slot.reset();
+    EXPECT_TRUE(pool.acquire(0) != nullptr);
+  }
+
+#ifndef _WIN32
+  {
+    ChildProcess child;
+    EXPECT_TRUE(child.spawn({"cat"}, true, fs::temp_directory_path()));
+    EXPECT_TRUE(child.running());
+    EXPECT_TRUE(child.queue_stdin("prompt\n"));
+    std::string seen;
+    const ProcessOutput out = child.collect(10, 1024, [&](std::string_view c) { seen.append(c); });
+    EXPECT_TRUE(out.ok);
+    EXPECT_EQ(seen, "prompt\n");
+    EXPECT_TRUE(!child.running());
+
+    // Far more than a pipe buffer each way: cat blocks on stdout until collect() drains it.
+    ChildProcess big;
+    EXPECT_TRUE(big.spawn({"cat"}, true));
+    EXPECT_TRUE(big.queue_stdin(std::string(4u * 1024u * 1024u, 'x')));
+    const ProcessOutput echoed = big.collect(30, 8u * 1024u * 1024u);
+    EXPECT_TRUE(echoed.ok);
+    EXPECT_EQ(echoed.out.size(), std::size_t{4u * 1024u * 1024u});
+
+    // A cancelled collect() kills the child instead of waiting out its timeout.
+    std::atomic<bool> cancel{false};
+    ChildProcess sleeper;
+    EXPECT_TRUE(sleeper.spawn({"sleep", "30"}));
+    std::thread canceller([&cancel]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      cancel.store(true);
+    });
+    const auto started = std::chrono::steady_clock::now();
+    const ProcessOutput stopped = sleeper.collect(60, 1024, {}, &cancel);
+    canceller.join();
+    EXPECT_TRUE(!stopped.ok);
+    EXPECT_EQ(stopped.err, "Error: cancelled");
+    EXPECT_TRUE(std::chrono::steady_clock::now() - started < std::chrono::seconds(5));
+  }
+#endif
+
+#ifndef _WIN32
+  {
+    // A codex that streams a line from the worker command, then rejects its flags.
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_cli_" + random_id(8));
+    fs::create_directories(dir);
+    const fs::path fake = dir / "codex";
+    write_text_file(fake,
+                    "#!/bin/sh\n"
+                    "if [ \"$4\" = - ]; then\n"
+                    "  cat > /dev/null\n"
+                    "  echo worker >> \"$(dirname \"$0\")/calls\"\n"
+                    "  echo '{\"type\":\"item.completed\",\"item\":{\"type\":\"agent_message\",\"text\":\"partial\"}}'\n"
+                    "  echo 'error: unknown option --json' >&2\n"
+                    "  exit 2\n"
+                    "fi\n"
+                    "echo command >> \"$(dirname \"$0\")/calls\"\n"
+                    "echo answer\n");
+    fs::permissions(fake, fs::perms::owner_exec, fs::perm_options::add);
+    const std::string old_path = CapabilityCache::current_path_env();
+    setenv("PATH", (dir.string() + ":" + old_path).c_str(), 1);
+
+    const ExternalCliRoute route{"codex", "--codex", "hi"};
+    std::string deltas;
+    EXPECT_EQ(run_external_cli(route, dir, false, [&](const std::string& d) { deltas += d; }), "answer");
+    EXPECT_EQ(deltas, "partialanswer");
+    deltas.clear();
+    EXPECT_EQ(run_external_cli(route, dir, false, [&](const std::string& d) { deltas += d; }), "answer");
+    EXPECT_EQ(deltas, "answer");
+    // One rejected worker (the refill spare died with it), then the command line only.
+    EXPECT_EQ(read_text_file(dir / "calls"), "worker\ncommand\ncommand\n");
+    EXPECT_EQ(external_cli_pool().idle_workers(), 0u);
+
+    setenv("PATH", old_path.c_str(), 1);
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+#endif
+
+#ifndef _WIN32
+  {
+    // The second request lands on the spare started by the first one's refill.
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_warm_" + random_id(8));
+    fs::create_directories(dir);
+    const fs::path fake = dir / "gemini";
+    write_text_file(fake, "#!/bin/sh\nread prompt\necho \"$prompt from $$\"\n");
+    fs::permissions(fake, fs::perms::owner_exec, fs::perm_options::add);
+    const std::string old_path = CapabilityCache::current_path_env();
+    setenv("PATH", (dir.string() + ":" + old_path).c_str(), 1);
+
+    external_cli_pool().configure(ExternalCliOptions{2, 1, 60});
+    const uint64_t hits_before = metrics().to_json().value("external_cli.warm_hits", uint64_t{0});
+    const ExternalCliRoute route{"gemini", "--gemini", "hi"};
+    const auto first = run_external_cli_worker(route, dir, "one\n", 10, {});
+    EXPECT_TRUE(first.has_value() && first->rfind("one from ", 0) == 0);
+    EXPECT_EQ(external_cli_pool().idle_workers(), 1u);
+    const auto second = run_external_cli_worker(route, dir, "two\n", 10, {});
+    EXPECT_TRUE(second.has_value() && second->rfind("two from ", 0) == 0);
+    EXPECT_EQ(metrics().to_json().value("external_cli.warm_hits", uint64_t{0}), hits_before + 1);
+    external_cli_pool().shutdown();
+
+    setenv("PATH", old_path.c_str(), 1);
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+#endif
+
+#ifndef _WIN32
+  {
+    const fs::path dir = fs::temp_directory_path() / ("attoclaw_test_caps_" + random_id(8));
+    fs::create_directories(dir);
+    const fs::path tool = dir / "attoclaw-probe-tool";
+    write_text_file(tool, "#!/bin/sh\n");
+    EXPECT_TRUE(CapabilityCache::scan("attoclaw-probe-tool", dir.string()).empty());  // not executable yet
+    fs::permissions(tool, fs::perms::owner_exec, fs::perm_options::add);
+    EXPECT_EQ(CapabilityCache::scan("attoclaw-probe-tool", "/nonexistent:" + dir.string()), tool);
+
+    CapabilityCache cache;
+    const std::string old_path = CapabilityCache::current_path_env();
+    EXPECT_TRUE(!cache.has("attoclaw-probe-tool"));
+    setenv("PATH", (dir.string() + ":" + old_path).c_str(), 1);
+    EXPECT_TRUE(cache.has("attoclaw-probe-tool"));  // PATH change drops the cached miss
+    EXPECT_EQ(cache.snapshot().size(), 1u);
+    fs::remove(tool);
+    EXPECT_TRUE(cache.has("attoclaw-probe-tool"));  // cached until TTL or invalidate()
+    cache.invalidate("attoclaw-probe-tool");
+    EXPECT_TRUE(!cache.has("attoclaw-probe-tool"));
+    setenv("PATH", old_path.c_str(), 1);
+    fs::remove_all(dir);
+    // Misses fall back to the login shell's PATH, which always has sh itself.
+    EXPECT_TRUE(!CapabilityCache::scan("sh", CapabilityCache::login_path_env()).empty());
+  }
+#endif
+
 #ifndef _WIN32
   {
     setenv("DISPLAY", ":0", 1);